@@ -1,63 +1,14 @@
 /*
- * this file take from grub 2.0
- * for btrfs UEFI driver
+ * CRC32C for the btrfs UEFI driver. grub_getcrc32c() keeps the interface
+ * of the grub 2.0 code this file was originally taken from; the work is done
+ * by the shared slicing-by-8 (or SSE4.2) code in include/crc32_slice8.h.
  */
 
-static uint32_t crc32c_table [256];
-
-static void
-init_crc32c_table (void)
-{
-  auto uint32_t reflect (uint32_t ref, int len);
-  uint32_t reflect (uint32_t ref, int len)
-    {
-      uint32_t result = 0;
-      int i;
-
-      for (i = 1; i <= len; i++)
-        {
-          if (ref & 1)
-            result |= 1 << (len - i);
-          ref >>= 1;
-        }
-
-      return result;
-    }
-
-  static int crc32c_table_inited;
-  if(crc32c_table_inited)
-	  return;
-  crc32c_table_inited = 1;
-
-  uint32_t polynomial = 0x1edc6f41;
-  int i, j;
-
-  for(i = 0; i < 256; i++)
-    {
-      crc32c_table[i] = reflect(i, 8) << 24;
-      for (j = 0; j < 8; j++)
-        crc32c_table[i] = (crc32c_table[i] << 1) ^
-            (crc32c_table[i] & (1 << 31) ? polynomial : 0);
-      crc32c_table[i] = reflect(crc32c_table[i], 32);
-    }
-}
+#define CRC32_SLICE8_WANT_CRC32C
+#include "../include/crc32_slice8.h"
 
 uint32_t
 grub_getcrc32c (uint32_t crc, const void *buf, int size)
 {
-  int i;
-  const uint8_t *data = buf;
-
-  if (! crc32c_table[1])
-    init_crc32c_table ();
-
-  crc^= 0xffffffff;
-
-  for (i = 0; i < size; i++)
-    {
-      crc = (crc >> 8) ^ crc32c_table[(crc & 0xFF) ^ *data];
-      data++;
-    }
-
-  return crc ^ 0xffffffff;
+  return Crc32cCompute (crc, buf, size);
 }
@@ -989,7 +989,6 @@ static fsw_status_t fsw_btrfs_volume_mount(struct fsw_volume *volg) {
     fsw_status_t err;
     int i;
 
-    init_crc32c_table();
     fsw_memzero((char *)vol+sizeof(*volg), sizeof(*vol)-sizeof(*volg));
 
     err = btrfs_read_superblock (volg, &sblock);
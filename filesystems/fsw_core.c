@@ -190,6 +190,8 @@ fsw_status_t fsw_block_get(struct VOLSTRUCTNAME *vol, fsw_u64 phys_bno, fsw_u32
     if (cache_level > MAX_CACHE_LEVEL)
         cache_level = MAX_CACHE_LEVEL;
 
+    vol->io_stats.block_gets++;
+
     if (vol->bcache_size > 0 && vol->bcache == NULL) {
         /* driver set the initial cache size */
         status = fsw_alloc(vol->bcache_size * sizeof(struct fsw_blockcache), &vol->bcache);
@@ -212,6 +214,7 @@ fsw_status_t fsw_block_get(struct VOLSTRUCTNAME *vol, fsw_u64 phys_bno, fsw_u32
             if (vol->bcache[i].cache_level < cache_level)
                 vol->bcache[i].cache_level = cache_level;  // promote the entry
             vol->bcache[i].refcount++;
+            vol->io_stats.bcache_hits++;
             *buffer_out = vol->bcache[i].data;
             return FSW_SUCCESS;
         }
@@ -266,6 +269,8 @@ miss:
         if (status)
             return status;
     }
+    vol->io_stats.block_reads++;
+    vol->io_stats.block_read_bytes += vol->phys_blocksize;
     status = vol->host_table->read_block(vol, phys_bno, vol->bcache[i].data);
     if (status)
         return status;
@@ -524,6 +529,40 @@ fsw_status_t fsw_dnode_stat(struct fsw_dnode *dno, struct fsw_dnode_stat *sb)
     return status;
 }
 
+/**
+ * Call the file system's dir_lookup function, updating the volume's I/O statistics.
+ */
+
+static fsw_status_t fsw_fstype_dir_lookup(struct fsw_volume *vol, struct fsw_dnode *dno,
+                                          struct fsw_string *lookup_name, struct fsw_dnode **child_dno_out)
+{
+    fsw_status_t    status;
+    fsw_u64         start;
+
+    start = FSW_TIMESTAMP();
+    status = vol->fstype_table->dir_lookup(vol, dno, lookup_name, child_dno_out);
+    vol->io_stats.dir_lookup_calls++;
+    vol->io_stats.dir_lookup_time += FSW_TIMESTAMP() - start;
+    return status;
+}
+
+/**
+ * Call the file system's get_extent function, updating the volume's I/O statistics.
+ */
+
+static fsw_status_t fsw_fstype_get_extent(struct fsw_volume *vol, struct fsw_dnode *dno,
+                                          struct fsw_extent *extent)
+{
+    fsw_status_t    status;
+    fsw_u64         start;
+
+    start = FSW_TIMESTAMP();
+    status = vol->fstype_table->get_extent(vol, dno, extent);
+    vol->io_stats.get_extent_calls++;
+    vol->io_stats.get_extent_time += FSW_TIMESTAMP() - start;
+    return status;
+}
+
 /**
  * Lookup a directory entry by name. This function is called by the host driver.
  * Given a directory dnode and a file name, it looks up the named entry in the
@@ -547,7 +586,7 @@ fsw_status_t fsw_dnode_lookup(struct fsw_dnode *dno,
     if (dno->type != FSW_DNODE_TYPE_DIR)
         return FSW_UNSUPPORTED;
 
-    return dno->vol->fstype_table->dir_lookup(dno->vol, dno, lookup_name, child_dno_out);
+    return fsw_fstype_dir_lookup(dno->vol, dno, lookup_name, child_dno_out);
 }
 
 /**
@@ -639,7 +678,7 @@ fsw_status_t fsw_dnode_lookup_path(struct fsw_dnode *dno,
 
             } else {
                 // do an actual lookup
-                status = vol->fstype_table->dir_lookup(vol, dno, &lookup_name, &child_dno);
+                status = fsw_fstype_dir_lookup(vol, dno, &lookup_name, &child_dno);
                 if (status)
                     goto errorexit;
             }
@@ -909,7 +948,7 @@ fsw_status_t fsw_shandle_read(struct fsw_shandle *shand, fsw_u32 *buffer_size_in
 
             // ask the file system for the proper extent
             shand->extent.log_start = log_bno;
-            status = vol->fstype_table->get_extent(vol, dno, &shand->extent);
+            status = fsw_fstype_get_extent(vol, dno, &shand->extent);
             if (status) {
                 shand->extent.type = FSW_EXTENT_TYPE_INVALID;
                 return status;
@@ -59,6 +59,11 @@
 #include "fsw_efi_base.h"
 #endif
 
+/** Timer hook for the I/O statistics; hosts without a cheap timer get zeros. */
+#ifndef FSW_TIMESTAMP
+#define FSW_TIMESTAMP() ((fsw_u64)0)
+#endif
+
 /** Maximum size for a path, specifically symlink target paths. */
 #ifndef HOST_EFI_EDK2
 #define FSW_PATH_MAX (4096)
@@ -234,6 +239,22 @@ struct fsw_blockcache {
     void        *data;              //!< Block data buffer
 };
 
+/**
+ * Core: Per-volume I/O counters. Times are in units of FSW_TIMESTAMP(), which
+ * are host-specific (and always zero on hosts that don't provide a timer).
+ */
+
+struct fsw_io_stats {
+    fsw_u64     block_gets;         //!< Calls to fsw_block_get
+    fsw_u64     bcache_hits;        //!< ...of which were satisfied from the block cache
+    fsw_u64     block_reads;        //!< Calls to the host's read_block
+    fsw_u64     block_read_bytes;   //!< Bytes requested from the host's read_block
+    fsw_u64     get_extent_calls;   //!< Calls to the file system's get_extent
+    fsw_u64     get_extent_time;    //!< Time spent in get_extent
+    fsw_u64     dir_lookup_calls;   //!< Calls to the file system's dir_lookup
+    fsw_u64     dir_lookup_time;    //!< Time spent in dir_lookup
+};
+
 /**
  * Core: Represents a mounted volume.
  */
@@ -254,6 +275,8 @@ struct fsw_volume {
     struct fsw_host_table *host_table;      //!< Dispatch table for host-specific functions
     struct fsw_fstype_table *fstype_table;  //!< Dispatch table for file system specific functions
     int         host_string_type;   //!< String type used by the host environment
+
+    struct fsw_io_stats io_stats;   //!< I/O counters, maintained by the core
 };
 
 /**
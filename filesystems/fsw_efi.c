@@ -563,6 +563,8 @@ fsw_status_t fsw_efi_read_block(struct fsw_volume *vol, fsw_u64 phys_bno, void *
       }
       i++;
    } while ((i < NUM_CACHES) && (ReadCache < 0));
+   if (ReadCache >= 0)
+      Volume->ReadAheadHits++;
 
    // No cache hit found; load new cache and pass it on....
    if (ReadCache < 0) {
@@ -573,6 +575,8 @@ fsw_status_t fsw_efi_read_block(struct fsw_volume *vol, fsw_u64 phys_bno, void *
       if (Caches[ReadCache].Cache == NULL)
          Caches[ReadCache].Cache = AllocatePool(CACHE_SIZE);
       if (Caches[ReadCache].Cache != NULL) {
+         Volume->DiskReads++;
+         Volume->DiskReadBytes += CACHE_SIZE;
          Status = refit_call5_wrapper(Volume->DiskIo->ReadDisk, Volume->DiskIo, Volume->MediaId,
                                       StartRead, CACHE_SIZE, Caches[ReadCache].Cache);
          if (!EFI_ERROR(Status)) {
@@ -595,6 +599,8 @@ fsw_status_t fsw_efi_read_block(struct fsw_volume *vol, fsw_u64 phys_bno, void *
    }
 
    if (ReadOneBlock) { // Something's failed, so try a simple disk read of one block....
+      Volume->DiskReads++;
+      Volume->DiskReadBytes += vol->phys_blocksize;
       Status = refit_call5_wrapper(Volume->DiskIo->ReadDisk, Volume->DiskIo, Volume->MediaId,
                                    phys_bno * vol->phys_blocksize,
                                    vol->phys_blocksize,
@@ -1019,6 +1025,60 @@ EFI_STATUS fsw_efi_dir_setpos(IN FSW_FILE_DATA *File, IN UINT64 Position)
     }
 }
 
+/**
+ * Return the number of FSW_TIMESTAMP() ticks per millisecond, measured against
+ * the firmware's Stall() the first time it's needed; or 0 if there's no timer.
+ */
+
+static UINT64 fsw_efi_ticks_per_ms(VOID)
+{
+    static UINT64   TicksPerMs = 0;
+    static BOOLEAN  Measured = FALSE;
+    UINT64          Start;
+
+    if (!Measured) {
+        Start = FSW_TIMESTAMP();
+        refit_call1_wrapper(BS->Stall, 1000);
+        TicksPerMs = FSW_TIMESTAMP() - Start;
+        Measured = TRUE;
+    }
+    return TicksPerMs;
+}
+
+/**
+ * Fill an FSW_IO_STATS_INFO structure with the volume's I/O counters.
+ */
+
+static EFI_STATUS fsw_efi_fill_IoStatsInfo(IN FSW_VOLUME_DATA *Volume,
+                                           IN OUT UINTN *BufferSize,
+                                           OUT VOID *Buffer)
+{
+    FSW_IO_STATS_INFO   *Info = (FSW_IO_STATS_INFO *)Buffer;
+    struct fsw_io_stats *Stats = &Volume->vol->io_stats;
+
+    if (*BufferSize < sizeof(FSW_IO_STATS_INFO)) {
+        *BufferSize = sizeof(FSW_IO_STATS_INFO);
+        return EFI_BUFFER_TOO_SMALL;
+    }
+
+    Info->Size              = sizeof(FSW_IO_STATS_INFO);
+    Info->TicksPerMs        = fsw_efi_ticks_per_ms();
+    Info->BlockGets         = Stats->block_gets;
+    Info->BlockCacheHits    = Stats->bcache_hits;
+    Info->BlockReads        = Stats->block_reads;
+    Info->BlockReadBytes    = Stats->block_read_bytes;
+    Info->GetExtentCalls    = Stats->get_extent_calls;
+    Info->GetExtentTicks    = Stats->get_extent_time;
+    Info->DirLookupCalls    = Stats->dir_lookup_calls;
+    Info->DirLookupTicks    = Stats->dir_lookup_time;
+    Info->ReadAheadHits     = Volume->ReadAheadHits;
+    Info->DiskReads         = Volume->DiskReads;
+    Info->DiskReadBytes     = Volume->DiskReadBytes;
+
+    *BufferSize = sizeof(FSW_IO_STATS_INFO);
+    return EFI_SUCCESS;
+}
+
 /**
  * Get file or volume information. This function implements the GetInfo call
  * for all file handles. Control is dispatched according to the type of information
@@ -1035,6 +1095,7 @@ EFI_STATUS fsw_efi_dnode_getinfo(IN FSW_FILE_DATA *File,
     EFI_FILE_SYSTEM_INFO  *FSInfo;
     UINTN                 RequiredSize;
     struct fsw_volume_stat vsb;
+    EFI_GUID              IoStatsInfoGuid = FSW_IO_STATS_INFO_GUID;
 
 
     if (CompareGuid(InformationType, &gEfiFileInfoGuid)) {
@@ -1094,6 +1155,13 @@ EFI_STATUS fsw_efi_dnode_getinfo(IN FSW_FILE_DATA *File,
         *BufferSize = RequiredSize;
         Status = EFI_SUCCESS;
 
+    } else if (CompareGuid(InformationType, &IoStatsInfoGuid)) {
+#if DEBUG_LEVEL
+        Print(L"fsw_efi_dnode_getinfo: IO_STATS_INFO\n");
+#endif
+
+        Status = fsw_efi_fill_IoStatsInfo(Volume, BufferSize, Buffer);
+
     } else {
         Status = EFI_UNSUPPORTED;
     }
@@ -53,6 +53,7 @@
 #define _FSW_EFI_H_
 
 #include "fsw_core.h"
+#include "../include/fsw_io_stats.h"
 
 #ifdef __MAKEWITH_GNUEFI
 #define CompareGuid(a, b) CompareGuid(a, b)==0
@@ -77,6 +78,10 @@ typedef struct {
 
     struct fsw_volume           *vol;           //!< FSW volume structure
 
+    UINT64                      ReadAheadHits;  //!< Blocks served from the read-ahead caches
+    UINT64                      DiskReads;      //!< Calls to ReadDisk
+    UINT64                      DiskReadBytes;  //!< Bytes requested from ReadDisk
+
 } FSW_VOLUME_DATA;
 
 /** Signature for the volume structure. */
@@ -98,5 +98,18 @@ typedef UINT64  fsw_u64;
 #define FSW_U64_SHR(val,shiftbits) RShiftU64((val), (shiftbits))
 #define FSW_U64_DIV(val,divisor) DivU64x32((val), (divisor), NULL)
 
+// timing hook (raw time stamp counter ticks; see fsw_efi_ticks_per_ms())
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+static __inline__ fsw_u64 fsw_efi_timestamp(void)
+{
+    fsw_u32 low, high;
+
+    __asm__ __volatile__ ("rdtsc" : "=a" (low), "=d" (high));
+    return ((fsw_u64)high << 32) | low;
+}
+#define FSW_TIMESTAMP() fsw_efi_timestamp()
+#endif
+
 
 #endif
@@ -0,0 +1,271 @@
+/*
+ * crctest.c
+ * Known-answer test and benchmark for the CRC32 and CRC32C code in
+ * include/crc32_slice8.h
+ *
+ * Copyright (c) 2014 Roderick W. Smith
+ *
+ * This program is distributed under the terms of the BSD license, as are
+ * the filesystem drivers that use the code it tests.
+ */
+
+// Every path through the shared code -- the precomputed tables, the
+// slicing-by-8 loop with its unaligned head and short tail, and (on x86-64
+// hosts with SSE4.2) the crc32 instruction -- is checked against a plain
+// bit-at-a-time CRC, then timed. Run with no arguments; the exit status is 0
+// only if every check passed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+typedef uint8_t   UINT8;
+typedef uint32_t  UINT32;
+typedef uint64_t  UINT64;
+typedef intptr_t  INTN;
+typedef uintptr_t UINTN;
+typedef UINT8     BOOLEAN;
+typedef void      VOID;
+
+#define CRC32_SLICE8_WANT_CRC32
+#define CRC32_SLICE8_WANT_CRC32C
+#include "../../include/crc32_slice8.h"
+
+#define CRC32_POLY      0xedb88320
+#define CRC32C_POLY     0x82f63b78
+
+#define TEST_BUFFER_SIZE 4096
+#define BENCH_SIZE      (1024 * 1024)
+#define BENCH_MIN_USEC  200000
+
+static int Failures = 0;
+
+// Reference CRC: one bit at a time, straight from the definition, with the
+// usual inversion on entry and exit (so Crc is passed as for zlib's crc32()).
+static UINT32 BitwiseCrc(UINT32 Poly, UINT32 Crc, const UINT8 *Data, size_t Size) {
+    int Bit;
+
+    Crc = ~Crc;
+    while (Size-- > 0) {
+        Crc ^= *Data++;
+        for (Bit = 0; Bit < 8; Bit++)
+            Crc = (Crc >> 1) ^ ((Crc & 1) ? Poly : 0);
+    }
+    return ~Crc;
+}
+
+// Byte-at-a-time table lookup, as crc32() and grub_getcrc32c() did before
+// they shared the slicing-by-8 code; timed for comparison.
+static UINT32 BytewiseCrc(const UINT32 Table[8][256], UINT32 Crc, const UINT8 *Data, size_t Size) {
+    Crc = ~Crc;
+    while (Size-- > 0)
+        Crc = Table[0][(Crc ^ *Data++) & 0xff] ^ (Crc >> 8);
+    return ~Crc;
+}
+
+// The three update functions under test, wrapped to take and return the
+// CRC in its external form.
+static UINT32 Slice8Crc32(UINT32 Crc, const UINT8 *Data, size_t Size) {
+    return ~Crc32Slice8Update(Crc32Table, ~Crc, Data, Size);
+}
+
+static UINT32 Slice8Crc32c(UINT32 Crc, const UINT8 *Data, size_t Size) {
+    return ~Crc32Slice8Update(Crc32cTable, ~Crc, Data, Size);
+}
+
+#ifdef CRC32_SLICE8_SSE42
+static UINT32 Sse42Crc32c(UINT32 Crc, const UINT8 *Data, size_t Size) {
+    return ~Crc32cSse42Update(~Crc, Data, Size);
+}
+#endif
+
+typedef UINT32 (*CRC_FUNCTION)(UINT32 Crc, const UINT8 *Data, size_t Size);
+
+static void Check(int Ok, const char *What, const char *Detail) {
+    if (!Ok) {
+        printf("FAIL: %s (%s)\n", What, Detail);
+        Failures++;
+    }
+}
+
+// Each Table[k][i] must be the CRC (without inversion) of byte i followed by
+// k zero bytes.
+static void CheckTables(const char *Name, UINT32 Poly, const UINT32 Table[8][256]) {
+    UINT32 Expected;
+    int    i, k, Bit, Bad = 0;
+
+    for (i = 0; i < 256; i++) {
+        Expected = i;
+        for (k = 0; k < 8; k++) {
+            for (Bit = 0; Bit < 8; Bit++)
+                Expected = (Expected >> 1) ^ ((Expected & 1) ? Poly : 0);
+            if (Table[k][i] != Expected)
+                Bad++;
+        }
+    }
+    Check(Bad == 0, Name, "table entries differ from the polynomial");
+    printf("%s: tables %s\n", Name, Bad ? "WRONG" : "ok");
+}
+
+// Standard check values: the CRC of the ASCII string "123456789".
+static void CheckValue(const char *Name, CRC_FUNCTION Function, UINT32 Expected) {
+    UINT32 Crc = Function(0, (const UINT8 *) "123456789", 9);
+    char   Detail[64];
+
+    snprintf(Detail, sizeof(Detail), "check value %08x, expected %08x", Crc, Expected);
+    Check(Crc == Expected, Name, Detail);
+    printf("%s: check value %08x\n", Name, Crc);
+}
+
+// Compares Function with the bitwise CRC on every length up to 64 bytes and
+// assorted longer ones, at every offset from an 8-byte boundary, and when
+// continued from a previous CRC after a split at each of those lengths.
+static void CheckAgainstReference(const char *Name, UINT32 Poly, CRC_FUNCTION Function, const UINT8 *Buffer) {
+    static const size_t LongSizes[] = { 127, 128, 129, 255, 256, 511, 1000, 1024, 4000 };
+    size_t Sizes[64 + sizeof(LongSizes) / sizeof(LongSizes[0])];
+    size_t NumSizes = 0, i, Offset, Split;
+    UINT32 Expected, Crc;
+    char   Detail[80];
+    int    Bad = 0;
+
+    for (i = 0; i <= 64 && NumSizes < sizeof(Sizes) / sizeof(Sizes[0]); i++)
+        Sizes[NumSizes++] = i;
+    for (i = 0; i < sizeof(LongSizes) / sizeof(LongSizes[0]) && NumSizes < sizeof(Sizes) / sizeof(Sizes[0]); i++)
+        Sizes[NumSizes++] = LongSizes[i];
+
+    for (Offset = 0; Offset < 16; Offset++) {
+        for (i = 0; i < NumSizes; i++) {
+            Expected = BitwiseCrc(Poly, 0, Buffer + Offset, Sizes[i]);
+            Crc = Function(0, Buffer + Offset, Sizes[i]);
+            if (Crc != Expected) {
+                if (Bad++ == 0) {
+                    snprintf(Detail, sizeof(Detail), "offset %u, size %u: %08x, expected %08x",
+                             (unsigned) Offset, (unsigned) Sizes[i], Crc, Expected);
+                    Check(0, Name, Detail);
+                }
+                continue;
+            }
+            // Continue from a partial CRC, splitting at an awkward point.
+            Split = Sizes[i] / 3 + (Offset & 3);
+            if (Split > Sizes[i])
+                Split = Sizes[i];
+            Crc = Function(Function(0, Buffer + Offset, Split), Buffer + Offset + Split, Sizes[i] - Split);
+            if ((Crc != Expected) && (Bad++ == 0)) {
+                snprintf(Detail, sizeof(Detail), "offset %u, size %u, split at %u: %08x, expected %08x",
+                         (unsigned) Offset, (unsigned) Sizes[i], (unsigned) Split, Crc, Expected);
+                Check(0, Name, Detail);
+            }
+        }
+    }
+    printf("%s: %u sizes at 16 offsets %s\n", Name, (unsigned) NumSizes, Bad ? "WRONG" : "ok");
+}
+
+static double Seconds(void) {
+    struct timeval Now;
+
+    gettimeofday(&Now, NULL);
+    return Now.tv_sec + Now.tv_usec / 1e6;
+}
+
+// Times Function on a 1 MiB buffer (at Offset bytes from an 8-byte boundary)
+// for at least BENCH_MIN_USEC and prints its throughput.
+static void Bench(const char *Name, CRC_FUNCTION Function, const UINT8 *Buffer, size_t Offset) {
+    volatile UINT32 Sink = 0;
+    double          Start, Elapsed;
+    unsigned long   Rounds = 0;
+
+    Start = Seconds();
+    do {
+        Sink ^= Function(0, Buffer + Offset, BENCH_SIZE);
+        Rounds++;
+        Elapsed = Seconds() - Start;
+    } while (Elapsed * 1e6 < BENCH_MIN_USEC);
+    printf("crcbench name=%s offset=%u rounds=%lu mbps=%.1f\n", Name, (unsigned) Offset, Rounds,
+           (double) Rounds * BENCH_SIZE / (1024.0 * 1024.0) / Elapsed);
+}
+
+static UINT32 BitwiseCrc32(UINT32 Crc, const UINT8 *Data, size_t Size) {
+    return BitwiseCrc(CRC32_POLY, Crc, Data, Size);
+}
+
+static UINT32 BitwiseCrc32c(UINT32 Crc, const UINT8 *Data, size_t Size) {
+    return BitwiseCrc(CRC32C_POLY, Crc, Data, Size);
+}
+
+static UINT32 BytewiseCrc32(UINT32 Crc, const UINT8 *Data, size_t Size) {
+    return BytewiseCrc(Crc32Table, Crc, Data, Size);
+}
+
+static UINT32 BytewiseCrc32c(UINT32 Crc, const UINT8 *Data, size_t Size) {
+    return BytewiseCrc(Crc32cTable, Crc, Data, Size);
+}
+
+static UINT32 ComputeCrc32(UINT32 Crc, const UINT8 *Data, size_t Size) {
+    return Crc32Compute(Crc, Data, Size);
+}
+
+static UINT32 ComputeCrc32c(UINT32 Crc, const UINT8 *Data, size_t Size) {
+    return Crc32cCompute(Crc, Data, Size);
+}
+
+int main(int argc, char **argv) {
+    UINT8  *Buffer;
+    size_t i;
+    int    DoBench = 1;
+
+    if ((argc > 1) && (strcmp(argv[1], "-n") == 0))
+        DoBench = 0;
+
+    // 8-byte aligned, with room for the largest offset used below
+    Buffer = aligned_alloc(64, BENCH_SIZE + 64);
+    if (Buffer == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 2;
+    }
+    srand(1);
+    for (i = 0; i < BENCH_SIZE + 64; i++)
+        Buffer[i] = (UINT8) rand();
+
+    CheckTables("crc32", CRC32_POLY, Crc32Table);
+    CheckTables("crc32c", CRC32C_POLY, Crc32cTable);
+
+    CheckValue("crc32", ComputeCrc32, 0xcbf43926);
+    CheckValue("crc32c", ComputeCrc32c, 0xe3069283);
+    CheckValue("crc32c-slice8", Slice8Crc32c, 0xe3069283);
+
+    CheckAgainstReference("crc32-slice8", CRC32_POLY, Slice8Crc32, Buffer);
+    CheckAgainstReference("crc32c-slice8", CRC32C_POLY, Slice8Crc32c, Buffer);
+#ifdef CRC32_SLICE8_SSE42
+    if (Crc32cHaveSse42()) {
+        CheckValue("crc32c-sse42", Sse42Crc32c, 0xe3069283);
+        CheckAgainstReference("crc32c-sse42", CRC32C_POLY, Sse42Crc32c, Buffer);
+    } else {
+        printf("crc32c-sse42: CPU lacks SSE4.2; not tested\n");
+    }
+#else
+    printf("crc32c-sse42: not built for this host; not tested\n");
+#endif
+
+    if (DoBench) {
+        Bench("crc32-bitwise", BitwiseCrc32, Buffer, 0);
+        Bench("crc32-bytewise", BytewiseCrc32, Buffer, 0);
+        Bench("crc32-slice8", Slice8Crc32, Buffer, 0);
+        Bench("crc32-slice8", Slice8Crc32, Buffer, 3);
+        Bench("crc32c-bitwise", BitwiseCrc32c, Buffer, 0);
+        Bench("crc32c-bytewise", BytewiseCrc32c, Buffer, 0);
+        Bench("crc32c-slice8", Slice8Crc32c, Buffer, 0);
+        Bench("crc32c-slice8", Slice8Crc32c, Buffer, 3);
+#ifdef CRC32_SLICE8_SSE42
+        if (Crc32cHaveSse42()) {
+            Bench("crc32c-sse42", Sse42Crc32c, Buffer, 0);
+            Bench("crc32c-sse42", Sse42Crc32c, Buffer, 3);
+        }
+#endif
+    }
+
+    free(Buffer);
+    printf("%s\n", Failures ? "FAILED" : "all CRC checks passed");
+    return Failures ? 1 : 0;
+}
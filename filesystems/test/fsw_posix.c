@@ -37,6 +37,8 @@
 
 #include "fsw_posix.h"
 
+#include <strings.h>
+
 
 #ifndef FSTYPE
 /** The file system type name to use. */
@@ -52,7 +54,7 @@ fsw_status_t fsw_posix_open_dno(struct fsw_posix_volume *pvol, const char *path,
 void fsw_posix_change_blocksize(struct fsw_volume *vol,
                               fsw_u32 old_phys_blocksize, fsw_u32 old_log_blocksize,
                               fsw_u32 new_phys_blocksize, fsw_u32 new_log_blocksize);
-fsw_status_t fsw_posix_read_block(struct fsw_volume *vol, fsw_u32 phys_bno, void *buffer);
+fsw_status_t fsw_posix_read_block(struct fsw_volume *vol, fsw_u64 phys_bno, void *buffer);
 
 /**
  * Dispatch table for our FSW host driver.
@@ -69,7 +71,83 @@ extern struct fsw_fstype_table   FSW_FSTYPE_TABLE_NAME(FSTYPE);
 
 
 /**
- * Mount function.
+ * Parse a disk model specification, as found in the FSW_POSIX_DISK environment
+ * variable: a comma-separated list of key=value pairs, from
+ *
+ *  - latency_us:       fixed cost of every device request, in microseconds
+ *  - bandwidth_kib:    transfer rate, in KiB per second (0 = unlimited)
+ *  - seek_us_per_gib:  seek cost per GiB of distance between a request and the
+ *                      end of the previous one, in microseconds
+ *  - seek_max_us:      upper limit on the seek cost, in microseconds
+ *  - readahead:        read this many bytes into one of two buffers on every
+ *                      miss, as the EFI host does (0 = read single blocks)
+ *  - delay:            1 to really sleep for the simulated time
+ *  - trace:            file to which a line is appended for every read_block
+ *
+ * For instance, "latency_us=100,bandwidth_kib=20480,seek_us_per_gib=8000,
+ * seek_max_us=12000,readahead=131072,trace=ext2.trace" approximates a hard
+ * disk behind a slow controller. Unless delay is set, nothing sleeps: the
+ * costs are only added up, so that runs are repeatable. Returns 0, or -1 if
+ * the specification can't be parsed.
+ */
+
+int fsw_posix_disk_model_parse(const char *spec, struct fsw_posix_disk_model *model)
+{
+    char                *copy, *item, *value, *end, *save = NULL;
+    unsigned long long  number;
+    int                 result = 0;
+
+    memset(model, 0, sizeof(struct fsw_posix_disk_model));
+    if (spec == NULL || *spec == 0)
+        return 0;
+    copy = strdup(spec);
+    if (copy == NULL)
+        return -1;
+
+    for (item = strtok_r(copy, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+        value = strchr(item, '=');
+        if (value == NULL) {
+            fprintf(stderr, "fsw_posix: %s: missing value for '%s'\n", FSW_POSIX_DISK_ENV, item);
+            result = -1;
+            break;
+        }
+        *value++ = 0;
+        if (strcasecmp(item, "trace") == 0) {
+            snprintf(model->trace_path, sizeof(model->trace_path), "%s", value);
+            continue;
+        }
+        number = strtoull(value, &end, 0);
+        if (*value == 0 || *end != 0) {
+            fprintf(stderr, "fsw_posix: %s: bad number '%s'\n", FSW_POSIX_DISK_ENV, value);
+            result = -1;
+            break;
+        }
+        if (strcasecmp(item, "latency_us") == 0)
+            model->latency_ns = number * 1000;
+        else if (strcasecmp(item, "bandwidth_kib") == 0)
+            model->bandwidth = number * 1024;
+        else if (strcasecmp(item, "seek_us_per_gib") == 0)
+            model->seek_ns_per_gib = number * 1000;
+        else if (strcasecmp(item, "seek_max_us") == 0)
+            model->seek_max_ns = number * 1000;
+        else if (strcasecmp(item, "readahead") == 0)
+            model->readahead = number;
+        else if (strcasecmp(item, "delay") == 0)
+            model->delay = (number != 0);
+        else {
+            fprintf(stderr, "fsw_posix: %s: unknown parameter '%s'\n", FSW_POSIX_DISK_ENV, item);
+            result = -1;
+            break;
+        }
+    }
+
+    free(copy);
+    return result;
+}
+
+/**
+ * Mount function. The simulated disk is configured from the FSW_POSIX_DISK
+ * environment variable (see fsw_posix_disk_model_parse).
  */
 
 struct fsw_posix_volume * fsw_posix_mount(const char *path, struct fsw_fstype_table *fstype_table)
@@ -83,11 +161,27 @@ struct fsw_posix_volume * fsw_posix_mount(const char *path, struct fsw_fstype_ta
         return NULL;
     pvol->fd = -1;
 
+    // set up the disk model
+    if (fsw_posix_disk_model_parse(getenv(FSW_POSIX_DISK_ENV), &pvol->model)) {
+        fsw_free(pvol);
+        return NULL;
+    }
+    if (pvol->model.trace_path[0]) {
+        pvol->trace = fopen(pvol->model.trace_path, "a");
+        if (pvol->trace == NULL) {
+            fprintf(stderr, "fsw_posix_mount: %s: %s\n", pvol->model.trace_path, strerror(errno));
+            fsw_free(pvol);
+            return NULL;
+        }
+        fprintf(pvol->trace, "# mount %s\n"
+                "# seq block offset size source dev_offset dev_bytes seek_bytes cost_ns sim_ns\n", path);
+    }
+
     // open underlying file/device
     pvol->fd = open(path, O_RDONLY, 0);
     if (pvol->fd < 0) {
         fprintf(stderr, "fsw_posix_mount: %s: %s\n", path, strerror(errno));
-        fsw_free(pvol);
+        fsw_posix_unmount(pvol);
         return NULL;
     }
 
@@ -97,7 +191,7 @@ struct fsw_posix_volume * fsw_posix_mount(const char *path, struct fsw_fstype_ta
     status = fsw_mount(pvol, &fsw_posix_host_table, fstype_table, &pvol->vol);
     if (status) {
         fprintf(stderr, "fsw_posix_mount: fsw_mount returned %d\n", status);
-        fsw_free(pvol);
+        fsw_posix_unmount(pvol);
         return NULL;
     }
 
@@ -110,8 +204,18 @@ struct fsw_posix_volume * fsw_posix_mount(const char *path, struct fsw_fstype_ta
 
 int fsw_posix_unmount(struct fsw_posix_volume *pvol)
 {
+    int                 i;
+
     if (pvol->vol != NULL)
         fsw_unmount(pvol->vol);
+    if (pvol->fd >= 0)
+        close(pvol->fd);
+    for (i = 0; i < FSW_POSIX_READAHEAD_BUFFERS; i++) {
+        if (pvol->ra_buffer[i] != NULL)
+            fsw_free(pvol->ra_buffer[i]);
+    }
+    if (pvol->trace != NULL)
+        fclose(pvol->trace);
     fsw_free(pvol);
     return 0;
 }
@@ -267,6 +371,7 @@ struct dirent * fsw_posix_readdir(struct fsw_posix_dir *dir)
 #endif
     memcpy(dent.d_name, dno->name.data, dno->name.size);
     dent.d_name[dno->name.size] = 0;
+    fsw_dnode_release(dno);
 
     return &dent;
 }
@@ -357,28 +462,124 @@ void fsw_posix_change_blocksize(struct fsw_volume *vol,
     // nothing to do
 }
 
+/**
+ * Read from the underlying file, charging the request to the simulated disk:
+ * a fixed latency, a transfer time, and a seek time proportional to the
+ * distance from the end of the previous request. Returns the number of bytes
+ * read (which may be short at the end of the file), or -1 on errors.
+ */
+
+static ssize_t fsw_posix_device_read(struct fsw_posix_volume *pvol, fsw_u64 offset, fsw_u64 size,
+                                     void *buffer, fsw_u64 *seek_out, fsw_u64 *cost_out)
+{
+    struct fsw_posix_disk_model *model = &pvol->model;
+    ssize_t             read_result;
+    fsw_u64             distance, cost, seek_cost;
+    struct timespec     ts;
+
+    read_result = pread(pvol->fd, buffer, size, offset);
+    if (read_result < 0)
+        return -1;
+
+    distance = (offset > pvol->head_pos) ? offset - pvol->head_pos : pvol->head_pos - offset;
+    cost = model->latency_ns;
+    if (model->bandwidth)
+        cost += (fsw_u64)read_result * 1000000000ULL / model->bandwidth;
+    seek_cost = (fsw_u64)((double)distance * model->seek_ns_per_gib / (1024.0 * 1024.0 * 1024.0));
+    if (model->seek_max_ns && seek_cost > model->seek_max_ns)
+        seek_cost = model->seek_max_ns;
+    cost += seek_cost;
+
+    pvol->head_pos = offset + read_result;
+    pvol->disk.requests++;
+    pvol->disk.bytes += read_result;
+    pvol->disk.seek_bytes += distance;
+    pvol->disk.sim_time_ns += cost;
+
+    if (model->delay && cost > 0) {
+        ts.tv_sec = cost / 1000000000ULL;
+        ts.tv_nsec = cost % 1000000000ULL;
+        nanosleep(&ts, NULL);
+    }
+
+    *seek_out = distance;
+    *cost_out = cost;
+    return read_result;
+}
+
 /**
  * FSW interface function to read data blocks. This function is called by the FSW core
  * to read a block of data from the device. The buffer is allocated by the core code.
+ * If the disk model asks for read-ahead, misses fill one of two buffers in turn,
+ * as fsw_efi_read_block does; otherwise each block is read on its own.
  */
 
-fsw_status_t fsw_posix_read_block(struct fsw_volume *vol, fsw_u32 phys_bno, void *buffer)
+fsw_status_t fsw_posix_read_block(struct fsw_volume *vol, fsw_u64 phys_bno, void *buffer)
 {
     struct fsw_posix_volume *pvol = (struct fsw_posix_volume *)vol->host_data;
-    off_t           block_offset, seek_result;
-    ssize_t         read_result;
+    fsw_u64         block_offset, dev_offset = 0, seek = 0, cost = 0;
+    ssize_t         read_result = 0;
+    const char      *source;
+    int             i, ra = -1, failed = 0;
+
+    FSW_MSG_DEBUGV((FSW_MSGSTR("fsw_posix_read_block: %llu  (%d)\n"), (unsigned long long)phys_bno, vol->phys_blocksize));
+
+    block_offset = phys_bno * vol->phys_blocksize;
+    pvol->disk.read_blocks++;
+
+    if (pvol->model.readahead >= vol->phys_blocksize) {
+        // look in the read-ahead buffers
+        for (i = 0; i < FSW_POSIX_READAHEAD_BUFFERS && ra < 0; i++) {
+            if (pvol->ra_length[i] && block_offset >= pvol->ra_start[i] &&
+                block_offset + vol->phys_blocksize <= pvol->ra_start[i] + pvol->ra_length[i])
+                ra = i;
+        }
+        if (ra >= 0) {
+            pvol->disk.readahead_hits++;
+            source = "hit";
+        } else {
+            // refill the buffer that was filled least recently
+            ra = (pvol->ra_last + 1) % FSW_POSIX_READAHEAD_BUFFERS;
+            pvol->ra_length[ra] = 0;
+            if (pvol->ra_buffer[ra] == NULL &&
+                fsw_alloc(pvol->model.readahead, &pvol->ra_buffer[ra]))
+                return FSW_OUT_OF_MEMORY;
+            source = "ra";
+            dev_offset = block_offset;
+            read_result = fsw_posix_device_read(pvol, dev_offset, pvol->model.readahead, pvol->ra_buffer[ra],
+                                                &seek, &cost);
+            if (read_result >= (ssize_t)vol->phys_blocksize) {
+                pvol->ra_start[ra] = block_offset;
+                pvol->ra_length[ra] = read_result;
+                pvol->ra_last = ra;
+            } else {
+                ra = -1;
+                source = "err";
+                failed = 1;
+            }
+        }
+        if (ra >= 0)
+            fsw_memcpy(buffer, pvol->ra_buffer[ra] + (block_offset - pvol->ra_start[ra]), vol->phys_blocksize);
+    } else {
+        source = "dev";
+        dev_offset = block_offset;
+        read_result = fsw_posix_device_read(pvol, dev_offset, vol->phys_blocksize, buffer, &seek, &cost);
+        if (read_result != vol->phys_blocksize) {
+            source = "err";
+            failed = 1;
+        }
+    }
 
-    FSW_MSG_DEBUGV((FSW_MSGSTR("fsw_posix_read_block: %d  (%d)\n"), phys_bno, vol->phys_blocksize));
+    if (pvol->trace != NULL)
+        fprintf(pvol->trace, "%llu %llu %llu %u %s %llu %llu %llu %llu %llu\n",
+                (unsigned long long)pvol->disk.read_blocks, (unsigned long long)phys_bno,
+                (unsigned long long)block_offset, vol->phys_blocksize, source,
+                (unsigned long long)dev_offset, (unsigned long long)(read_result > 0 ? read_result : 0),
+                (unsigned long long)seek, (unsigned long long)cost,
+                (unsigned long long)pvol->disk.sim_time_ns);
 
-    // read from disk
-    block_offset = (off_t)phys_bno * vol->phys_blocksize;
-    seek_result = lseek(pvol->fd, block_offset, SEEK_SET);
-    if (seek_result != block_offset)
+    if (failed)
         return FSW_IO_ERROR;
-    read_result = read(pvol->fd, buffer, vol->phys_blocksize);
-    if (read_result != vol->phys_blocksize)
-        return FSW_IO_ERROR;
-
     return FSW_SUCCESS;
 }
 
@@ -43,8 +43,43 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/dir.h>
+#include <stdio.h>
 
 
+/** Environment variable that configures the simulated disk (see fsw_posix.c). */
+#define FSW_POSIX_DISK_ENV  "FSW_POSIX_DISK"
+
+/** Number of read-ahead buffers, as in the EFI host. */
+#define FSW_POSIX_READAHEAD_BUFFERS (2)
+
+/**
+ * POSIX Host: Model of a slow block device. All zeros means a plain,
+ * untimed file.
+ */
+
+struct fsw_posix_disk_model {
+    fsw_u64                     latency_ns;     //!< Fixed cost of every device request
+    fsw_u64                     bandwidth;      //!< Transfer rate in bytes per second (0 = unlimited)
+    fsw_u64                     seek_ns_per_gib;    //!< Seek cost per GiB between requests
+    fsw_u64                     seek_max_ns;    //!< Upper limit on the seek cost (0 = none)
+    fsw_u64                     readahead;      //!< Size of each read-ahead buffer (0 = none)
+    int                         delay;          //!< Really sleep for the simulated time
+    char                        trace_path[256];    //!< File to append the access trace to
+};
+
+/**
+ * POSIX Host: Counters of the simulated disk, in the style of struct fsw_io_stats.
+ */
+
+struct fsw_posix_disk_stats {
+    fsw_u64                     read_blocks;    //!< Calls to read_block
+    fsw_u64                     readahead_hits; //!< ...satisfied from the read-ahead buffers
+    fsw_u64                     requests;       //!< Requests sent to the device
+    fsw_u64                     bytes;          //!< Bytes read from the device
+    fsw_u64                     seek_bytes;     //!< Total head movement
+    fsw_u64                     sim_time_ns;    //!< Simulated device time
+};
+
 /**
  * POSIX Host: Private per-volume structure.
  */
@@ -54,6 +89,15 @@ struct fsw_posix_volume {
 
     int                         fd;             //!< System file descriptor for data access
 
+    struct fsw_posix_disk_model model;          //!< Simulated disk parameters
+    struct fsw_posix_disk_stats disk;           //!< Simulated disk counters
+    fsw_u64                     head_pos;       //!< Byte offset following the last device request
+    FILE                        *trace;         //!< Access trace, or NULL
+
+    fsw_u8                      *ra_buffer[FSW_POSIX_READAHEAD_BUFFERS];
+    fsw_u64                     ra_start[FSW_POSIX_READAHEAD_BUFFERS];
+    fsw_u64                     ra_length[FSW_POSIX_READAHEAD_BUFFERS];   //!< 0 = buffer empty
+    int                         ra_last;        //!< Buffer filled most recently
 };
 
 /**
@@ -81,6 +125,7 @@ struct fsw_posix_dir {
 
 /* functions */
 
+int fsw_posix_disk_model_parse(const char *spec, struct fsw_posix_disk_model *model);
 struct fsw_posix_volume * fsw_posix_mount(const char *path, struct fsw_fstype_table *fstype_table);
 int fsw_posix_unmount(struct fsw_posix_volume *pvol);
 
@@ -45,6 +45,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
 
 #define FSW_LITTLE_ENDIAN (1)
 // TODO: use info from the headers to define FSW_LITTLE_ENDIAN or FSW_BIG_ENDIAN
@@ -82,6 +83,17 @@ typedef uint64_t            fsw_u64;
 
 #define FSW_U64_SHR(val,shiftbits) ((val) >> (shiftbits))
 #define FSW_U64_DIV(val,divisor) ((val) / (divisor))
+
+// timing hook (nanoseconds)
+
+static inline fsw_u64 fsw_posix_timestamp(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (fsw_u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#define FSW_TIMESTAMP() fsw_posix_timestamp()
 #define DEBUG(x)
 
 #define RShiftU64(val, shift) ((val) >> (shift))
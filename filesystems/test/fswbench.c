@@ -0,0 +1,345 @@
+/**
+ * \file fswbench.c
+ * Benchmark and regression test for the FSW drivers in the POSIX user space
+ * environment.
+ */
+
+/*-
+ * Copyright (c) 2014 Roderick W. Smith
+ * Copyright (c) 2006 Christoph Pfisterer
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ *  * Neither the name of Christoph Pfisterer nor the names of the
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Each run mounts the image afresh (so the core's block cache starts out
+ * empty, and the image's pages are dropped from the OS page cache) and then
+ * performs, twice ("cold" and "warm"):
+ *
+ *  - walk:   a recursive directory listing of the whole volume;
+ *  - lookup: opening every regular file found by the walk, by full path;
+ *  - read:   a sequential read of the largest file found.
+ *
+ * Each phase prints one line of "key=value" pairs: its time, the volume's
+ * I/O counters for that phase (see struct fsw_io_stats), and those of the
+ * simulated disk (struct fsw_posix_disk_stats; the sim_usec figure is only
+ * meaningful if FSW_POSIX_DISK sets up a disk model). With -c, the program
+ * instead copies a single file to stdout, so that a test script can compare
+ * what the driver reads against the original.
+ */
+
+#include "fsw_posix.h"
+
+#include <getopt.h>
+
+
+extern struct fsw_fstype_table FSW_FSTYPE_TABLE_NAME(FSTYPE);
+
+#define FSWBENCH_STRINGIFY2(x) #x
+#define FSWBENCH_STRINGIFY(x) FSWBENCH_STRINGIFY2(x)
+#define FSWBENCH_DRIVER FSWBENCH_STRINGIFY(FSTYPE)
+
+#define READ_CHUNK (64 * 1024)
+
+struct bench_tree {
+    char        **paths;            //!< Full paths of all regular files
+    int         count;
+    int         alloc;
+    fsw_u64     dirs;               //!< Number of directories, including the root
+    char        *largest;           //!< Largest file, found by the lookup phase
+    fsw_u64     largest_size;
+};
+
+struct bench_phase {
+    const char  *image;
+    int         run;
+    const char  *cache;             //!< "cold" or "warm"
+    fsw_u64     start;
+    struct fsw_io_stats stats;
+    struct fsw_posix_disk_stats disk;
+};
+
+static void phase_begin(struct bench_phase *phase, struct fsw_posix_volume *pvol)
+{
+    phase->stats = pvol->vol->io_stats;
+    phase->disk = pvol->disk;
+    phase->start = FSW_TIMESTAMP();
+}
+
+// Print one result line; "extra" holds the phase-specific pairs.
+static void phase_end(struct bench_phase *phase, struct fsw_posix_volume *pvol, const char *name,
+                      const char *extra)
+{
+    fsw_u64 usec = (FSW_TIMESTAMP() - phase->start) / 1000;
+    struct fsw_io_stats *now = &pvol->vol->io_stats;
+    struct fsw_posix_disk_stats *disk = &pvol->disk;
+
+    printf("fswbench driver=%s image=%s run=%d phase=%s cache=%s usec=%llu %s"
+           " block_gets=%llu bcache_hits=%llu block_reads=%llu read_bytes=%llu"
+           " dir_lookups=%llu dir_lookup_usec=%llu get_extents=%llu get_extent_usec=%llu"
+           " readahead_hits=%llu dev_requests=%llu dev_bytes=%llu seek_bytes=%llu sim_usec=%llu\n",
+           FSWBENCH_DRIVER, phase->image, phase->run, name, phase->cache,
+           (unsigned long long)usec, extra,
+           (unsigned long long)(now->block_gets - phase->stats.block_gets),
+           (unsigned long long)(now->bcache_hits - phase->stats.bcache_hits),
+           (unsigned long long)(now->block_reads - phase->stats.block_reads),
+           (unsigned long long)(now->block_read_bytes - phase->stats.block_read_bytes),
+           (unsigned long long)(now->dir_lookup_calls - phase->stats.dir_lookup_calls),
+           (unsigned long long)((now->dir_lookup_time - phase->stats.dir_lookup_time) / 1000),
+           (unsigned long long)(now->get_extent_calls - phase->stats.get_extent_calls),
+           (unsigned long long)((now->get_extent_time - phase->stats.get_extent_time) / 1000),
+           (unsigned long long)(disk->readahead_hits - phase->disk.readahead_hits),
+           (unsigned long long)(disk->requests - phase->disk.requests),
+           (unsigned long long)(disk->bytes - phase->disk.bytes),
+           (unsigned long long)(disk->seek_bytes - phase->disk.seek_bytes),
+           (unsigned long long)((disk->sim_time_ns - phase->disk.sim_time_ns) / 1000));
+    fflush(stdout);
+}
+
+static void tree_add(struct bench_tree *tree, const char *path)
+{
+    if (tree->count == tree->alloc) {
+        tree->alloc = tree->alloc ? tree->alloc * 2 : 256;
+        tree->paths = realloc(tree->paths, tree->alloc * sizeof(char *));
+        if (tree->paths == NULL) {
+            fprintf(stderr, "fswbench: out of memory\n");
+            exit(1);
+        }
+    }
+    tree->paths[tree->count++] = strdup(path);
+}
+
+static void tree_free(struct bench_tree *tree)
+{
+    int i;
+
+    for (i = 0; i < tree->count; i++)
+        free(tree->paths[i]);
+    free(tree->paths);
+    memset(tree, 0, sizeof(struct bench_tree));
+}
+
+// Recursively list path (which ends in '/'), adding regular files to tree
+// if it's not NULL. Returns the number of entries seen, or -1 on errors.
+static long walk_dir(struct fsw_posix_volume *pvol, const char *path, struct bench_tree *tree)
+{
+    struct fsw_posix_dir *dir;
+    struct dirent *dent;
+    char subpath[4096];
+    long entries = 0, sub;
+
+    dir = fsw_posix_opendir(pvol, path);
+    if (dir == NULL)
+        return -1;
+    if (tree != NULL)
+        tree->dirs++;
+    while ((dent = fsw_posix_readdir(dir)) != NULL) {
+        if (strcmp(dent->d_name, ".") == 0 || strcmp(dent->d_name, "..") == 0)
+            continue;
+        entries++;
+        if (dent->d_type == DT_DIR) {
+            snprintf(subpath, sizeof(subpath), "%s%s/", path, dent->d_name);
+            sub = walk_dir(pvol, subpath, tree);
+            if (sub < 0) {
+                entries = -1;
+                break;
+            }
+            entries += sub;
+        } else if (dent->d_type == DT_REG && tree != NULL) {
+            snprintf(subpath, sizeof(subpath), "%s%s", path, dent->d_name);
+            tree_add(tree, subpath);
+        }
+    }
+    fsw_posix_closedir(dir);
+    return entries;
+}
+
+// Open every file in tree by path, recording the largest. Returns the number
+// of files that could not be opened.
+static int lookup_all(struct fsw_posix_volume *pvol, struct bench_tree *tree)
+{
+    struct fsw_posix_file *file;
+    fsw_u64 size;
+    int i, failed = 0;
+
+    for (i = 0; i < tree->count; i++) {
+        file = fsw_posix_open(pvol, tree->paths[i], 0, 0);
+        if (file == NULL) {
+            failed++;
+            continue;
+        }
+        size = fsw_posix_lseek(file, 0, SEEK_END);
+        if (tree->largest == NULL || size > tree->largest_size) {
+            tree->largest = tree->paths[i];
+            tree->largest_size = size;
+        }
+        fsw_posix_close(file);
+    }
+    return failed;
+}
+
+// Read path sequentially; returns the number of bytes read, or -1.
+static long long read_file(struct fsw_posix_volume *pvol, const char *path, FILE *out)
+{
+    struct fsw_posix_file *file;
+    static char buf[READ_CHUNK];
+    long long total = 0;
+    ssize_t r;
+
+    file = fsw_posix_open(pvol, path, 0, 0);
+    if (file == NULL)
+        return -1;
+    while ((r = fsw_posix_read(file, buf, sizeof(buf))) > 0) {
+        if (out != NULL && fwrite(buf, 1, r, out) != (size_t)r) {
+            total = -1;
+            break;
+        }
+        total += r;
+    }
+    if (r < 0)
+        total = -1;
+    fsw_posix_close(file);
+    return total;
+}
+
+// Ask the OS to forget the image's cached pages, so that a cold run really
+// reads the disk (where the OS supports it; a no-op otherwise).
+static void drop_os_cache(const char *image)
+{
+#ifdef POSIX_FADV_DONTNEED
+    int fd = open(image, O_RDONLY);
+
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#endif
+}
+
+static int bench_pass(struct fsw_posix_volume *pvol, struct bench_phase *phase, struct bench_tree *tree)
+{
+    char extra[256];
+    long entries;
+    int failed;
+    long long bytes;
+    fsw_u64 usec;
+
+    // walk (the first pass also collects the file list)
+    phase_begin(phase, pvol);
+    entries = walk_dir(pvol, "/", tree->count == 0 ? tree : NULL);
+    snprintf(extra, sizeof(extra), "entries=%ld dirs=%llu files=%d", entries,
+             (unsigned long long)tree->dirs, tree->count);
+    phase_end(phase, pvol, "walk", extra);
+    if (entries < 0)
+        return 1;
+
+    // lookup
+    phase_begin(phase, pvol);
+    failed = lookup_all(pvol, tree);
+    snprintf(extra, sizeof(extra), "files=%d failed=%d", tree->count, failed);
+    phase_end(phase, pvol, "lookup", extra);
+    if (failed)
+        return 1;
+
+    // sequential read of the largest file
+    if (tree->largest == NULL)
+        return 0;
+    phase_begin(phase, pvol);
+    bytes = read_file(pvol, tree->largest, NULL);
+    usec = (FSW_TIMESTAMP() - phase->start) / 1000;
+    snprintf(extra, sizeof(extra), "file=%s bytes=%lld kib_per_sec=%llu", tree->largest, bytes,
+             (unsigned long long)(usec ? (bytes / 1024) * 1000000ULL / usec : 0));
+    phase_end(phase, pvol, "read", extra);
+    return (bytes != (long long)tree->largest_size);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: fswbench_%s [-n runs] <image>\n"
+                    "       fswbench_%s -c <path> <image>\n", FSWBENCH_DRIVER, FSWBENCH_DRIVER);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    struct fsw_posix_volume *pvol;
+    struct bench_tree tree;
+    struct bench_phase phase;
+    const char *cat_path = NULL;
+    int opt, runs = 1, run, status = 0;
+
+    while ((opt = getopt(argc, argv, "n:c:")) != -1) {
+        switch (opt) {
+            case 'n':
+                runs = atoi(optarg);
+                break;
+            case 'c':
+                cat_path = optarg;
+                break;
+            default:
+                usage();
+        }
+    }
+    if (optind != argc - 1 || runs < 1)
+        usage();
+
+    if (cat_path != NULL) {
+        pvol = fsw_posix_mount(argv[optind], &FSW_FSTYPE_TABLE_NAME(FSTYPE));
+        if (pvol == NULL)
+            return 2;
+        status = (read_file(pvol, cat_path, stdout) < 0);
+        fsw_posix_unmount(pvol);
+        return status;
+    }
+
+    memset(&phase, 0, sizeof(phase));
+    phase.image = argv[optind];
+    for (run = 1; run <= runs && status == 0; run++) {
+        memset(&tree, 0, sizeof(tree));
+        drop_os_cache(phase.image);
+        pvol = fsw_posix_mount(phase.image, &FSW_FSTYPE_TABLE_NAME(FSTYPE));
+        if (pvol == NULL) {
+            fprintf(stderr, "fswbench: %s: mounting as %s failed\n", phase.image, FSWBENCH_DRIVER);
+            return 2;
+        }
+        phase.run = run;
+        phase.cache = "cold";
+        status = bench_pass(pvol, &phase, &tree);
+        if (status == 0) {
+            phase.cache = "warm";
+            status = bench_pass(pvol, &phase, &tree);
+        }
+        fsw_posix_unmount(pvol);
+        tree_free(&tree);
+    }
+
+    return status;
+}
+
+// EOF
@@ -0,0 +1,167 @@
+#!/bin/bash
+#
+# filesystems/test/fswbench.sh
+# Builds test file system images and runs the fswbench_<driver> programs on
+# them, checking that each driver sees the same files (and the same contents
+# for the largest one) as went into the image.
+#
+# Usage: fswbench.sh [-n runs] [-d workdir] [-i driver:image ...] driver ...
+#
+# Images are built without mounting anything (and so without root
+# privileges), which is possible for ext2/ext4 (mke2fs -d) and iso9660
+# (genisoimage, mkisofs, or xorriso). For other file systems, or to test
+# real-world images, pass existing images with -i; their contents are only
+# benchmarked, not checked. Drivers with no image are reported as skipped.
+#
+# Benchmark results ("fswbench ..." lines of key=value pairs) go to stdout
+# and to <workdir>/results.txt; test verdicts go to stderr. The exit status
+# is 1 if any test failed.
+#
+# Copyright (c) 2014 Roderick W. Smith
+#
+# Distributed under the terms of the GNU General Public License (GPL)
+# version 3 (GPLv3), a copy of which must be distributed with this source
+# code or binaries made from it.
+#
+
+Runs=3
+WorkDir="bench-images"
+ExtraImages=""
+Failures=0
+
+# Fixed identifiers, so that the images (and therefore the I/O counts) are
+# the same from one run to the next
+FsUuid="5a1e5ca1-0000-4000-8000-000000000001"
+HashSeed="5a1e5ca1-0000-4000-8000-000000000002"
+export E2FSPROGS_FAKE_TIME=1400000000
+export SOURCE_DATE_EPOCH=1400000000
+
+Verdict() {
+   echo "$1: $2" 1>&2
+   if [[ "$1" == "FAIL" ]] ; then
+      Failures=$((Failures + 1))
+   fi
+}
+
+# Creates the tree that goes into each image: many small files spread over
+# nested directories (for the walk and lookup phases) and one large file (for
+# the sequential read).
+MakeSourceTree() {
+   local Src="$1" Dir File
+
+   rm -rf "$Src"
+   mkdir -p "$Src/boot/efi/deep/a/b/c/d/e/f/g/h"
+   for Dir in $(seq -w 0 15) ; do
+      mkdir -p "$Src/tree/d$Dir"
+      for File in $(seq -w 0 39) ; do
+         seq 1 $((10#$Dir * 40 + 10#$File)) > "$Src/tree/d$Dir/f$File.txt"
+      done
+   done
+   echo "deep file" > "$Src/boot/efi/deep/a/b/c/d/e/f/g/h/deep.txt"
+   seq 1 2500000 > "$Src/boot/vmlinuz"
+} # MakeSourceTree()
+
+# Builds an image for driver $1 from $2 as $3; returns 1 if the host lacks
+# the tools to do so.
+MakeImage() {
+   local Driver="$1" Src="$2" Image="$3" Tool
+
+   rm -f "$Image"
+   case "$Driver" in
+      ext2)
+         which mke2fs &> /dev/null || return 1
+         mke2fs -q -F -t ext2 -U "$FsUuid" -E "hash_seed=$HashSeed" -d "$Src" "$Image" 64M > /dev/null
+         ;;
+      ext4)
+         # The driver doesn't handle the 64bit feature, which newer versions
+         # of mke2fs enable by default
+         which mke2fs &> /dev/null || return 1
+         mke2fs -q -F -t ext4 -O ^64bit -U "$FsUuid" -E "hash_seed=$HashSeed" -d "$Src" "$Image" 64M > /dev/null
+         ;;
+      iso9660)
+         for Tool in genisoimage mkisofs ; do
+            if which $Tool &> /dev/null ; then
+               $Tool -quiet -R -o "$Image" "$Src"
+               return $?
+            fi
+         done
+         which xorriso &> /dev/null || return 1
+         xorriso -as mkisofs -quiet -R -o "$Image" "$Src" 2> /dev/null
+         ;;
+      *)
+         return 1
+         ;;
+   esac
+} # MakeImage()
+
+# Runs the benchmark for driver $1 on image $2; if $3 is given, it's the
+# source tree, against which the results are checked.
+RunBench() {
+   local Driver="$1" Image="$2" Src="$3" Output Files Expected
+
+   Output=$(./fswbench_$Driver -n $Runs "$Image")
+   if [[ $? -ne 0 ]] ; then
+      echo "$Output" | tee -a "$WorkDir/results.txt"
+      Verdict FAIL "$Driver: benchmark on $Image"
+      return
+   fi
+   echo "$Output" | tee -a "$WorkDir/results.txt"
+   if [[ -z "$Src" ]] ; then
+      Verdict PASS "$Driver: benchmark on $Image"
+      return
+   fi
+
+   Files=$(echo "$Output" | grep -m 1 "phase=walk" | sed -e 's/.* files=\([0-9]*\).*/\1/')
+   Expected=$(find "$Src" -type f | wc -l)
+   if [[ "$Files" != "$Expected" ]] ; then
+      Verdict FAIL "$Driver: found $Files files in $Image, expected $Expected"
+   elif ! ./fswbench_$Driver -c /boot/vmlinuz "$Image" | cmp -s - "$Src/boot/vmlinuz" ; then
+      Verdict FAIL "$Driver: /boot/vmlinuz read from $Image differs from the original"
+   elif ! ./fswbench_$Driver -c /boot/efi/deep/a/b/c/d/e/f/g/h/deep.txt "$Image" | \
+        cmp -s - "$Src/boot/efi/deep/a/b/c/d/e/f/g/h/deep.txt" ; then
+      Verdict FAIL "$Driver: deep path read from $Image differs from the original"
+   else
+      Verdict PASS "$Driver: $Image"
+   fi
+} # RunBench()
+
+while getopts "n:d:i:" Opt ; do
+   case $Opt in
+      n) Runs="$OPTARG" ;;
+      d) WorkDir="$OPTARG" ;;
+      i) ExtraImages="$ExtraImages $OPTARG" ;;
+      *) echo "Usage: $0 [-n runs] [-d workdir] [-i driver:image ...] driver ..." 1>&2
+         exit 1 ;;
+   esac
+done
+shift $((OPTIND - 1))
+
+mkdir -p "$WorkDir"
+rm -f "$WorkDir/results.txt"
+MakeSourceTree "$WorkDir/src"
+
+for Driver in "$@" ; do
+   if [[ ! -x ./fswbench_$Driver ]] ; then
+      Verdict FAIL "$Driver: ./fswbench_$Driver has not been built"
+      continue
+   fi
+   Tested=0
+   if MakeImage "$Driver" "$WorkDir/src" "$WorkDir/$Driver.img" ; then
+      RunBench "$Driver" "$WorkDir/$Driver.img" "$WorkDir/src"
+      Tested=1
+   fi
+   for Extra in $ExtraImages ; do
+      if [[ "${Extra%%:*}" == "$Driver" ]] ; then
+         RunBench "$Driver" "${Extra#*:}"
+         Tested=1
+      fi
+   done
+   if [[ $Tested -eq 0 ]] ; then
+      Verdict SKIP "$Driver: no image (the host can't build one; use -i $Driver:<image>)"
+   fi
+done
+
+if [[ $Failures -gt 0 ]] ; then
+   exit 1
+fi
+exit 0
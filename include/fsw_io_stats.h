@@ -0,0 +1,42 @@
+/*
+ * include/fsw_io_stats.h
+ * I/O statistics reported by rEFInd's filesystem drivers
+ *
+ * Copyright (c) 2014 Roderick W. Smith
+ *
+ * This header is shared by the filesystem drivers (which are distributed
+ * under the terms of the BSD license) and rEFInd (GPLv3), and may be used
+ * under either license.
+ *
+ */
+
+#ifndef __FSW_IO_STATS_H_
+#define __FSW_IO_STATS_H_
+
+// The drivers answer an EFI_FILE GetInfo() call on any file or directory
+// with this information type, filling in an FSW_IO_STATS_INFO structure for
+// the volume. Other filesystem drivers return EFI_UNSUPPORTED.
+#define FSW_IO_STATS_INFO_GUID \
+   { 0xfa173af1, 0x5112, 0x46a3, { 0x90, 0x6c, 0x8d, 0x02, 0x95, 0xcf, 0xb5, 0xa0 } }
+
+typedef struct {
+   UINT64   Size;               // size of this structure, in bytes
+   UINT64   TicksPerMs;         // units of the *Ticks fields; 0 if not timed
+
+   // Counters kept by the driver's core
+   UINT64   BlockGets;          // requests for filesystem blocks
+   UINT64   BlockCacheHits;     // ...satisfied by the block cache
+   UINT64   BlockReads;         // ...passed on to the driver's disk layer
+   UINT64   BlockReadBytes;
+   UINT64   GetExtentCalls;     // file block mapping
+   UINT64   GetExtentTicks;
+   UINT64   DirLookupCalls;     // directory searches
+   UINT64   DirLookupTicks;
+
+   // Counters kept by the driver's disk layer
+   UINT64   ReadAheadHits;      // blocks found in the read-ahead buffers
+   UINT64   DiskReads;          // calls to the Disk I/O protocol's ReadDisk()
+   UINT64   DiskReadBytes;
+} FSW_IO_STATS_INFO;
+
+#endif
@@ -46,6 +46,7 @@
 #include "../refind/global.h"
 #include "../refind/lib.h"
 #include "../refind/screen.h"
+#include "../refind/crc32.h"
 #include "../include/refit_call_wrapper.h"
 #include "lodepng.h"
 
@@ -305,6 +306,21 @@ static EG_IMAGE * egDecodeAny(IN UINT8 *FileData, IN UINTN FileDataLength, IN UI
    return NewImage;
 }
 
+// Decode the specified icon data into an IconSize x IconSize image. PNG data is
+// scaled as it's decoded; other formats are scaled by the caller if necessary.
+static EG_IMAGE * egDecodeIcon(IN UINT8 *FileData, IN UINTN FileDataLength, IN UINTN IconSize)
+{
+   EG_IMAGE        *NewImage = NULL;
+
+   NewImage = egDecodeICNS(FileData, FileDataLength, IconSize, TRUE);
+   if (NewImage == NULL)
+      NewImage = egDecodePNGScaled(FileData, FileDataLength, IconSize, IconSize, TRUE);
+   if (NewImage == NULL)
+      NewImage = egDecodeBMP(FileData, FileDataLength, IconSize, TRUE);
+
+   return NewImage;
+}
+
 EG_IMAGE * egLoadImage(IN EFI_FILE* BaseDir, IN CHAR16 *FileName, IN BOOLEAN WantAlpha)
 {
     EFI_STATUS      Status;
@@ -327,7 +343,253 @@ EG_IMAGE * egLoadImage(IN EFI_FILE* BaseDir, IN CHAR16 *FileName, IN BOOLEAN Wan
     return NewImage;
 }
 
+//
+// Persistent icon cache
+//
+
+// When GlobalConfig.CacheIcons is set, icons loaded from rEFInd's own
+// directory are also stored, already decoded and scaled, in a cache file in
+// that directory. Each record is keyed by the icon's path, the size to which
+// it was scaled, and the source file's size and modification time, so
+// replacing a theme's files or changing the icon sizes simply causes the
+// affected records to be ignored and rebuilt. The file is read (with a single
+// egLoadFile() call) the first time an icon is loaded and is rewritten by
+// egSaveIconCache() if new icons were decoded.
+
+#define ICON_CACHE_FILE_NAME L"icons.cache"
+#define ICON_CACHE_MAGIC     0x43494552  /* "REIC" */
+#define ICON_CACHE_VERSION   1
+
+typedef struct {
+   UINT32      Magic;
+   UINT32      Version;
+   UINT32      EntryCount;
+   UINT32      DataSize;    // number of bytes following this header
+   UINT32      Checksum;    // CRC32 of the DataSize bytes following this header
+   UINT32      Reserved;
+} EG_ICON_FILE_HEADER;
+
+// Each record is followed by the NULL-terminated path (zero-padded to PathSize
+// bytes, a multiple of 4) and then by Width * Height BGRA pixels.
+typedef struct {
+   UINT32      RecordSize;  // this structure, path, and pixels
+   UINT32      PathSize;
+   UINT32      IconSize;
+   UINT32      Width;
+   UINT32      Height;
+   UINT32      HasAlpha;
+   UINT64      FileSize;    // of the source icon file
+   EFI_TIME    ModTime;     // of the source icon file
+} EG_ICON_FILE_RECORD;
+
+typedef struct _eg_disk_icon {
+   CHAR16                *Path;
+   UINTN                 IconSize;
+   UINT64                FileSize;
+   EFI_TIME              ModTime;
+   UINTN                 Width;
+   UINTN                 Height;
+   BOOLEAN               HasAlpha;
+   BOOLEAN               Used;      // loaded in this session; written by egSaveIconCache()
+   EG_PIXEL              *PixelData;
+   struct _eg_disk_icon  *Next;
+} EG_DISK_ICON;
+
+static EG_DISK_ICON *DiskIcons = NULL;
+static UINT8 *DiskIconData = NULL;  // file contents; referenced by DiskIcons entries
+static BOOLEAN DiskIconsRead = FALSE;
+static BOOLEAN DiskIconsDirty = FALSE;
+
+// Find the size and modification time of the specified file. Returns TRUE
+// if the file exists, FALSE otherwise.
+static BOOLEAN egGetIconFileInfo(IN EFI_FILE *BaseDir, IN CHAR16 *Path, OUT UINT64 *FileSize, OUT EFI_TIME *ModTime) {
+   EFI_STATUS      Status;
+   EFI_FILE_HANDLE FileHandle;
+   EFI_FILE_INFO   *FileInfo;
+
+   Status = refit_call5_wrapper(BaseDir->Open, BaseDir, &FileHandle, Path, EFI_FILE_MODE_READ, 0);
+   if (EFI_ERROR(Status))
+      return FALSE;
+   FileInfo = LibFileInfo(FileHandle);
+   refit_call1_wrapper(FileHandle->Close, FileHandle);
+   if (FileInfo == NULL)
+      return FALSE;
+   *FileSize = FileInfo->FileSize;
+   CopyMem(ModTime, &(FileInfo->ModificationTime), sizeof(EFI_TIME));
+   FreePool(FileInfo);
+   return TRUE;
+} // static BOOLEAN egGetIconFileInfo()
+
+// Read the icon cache file and build the DiskIcons list from it. A file that's
+// damaged or from another version is ignored (and replaced when next saved).
+static VOID egReadIconCache(VOID) {
+   EFI_STATUS          Status;
+   UINT8               *FileData;
+   UINTN               FileDataLength, Offset, End, i;
+   EG_ICON_FILE_HEADER *Header;
+   EG_ICON_FILE_RECORD *Record;
+   EG_DISK_ICON        *Icon;
+
+   DiskIconsRead = TRUE;
+   Status = egLoadFile(SelfDir, ICON_CACHE_FILE_NAME, &FileData, &FileDataLength);
+   if (EFI_ERROR(Status))
+      return;
+
+   Header = (EG_ICON_FILE_HEADER *) FileData;
+   if ((FileDataLength < sizeof(EG_ICON_FILE_HEADER)) || (Header->Magic != ICON_CACHE_MAGIC) ||
+       (Header->Version != ICON_CACHE_VERSION) || (Header->DataSize > FileDataLength - sizeof(EG_ICON_FILE_HEADER)) ||
+       (crc32(0x0, FileData + sizeof(EG_ICON_FILE_HEADER), Header->DataSize) != Header->Checksum)) {
+      FreePool(FileData);
+      DiskIconsDirty = TRUE;
+      return;
+   } // if
+
+   Offset = sizeof(EG_ICON_FILE_HEADER);
+   End = Offset + Header->DataSize;
+   for (i = 0; i < Header->EntryCount; i++) {
+      if (End - Offset < sizeof(EG_ICON_FILE_RECORD))
+         break;
+      Record = (EG_ICON_FILE_RECORD *) (FileData + Offset);
+      if ((Record->RecordSize > End - Offset) || (Record->PathSize < sizeof(CHAR16)) || (Record->RecordSize % 4 != 0) ||
+          (Record->RecordSize != sizeof(EG_ICON_FILE_RECORD) + Record->PathSize +
+                                 (UINTN) Record->Width * Record->Height * sizeof(EG_PIXEL)))
+         break;
+      Icon = AllocateZeroPool(sizeof(EG_DISK_ICON));
+      if (Icon == NULL)
+         break;
+      Icon->Path = (CHAR16 *) (FileData + Offset + sizeof(EG_ICON_FILE_RECORD));
+      Icon->Path[Record->PathSize / sizeof(CHAR16) - 1] = 0;
+      Icon->IconSize = Record->IconSize;
+      Icon->FileSize = Record->FileSize;
+      CopyMem(&(Icon->ModTime), &(Record->ModTime), sizeof(EFI_TIME));
+      Icon->Width = Record->Width;
+      Icon->Height = Record->Height;
+      Icon->HasAlpha = (Record->HasAlpha != 0);
+      Icon->PixelData = (EG_PIXEL *) (FileData + Offset + sizeof(EG_ICON_FILE_RECORD) + Record->PathSize);
+      Icon->Next = DiskIcons;
+      DiskIcons = Icon;
+      Offset += Record->RecordSize;
+   } // for
+   DiskIconData = FileData;
+} // static VOID egReadIconCache()
+
+// Returns a new copy of the cached icon matching all the specified criteria,
+// or NULL if there's no such icon in the cache.
+static EG_IMAGE * egLoadDiskCachedIcon(IN CHAR16 *Path, IN UINTN IconSize, IN UINT64 FileSize, IN EFI_TIME *ModTime) {
+   EG_DISK_ICON *Icon;
+   EG_IMAGE     *Image;
+
+   if (!DiskIconsRead)
+      egReadIconCache();
+
+   for (Icon = DiskIcons; Icon != NULL; Icon = Icon->Next) {
+      if ((Icon->IconSize == IconSize) && (Icon->FileSize == FileSize) &&
+          (CompareMem(&(Icon->ModTime), ModTime, sizeof(EFI_TIME)) == 0) && (StriCmp(Icon->Path, Path) == 0)) {
+         Image = egCreateImage(Icon->Width, Icon->Height, Icon->HasAlpha);
+         if (Image != NULL) {
+            CopyMem(Image->PixelData, Icon->PixelData, Icon->Width * Icon->Height * sizeof(EG_PIXEL));
+            Icon->Used = TRUE;
+         }
+         return Image;
+      } // if
+   } // for
+   return NULL;
+} // static EG_IMAGE * egLoadDiskCachedIcon()
+
+// Adds a copy of Image to the in-memory list of icons to be written to the
+// cache file.
+static VOID egAddDiskCachedIcon(IN CHAR16 *Path, IN UINTN IconSize, IN UINT64 FileSize, IN EFI_TIME *ModTime, IN EG_IMAGE *Image) {
+   EG_DISK_ICON *Icon;
+   UINTN        PixelBytes;
+
+   Icon = AllocateZeroPool(sizeof(EG_DISK_ICON));
+   if (Icon == NULL)
+      return;
+   PixelBytes = Image->Width * Image->Height * sizeof(EG_PIXEL);
+   Icon->Path = StrDuplicate(Path);
+   Icon->PixelData = AllocatePool(PixelBytes);
+   if ((Icon->Path == NULL) || (Icon->PixelData == NULL)) {
+      MyFreePool(Icon->Path);
+      MyFreePool(Icon->PixelData);
+      FreePool(Icon);
+      return;
+   } // if
+   CopyMem(Icon->PixelData, Image->PixelData, PixelBytes);
+   Icon->IconSize = IconSize;
+   Icon->FileSize = FileSize;
+   CopyMem(&(Icon->ModTime), ModTime, sizeof(EFI_TIME));
+   Icon->Width = Image->Width;
+   Icon->Height = Image->Height;
+   Icon->HasAlpha = Image->HasAlpha;
+   Icon->Used = TRUE;
+   Icon->Next = DiskIcons;
+   DiskIcons = Icon;
+   DiskIconsDirty = TRUE;
+} // static VOID egAddDiskCachedIcon()
+
+// Writes all the icons used in this session to the icon cache file, if any of
+// them had to be decoded from their source files. Entries that weren't used
+// (for instance, because their source files have changed) are dropped.
+VOID egSaveIconCache(VOID) {
+   EFI_STATUS          Status;
+   EFI_FILE_HANDLE     FileHandle;
+   EG_DISK_ICON        *Icon;
+   EG_ICON_FILE_HEADER *Header;
+   EG_ICON_FILE_RECORD *Record;
+   UINTN               PathSize, PixelBytes, DataSize = 0, Offset;
+   UINT8               *Buffer;
+
+   if (!GlobalConfig.CacheIcons || !DiskIconsDirty || (SelfDir == NULL))
+      return;
+
+   for (Icon = DiskIcons; Icon != NULL; Icon = Icon->Next) {
+      if (Icon->Used)
+         DataSize += sizeof(EG_ICON_FILE_RECORD) + ((StrSize(Icon->Path) + 3) & ~((UINTN) 3)) +
+                     Icon->Width * Icon->Height * sizeof(EG_PIXEL);
+   } // for
+
+   Buffer = AllocateZeroPool(sizeof(EG_ICON_FILE_HEADER) + DataSize);
+   if (Buffer == NULL)
+      return;
+   Header = (EG_ICON_FILE_HEADER *) Buffer;
+   Header->Magic = ICON_CACHE_MAGIC;
+   Header->Version = ICON_CACHE_VERSION;
+   Header->DataSize = (UINT32) DataSize;
+   Offset = sizeof(EG_ICON_FILE_HEADER);
+   for (Icon = DiskIcons; Icon != NULL; Icon = Icon->Next) {
+      if (!Icon->Used)
+         continue;
+      PathSize = (StrSize(Icon->Path) + 3) & ~((UINTN) 3);
+      PixelBytes = Icon->Width * Icon->Height * sizeof(EG_PIXEL);
+      Record = (EG_ICON_FILE_RECORD *) (Buffer + Offset);
+      Record->RecordSize = (UINT32) (sizeof(EG_ICON_FILE_RECORD) + PathSize + PixelBytes);
+      Record->PathSize = (UINT32) PathSize;
+      Record->IconSize = (UINT32) Icon->IconSize;
+      Record->Width = (UINT32) Icon->Width;
+      Record->Height = (UINT32) Icon->Height;
+      Record->HasAlpha = Icon->HasAlpha ? 1 : 0;
+      Record->FileSize = Icon->FileSize;
+      CopyMem(&(Record->ModTime), &(Icon->ModTime), sizeof(EFI_TIME));
+      CopyMem(Buffer + Offset + sizeof(EG_ICON_FILE_RECORD), Icon->Path, StrSize(Icon->Path));
+      CopyMem(Buffer + Offset + sizeof(EG_ICON_FILE_RECORD) + PathSize, Icon->PixelData, PixelBytes);
+      Offset += Record->RecordSize;
+      Header->EntryCount++;
+   } // for
+   Header->Checksum = crc32(0x0, Buffer + sizeof(EG_ICON_FILE_HEADER), DataSize);
+
+   // egSaveFile() doesn't truncate an existing file, so delete it first....
+   Status = refit_call5_wrapper(SelfDir->Open, SelfDir, &FileHandle, ICON_CACHE_FILE_NAME,
+                                EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE, 0);
+   if (!EFI_ERROR(Status))
+      refit_call1_wrapper(FileHandle->Delete, FileHandle);
+   Status = egSaveFile(SelfDir, ICON_CACHE_FILE_NAME, Buffer, sizeof(EG_ICON_FILE_HEADER) + DataSize);
+   if (!EFI_ERROR(Status))
+      DiskIconsDirty = FALSE;
+   FreePool(Buffer);
+} // VOID egSaveIconCache()
+
 // Load an icon from (BaseDir)/Path, extracting the icon of size IconSize x IconSize.
+// Icons in rEFInd's own directory may come from the persistent icon cache.
 // Returns a pointer to the image data, or NULL if the icon could not be loaded.
 EG_IMAGE * egLoadIcon(IN EFI_FILE* BaseDir, IN CHAR16 *Path, IN UINTN IconSize)
 {
@@ -335,19 +597,31 @@ EG_IMAGE * egLoadIcon(IN EFI_FILE* BaseDir, IN CHAR16 *Path, IN UINTN IconSize)
     UINT8           *FileData;
     UINTN           FileDataLength;
     EG_IMAGE        *Image, *NewImage;
+    BOOLEAN         UseDiskCache;
+    UINT64          FileSize = 0;
+    EFI_TIME        ModTime;
 
     if (BaseDir == NULL || Path == NULL)
         return NULL;
 
+    UseDiskCache = GlobalConfig.CacheIcons && (BaseDir == SelfDir);
+    if (UseDiskCache) {
+       if (!egGetIconFileInfo(BaseDir, Path, &FileSize, &ModTime))
+          return NULL;
+       Image = egLoadDiskCachedIcon(Path, IconSize, FileSize, &ModTime);
+       if (Image != NULL)
+          return Image;
+    } // if
+
     // load file
     Status = egLoadFile(BaseDir, Path, &FileData, &FileDataLength);
     if (EFI_ERROR(Status))
        return NULL;
 
     // decode it
-    Image = egDecodeAny(FileData, FileDataLength, IconSize, TRUE);
+    Image = egDecodeIcon(FileData, FileDataLength, IconSize);
     FreePool(FileData);
-    if ((Image->Width != IconSize) || (Image->Height != IconSize)) {
+    if ((Image != NULL) && ((Image->Width != IconSize) || (Image->Height != IconSize))) {
        NewImage = egScaleImage(Image, IconSize, IconSize);
        if (!NewImage)
           Print(L"Warning: Unable to scale icon of the wrong size from '%s'\n", Path);
@@ -355,6 +629,9 @@ EG_IMAGE * egLoadIcon(IN EFI_FILE* BaseDir, IN CHAR16 *Path, IN UINTN IconSize)
        Image = NewImage;
     }
 
+    if (UseDiskCache && (Image != NULL))
+       egAddDiskCachedIcon(Path, IconSize, FileSize, &ModTime, Image);
+
     return Image;
 } // EG_IMAGE *egLoadIcon()
 
@@ -378,6 +655,67 @@ EG_IMAGE * egLoadIconAnyType(IN EFI_FILE *BaseDir, IN CHAR16 *SubdirName, IN CHA
    return Image;
 } // EG_IMAGE *egLoadIconAnyType()
 
+//
+// Icon cache
+//
+
+// Every icon lookup made via egFindIcon() is remembered here, keyed by icon
+// directory, base name, and icon size, so that (for instance) os_linux.png is
+// decoded and scaled only once no matter how many Linux entries use it. Failed
+// lookups are stored, too (with a NULL Image), so that missing icons aren't
+// re-probed on every rescan. Cached images are shared by reference; callers
+// must NOT free images obtained from egFindIcon().
+typedef struct _eg_icon_cache_entry {
+   CHAR16                       *SubdirName;
+   CHAR16                       *BaseName;
+   UINTN                        IconSize;
+   EG_IMAGE                     *Image;
+   struct _eg_icon_cache_entry  *Next;
+} EG_ICON_CACHE_ENTRY;
+
+static EG_ICON_CACHE_ENTRY *IconCache = NULL;
+static UINTN IconCacheHits = 0;
+static UINTN IconCacheMisses = 0;
+
+// Returns the icon from SubdirName (relative to SelfDir) with the specified
+// base name and size, consulting and updating the icon cache. Returns NULL if
+// no such icon exists (or if a previous search found none).
+static EG_IMAGE * egLoadCachedIcon(IN CHAR16 *SubdirName, IN CHAR16 *BaseName, IN UINTN IconSize) {
+   EG_ICON_CACHE_ENTRY *Entry;
+
+   if ((SubdirName == NULL) || (BaseName == NULL))
+      return NULL;
+
+   for (Entry = IconCache; Entry != NULL; Entry = Entry->Next) {
+      if ((Entry->IconSize == IconSize) && (StriCmp(Entry->BaseName, BaseName) == 0) &&
+          (StriCmp(Entry->SubdirName, SubdirName) == 0)) {
+         IconCacheHits++;
+         return Entry->Image;
+      } // if
+   } // for
+
+   IconCacheMisses++;
+   Entry = AllocateZeroPool(sizeof(EG_ICON_CACHE_ENTRY));
+   if (Entry == NULL)
+      return egLoadIconAnyType(SelfDir, SubdirName, BaseName, IconSize);
+   Entry->SubdirName = StrDuplicate(SubdirName);
+   Entry->BaseName = StrDuplicate(BaseName);
+   Entry->IconSize = IconSize;
+   Entry->Image = egLoadIconAnyType(SelfDir, SubdirName, BaseName, IconSize);
+   Entry->Next = IconCache;
+   IconCache = Entry;
+   return Entry->Image;
+} // static EG_IMAGE * egLoadCachedIcon()
+
+// Reports the number of icon lookups satisfied from the icon cache (Hits) and
+// the number that required a search of the disk (Misses).
+VOID egGetIconCacheStats(OUT UINTN *Hits, OUT UINTN *Misses) {
+   if (Hits != NULL)
+      *Hits = IconCacheHits;
+   if (Misses != NULL)
+      *Misses = IconCacheMisses;
+} // VOID egGetIconCacheStats()
+
 // Returns an icon with any extension in ICON_EXTENSIONS from either the directory
 // specified by GlobalConfig.IconsDir or DEFAULT_ICONS_DIR. The input BaseName
 // should be the icon name without an extension. For instance, if BaseName is
@@ -385,16 +723,17 @@ EG_IMAGE * egLoadIconAnyType(IN EFI_FILE *BaseDir, IN CHAR16 *SubdirName, IN CHA
 // ICON_EXTENSIONS is "icns,png", this function will return myicons/os_linux.icns,
 // myicons/os_linux.png, icons/os_linux.icns, or icons/os_linux.png, in that
 // order of preference. Returns NULL if no such icon can be found. All file
-// references are relative to SelfDir.
+// references are relative to SelfDir. The returned image belongs to the icon
+// cache and must not be freed by the caller.
 EG_IMAGE * egFindIcon(IN CHAR16 *BaseName, IN UINTN IconSize) {
    EG_IMAGE *Image = NULL;
 
    if (GlobalConfig.IconsDir != NULL) {
-      Image = egLoadIconAnyType(SelfDir, GlobalConfig.IconsDir, BaseName, IconSize);
+      Image = egLoadCachedIcon(GlobalConfig.IconsDir, BaseName, IconSize);
    }
 
    if (Image == NULL) {
-      Image = egLoadIconAnyType(SelfDir, DEFAULT_ICONS_DIR, BaseName, IconSize);
+      Image = egLoadCachedIcon(DEFAULT_ICONS_DIR, BaseName, IconSize);
    }
 
    return Image;
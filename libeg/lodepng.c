@@ -499,6 +499,11 @@ typedef struct HuffmanTree
   unsigned* lengths; /*the lengths of the codes of the 1d-tree*/
   unsigned maxbitlen; /*maximum number of bits a single code can get*/
   unsigned numcodes; /*number of symbols in the alphabet = number of codes*/
+  /*decoder lookup table, indexed by the next FIRSTBITS bits of the stream: table_len is the
+  length of the code (or FIRSTBITS + 1 if it's longer, 0 if invalid) and table_value the symbol
+  (or the tree2d position to continue from for longer codes)*/
+  unsigned char* table_len;
+  unsigned short* table_value;
 } HuffmanTree;
 
 /*function used for debug purposes to draw the tree in ascii art with C++*/
@@ -519,6 +524,8 @@ static void HuffmanTree_init(HuffmanTree* tree)
   tree->tree2d = 0;
   tree->tree1d = 0;
   tree->lengths = 0;
+  tree->table_len = 0;
+  tree->table_value = 0;
 }
 
 static void HuffmanTree_cleanup(HuffmanTree* tree)
@@ -526,6 +533,8 @@ static void HuffmanTree_cleanup(HuffmanTree* tree)
   lodepng_free(tree->tree2d);
   lodepng_free(tree->tree1d);
   lodepng_free(tree->lengths);
+  lodepng_free(tree->table_len);
+  lodepng_free(tree->table_value);
 }
 
 /*the tree representation used by the decoder. return value is error*/
@@ -921,6 +930,72 @@ static unsigned generateFixedDistanceTree(HuffmanTree* tree)
 
 #ifdef LODEPNG_COMPILE_DECODER
 
+/*number of bits looked up at once by huffmanDecodeSymbol; longer codes continue in tree2d*/
+#define FIRSTBITS 9
+
+/*
+build the decoder lookup table from tree2d, by walking the tree for every possible combination
+of the next FIRSTBITS bits (in stream order, so the first bit is the least significant one)
+*/
+static unsigned HuffmanTree_makeTable(HuffmanTree* tree)
+{
+  unsigned headsize = 1u << FIRSTBITS;
+  unsigned i, b, treepos, ct;
+
+  tree->table_len = (unsigned char*)lodepng_malloc(headsize * sizeof(unsigned char));
+  tree->table_value = (unsigned short*)lodepng_malloc(headsize * sizeof(unsigned short));
+  if(!tree->table_len || !tree->table_value) return 83; /*alloc fail*/
+
+  for(i = 0; i < headsize; i++)
+  {
+    treepos = 0;
+    tree->table_len[i] = 0; /*invalid unless a symbol or a valid subtree is reached*/
+    tree->table_value[i] = 0;
+    for(b = 0; b < FIRSTBITS; b++)
+    {
+      ct = tree->tree2d[(treepos << 1) + ((i >> b) & 1)];
+      if(ct < tree->numcodes)
+      {
+        tree->table_len[i] = (unsigned char)(b + 1);
+        tree->table_value[i] = (unsigned short)ct;
+        break;
+      }
+      treepos = ct - tree->numcodes;
+      if(treepos >= tree->numcodes) break;
+    }
+    if(b == FIRSTBITS)
+    {
+      tree->table_len[i] = FIRSTBITS + 1;
+      tree->table_value[i] = (unsigned short)treepos;
+    }
+  }
+  return 0;
+}
+
+/*
+same as HuffmanTree_makeFromLengths, but also builds the lookup table used for decoding
+*/
+static unsigned HuffmanTree_makeDecoder(HuffmanTree* tree, const unsigned* bitlen,
+                                        size_t numcodes, unsigned maxbitlen)
+{
+  unsigned error = HuffmanTree_makeFromLengths(tree, bitlen, numcodes, maxbitlen);
+  if(!error) error = HuffmanTree_makeTable(tree);
+  return error;
+}
+
+/*
+read nbits (at most 17) bits; like readBitsFromStream, but reading whole bytes where the buffer allows
+*/
+static unsigned readBitsFast(size_t* bp, const unsigned char* in, size_t inlength, size_t nbits)
+{
+  size_t p = (*bp) >> 3;
+  unsigned result;
+  if(p + 2 >= inlength) return readBitsFromStream(bp, in, nbits);
+  result = ((unsigned)in[p] | ((unsigned)in[p + 1] << 8) | ((unsigned)in[p + 2] << 16)) >> ((*bp) & 0x7);
+  (*bp) += nbits;
+  return result & ((1u << nbits) - 1u);
+}
+
 /*
 returns the code, or (unsigned)(-1) if error happened
 inbitlength is the length of the complete buffer, in bits (so its byte length times 8)
@@ -929,6 +1004,21 @@ static unsigned huffmanDecodeSymbol(const unsigned char* in, size_t* bp,
                                     const HuffmanTree* codetree, size_t inbitlength)
 {
   unsigned treepos = 0, ct;
+  if(codetree->table_len && (*bp) + FIRSTBITS <= inbitlength)
+  {
+    /*look up the next FIRSTBITS bits at once; they span at most two bytes*/
+    size_t p = (*bp) >> 3;
+    unsigned bits = (((unsigned)in[p] | ((unsigned)in[p + 1] << 8)) >> ((*bp) & 0x7)) & ((1u << FIRSTBITS) - 1u);
+    unsigned len = codetree->table_len[bits];
+    if(len == 0) return (unsigned)(-1); /*error: it appeared outside the codetree*/
+    if(len <= FIRSTBITS)
+    {
+      (*bp) += len;
+      return codetree->table_value[bits];
+    }
+    (*bp) += FIRSTBITS;
+    treepos = codetree->table_value[bits];
+  }
   for(;;)
   {
     if(*bp >= inbitlength) return (unsigned)(-1); /*error: end of input memory reached without endcode*/
@@ -953,11 +1043,13 @@ static unsigned huffmanDecodeSymbol(const unsigned char* in, size_t* bp,
 /* ////////////////////////////////////////////////////////////////////////// */
 
 /*get the tree of a deflated block with fixed tree, as specified in the deflate specification*/
-static void getTreeInflateFixed(HuffmanTree* tree_ll, HuffmanTree* tree_d)
+static unsigned getTreeInflateFixed(HuffmanTree* tree_ll, HuffmanTree* tree_d)
 {
-  /*TODO: check for out of memory errors*/
-  generateFixedLitLenTree(tree_ll);
-  generateFixedDistanceTree(tree_d);
+  unsigned error = generateFixedLitLenTree(tree_ll);
+  if(!error) error = HuffmanTree_makeTable(tree_ll);
+  if(!error) error = generateFixedDistanceTree(tree_d);
+  if(!error) error = HuffmanTree_makeTable(tree_d);
+  return error;
 }
 
 /*get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree*/
@@ -1000,7 +1092,7 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
       else bitlen_cl[CLCL_ORDER[i]] = 0; /*if not, it must stay 0*/
     }
 
-    error = HuffmanTree_makeFromLengths(&tree_cl, bitlen_cl, NUM_CODE_LENGTH_CODES, 7);
+    error = HuffmanTree_makeDecoder(&tree_cl, bitlen_cl, NUM_CODE_LENGTH_CODES, 7);
     if(error) break;
 
     /*now we can use this tree to read the lengths for the tree that this function will return*/
@@ -1093,9 +1185,9 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
     if(bitlen_ll[256] == 0) ERROR_BREAK(64); /*the length of the end code 256 must be larger than 0*/
 
     /*now we've finally got HLIT and HDIST, so generate the code trees, and the function is done*/
-    error = HuffmanTree_makeFromLengths(tree_ll, bitlen_ll, NUM_DEFLATE_CODE_SYMBOLS, 15);
+    error = HuffmanTree_makeDecoder(tree_ll, bitlen_ll, NUM_DEFLATE_CODE_SYMBOLS, 15);
     if(error) break;
-    error = HuffmanTree_makeFromLengths(tree_d, bitlen_d, NUM_DISTANCE_SYMBOLS, 15);
+    error = HuffmanTree_makeDecoder(tree_d, bitlen_d, NUM_DISTANCE_SYMBOLS, 15);
 
     break; /*end of error-while*/
   }
@@ -1120,7 +1212,7 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
   HuffmanTree_init(&tree_ll);
   HuffmanTree_init(&tree_d);
 
-  if(btype == 1) getTreeInflateFixed(&tree_ll, &tree_d);
+  if(btype == 1) error = getTreeInflateFixed(&tree_ll, &tree_d);
   else if(btype == 2) error = getTreeInflateDynamic(&tree_ll, &tree_d, in, bp, inlength);
 
   while(!error) /*decode all symbols until end reached, breaks at end code*/
@@ -1149,7 +1241,7 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
       /*part 2: get extra bits and add the value of that to length*/
       numextrabits_l = LENGTHEXTRA[code_ll - FIRST_LENGTH_CODE_INDEX];
       if(*bp >= inbitlength) ERROR_BREAK(51); /*error, bit pointer will jump past memory*/
-      length += readBitsFromStream(bp, in, numextrabits_l);
+      length += readBitsFast(bp, in, inlength, numextrabits_l);
 
       /*part 3: get distance code*/
       code_d = huffmanDecodeSymbol(in, bp, &tree_d, inbitlength);
@@ -1170,7 +1262,7 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
       numextrabits_d = DISTANCEEXTRA[code_d];
       if(*bp >= inbitlength) ERROR_BREAK(51); /*error, bit pointer will jump past memory*/
 
-      distance += readBitsFromStream(bp, in, numextrabits_d);
+      distance += readBitsFast(bp, in, inlength, numextrabits_d);
 
       /*part 5: fill in all the out[n] values based on the length and dist*/
       start = (*pos);
@@ -1182,12 +1274,21 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
         if(!ucvector_resize(out, ((*pos) + length) * 2)) ERROR_BREAK(83 /*alloc fail*/);
       }
 
-      for(forward = 0; forward < length; forward++)
+      /*copy the match; when it overlaps itself (distance < length), copying forward byte by byte
+      repeats the last distance bytes as required*/
       {
-        out->data[(*pos)] = out->data[backward];
-        (*pos)++;
-        backward++;
-        if(backward >= start) backward = start - distance;
+        unsigned char* dest = &out->data[start];
+        const unsigned char* src = &out->data[backward];
+        if(distance == 1) /*run of a single byte*/
+        {
+          unsigned char value = src[0];
+          for(forward = 0; forward < length; forward++) dest[forward] = value;
+        }
+        else
+        {
+          for(forward = 0; forward < length; forward++) dest[forward] = src[forward];
+        }
+        (*pos) += length;
       }
     }
     else if(code_ll == 256)
@@ -3879,9 +3980,10 @@ static unsigned char paethPredictor(short a, short b, short c)
   short pb = abs(a - c);
   short pc = abs(a + b - c - c);
 
-  if(pc < pa && pc < pb) return (unsigned char)c;
-  else if(pb < pa) return (unsigned char)b;
-  else return (unsigned char)a;
+  /*return the input value with the smallest distance, preferring a, then b, then c if equal;
+  written with one branch less than the obvious form since this runs for every byte*/
+  if(pb < pa) { a = b; pa = pb; }
+  return (unsigned char)((pc < pa) ? c : a);
 }
 
 /*shared values used by multiple Adam7 related functions*/
@@ -4049,7 +4151,37 @@ static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scan
         {
           recon[i] = (scanline[i] + precon[i]); /*paethPredictor(0, precon[i], 0) is always precon[i]*/
         }
-        for(i = bytewidth; i < length; i++)
+        i = bytewidth;
+        if(bytewidth == 4)
+        {
+          /*RGBA8: keep the left and upper-left pixels in registers rather than re-reading them*/
+          unsigned char r0 = recon[0], r1 = recon[1], r2 = recon[2], r3 = recon[3];
+          unsigned char q0 = precon[0], q1 = precon[1], q2 = precon[2], q3 = precon[3];
+          for(; i + 3 < length; i += 4)
+          {
+            unsigned char p0 = precon[i + 0], p1 = precon[i + 1], p2 = precon[i + 2], p3 = precon[i + 3];
+            r0 = recon[i + 0] = scanline[i + 0] + paethPredictor(r0, p0, q0);
+            r1 = recon[i + 1] = scanline[i + 1] + paethPredictor(r1, p1, q1);
+            r2 = recon[i + 2] = scanline[i + 2] + paethPredictor(r2, p2, q2);
+            r3 = recon[i + 3] = scanline[i + 3] + paethPredictor(r3, p3, q3);
+            q0 = p0; q1 = p1; q2 = p2; q3 = p3;
+          }
+        }
+        else if(bytewidth == 3)
+        {
+          /*RGB8: same as above*/
+          unsigned char r0 = recon[0], r1 = recon[1], r2 = recon[2];
+          unsigned char q0 = precon[0], q1 = precon[1], q2 = precon[2];
+          for(; i + 2 < length; i += 3)
+          {
+            unsigned char p0 = precon[i + 0], p1 = precon[i + 1], p2 = precon[i + 2];
+            r0 = recon[i + 0] = scanline[i + 0] + paethPredictor(r0, p0, q0);
+            r1 = recon[i + 1] = scanline[i + 1] + paethPredictor(r1, p1, q1);
+            r2 = recon[i + 2] = scanline[i + 2] + paethPredictor(r2, p2, q2);
+            q0 = p0; q1 = p1; q2 = p2;
+          }
+        }
+        for(; i < length; i++)
         {
           recon[i] = (scanline[i] + paethPredictor(recon[i - bytewidth], precon[i], precon[i - bytewidth]));
         }
@@ -4552,9 +4684,11 @@ static unsigned readChunk_pHYs(LodePNGInfo* info, const unsigned char* data, siz
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
 /*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
-static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
-                          LodePNGState* state,
-                          const unsigned char* in, size_t insize)
+/*reads the chunks and decompresses the image data into scanlines, which are still filtered.
+scanlines is initialized here and must be cleaned up by the caller, also on error.*/
+static void decodeScanlines(ucvector* scanlines, unsigned* w, unsigned* h,
+                            LodePNGState* state,
+                            const unsigned char* in, size_t insize)
 {
   unsigned char IEND = 0;
   const unsigned char* chunk;
@@ -4567,8 +4701,7 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
   unsigned critical_pos = 1; /*1 = after IHDR, 2 = after PLTE, 3 = after IDAT*/
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
-  /*provide some proper output values if error will happen*/
-  *out = 0;
+  ucvector_init(scanlines);
 
   state->error = lodepng_inspect(w, h, state, in, insize); /*reads header and resets other parameters in state->info_png*/
   if(state->error) return;
@@ -4699,36 +4832,44 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
 
   if(!state->error)
   {
-    ucvector scanlines;
-    ucvector_init(&scanlines);
-
     /*maximum final image length is already reserved in the vector's length - this is not really necessary*/
-    if(!ucvector_resize(&scanlines, lodepng_get_raw_size(*w, *h, &state->info_png.color) + *h))
+    if(!ucvector_resize(scanlines, lodepng_get_raw_size(*w, *h, &state->info_png.color) + *h))
     {
       state->error = 83; /*alloc fail*/
     }
     if(!state->error)
     {
       /*decompress with the Zlib decompressor*/
-      state->error = zlib_decompress(&scanlines.data, &scanlines.size, idat.data,
+      state->error = zlib_decompress(&scanlines->data, &scanlines->size, idat.data,
                                      idat.size, &state->decoder.zlibsettings);
     }
-
-    if(!state->error)
-    {
-      ucvector outv;
-      ucvector_init(&outv);
-      if(!ucvector_resizev(&outv,
-          lodepng_get_raw_size(*w, *h, &state->info_png.color), 0)) state->error = 83; /*alloc fail*/
-      if(!state->error) state->error = postProcessScanlines(outv.data, scanlines.data, *w, *h, &state->info_png);
-      *out = outv.data;
-    }
-    ucvector_cleanup(&scanlines);
   }
 
   ucvector_cleanup(&idat);
 }
 
+static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
+                          LodePNGState* state,
+                          const unsigned char* in, size_t insize)
+{
+  ucvector scanlines;
+
+  /*provide some proper output values if error will happen*/
+  *out = 0;
+
+  decodeScanlines(&scanlines, w, h, state, in, insize);
+  if(!state->error)
+  {
+    ucvector outv;
+    ucvector_init(&outv);
+    if(!ucvector_resizev(&outv,
+        lodepng_get_raw_size(*w, *h, &state->info_png.color), 0)) state->error = 83; /*alloc fail*/
+    if(!state->error) state->error = postProcessScanlines(outv.data, scanlines.data, *w, *h, &state->info_png);
+    *out = outv.data;
+  }
+  ucvector_cleanup(&scanlines);
+}
+
 unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
                         LodePNGState* state,
                         const unsigned char* in, size_t insize)
@@ -4786,6 +4927,146 @@ unsigned lodepng_decode_memory(unsigned char** out, unsigned* w, unsigned* h, co
   return error;
 }
 
+/*
+rEFInd addition: write the image as 8-bit BGRA (the EFI pixel layout) into out, which must
+hold outw * outh * 4 bytes, optionally scaling it (bilinearly) on the way. rows points to the
+first of h unfiltered scanlines of w pixels in the PNG's color mode, each starting rowstride
+bytes after the previous one. Without scaling, each row is converted in place in out.
+*/
+static unsigned convertRowsToBGRA8(unsigned char* out, unsigned outw, unsigned outh,
+                                   const unsigned char* rows, size_t rowstride, unsigned w, unsigned h,
+                                   const LodePNGColorMode* mode, unsigned fix_png, unsigned want_alpha)
+{
+  unsigned error = 0;
+  size_t x, y;
+
+  if(outw == w && outh == h)
+  {
+    for(y = 0; y < h && !error; y++)
+    {
+      unsigned char* line = &out[y * w * 4];
+      error = getPixelColorsRGBA8(line, w, 1, &rows[y * rowstride], mode, fix_png);
+      for(x = 0; x < w; x++, line += 4)
+      {
+        unsigned char red = line[0];
+        line[0] = line[2];
+        line[2] = red;
+        if(!want_alpha) line[3] = 0;
+      }
+    }
+  }
+  else
+  {
+    /*same sampling as egScaleImage(): source row y and y + 1, converted to RGBA8 as needed*/
+    unsigned char* line[2];
+    size_t linerow[2] = {(size_t)(-1), (size_t)(-1)};
+    float x_ratio = ((float)(w - 1)) / outw;
+    float y_ratio = ((float)(h - 1)) / outh;
+
+    line[0] = (unsigned char*)lodepng_malloc(w * 4);
+    line[1] = (unsigned char*)lodepng_malloc(w * 4);
+    if(!line[0] || !line[1]) error = 83; /*alloc fail*/
+
+    for(y = 0; y < outh && !error; y++)
+    {
+      size_t sy = (size_t)(y_ratio * y);
+      float y_diff = (y_ratio * y) - sy;
+      unsigned k;
+      unsigned char* dest = &out[y * outw * 4];
+
+      for(k = 0; k < 2 && !error; k++)
+      {
+        size_t want = (sy + k < h) ? sy + k : h - 1;
+        if(linerow[k] != want)
+        {
+          if(k == 0 && linerow[1] == want)
+          {
+            unsigned char* temp = line[0];
+            line[0] = line[1];
+            line[1] = temp;
+            linerow[1] = linerow[0];
+          }
+          else error = getPixelColorsRGBA8(line[k], w, 1, &rows[want * rowstride], mode, fix_png);
+          linerow[k] = want;
+        }
+      }
+
+      for(x = 0; x < outw && !error; x++, dest += 4)
+      {
+        size_t sx = (size_t)(x_ratio * x);
+        size_t sx1 = (sx + 1 < w) ? sx + 1 : w - 1;
+        float x_diff = (x_ratio * x) - sx;
+        const unsigned char* a = &line[0][sx * 4];
+        const unsigned char* b = &line[0][sx1 * 4];
+        const unsigned char* c = &line[1][sx * 4];
+        const unsigned char* d = &line[1][sx1 * 4];
+        unsigned i;
+        for(i = 0; i < 4; i++)
+        {
+          dest[i == 3 ? 3 : 2 - i] = (unsigned char)(a[i] * (1 - x_diff) * (1 - y_diff) + b[i] * x_diff * (1 - y_diff)
+                                                     + c[i] * y_diff * (1 - x_diff) + d[i] * (x_diff * y_diff));
+        }
+        if(!want_alpha) dest[3] = 0;
+      }
+    }
+
+    lodepng_free(line[0]);
+    lodepng_free(line[1]);
+  }
+
+  return error;
+}
+
+unsigned lodepng_decode_bgra(unsigned char* out, unsigned outw, unsigned outh, unsigned want_alpha,
+                             LodePNGState* state, const unsigned char* in, size_t insize)
+{
+  ucvector scanlines;
+  unsigned w, h;
+
+  decodeScanlines(&scanlines, &w, &h, state, in, insize);
+  if(!state->error && (outw == 0 || outh == 0 || w == 0 || h == 0)) state->error = 93; /*zero width or height*/
+  if(!state->error)
+  {
+    const LodePNGColorMode* mode = &state->info_png.color;
+    unsigned bpp = lodepng_get_bpp(mode);
+
+    if(bpp == 0) state->error = 31; /*error: invalid colortype*/
+    else if(state->info_png.interlace_method == 0)
+    {
+      /*unfilter in place; every row then starts at a byte boundary, as getPixelColorsRGBA8 requires*/
+      size_t linebytes = (w * bpp + 7) / 8;
+      state->error = unfilter(scanlines.data, scanlines.data, w, h, bpp);
+      if(!state->error)
+      {
+        state->error = convertRowsToBGRA8(out, outw, outh, scanlines.data, linebytes, w, h,
+                                          mode, state->decoder.fix_png, want_alpha);
+      }
+    }
+    else
+    {
+      /*Adam7: deinterlace the usual way, then convert via an RGBA8 image*/
+      unsigned char* raw = 0;
+      unsigned char* rgba = 0;
+      LodePNGColorMode mode_rgba;
+      lodepng_color_mode_init(&mode_rgba);
+
+      raw = (unsigned char*)lodepng_malloc(lodepng_get_raw_size(w, h, mode));
+      rgba = (unsigned char*)lodepng_malloc(w * h * 4);
+      if(!raw || !rgba) state->error = 83; /*alloc fail*/
+      if(!state->error) state->error = postProcessScanlines(raw, scanlines.data, w, h, &state->info_png);
+      if(!state->error) state->error = lodepng_convert(rgba, raw, &mode_rgba, &state->info_png.color,
+                                                       w, h, state->decoder.fix_png);
+      if(!state->error) state->error = convertRowsToBGRA8(out, outw, outh, rgba, w * 4, w, h,
+                                                          &mode_rgba, state->decoder.fix_png, want_alpha);
+      lodepng_free(raw);
+      lodepng_free(rgba);
+      lodepng_color_mode_cleanup(&mode_rgba);
+    }
+  }
+  ucvector_cleanup(&scanlines);
+  return state->error;
+}
+
 unsigned lodepng_decode32(unsigned char** out, unsigned* w, unsigned* h, const unsigned char* in, size_t insize)
 {
   return lodepng_decode_memory(out, w, h, in, insize, LCT_RGBA, 8);
@@ -6014,6 +6295,7 @@ const char* lodepng_error_text(unsigned code)
     case 87: return "must provide custom zlib function pointer if LODEPNG_COMPILE_ZLIB is not defined";
     case 88: return "invalid filter strategy given for LodePNGEncoderSettings.filter_strategy";
     case 89: return "text chunk keyword too short or long: must have size 1-79";
+    case 93: return "zero width or height is invalid";
   }
   return "unknown error code";
 }
@@ -654,6 +654,16 @@ information is placed in the info_png field of the LodePNGState.
 unsigned lodepng_inspect(unsigned* w, unsigned* h,
                          LodePNGState* state,
                          const unsigned char* in, size_t insize);
+
+/*
+rEFInd addition: decode the PNG straight into out as 8-bit BGRA pixels (EFI's pixel
+layout), scaled to outw x outh. out is provided by the caller and must hold
+outw * outh * 4 bytes; use lodepng_inspect first to learn the image's own size.
+If want_alpha is 0, the alpha bytes are set to 0. No copy of the whole image in
+the PNG's own color type is made, except for interlaced images.
+*/
+unsigned lodepng_decode_bgra(unsigned char* out, unsigned outw, unsigned outh, unsigned want_alpha,
+                             LodePNGState* state, const unsigned char* in, size_t insize);
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 
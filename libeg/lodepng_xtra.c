@@ -70,44 +70,42 @@ int MyStrlen(const char *InString) {
    return Length;
 } // int MyStrlen()
 
-typedef struct _lode_color {
-   UINT8 red;
-   UINT8 green;
-   UINT8 blue;
-   UINT8 alpha;
-} lode_color;
-
-EG_IMAGE * egDecodePNG(IN UINT8 *FileData, IN UINTN FileDataLength, IN UINTN IconSize, IN BOOLEAN WantAlpha) {
+// Decode a PNG file into a new image of Width x Height pixels, scaling it if
+// necessary; if Width or Height is 0, the image's own size is used. LodePNG
+// writes the pixels directly into the new image, in EFI's BGRA order.
+// Returns NULL if the data can't be decoded.
+EG_IMAGE * egDecodePNGScaled(IN UINT8 *FileData, IN UINTN FileDataLength, IN UINTN Width, IN UINTN Height,
+                             IN BOOLEAN WantAlpha) {
    EG_IMAGE *NewImage = NULL;
-   unsigned Error, Width, Height;
-   EG_PIXEL *PixelData;
-   lode_color *LodeData;
-   UINTN i;
-
-   Error = lodepng_decode_memory((unsigned char **) &PixelData, &Width, &Height, (unsigned char*) FileData,
-                                 (size_t) FileDataLength, LCT_RGBA, 8);
-
-   if (Error) {
-      return NULL;
+   LodePNGState State;
+   unsigned Error, PngWidth, PngHeight;
+
+   lodepng_state_init(&State);
+   Error = lodepng_inspect(&PngWidth, &PngHeight, &State, (unsigned char *) FileData, (size_t) FileDataLength);
+   if (!Error && ((PngWidth == 0) || (PngHeight == 0)))
+      Error = 93;
+   if (!Error) {
+      if ((Width == 0) || (Height == 0)) {
+         Width = PngWidth;
+         Height = PngHeight;
+      }
+      NewImage = egCreateImage(Width, Height, WantAlpha);
+      if (NewImage == NULL)
+         Error = 83;
+   } // if
+   if (!Error) {
+      Error = lodepng_decode_bgra((unsigned char *) NewImage->PixelData, (unsigned) Width, (unsigned) Height,
+                                  WantAlpha, &State, (unsigned char *) FileData, (size_t) FileDataLength);
    }
+   lodepng_state_cleanup(&State);
 
-   // allocate image structure and buffer
-   NewImage = egCreateImage(Width, Height, WantAlpha);
-   if ((NewImage == NULL) || (NewImage->Width != Width) || (NewImage->Height != Height))
-      return NULL;
-
-   LodeData = (lode_color *) PixelData;
-
-   // Annoyingly, EFI and LodePNG use different ordering of RGB values in
-   // their pixel data representations, so we've got to adjust them....
-   for (i = 0; i < (NewImage->Height * NewImage->Width); i++) {
-      NewImage->PixelData[i].r = LodeData[i].red;
-      NewImage->PixelData[i].g = LodeData[i].green;
-      NewImage->PixelData[i].b = LodeData[i].blue;
-      if (WantAlpha)
-         NewImage->PixelData[i].a = LodeData[i].alpha;
+   if (Error) {
+      egFreeImage(NewImage);
+      NewImage = NULL;
    }
-   lodepng_free(PixelData);
-
    return NewImage;
+} // EG_IMAGE * egDecodePNGScaled()
+
+EG_IMAGE * egDecodePNG(IN UINT8 *FileData, IN UINTN FileDataLength, IN UINTN IconSize, IN BOOLEAN WantAlpha) {
+   return egDecodePNGScaled(FileData, FileDataLength, 0, 0, WantAlpha);
 } // EG_IMAGE * egDecodePNG()
\ No newline at end of file
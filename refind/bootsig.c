@@ -0,0 +1,166 @@
+/*
+ * refind/bootsig.c
+ * Identification of BIOS-mode boot loaders by their boot sectors
+ *
+ * Copyright (c) 2014 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+// This code has no dependencies beyond ZeroMem() and CompareMem(), so that
+// refind/test can build it on the host and check it against a corpus of boot
+// sectors.
+
+#include "bootsig.h"
+
+// ScanVolumeBootcode() identifies BIOS-mode boot loaders by these byte
+// strings, all of which lie within the first SECTOR_SIZE bytes of a volume.
+// BOOTSIG_AT() entries must begin at exactly the given offset;
+// BOOTSIG_IN() entries may begin anywhere short of the limit (with the same
+// off-by-one as FindMem(), which was once used for these). Where a volume
+// matches several BOOTSIG_OS entries, the earliest in the table wins, so
+// more specific signatures must come first. BOOTSIG_DUMMY entries mark the
+// placeholder boot code that formatting tools write, and BOOTSIG_EXFAT keeps
+// exFAT volumes (whose boot sector looks bootable) from being treated as
+// bootable.
+// NOTE: If you add an operating system with a name that starts with 'W' or
+//  'L', you need to fix AddLegacyEntry in main.c.
+
+#define BOOTSIG_OS       (0)
+#define BOOTSIG_DUMMY    (1)
+#define BOOTSIG_EXFAT    (2)
+
+typedef struct {
+   UINTN    Kind;
+   UINTN    Offset;     // first offset at which the pattern may begin...
+   UINTN    Range;      // ...and number of offsets to try from there
+   VOID     *Pattern;
+   UINTN    Length;
+   CHAR16   *OSIconName;
+   CHAR16   *OSName;
+} BOOT_SIGNATURE;
+
+#define BOOTSIG_AT(Offset, Pattern) (Offset), 1, (Pattern), sizeof(Pattern) - 1
+#define BOOTSIG_IN(Limit, Pattern) 0, (Limit) - (sizeof(Pattern) - 1), (Pattern), sizeof(Pattern) - 1
+
+static BOOT_SIGNATURE BootSignatures[] = {
+   { BOOTSIG_OS, BOOTSIG_AT(2, "LILO"), L"linux", L"Linux" },
+   { BOOTSIG_OS, BOOTSIG_AT(6, "LILO"), L"linux", L"Linux" },
+   { BOOTSIG_OS, BOOTSIG_AT(3, "SYSLINUX"), L"linux", L"Linux" },
+   { BOOTSIG_OS, BOOTSIG_IN(SECTOR_SIZE, "ISOLINUX"), L"linux", L"Linux" },
+   { BOOTSIG_OS, BOOTSIG_IN(512, "Geom\0Hard Disk\0Read\0 Error"), L"grub,linux", L"Linux" },
+   // Below doesn't produce a bootable entry, so it's disabled for the moment. (It'd
+   // also need to set the volume name to "BIOS Boot Partition" and make it bootable.)
+   // { BOOTSIG_OS, BOOTSIG_IN(512, "Geom\0Read\0 Error"), L"grub,linux", L"Linux" },
+   // 0 and 50000 as UINT32s at 502 and 506, then the 0xaa55 boot signature
+   { BOOTSIG_OS, BOOTSIG_AT(502, "\x00\x00\x00\x00\x50\xc3\x00\x00\x55\xaa"), L"freebsd", L"FreeBSD" },
+   { BOOTSIG_OS, BOOTSIG_IN(SECTOR_SIZE, "Starting the BTX loader"), L"freebsd", L"FreeBSD" },
+   { BOOTSIG_OS, BOOTSIG_IN(512, "!Loading"), L"openbsd", L"OpenBSD" },
+   { BOOTSIG_OS, BOOTSIG_IN(SECTOR_SIZE, "/cdboot\0/CDBOOT\0"), L"openbsd", L"OpenBSD" },
+   { BOOTSIG_OS, BOOTSIG_IN(512, "Not a bootxx image"), L"netbsd", L"NetBSD" },
+   // 0x7886b6d1 as a UINT32
+   { BOOTSIG_OS, BOOTSIG_AT(1028, "\xd1\xb6\x86\x78"), L"netbsd", L"NetBSD" },
+   { BOOTSIG_OS, BOOTSIG_IN(SECTOR_SIZE, "NTLDR"), L"win", L"Windows" },
+   { BOOTSIG_OS, BOOTSIG_IN(SECTOR_SIZE, "BOOTMGR"), L"winvista,win", L"Windows" },
+   { BOOTSIG_OS, BOOTSIG_IN(512, "CPUBOOT SYS"), L"freedos", L"FreeDOS" },
+   { BOOTSIG_OS, BOOTSIG_IN(512, "KERNEL  SYS"), L"freedos", L"FreeDOS" },
+   { BOOTSIG_OS, BOOTSIG_IN(512, "OS2LDR"), L"ecomstation", L"eComStation" },
+   { BOOTSIG_OS, BOOTSIG_IN(512, "OS2BOOT"), L"ecomstation", L"eComStation" },
+   { BOOTSIG_OS, BOOTSIG_IN(512, "Be Boot Loader"), L"beos", L"BeOS" },
+   { BOOTSIG_OS, BOOTSIG_IN(512, "yT Boot Loader"), L"zeta,beos", L"ZETA" },
+   { BOOTSIG_OS, BOOTSIG_IN(512, "\x04" "beos\x06" "system\x05" "zbeos"), L"haiku,beos", L"Haiku" },
+   { BOOTSIG_OS, BOOTSIG_IN(512, "\x06" "system\x0c" "haiku_loader"), L"haiku,beos", L"Haiku" },
+   // dummy FAT boot sectors, created by OS X's newfs_msdos, Linux's mkdosfs,
+   // and Windows
+   { BOOTSIG_DUMMY, BOOTSIG_IN(512, "Non-system disk"), NULL, NULL },
+   { BOOTSIG_DUMMY, BOOTSIG_IN(512, "This is not a bootable disk"), NULL, NULL },
+   { BOOTSIG_DUMMY, BOOTSIG_IN(512, "Press any key to restart"), NULL, NULL },
+   { BOOTSIG_EXFAT, BOOTSIG_IN(512, "EXFAT"), NULL, NULL }
+};
+
+#define BOOTSIG_COUNT (sizeof(BootSignatures) / sizeof(BOOT_SIGNATURE))
+
+// For each byte value, 1 + the index of the first signature that begins
+// with it, or 0 if none does; BootSigNext[] chains the rest.
+static UINT8    BootSigFirst[256];
+static UINT8    BootSigNext[BOOTSIG_COUNT];
+static UINTN    BootSigScanEnd = 0;
+static BOOLEAN  BootSigReady = FALSE;
+
+static VOID CompileBootSignatures(VOID) {
+   UINTN  i, c;
+
+   ZeroMem(BootSigFirst, sizeof(BootSigFirst));
+   for (i = BOOTSIG_COUNT; i > 0; i--) {
+      c = ((UINT8 *) BootSignatures[i - 1].Pattern)[0];
+      BootSigNext[i - 1] = BootSigFirst[c];
+      BootSigFirst[c] = (UINT8) i;
+      if (BootSignatures[i - 1].Offset + BootSignatures[i - 1].Range > BootSigScanEnd)
+         BootSigScanEnd = BootSignatures[i - 1].Offset + BootSignatures[i - 1].Range;
+   } // for
+   BootSigReady = TRUE;
+} // static VOID CompileBootSignatures()
+
+// Scans Buffer, which must hold at least SECTOR_SIZE bytes, for all of the
+// BootSignatures in a single pass. Returns the first BOOTSIG_OS entry that
+// matches (or NULL if none does) and sets *IsDummy and *IsExFat according
+// to whether any BOOTSIG_DUMMY or BOOTSIG_EXFAT entry matches.
+static BOOT_SIGNATURE * MatchBootSignatures(IN UINT8 *Buffer, OUT BOOLEAN *IsDummy, OUT BOOLEAN *IsExFat) {
+   BOOT_SIGNATURE  *Sig, *Found = NULL;
+   UINTN           Pos, i;
+
+   if (!BootSigReady)
+      CompileBootSignatures();
+
+   *IsDummy = *IsExFat = FALSE;
+   for (Pos = 0; Pos < BootSigScanEnd; Pos++) {
+      for (i = BootSigFirst[Buffer[Pos]]; i > 0; i = BootSigNext[i - 1]) {
+         Sig = &BootSignatures[i - 1];
+         if ((Pos < Sig->Offset) || (Pos - Sig->Offset >= Sig->Range) ||
+             (CompareMem(Buffer + Pos, Sig->Pattern, Sig->Length) != 0))
+            continue;
+         if (Sig->Kind == BOOTSIG_DUMMY)
+            *IsDummy = TRUE;
+         else if (Sig->Kind == BOOTSIG_EXFAT)
+            *IsExFat = TRUE;
+         else if ((Found == NULL) || (Sig < Found))
+            Found = Sig;
+      } // for
+   } // for
+   return Found;
+} // static BOOT_SIGNATURE * MatchBootSignatures()
+
+// Examines the first SECTOR_SIZE bytes of a volume, in Buffer. Sets
+// *Bootable if they look like a BIOS boot sector, *HasBootCode if that boot
+// code (rather than a formatting tool's placeholder) seems to do something,
+// and *OSIconName and *OSName (to constant strings, or NULL) if it's from a
+// recognized OS's boot loader.
+VOID IdentifyBootCode(IN UINT8 *Buffer, OUT BOOLEAN *HasBootCode, OUT BOOLEAN *Bootable,
+                      OUT CHAR16 **OSIconName, OUT CHAR16 **OSName) {
+   BOOT_SIGNATURE  *Signature;
+   BOOLEAN         IsDummy, IsExFat;
+
+   *HasBootCode = *Bootable = FALSE;
+   *OSIconName = *OSName = NULL;
+
+   Signature = MatchBootSignatures(Buffer, &IsDummy, &IsExFat);
+   if ((*((UINT16 *)(Buffer + 510)) == 0xaa55 && Buffer[0] != 0) && !IsExFat) {
+      *Bootable = TRUE;
+      *HasBootCode = TRUE;
+   }
+
+   // detect specific boot codes
+   if (Signature != NULL) {
+      *HasBootCode = TRUE;
+      *OSIconName = Signature->OSIconName;
+      *OSName = Signature->OSName;
+   }
+
+   // dummy FAT boot sector
+   if (IsDummy)
+      *HasBootCode = FALSE;
+} // VOID IdentifyBootCode()
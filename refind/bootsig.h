@@ -0,0 +1,35 @@
+/*
+ * refind/bootsig.h
+ * Identification of BIOS-mode boot loaders by their boot sectors
+ *
+ * Copyright (c) 2014 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+#ifndef __BOOTSIG_H_
+#define __BOOTSIG_H_
+
+// The host test in refind/test defines HOST_POSIX and supplies the EFI
+// types, ZeroMem() and CompareMem() itself.
+#ifndef HOST_POSIX
+#include "global.h"
+#ifdef __MAKEWITH_GNUEFI
+#include "efi.h"
+#include "efilib.h"
+#else
+#include "../include/tiano_includes.h"
+#endif
+#endif
+
+// Maximum size for disk sectors; IdentifyBootCode() looks at this many bytes
+#define SECTOR_SIZE 4096
+
+VOID IdentifyBootCode(IN UINT8 *Buffer, OUT BOOLEAN *HasBootCode, OUT BOOLEAN *Bootable,
+                      OUT CHAR16 **OSIconName, OUT CHAR16 **OSName);
+
+#endif
@@ -0,0 +1,291 @@
+/*
+ * refind/boottime.c
+ * Timing of rEFInd's start-up phases
+ *
+ * Copyright (c) 2014 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+// Each phase of rEFInd's start-up (reading the configuration, loading each
+// driver, scanning each volume, and so on) is bracketed by BootTimeBegin()
+// and BootTimeEnd(), which record raw timer ticks in a fixed-size ring
+// buffer; no memory is allocated and nothing is converted while timing. The
+// ticks come from the CPU's time stamp counter on x86 and from the real-time
+// clock (via TimeStampMs()) elsewhere. They're turned into milliseconds only
+// when a report is produced: on the About screen, or, if the
+// boot_time_report option is set, in a file in rEFInd's directory and/or a
+// (volatile) NVRAM variable, written just before an OS is launched, from
+// which an OS can collect it. The report ends with the I/O statistics of
+// each volume served by one of rEFInd's own filesystem drivers.
+
+#include "boottime.h"
+#include "lib.h"
+#include "menu.h"
+#include "../include/refit_call_wrapper.h"
+#include "../include/fsw_io_stats.h"
+#include "../libeg/libeg.h"
+
+#define BOOT_TIME_MAX_EVENTS    64
+#define BOOT_TIME_LABEL_LENGTH  48
+#define BOOT_TIME_MAX_DEPTH     4
+#define BOOT_TIME_NVRAM_MAX     4096   // bytes
+#define BOOT_TIME_IO_LINE_MAX   192    // characters
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BOOT_TIME_USE_TSC 1
+#endif
+
+typedef struct {
+   UINTN    Id;          // sequence number, from 1; 0 = slot unused
+   UINTN    Depth;       // number of enclosing phases
+   BOOLEAN  IsMark;      // instantaneous event, with no duration
+   BOOLEAN  Finished;
+   UINT64   Start;
+   UINT64   End;
+   CHAR16   Label[BOOT_TIME_LABEL_LENGTH];
+} BOOT_TIME_EVENT;
+
+static BOOT_TIME_EVENT BootTimeEvents[BOOT_TIME_MAX_EVENTS];
+static UINTN           BootTimeEventCount = 0;   // all events ever recorded
+static UINTN           BootTimeDepth = 0;
+static UINT64          BootTimeOrigin = 0;
+static UINT64          BootTimeTicksPerMs = 0;
+
+static UINT64 ReadTimer(VOID) {
+#ifdef BOOT_TIME_USE_TSC
+   UINT32 Low, High;
+
+   __asm__ __volatile__ ("rdtsc" : "=a" (Low), "=d" (High));
+   return ((UINT64) High << 32) | Low;
+#else
+   return TimeStampMs();
+#endif
+} // static UINT64 ReadTimer()
+
+// Returns the number of timer ticks per millisecond, measuring it against
+// the firmware's Stall() the first time it's needed.
+static UINT64 TicksPerMs(VOID) {
+#ifdef BOOT_TIME_USE_TSC
+   UINT64 Start;
+
+   if (BootTimeTicksPerMs == 0) {
+      Start = ReadTimer();
+      refit_call1_wrapper(BS->Stall, 10000);
+      BootTimeTicksPerMs = (ReadTimer() - Start) / 10;
+   } // if
+#endif
+   if (BootTimeTicksPerMs == 0)
+      BootTimeTicksPerMs = 1;
+   return BootTimeTicksPerMs;
+} // static UINT64 TicksPerMs()
+
+// Sets "time zero" for all later events; called as early as possible.
+VOID BootTimeInit(VOID) {
+   BootTimeOrigin = ReadTimer();
+} // VOID BootTimeInit()
+
+static BOOT_TIME_EVENT * NewBootTimeEvent(IN CHAR16 *Label, IN CHAR16 *Detail OPTIONAL) {
+   BOOT_TIME_EVENT *Event;
+
+   Event = &BootTimeEvents[BootTimeEventCount % BOOT_TIME_MAX_EVENTS];
+   ZeroMem(Event, sizeof(BOOT_TIME_EVENT));
+   Event->Id = ++BootTimeEventCount;
+   Event->Depth = BootTimeDepth;
+   if (Detail != NULL)
+      SPrint(Event->Label, sizeof(Event->Label), L"%s: %s", Label, Detail);
+   else
+      SPrint(Event->Label, sizeof(Event->Label), L"%s", Label);
+   Event->Start = ReadTimer();
+   return Event;
+} // static BOOT_TIME_EVENT * NewBootTimeEvent()
+
+// Starts timing a phase called Label (optionally qualified by Detail).
+// Returns an identifier to pass to BootTimeEnd().
+UINTN BootTimeBegin(IN CHAR16 *Label, IN CHAR16 *Detail OPTIONAL) {
+   BOOT_TIME_EVENT *Event;
+
+   Event = NewBootTimeEvent(Label, Detail);
+   BootTimeDepth++;
+   return Event->Id;
+} // UINTN BootTimeBegin()
+
+// Finishes timing the phase identified by Id. If Detail is not NULL, it
+// replaces the detail given to BootTimeBegin() (for instance, with a volume
+// name that wasn't known at the start).
+VOID BootTimeEnd(IN UINTN Id, IN CHAR16 *Detail OPTIONAL) {
+   BOOT_TIME_EVENT *Event;
+   UINTN           i;
+
+   if (BootTimeDepth > 0)
+      BootTimeDepth--;
+   if ((Id == 0) || (Id > BootTimeEventCount))
+      return;
+   Event = &BootTimeEvents[(Id - 1) % BOOT_TIME_MAX_EVENTS];
+   if (Event->Id != Id)
+      return;   // overwritten by newer events
+   Event->End = ReadTimer();
+   Event->Finished = TRUE;
+   if (Detail != NULL) {
+      for (i = 0; (Event->Label[i] != 0) && (Event->Label[i] != L':'); i++)
+         ;
+      Event->Label[i] = 0;
+      SPrint(Event->Label + i, sizeof(Event->Label) - i * sizeof(CHAR16), L": %s", Detail);
+   } // if
+} // VOID BootTimeEnd()
+
+// Records an instantaneous event.
+VOID BootTimeMark(IN CHAR16 *Label, IN CHAR16 *Detail OPTIONAL) {
+   BOOT_TIME_EVENT *Event;
+
+   Event = NewBootTimeEvent(Label, Detail);
+   Event->IsMark = TRUE;
+} // VOID BootTimeMark()
+
+// Returns a newly-allocated line describing Event, in the form
+// "   123 ms  Label (45 ms)", indented by its depth.
+static CHAR16 * BootTimeEventLine(IN BOOT_TIME_EVENT *Event) {
+   UINT64 StartMs, Ms;
+   UINTN  Depth;
+   CHAR16 *Indent = L"        ";
+
+   StartMs = (Event->Start - BootTimeOrigin) / TicksPerMs();
+   Depth = (Event->Depth > BOOT_TIME_MAX_DEPTH) ? BOOT_TIME_MAX_DEPTH : Event->Depth;
+   Indent += 2 * (BOOT_TIME_MAX_DEPTH - Depth);
+   if (Event->IsMark)
+      return PoolPrint(L"%6ld ms  %s%s", StartMs, Indent, Event->Label);
+   if (!Event->Finished)
+      return PoolPrint(L"%6ld ms  %s%s (unfinished)", StartMs, Indent, Event->Label);
+   Ms = (Event->End - Event->Start) / TicksPerMs();
+   return PoolPrint(L"%6ld ms  %s%s (%ld ms)", StartMs, Indent, Event->Label, Ms);
+} // static CHAR16 * BootTimeEventLine()
+
+// Returns the oldest event still held in the ring buffer, for use as the
+// starting index of a loop that runs to BootTimeEventCount.
+static UINTN FirstBootTimeEvent(VOID) {
+   return (BootTimeEventCount > BOOT_TIME_MAX_EVENTS) ? BootTimeEventCount - BOOT_TIME_MAX_EVENTS : 0;
+} // static UINTN FirstBootTimeEvent()
+
+// Adds the top-level phases (those not nested in another phase) to Screen's
+// information lines, as on the About screen.
+VOID BootTimeAddInfoLines(IN REFIT_MENU_SCREEN *Screen) {
+   BOOT_TIME_EVENT *Event;
+   UINTN           i;
+   CHAR16          *Line;
+
+   if (BootTimeEventCount == 0)
+      return;
+   AddMenuInfoLine(Screen, L"Start-up timing (ms since rEFInd started):");
+   for (i = FirstBootTimeEvent(); i < BootTimeEventCount; i++) {
+      Event = &BootTimeEvents[i % BOOT_TIME_MAX_EVENTS];
+      if (Event->Depth == 0) {
+         Line = BootTimeEventLine(Event);
+         if (Line != NULL)
+            AddMenuInfoLine(Screen, Line);
+      } // if
+   } // for
+} // VOID BootTimeAddInfoLines()
+
+// Appends Line (converted to ASCII, with non-ASCII characters replaced by
+// '?') and a newline to Report, which has room for Size bytes, at *Offset.
+// Returns FALSE, leaving the report unchanged, if there isn't room.
+static BOOLEAN AppendReportLine(IN OUT CHAR8 *Report, IN UINTN Size, IN OUT UINTN *Offset, IN CHAR16 *Line) {
+   UINTN i, Length;
+
+   Length = StrLen(Line);
+   if (*Offset + Length + 1 > Size)
+      return FALSE;
+   for (i = 0; i < Length; i++)
+      Report[(*Offset)++] = (Line[i] < 0x80) ? (CHAR8) Line[i] : '?';
+   Report[(*Offset)++] = '\n';
+   return TRUE;
+} // static BOOLEAN AppendReportLine()
+
+// Returns a newly-allocated line summarizing the disk traffic generated on
+// Volume by its filesystem driver, or NULL if the driver isn't one of ours
+// (which answer a GetInfo() call for FSW_IO_STATS_INFO_GUID).
+static CHAR16 * VolumeIoStatsLine(IN REFIT_VOLUME *Volume) {
+   EFI_STATUS        Status;
+   FSW_IO_STATS_INFO Info;
+   UINTN             Size = sizeof(FSW_IO_STATS_INFO);
+   UINT64            TicksPerMs;
+   EFI_GUID          IoStatsInfoGuid = FSW_IO_STATS_INFO_GUID;
+
+   if ((Volume == NULL) || (Volume->RootDir == NULL))
+      return NULL;
+   Status = refit_call4_wrapper(Volume->RootDir->GetInfo, Volume->RootDir, &IoStatsInfoGuid, &Size, &Info);
+   if (EFI_ERROR(Status) || (Info.Size < sizeof(FSW_IO_STATS_INFO)))
+      return NULL;
+   TicksPerMs = (Info.TicksPerMs > 0) ? Info.TicksPerMs : 1;
+   return PoolPrint(L"I/O %s: %ld reads (%ld KiB), %ld/%ld block cache hits, %ld read-ahead hits, "
+                    L"%ld lookups (%ld ms), %ld extents (%ld ms)",
+                    Volume->VolName ? Volume->VolName : L"unnamed volume",
+                    Info.DiskReads, Info.DiskReadBytes / 1024, Info.BlockCacheHits, Info.BlockGets,
+                    Info.ReadAheadHits, Info.DirLookupCalls, Info.DirLookupTicks / TicksPerMs,
+                    Info.GetExtentCalls, Info.GetExtentTicks / TicksPerMs);
+} // static CHAR16 * VolumeIoStatsLine()
+
+// Writes every recorded event to the file and/or NVRAM variable selected by
+// GlobalConfig.BootTimeReport. The NVRAM copy is volatile (it lasts until the
+// next reset) and is cut off, at a line boundary, at BOOT_TIME_NVRAM_MAX bytes.
+VOID BootTimeSaveReport(VOID) {
+   EFI_STATUS      Status;
+   EFI_FILE_HANDLE FileHandle;
+   CHAR8           *Report;
+   CHAR16          *Line;
+   UINTN           i, Size, Length = 0, NvramLength = 0;
+   EFI_GUID        RefindGuid = REFIND_GUID_VALUE;
+
+   if ((GlobalConfig.BootTimeReport == 0) || (BootTimeEventCount == 0))
+      return;
+
+   Size = (BOOT_TIME_MAX_EVENTS + 2) * (BOOT_TIME_LABEL_LENGTH + 48) + VolumesCount * BOOT_TIME_IO_LINE_MAX;
+   Report = AllocatePool(Size);
+   if (Report == NULL)
+      return;
+#ifdef BOOT_TIME_USE_TSC
+   Line = PoolPrint(L"rEFInd start-up timing (TSC, %ld ticks/ms); %d events, %d dropped",
+                    TicksPerMs(), BootTimeEventCount, FirstBootTimeEvent());
+#else
+   Line = PoolPrint(L"rEFInd start-up timing (real-time clock); %d events, %d dropped",
+                    BootTimeEventCount, FirstBootTimeEvent());
+#endif
+   if (Line != NULL) {
+      AppendReportLine(Report, Size, &Length, Line);
+      MyFreePool(Line);
+   } // if
+   for (i = FirstBootTimeEvent(); i < BootTimeEventCount; i++) {
+      Line = BootTimeEventLine(&BootTimeEvents[i % BOOT_TIME_MAX_EVENTS]);
+      if (Line == NULL)
+         break;
+      AppendReportLine(Report, Size, &Length, Line);
+      MyFreePool(Line);
+      if (Length <= BOOT_TIME_NVRAM_MAX)
+         NvramLength = Length;
+   } // for
+   for (i = 0; i < VolumesCount; i++) {
+      Line = VolumeIoStatsLine(Volumes[i]);
+      if (Line != NULL) {
+         AppendReportLine(Report, Size, &Length, Line);
+         MyFreePool(Line);
+         if (Length <= BOOT_TIME_NVRAM_MAX)
+            NvramLength = Length;
+      } // if
+   } // for
+
+   if ((GlobalConfig.BootTimeReport & BOOT_TIME_REPORT_FILE) && (SelfDir != NULL)) {
+      // egSaveFile() doesn't truncate an existing file, so delete it first....
+      Status = refit_call5_wrapper(SelfDir->Open, SelfDir, &FileHandle, BOOT_TIME_FILE_NAME,
+                                   EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE, 0);
+      if (!EFI_ERROR(Status))
+         refit_call1_wrapper(FileHandle->Delete, FileHandle);
+      egSaveFile(SelfDir, BOOT_TIME_FILE_NAME, (UINT8 *) Report, Length);
+   } // if
+   if (GlobalConfig.BootTimeReport & BOOT_TIME_REPORT_NVRAM)
+      EfivarSetRaw(&RefindGuid, BOOT_TIME_VARIABLE_NAME, Report, NvramLength, FALSE);
+   MyFreePool(Report);
+} // VOID BootTimeSaveReport()
@@ -0,0 +1,40 @@
+/*
+ * refind/boottime.h
+ * Timing of rEFInd's start-up phases
+ *
+ * Copyright (c) 2014 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+#include "global.h"
+
+#ifndef __BOOTTIME_H_
+#define __BOOTTIME_H_
+
+#ifdef __MAKEWITH_GNUEFI
+#include "efi.h"
+#include "efilib.h"
+#else
+#include "../include/tiano_includes.h"
+#endif
+
+#define BOOT_TIME_FILE_NAME     L"boottime.log"
+#define BOOT_TIME_VARIABLE_NAME L"BootTimes"
+
+// Where BootTimeSaveReport() puts its report (GlobalConfig.BootTimeReport)
+#define BOOT_TIME_REPORT_FILE   0x01
+#define BOOT_TIME_REPORT_NVRAM  0x02
+
+VOID BootTimeInit(VOID);
+UINTN BootTimeBegin(IN CHAR16 *Label, IN CHAR16 *Detail OPTIONAL);
+VOID BootTimeEnd(IN UINTN Id, IN CHAR16 *Detail OPTIONAL);
+VOID BootTimeMark(IN CHAR16 *Label, IN CHAR16 *Detail OPTIONAL);
+VOID BootTimeAddInfoLines(IN REFIT_MENU_SCREEN *Screen);
+VOID BootTimeSaveReport(VOID);
+
+#endif
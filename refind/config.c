@@ -49,6 +49,7 @@
 #include "menu.h"
 #include "config.h"
 #include "screen.h"
+#include "boottime.h"
 #include "../include/refit_call_wrapper.h"
 #include "../mok/mok.h"
 
@@ -70,16 +71,143 @@ static REFIT_MENU_ENTRY MenuEntryReturn   = { L"Return to Main Menu", TAG_RETURN
 // read a file into a buffer
 //
 
+// Decodes the UTF-8 sequence at *p into *Char and advances *p past it.
+// Returns FALSE if the sequence is malformed (in which case *Char is set to
+// U+FFFD and *p is advanced past the bad bytes). Well-formed characters
+// beyond the 16-bit range that EFI strings can hold also become U+FFFD.
+static BOOLEAN DecodeUtf8(IN OUT UINT8 **p, IN UINT8 *End, OUT CHAR16 *Char) {
+   UINT8   *q = *p;
+   UINT32  Value;
+   UINTN   Extra, i;
+
+   Value = *q++;
+   if (Value < 0x80) {
+      Extra = 0;
+   } else if ((Value & 0xE0) == 0xC0) {
+      Extra = 1;
+      Value &= 0x1F;
+   } else if ((Value & 0xF0) == 0xE0) {
+      Extra = 2;
+      Value &= 0x0F;
+   } else if ((Value & 0xF8) == 0xF0) {
+      Extra = 3;
+      Value &= 0x07;
+   } else {
+      *p = q;
+      *Char = 0xFFFD;
+      return FALSE;
+   } // if/else
+   for (i = 0; i < Extra; i++) {
+      if ((q >= End) || ((*q & 0xC0) != 0x80)) {
+         *p = q;
+         *Char = 0xFFFD;
+         return FALSE;
+      } // if
+      Value = (Value << 6) | (*q++ & 0x3F);
+   } // for
+   *p = q;
+
+   // Reject overlong encodings and UTF-16 surrogates....
+   if (((Extra == 1) && (Value < 0x80)) || ((Extra == 2) && (Value < 0x800)) ||
+       ((Extra == 3) && (Value < 0x10000)) || ((Value >= 0xD800) && (Value <= 0xDFFF))) {
+      *Char = 0xFFFD;
+      return FALSE;
+   } // if
+   *Char = (Value > 0xFFFF) ? 0xFFFD : (CHAR16) Value;
+   return TRUE;
+} // static BOOLEAN DecodeUtf8()
+
+// Returns TRUE if the DataSize bytes at Data form valid UTF-8.
+static BOOLEAN IsUtf8(IN UINT8 *Data, IN UINTN DataSize) {
+   UINT8   *End = Data + DataSize;
+   CHAR16  Char;
+
+   while (Data < End) {
+      if (*Data < 0x80)
+         Data++;
+      else if (!DecodeUtf8(&Data, End, &Char))
+         return FALSE;
+   } // while
+   return TRUE;
+} // static BOOLEAN IsUtf8()
+
+// Returns the character at *p in the specified encoding, advancing *p past it.
+static CHAR16 NextFileChar(IN UINTN Encoding, IN OUT UINT8 **p, IN UINT8 *End) {
+   CHAR16 Char;
+
+   if (Encoding == ENCODING_UTF16_LE) {
+      Char = (CHAR16) ((*p)[0] | ((*p)[1] << 8));
+      *p += 2;
+   } else if ((Encoding == ENCODING_UTF8) && (**p >= 0x80)) {
+      DecodeUtf8(p, End, &Char);
+   } else { // ISO-8859-1, or the ASCII subset of UTF-8
+      Char = **p;
+      (*p)++;
+   } // if/else
+   return Char;
+} // static CHAR16 NextFileChar()
+
+// Converts the DataSize bytes at Data, in the specified encoding, to UTF-16 and
+// stores the result in File, ready for ReadTokenLine(). Both the text and the
+// space ReadTokenLine() needs for one line's worth of token pointers come from
+// a single allocation, File->Buffer; freeing it releases everything.
+static EFI_STATUS SetFileText(IN OUT REFIT_FILE *File, IN UINT8 *Data, IN UINTN DataSize, IN UINTN Encoding) {
+   UINT8   *p, *End;
+   CHAR16  *Text, Char;
+   UINTN   Length = 0, LineLength = 0, MaxLineLength = 0, TextSize, i;
+
+   if (Encoding == ENCODING_UTF16_LE)
+      DataSize &= ~((UINTN) 1);
+   End = Data + DataSize;
+
+   // First pass: measure the text and its longest line....
+   for (p = Data; p < End; Length++) {
+      Char = NextFileChar(Encoding, &p, End);
+      if ((Char == 13) || (Char == 10)) {
+         LineLength = 0;
+      } else if (++LineLength > MaxLineLength) {
+         MaxLineLength = LineLength;
+      } // if/else
+   } // for
+
+   // A line of n characters holds at most (n + 1) / 2 tokens....
+   TextSize = ((Length + 1) * sizeof(CHAR16) + sizeof(CHAR16 *) - 1) & ~(sizeof(CHAR16 *) - 1);
+   File->Buffer = AllocatePool(TextSize + (MaxLineLength / 2 + 2) * sizeof(CHAR16 *));
+   if (File->Buffer == NULL) {
+      File->BufferSize = 0;
+      File->TokenBuffer = NULL;
+      return EFI_OUT_OF_RESOURCES;
+   } // if
+
+   // Second pass: decode....
+   Text = (CHAR16 *) File->Buffer;
+   for (p = Data, i = 0; p < End; i++)
+      Text[i] = NextFileChar(Encoding, &p, End);
+   Text[Length] = 0;
+
+   File->BufferSize   = Length * sizeof(CHAR16);
+   File->Encoding     = ENCODING_UTF16_LE;
+   File->Current8Ptr  = (CHAR8 *)File->Buffer;
+   File->End8Ptr      = File->Current8Ptr + File->BufferSize;
+   File->Current16Ptr = Text;
+   File->End16Ptr     = Text + Length;
+   File->TokenBuffer  = (CHAR16 **) (File->Buffer + TextSize);
+   return EFI_SUCCESS;
+} // static EFI_STATUS SetFileText()
+
 EFI_STATUS ReadFile(IN EFI_FILE_HANDLE BaseDir, IN CHAR16 *FileName, IN OUT REFIT_FILE *File, OUT UINTN *size)
 {
     EFI_STATUS      Status;
     EFI_FILE_HANDLE FileHandle;
     EFI_FILE_INFO   *FileInfo;
     UINT64          ReadSize;
+    UINT8           *Data;
+    UINTN           DataSize, Skip = 0, Encoding;
     CHAR16          Message[256];
 
     File->Buffer = NULL;
     File->BufferSize = 0;
+    File->TokenBuffer = NULL;
 
     // read the file, allocating a buffer on the way
     Status = refit_call5_wrapper(BaseDir->Open, BaseDir, &FileHandle, FileName, EFI_FILE_MODE_READ, 0);
@@ -96,124 +224,77 @@ EFI_STATUS ReadFile(IN EFI_FILE_HANDLE BaseDir, IN CHAR16 *FileName, IN OUT REFI
     ReadSize = FileInfo->FileSize;
     FreePool(FileInfo);
 
-    File->BufferSize = (UINTN)ReadSize;
-    File->Buffer = AllocatePool(File->BufferSize);
-    if (File->Buffer == NULL) {
-       size = 0;
+    DataSize = (UINTN)ReadSize;
+    Data = AllocatePool(DataSize);
+    if (Data == NULL) {
+       *size = 0;
+       refit_call1_wrapper(FileHandle->Close, FileHandle);
        return EFI_OUT_OF_RESOURCES;
     } else {
-       *size = File->BufferSize;
+       *size = DataSize;
     } // if/else
-    Status = refit_call3_wrapper(FileHandle->Read, FileHandle, &File->BufferSize, File->Buffer);
+    Status = refit_call3_wrapper(FileHandle->Read, FileHandle, &DataSize, Data);
     if (CheckError(Status, Message)) {
-        MyFreePool(File->Buffer);
-        File->Buffer = NULL;
+        MyFreePool(Data);
         refit_call1_wrapper(FileHandle->Close, FileHandle);
         return Status;
     }
     Status = refit_call1_wrapper(FileHandle->Close, FileHandle);
 
-    // setup for reading
-    File->Current8Ptr  = (CHAR8 *)File->Buffer;
-    File->End8Ptr      = File->Current8Ptr + File->BufferSize;
-    File->Current16Ptr = (CHAR16 *)File->Buffer;
-    File->End16Ptr     = File->Current16Ptr + (File->BufferSize >> 1);
-
     // detect encoding
-    File->Encoding = ENCODING_ISO8859_1;   // default: 1:1 translation of CHAR8 to CHAR16
-    if (File->BufferSize >= 4) {
-        if (File->Buffer[0] == 0xFF && File->Buffer[1] == 0xFE) {
+    Encoding = ENCODING_ISO8859_1;   // default: 1:1 translation of CHAR8 to CHAR16
+    if (DataSize >= 4) {
+        if (Data[0] == 0xFF && Data[1] == 0xFE) {
             // BOM in UTF-16 little endian (or UTF-32 little endian)
-            File->Encoding = ENCODING_UTF16_LE;   // use CHAR16 as is
-            File->Current16Ptr++;
-        } else if (File->Buffer[0] == 0xEF && File->Buffer[1] == 0xBB && File->Buffer[2] == 0xBF) {
+            Encoding = ENCODING_UTF16_LE;   // use CHAR16 as is
+            Skip = 2;
+        } else if (Data[0] == 0xEF && Data[1] == 0xBB && Data[2] == 0xBF) {
             // BOM in UTF-8
-            File->Encoding = ENCODING_UTF8;       // translate from UTF-8 to UTF-16
-            File->Current8Ptr += 3;
-        } else if (File->Buffer[1] == 0 && File->Buffer[3] == 0) {
-            File->Encoding = ENCODING_UTF16_LE;   // use CHAR16 as is
+            Encoding = ENCODING_UTF8;       // translate from UTF-8 to UTF-16
+            Skip = 3;
+        } else if (Data[1] == 0 && Data[3] == 0) {
+            Encoding = ENCODING_UTF16_LE;   // use CHAR16 as is
         }
         // TODO: detect other encodings as they are implemented
     }
-
-    return EFI_SUCCESS;
+    // Most Linux files are UTF-8 without a BOM; anything that doesn't decode
+    // cleanly is assumed to be ISO-8859-1.
+    if ((Encoding == ENCODING_ISO8859_1) && IsUtf8(Data, DataSize))
+        Encoding = ENCODING_UTF8;
+
+    // convert to UTF-16 for reading
+    Status = SetFileText(File, Data + Skip, DataSize - Skip, Encoding);
+    MyFreePool(Data);
+    return Status;
 }
 
 //
 // get a single line of text from a file
 //
 
+// Returns the next line of File, terminated in place within the file's
+// buffer, or NULL at the end of the file.
 static CHAR16 *ReadLine(REFIT_FILE *File)
 {
-    CHAR16  *Line, *q;
-    UINTN   LineLength;
+    CHAR16  *Line, *LineEnd, *p;
 
     if (File->Buffer == NULL)
         return NULL;
 
-    if (File->Encoding == ENCODING_ISO8859_1 || File->Encoding == ENCODING_UTF8) {
-
-        CHAR8 *p, *LineStart, *LineEnd;
-
-        p = File->Current8Ptr;
-        if (p >= File->End8Ptr)
-            return NULL;
-
-        LineStart = p;
-        for (; p < File->End8Ptr; p++)
-            if (*p == 13 || *p == 10)
-                break;
-        LineEnd = p;
-        for (; p < File->End8Ptr; p++)
-            if (*p != 13 && *p != 10)
-                break;
-        File->Current8Ptr = p;
-
-        LineLength = (UINTN)(LineEnd - LineStart) + 1;
-        Line = AllocatePool(LineLength * sizeof(CHAR16));
-        if (Line == NULL)
-            return NULL;
-
-        q = Line;
-        if (File->Encoding == ENCODING_ISO8859_1) {
-            for (p = LineStart; p < LineEnd; )
-                *q++ = *p++;
-        } else if (File->Encoding == ENCODING_UTF8) {
-            // TODO: actually handle UTF-8
-            for (p = LineStart; p < LineEnd; )
-                *q++ = *p++;
-        }
-        *q = 0;
-
-    } else if (File->Encoding == ENCODING_UTF16_LE) {
-
-        CHAR16 *p, *LineStart, *LineEnd;
-
-        p = File->Current16Ptr;
-        if (p >= File->End16Ptr)
-            return NULL;
-
-        LineStart = p;
-        for (; p < File->End16Ptr; p++)
-            if (*p == 13 || *p == 10)
-                break;
-        LineEnd = p;
-        for (; p < File->End16Ptr; p++)
-            if (*p != 13 && *p != 10)
-                break;
-        File->Current16Ptr = p;
-
-        LineLength = (UINTN)(LineEnd - LineStart) + 1;
-        Line = AllocatePool(LineLength * sizeof(CHAR16));
-        if (Line == NULL)
-            return NULL;
-
-        for (p = LineStart, q = Line; p < LineEnd; )
-            *q++ = *p++;
-        *q = 0;
+    p = File->Current16Ptr;
+    if (p >= File->End16Ptr)
+        return NULL;
 
-    } else
-        return NULL;   // unsupported encoding
+    Line = p;
+    for (; p < File->End16Ptr; p++)
+        if (*p == 13 || *p == 10)
+            break;
+    LineEnd = p;
+    for (; p < File->End16Ptr; p++)
+        if (*p != 13 && *p != 10)
+            break;
+    *LineEnd = 0;
+    File->Current16Ptr = p;
 
     return Line;
 }
@@ -223,7 +304,7 @@ static CHAR16 *ReadLine(REFIT_FILE *File)
 // quotes ('"'); it deletes one of them.
 static BOOLEAN KeepReading(IN OUT CHAR16 *p, IN OUT BOOLEAN *IsQuoted) {
    BOOLEAN MoreToRead = FALSE;
-   CHAR16  *Temp = NULL;
+   CHAR16  *Temp;
 
    if ((p == NULL) || (IsQuoted == NULL))
       return FALSE;
@@ -236,11 +317,10 @@ static BOOLEAN KeepReading(IN OUT CHAR16 *p, IN OUT BOOLEAN *IsQuoted) {
    }
    if (*p == L'"') {
       if (p[1] == L'"') {
-         Temp = StrDuplicate(&p[1]);
-         if (Temp != NULL) {
-            StrCpy(p, Temp);
-            FreePool(Temp);
-         }
+         Temp = p;
+         do {
+            Temp[0] = Temp[1];
+         } while (*Temp++ != L'\0');
          MoreToRead = TRUE;
       } else {
          *IsQuoted = !(*IsQuoted);
@@ -254,6 +334,10 @@ static BOOLEAN KeepReading(IN OUT CHAR16 *p, IN OUT BOOLEAN *IsQuoted) {
 //
 // get a line of tokens from a file
 //
+// Tokens are split out in place within the file's buffer, so nothing is
+// allocated. The returned TokenList is reused by the next call on the same
+// File, but the token strings it points to remain valid until the file's
+// buffer is freed.
 UINTN ReadTokenLine(IN REFIT_FILE *File, OUT CHAR16 ***TokenList)
 {
     BOOLEAN         LineFinished, IsQuoted = FALSE;
@@ -261,6 +345,8 @@ UINTN ReadTokenLine(IN REFIT_FILE *File, OUT CHAR16 ***TokenList)
     UINTN           TokenCount = 0;
 
     *TokenList = NULL;
+    if (File->TokenBuffer == NULL)
+        return(0);
 
     while (TokenCount == 0) {
         Line = ReadLine(File);
@@ -292,18 +378,17 @@ UINTN ReadTokenLine(IN REFIT_FILE *File, OUT CHAR16 ***TokenList)
                 LineFinished = TRUE;
             *p++ = 0;
 
-            AddListElement((VOID ***)TokenList, &TokenCount, (VOID *)StrDuplicate(Token));
+            File->TokenBuffer[TokenCount++] = Token;
         }
-
-        FreePool(Line);
     }
+    *TokenList = File->TokenBuffer;
     return (TokenCount);
 } /* ReadTokenLine() */
 
+// The tokens live in the file's buffer, so there's nothing to free here.
 VOID FreeTokenLine(IN OUT CHAR16 ***TokenList, IN OUT UINTN *TokenCount)
 {
-    // TODO: also free the items
-    FreeList((VOID ***)TokenList, TokenCount);
+    *TokenList = NULL;
 }
 
 // handle a parameter with a single integer argument
@@ -432,6 +517,136 @@ static VOID SetDefaultByTime(IN CHAR16 **TokenList, OUT CHAR16 **Default) {
    } // if ((StartTime <= LAST_MINUTE) && (EndTime <= LAST_MINUTE))
 } // VOID SetDefaultByTime()
 
+//
+// configuration keywords
+//
+
+#define KW_UNKNOWN                 (0)
+#define KW_TIMEOUT                 (1)
+#define KW_HIDEUI                  (2)
+#define KW_ICONS_DIR               (3)
+#define KW_SCANFOR                 (4)
+#define KW_UEFI_DEEP_LEGACY_SCAN   (5)
+#define KW_SCAN_DELAY              (6)
+#define KW_ALSO_SCAN_DIRS          (7)
+#define KW_DONT_SCAN_VOLUMES       (8)
+#define KW_DONT_SCAN_DIRS          (9)
+#define KW_DONT_SCAN_FILES         (10)
+#define KW_WINDOWS_RECOVERY_FILES  (11)
+#define KW_SCAN_DRIVER_DIRS        (12)
+#define KW_SHOWTOOLS               (13)
+#define KW_BANNER                  (14)
+#define KW_BANNER_SCALE            (15)
+#define KW_SMALL_ICON_SIZE         (16)
+#define KW_BIG_ICON_SIZE           (17)
+#define KW_SELECTION_SMALL         (18)
+#define KW_SELECTION_BIG           (19)
+#define KW_DEFAULT_SELECTION       (20)
+#define KW_TEXTONLY                (21)
+#define KW_TEXTMODE                (22)
+#define KW_RESOLUTION              (23)
+#define KW_SCREENSAVER             (24)
+#define KW_USE_GRAPHICS_FOR        (25)
+#define KW_FONT                    (26)
+#define KW_SCAN_ALL_LINUX_KERNELS  (27)
+#define KW_CACHE_ICONS             (28)
+#define KW_CACHE_SCANS             (29)
+#define KW_MAX_TAGS                (30)
+#define KW_INCLUDE                 (31)
+#define KW_BOOT_TIME_REPORT        (32)
+#define KW_DRIVER_MANIFEST         (33)
+
+typedef struct {
+   CHAR16   *Keyword;
+   UINTN    Id;
+} CONFIG_KEYWORD;
+
+static CONFIG_KEYWORD ConfigKeywords[] = {
+   { L"timeout",                KW_TIMEOUT },
+   { L"hideui",                 KW_HIDEUI },
+   { L"icons_dir",              KW_ICONS_DIR },
+   { L"scanfor",                KW_SCANFOR },
+   { L"uefi_deep_legacy_scan",  KW_UEFI_DEEP_LEGACY_SCAN },
+   { L"scan_delay",             KW_SCAN_DELAY },
+   { L"also_scan_dirs",         KW_ALSO_SCAN_DIRS },
+   { L"don't_scan_volumes",     KW_DONT_SCAN_VOLUMES },
+   { L"dont_scan_volumes",      KW_DONT_SCAN_VOLUMES },
+   { L"don't_scan_dirs",        KW_DONT_SCAN_DIRS },
+   { L"dont_scan_dirs",         KW_DONT_SCAN_DIRS },
+   { L"don't_scan_files",       KW_DONT_SCAN_FILES },
+   { L"dont_scan_files",        KW_DONT_SCAN_FILES },
+   { L"windows_recovery_files", KW_WINDOWS_RECOVERY_FILES },
+   { L"scan_driver_dirs",       KW_SCAN_DRIVER_DIRS },
+   { L"showtools",              KW_SHOWTOOLS },
+   { L"banner",                 KW_BANNER },
+   { L"banner_scale",           KW_BANNER_SCALE },
+   { L"small_icon_size",        KW_SMALL_ICON_SIZE },
+   { L"big_icon_size",          KW_BIG_ICON_SIZE },
+   { L"selection_small",        KW_SELECTION_SMALL },
+   { L"selection_big",          KW_SELECTION_BIG },
+   { L"default_selection",      KW_DEFAULT_SELECTION },
+   { L"textonly",               KW_TEXTONLY },
+   { L"textmode",               KW_TEXTMODE },
+   { L"resolution",             KW_RESOLUTION },
+   { L"screensaver",            KW_SCREENSAVER },
+   { L"use_graphics_for",       KW_USE_GRAPHICS_FOR },
+   { L"font",                   KW_FONT },
+   { L"scan_all_linux_kernels", KW_SCAN_ALL_LINUX_KERNELS },
+   { L"cache_icons",            KW_CACHE_ICONS },
+   { L"cache_scans",            KW_CACHE_SCANS },
+   { L"max_tags",               KW_MAX_TAGS },
+   { L"include",                KW_INCLUDE },
+   { L"boot_time_report",       KW_BOOT_TIME_REPORT },
+   { L"driver_manifest",        KW_DRIVER_MANIFEST },
+   { NULL,                      KW_UNKNOWN }
+};
+
+// Open-addressed hash of ConfigKeywords; each slot holds an index into
+// ConfigKeywords plus one, or 0 if empty. Must be a power of two comfortably
+// larger than the number of keywords.
+#define KEYWORD_HASH_SIZE 128
+
+static UINT8    KeywordHash[KEYWORD_HASH_SIZE];
+static BOOLEAN  KeywordHashReady = FALSE;
+
+// Case-insensitive hash of a keyword.
+static UINTN HashKeyword(IN CHAR16 *Keyword) {
+   UINTN  Hash = 5381;
+   CHAR16 c;
+
+   while ((c = *Keyword++) != 0) {
+      if ((c >= L'A') && (c <= L'Z'))
+         c = c - L'A' + L'a';
+      Hash = (Hash * 33) ^ c;
+   } // while
+   return Hash;
+} // static UINTN HashKeyword()
+
+// Returns the KW_* code for the configuration keyword Keyword, or KW_UNKNOWN
+// if it isn't one. Builds the hash on first use.
+static UINTN FindConfigKeyword(IN CHAR16 *Keyword) {
+   UINTN i, Slot;
+
+   if (!KeywordHashReady) {
+      for (i = 0; ConfigKeywords[i].Keyword != NULL; i++) {
+         Slot = HashKeyword(ConfigKeywords[i].Keyword) & (KEYWORD_HASH_SIZE - 1);
+         while (KeywordHash[Slot] != 0)
+            Slot = (Slot + 1) & (KEYWORD_HASH_SIZE - 1);
+         KeywordHash[Slot] = (UINT8) (i + 1);
+      } // for
+      KeywordHashReady = TRUE;
+   } // if
+
+   Slot = HashKeyword(Keyword) & (KEYWORD_HASH_SIZE - 1);
+   while (KeywordHash[Slot] != 0) {
+      i = KeywordHash[Slot] - 1;
+      if (StriCmp(ConfigKeywords[i].Keyword, Keyword) == 0)
+         return ConfigKeywords[i].Id;
+      Slot = (Slot + 1) & (KEYWORD_HASH_SIZE - 1);
+   } // while
+   return KW_UNKNOWN;
+} // static UINTN FindConfigKeyword()
+
 // read config file
 VOID ReadConfig(CHAR16 *FileName)
 {
@@ -489,10 +704,12 @@ VOID ReadConfig(CHAR16 *FileName)
         if (TokenCount == 0)
             break;
 
-        if (StriCmp(TokenList[0], L"timeout") == 0) {
+        switch (FindConfigKeyword(TokenList[0])) {
+        case KW_TIMEOUT:
             HandleInt(TokenList, TokenCount, &(GlobalConfig.Timeout));
+            break;
 
-        } else if (StriCmp(TokenList[0], L"hideui") == 0) {
+        case KW_HIDEUI:
             for (i = 1; i < TokenCount; i++) {
                 FlagName = TokenList[i];
                 if (StriCmp(FlagName, L"banner") == 0) {
@@ -517,48 +734,60 @@ VOID ReadConfig(CHAR16 *FileName)
                     Print(L" unknown hideui flag: '%s'\n", FlagName);
                 }
             }
+            break;
 
-        } else if (StriCmp(TokenList[0], L"icons_dir") == 0) {
+        case KW_ICONS_DIR:
            HandleString(TokenList, TokenCount, &(GlobalConfig.IconsDir));
+           break;
 
-        } else if (StriCmp(TokenList[0], L"scanfor") == 0) {
+        case KW_SCANFOR:
            for (i = 0; i < NUM_SCAN_OPTIONS; i++) {
               if (i < TokenCount)
                  GlobalConfig.ScanFor[i] = TokenList[i][0];
               else
                  GlobalConfig.ScanFor[i] = ' ';
            }
+           break;
 
-        } else if (StriCmp(TokenList[0], L"uefi_deep_legacy_scan") == 0) {
+        case KW_UEFI_DEEP_LEGACY_SCAN:
            GlobalConfig.DeepLegacyScan = HandleBoolean(TokenList, TokenCount);
+           break;
 
-        } else if ((StriCmp(TokenList[0], L"scan_delay") == 0) && (TokenCount == 2)) {
-           HandleInt(TokenList, TokenCount, &(GlobalConfig.ScanDelay));
+        case KW_SCAN_DELAY:
+           if (TokenCount == 2)
+              HandleInt(TokenList, TokenCount, &(GlobalConfig.ScanDelay));
+           break;
 
-        } else if (StriCmp(TokenList[0], L"also_scan_dirs") == 0) {
+        case KW_ALSO_SCAN_DIRS:
             HandleStrings(TokenList, TokenCount, &(GlobalConfig.AlsoScan));
+            break;
 
-        } else if ((StriCmp(TokenList[0], L"don't_scan_volumes") == 0) || (StriCmp(TokenList[0], L"dont_scan_volumes") == 0)) {
+        case KW_DONT_SCAN_VOLUMES:
            // Note: Don't use HandleStrings() because it modifies slashes, which might be present in volume name
            MyFreePool(GlobalConfig.DontScanVolumes);
            GlobalConfig.DontScanVolumes = NULL;
            for (i = 1; i < TokenCount; i++) {
               MergeStrings(&GlobalConfig.DontScanVolumes, TokenList[i], L',');
            }
+           break;
 
-        } else if ((StriCmp(TokenList[0], L"don't_scan_dirs") == 0) || (StriCmp(TokenList[0], L"dont_scan_dirs") == 0)) {
+        case KW_DONT_SCAN_DIRS:
             HandleStrings(TokenList, TokenCount, &(GlobalConfig.DontScanDirs));
+            break;
 
-        } else if ((StriCmp(TokenList[0], L"don't_scan_files") == 0) || (StriCmp(TokenList[0], L"dont_scan_files") == 0)) {
+        case KW_DONT_SCAN_FILES:
            HandleStrings(TokenList, TokenCount, &(GlobalConfig.DontScanFiles));
+           break;
 
-        } else if (StriCmp(TokenList[0], L"windows_recovery_files") == 0) {
+        case KW_WINDOWS_RECOVERY_FILES:
            HandleStrings(TokenList, TokenCount, &(GlobalConfig.WindowsRecoveryFiles));
+           break;
 
-        } else if (StriCmp(TokenList[0], L"scan_driver_dirs") == 0) {
+        case KW_SCAN_DRIVER_DIRS:
             HandleStrings(TokenList, TokenCount, &(GlobalConfig.DriverDirs));
+            break;
 
-        } else if (StriCmp(TokenList[0], L"showtools") == 0) {
+        case KW_SHOWTOOLS:
             SetMem(GlobalConfig.ShowTools, NUM_TOOLS * sizeof(UINTN), 0);
             for (i = 1; (i < TokenCount) && (i < NUM_TOOLS); i++) {
                 FlagName = TokenList[i];
@@ -590,11 +819,15 @@ VOID ReadConfig(CHAR16 *FileName)
                    Print(L" unknown showtools flag: '%s'\n", FlagName);
                 }
             } // showtools options
+            break;
 
-        } else if (StriCmp(TokenList[0], L"banner") == 0) {
+        case KW_BANNER:
            HandleString(TokenList, TokenCount, &(GlobalConfig.BannerFileName));
+           break;
 
-        } else if ((StriCmp(TokenList[0], L"banner_scale") == 0) && (TokenCount == 2)) {
+        case KW_BANNER_SCALE:
+           if (TokenCount != 2)
+              break;
            if (StriCmp(TokenList[1], L"noscale") == 0) {
               GlobalConfig.BannerScale = BANNER_NOSCALE;
            } else if ((StriCmp(TokenList[1], L"fillscreen") == 0) || (StriCmp(TokenList[1], L"fullscreen") == 0)) {
@@ -602,49 +835,65 @@ VOID ReadConfig(CHAR16 *FileName)
            } else {
               Print(L" unknown banner_type flag: '%s'\n", TokenList[1]);
            } // if/else
+           break;
 
-        } else if ((StriCmp(TokenList[0], L"small_icon_size") == 0) && (TokenCount == 2)) {
-           HandleInt(TokenList, TokenCount, &i);
-           if (i >= 32)
-              GlobalConfig.IconSizes[ICON_SIZE_SMALL] = i;
-
-        } else if ((StriCmp(TokenList[0], L"big_icon_size") == 0) && (TokenCount == 2)) {
-           HandleInt(TokenList, TokenCount, &i);
-           if (i >= 32) {
-              GlobalConfig.IconSizes[ICON_SIZE_BIG] = i;
-              GlobalConfig.IconSizes[ICON_SIZE_BADGE] = i / 4;
+        case KW_SMALL_ICON_SIZE:
+           if (TokenCount == 2) {
+              HandleInt(TokenList, TokenCount, &i);
+              if (i >= 32)
+                 GlobalConfig.IconSizes[ICON_SIZE_SMALL] = i;
+           }
+           break;
+
+        case KW_BIG_ICON_SIZE:
+           if (TokenCount == 2) {
+              HandleInt(TokenList, TokenCount, &i);
+              if (i >= 32) {
+                 GlobalConfig.IconSizes[ICON_SIZE_BIG] = i;
+                 GlobalConfig.IconSizes[ICON_SIZE_BADGE] = i / 4;
+              }
            }
+           break;
 
-        } else if (StriCmp(TokenList[0], L"selection_small") == 0) {
+        case KW_SELECTION_SMALL:
            HandleString(TokenList, TokenCount, &(GlobalConfig.SelectionSmallFileName));
+           break;
 
-        } else if (StriCmp(TokenList[0], L"selection_big") == 0) {
+        case KW_SELECTION_BIG:
            HandleString(TokenList, TokenCount, &(GlobalConfig.SelectionBigFileName));
+           break;
 
-        } else if (StriCmp(TokenList[0], L"default_selection") == 0) {
+        case KW_DEFAULT_SELECTION:
            if (TokenCount == 4) {
               SetDefaultByTime(TokenList, &(GlobalConfig.DefaultSelection));
            } else {
               HandleString(TokenList, TokenCount, &(GlobalConfig.DefaultSelection));
            }
+           break;
 
-        } else if (StriCmp(TokenList[0], L"textonly") == 0) {
+        case KW_TEXTONLY:
            GlobalConfig.TextOnly = HandleBoolean(TokenList, TokenCount);
+           break;
 
-        } else if (StriCmp(TokenList[0], L"textmode") == 0) {
+        case KW_TEXTMODE:
            HandleInt(TokenList, TokenCount, &(GlobalConfig.RequestedTextMode));
+           break;
 
-        } else if ((StriCmp(TokenList[0], L"resolution") == 0) && ((TokenCount == 2) || (TokenCount == 3))) {
-           GlobalConfig.RequestedScreenWidth = Atoi(TokenList[1]);
-           if (TokenCount == 3)
-              GlobalConfig.RequestedScreenHeight = Atoi(TokenList[2]);
-           else
-              GlobalConfig.RequestedScreenHeight = 0;
+        case KW_RESOLUTION:
+           if ((TokenCount == 2) || (TokenCount == 3)) {
+              GlobalConfig.RequestedScreenWidth = Atoi(TokenList[1]);
+              if (TokenCount == 3)
+                 GlobalConfig.RequestedScreenHeight = Atoi(TokenList[2]);
+              else
+                 GlobalConfig.RequestedScreenHeight = 0;
+           }
+           break;
 
-        } else if (StriCmp(TokenList[0], L"screensaver") == 0) {
+        case KW_SCREENSAVER:
            HandleInt(TokenList, TokenCount, &(GlobalConfig.ScreensaverTime));
+           break;
 
-        } else if (StriCmp(TokenList[0], L"use_graphics_for") == 0) {
+        case KW_USE_GRAPHICS_FOR:
            if ((TokenCount == 2) || ((TokenCount > 2) && (StriCmp(TokenList[1], L"+") != 0)))
               GlobalConfig.GraphicsFor = 0;
            for (i = 1; i < TokenCount; i++) {
@@ -660,34 +909,64 @@ VOID ReadConfig(CHAR16 *FileName)
                  GlobalConfig.GraphicsFor |= GRAPHICS_FOR_WINDOWS;
               }
            } // for (graphics_on tokens)
+           break;
 
-        } else if ((StriCmp(TokenList[0], L"font") == 0) && (TokenCount == 2)) {
-           egLoadFont(TokenList[1]);
+        case KW_FONT:
+           if (TokenCount == 2)
+              egLoadFont(TokenList[1]);
+           break;
 
-        } else if (StriCmp(TokenList[0], L"scan_all_linux_kernels") == 0) {
+        case KW_SCAN_ALL_LINUX_KERNELS:
            GlobalConfig.ScanAllLinux = HandleBoolean(TokenList, TokenCount);
-//            if ((TokenCount >= 2) && (StriCmp(TokenList[1], L"0") == 0)) {
-//               GlobalConfig.ScanAllLinux = FALSE;
-//            } else {
-//               GlobalConfig.ScanAllLinux = TRUE;
-//            }
+           break;
+
+        case KW_CACHE_ICONS:
+           GlobalConfig.CacheIcons = HandleBoolean(TokenList, TokenCount);
+           break;
 
-        } else if (StriCmp(TokenList[0], L"max_tags") == 0) {
+        case KW_CACHE_SCANS:
+           GlobalConfig.CacheScans = HandleBoolean(TokenList, TokenCount);
+           break;
+
+        case KW_MAX_TAGS:
            HandleInt(TokenList, TokenCount, &(GlobalConfig.MaxTags));
+           break;
 
-        } else if ((StriCmp(TokenList[0], L"include") == 0) && (TokenCount == 2) &&
-                   (StriCmp(FileName, GlobalConfig.ConfigFilename) == 0)) {
-           if (StriCmp(TokenList[1], FileName) != 0) {
+        case KW_INCLUDE:
+           if ((TokenCount == 2) && (StriCmp(FileName, GlobalConfig.ConfigFilename) == 0) &&
+               (StriCmp(TokenList[1], FileName) != 0)) {
               ReadConfig(TokenList[1]);
            }
+           break;
 
-        }
+        case KW_BOOT_TIME_REPORT:
+           GlobalConfig.BootTimeReport = 0;
+           for (i = 1; i < TokenCount; i++) {
+              if (StriCmp(TokenList[i], L"file") == 0) {
+                 GlobalConfig.BootTimeReport |= BOOT_TIME_REPORT_FILE;
+              } else if (StriCmp(TokenList[i], L"nvram") == 0) {
+                 GlobalConfig.BootTimeReport |= BOOT_TIME_REPORT_NVRAM;
+              }
+           } // for (boot_time_report tokens)
+           break;
+
+        case KW_DRIVER_MANIFEST:
+           GlobalConfig.DriverManifest = HandleBoolean(TokenList, TokenCount);
+           break;
+
+        } // switch
 
         FreeTokenLine(&TokenList, &TokenCount);
     }
     if ((GlobalConfig.DontScanFiles) && (GlobalConfig.WindowsRecoveryFiles))
        MergeStrings(&(GlobalConfig.DontScanFiles), GlobalConfig.WindowsRecoveryFiles, L',');
     MyFreePool(File.Buffer);
+
+    // Split the scan filters once, rather than on every test during scanning....
+    CompileNameList(GlobalConfig.AlsoScan, NAME_LIST_PATHS, &GlobalConfig.AlsoScanList);
+    CompileNameList(GlobalConfig.DontScanVolumes, NAME_LIST_PLAIN, &GlobalConfig.DontScanVolumesList);
+    CompileNameList(GlobalConfig.DontScanDirs, NAME_LIST_PATHS, &GlobalConfig.DontScanDirsList);
+    CompileNameList(GlobalConfig.DontScanFiles, NAME_LIST_FILES, &GlobalConfig.DontScanFilesList);
 } /* VOID ReadConfig() */
 
 // Finds a volume with the specified Identifier (a filesystem label, a
@@ -748,40 +1027,36 @@ static VOID AddSubmenu(LOADER_ENTRY *Entry, REFIT_FILE *File, REFIT_VOLUME *Volu
 
    if ((SubEntry == NULL) || (SubScreen == NULL))
       return;
-   SubEntry->me.Title        = StrDuplicate(Title);
+   SubEntry->me.Title        = ScanArenaStrDuplicate(Title);
 
    while (((TokenCount = ReadTokenLine(File, &TokenList)) > 0) && (StriCmp(TokenList[0], L"}") != 0)) {
 
       if ((StriCmp(TokenList[0], L"loader") == 0) && (TokenCount > 1)) { // set the boot loader filename
-         MyFreePool(SubEntry->LoaderPath);
-         SubEntry->LoaderPath = StrDuplicate(TokenList[1]);
-         SubEntry->DevicePath = FileDevicePath(Volume->DeviceHandle, SubEntry->LoaderPath);
+         SubEntry->LoaderPath = ScanArenaStrDuplicate(TokenList[1]);
+         SubEntry->DevicePath = ScanArenaKeepDevicePath(FileDevicePath(Volume->DeviceHandle, SubEntry->LoaderPath));
 
       } else if ((StriCmp(TokenList[0], L"volume") == 0) && (TokenCount > 1)) {
          if (FindVolume(&Volume, TokenList[1])) {
-            MyFreePool(SubEntry->me.Title);
-            SubEntry->me.Title        = AllocateZeroPool(256 * sizeof(CHAR16));
+            SubEntry->me.Title        = ScanArenaAllocateZero(256 * sizeof(CHAR16));
             SPrint(SubEntry->me.Title, 255, L"Boot %s from %s", (Title != NULL) ? Title : L"Unknown", Volume->VolName);
             SubEntry->me.BadgeImage   = Volume->VolBadgeImage;
             SubEntry->VolName         = Volume->VolName;
          } // if match found
 
       } else if (StriCmp(TokenList[0], L"initrd") == 0) {
-         MyFreePool(SubEntry->InitrdPath);
          SubEntry->InitrdPath = NULL;
          if (TokenCount > 1) {
-            SubEntry->InitrdPath = StrDuplicate(TokenList[1]);
+            SubEntry->InitrdPath = ScanArenaStrDuplicate(TokenList[1]);
          }
 
       } else if (StriCmp(TokenList[0], L"options") == 0) {
-         MyFreePool(SubEntry->LoadOptions);
          SubEntry->LoadOptions = NULL;
          if (TokenCount > 1) {
-            SubEntry->LoadOptions = StrDuplicate(TokenList[1]);
+            SubEntry->LoadOptions = ScanArenaStrDuplicate(TokenList[1]);
          } // if/else
 
       } else if ((StriCmp(TokenList[0], L"add_options") == 0) && (TokenCount > 1)) {
-         MergeStrings(&SubEntry->LoadOptions, TokenList[1], L' ');
+         ScanArenaMergeStrings(&SubEntry->LoadOptions, TokenList[1], L' ');
 
       } else if ((StriCmp(TokenList[0], L"graphics") == 0) && (TokenCount > 1)) {
          SubEntry->UseGraphicsMode = (StriCmp(TokenList[1], L"on") == 0);
@@ -794,9 +1069,8 @@ static VOID AddSubmenu(LOADER_ENTRY *Entry, REFIT_FILE *File, REFIT_VOLUME *Volu
    } // while()
 
    if (SubEntry->InitrdPath != NULL) {
-      MergeStrings(&SubEntry->LoadOptions, L"initrd=", L' ');
-      MergeStrings(&SubEntry->LoadOptions, SubEntry->InitrdPath, 0);
-      MyFreePool(SubEntry->InitrdPath);
+      ScanArenaMergeStrings(&SubEntry->LoadOptions, L"initrd=", L' ');
+      ScanArenaMergeStrings(&SubEntry->LoadOptions, SubEntry->InitrdPath, 0);
       SubEntry->InitrdPath = NULL;
    } // if
    if (SubEntry->Enabled == TRUE) {
@@ -820,8 +1094,8 @@ static LOADER_ENTRY * AddStanzaEntries(REFIT_FILE *File, REFIT_VOLUME *Volume, C
    if (Entry == NULL)
       return NULL;
 
-   Entry->Title           = StrDuplicate(Title);
-   Entry->me.Title        = AllocateZeroPool(256 * sizeof(CHAR16));
+   Entry->Title           = ScanArenaStrDuplicate(Title);
+   Entry->me.Title        = ScanArenaAllocateZero(256 * sizeof(CHAR16));
    SPrint(Entry->me.Title, 255, L"Boot %s from %s", (Title != NULL) ? Title : L"Unknown", CurrentVolume->VolName);
    Entry->me.Row          = 0;
    Entry->me.BadgeImage   = CurrentVolume->VolBadgeImage;
@@ -831,36 +1105,35 @@ static LOADER_ENTRY * AddStanzaEntries(REFIT_FILE *File, REFIT_VOLUME *Volume, C
    // is "}" or when the end of file is reached.
    while (((TokenCount = ReadTokenLine(File, &TokenList)) > 0) && (StriCmp(TokenList[0], L"}") != 0)) {
       if ((StriCmp(TokenList[0], L"loader") == 0) && (TokenCount > 1)) { // set the boot loader filename
-         Entry->LoaderPath = StrDuplicate(TokenList[1]);
-         Entry->DevicePath = FileDevicePath(CurrentVolume->DeviceHandle, Entry->LoaderPath);
+         Entry->LoaderPath = ScanArenaStrDuplicate(TokenList[1]);
+         Entry->DevicePath = ScanArenaKeepDevicePath(FileDevicePath(CurrentVolume->DeviceHandle, Entry->LoaderPath));
          SetLoaderDefaults(Entry, TokenList[1], CurrentVolume);
-         MyFreePool(Entry->LoadOptions);
          Entry->LoadOptions = NULL; // Discard default options, if any
+         Entry->OptionsPending = FALSE;
          DefaultsSet = TRUE;
 
       } else if ((StriCmp(TokenList[0], L"volume") == 0) && (TokenCount > 1)) {
          if (FindVolume(&CurrentVolume, TokenList[1])) {
-            MyFreePool(Entry->me.Title);
-            Entry->me.Title        = AllocateZeroPool(256 * sizeof(CHAR16));
+            Entry->me.Title        = ScanArenaAllocateZero(256 * sizeof(CHAR16));
             SPrint(Entry->me.Title, 255, L"Boot %s from %s", (Title != NULL) ? Title : L"Unknown", CurrentVolume->VolName);
             Entry->me.BadgeImage   = CurrentVolume->VolBadgeImage;
             Entry->VolName         = CurrentVolume->VolName;
          } // if match found
 
       } else if ((StriCmp(TokenList[0], L"icon") == 0) && (TokenCount > 1)) {
-         MyFreePool(Entry->me.Image);
-         Entry->me.Image = egLoadIcon(CurrentVolume->RootDir, TokenList[1], GlobalConfig.IconSizes[ICON_SIZE_BIG]);
+         // The icon set by SetLoaderDefaults() is either shared via the icon
+         // cache or owned by the scan arena, so it must not be freed here.
+         Entry->me.Image = ScanArenaKeepImage(egLoadIcon(CurrentVolume->RootDir, TokenList[1],
+                                                         GlobalConfig.IconSizes[ICON_SIZE_BIG]));
          if (Entry->me.Image == NULL) {
-            Entry->me.Image = DummyImage(GlobalConfig.IconSizes[ICON_SIZE_BIG]);
+            Entry->me.Image = ScanArenaKeepImage(DummyImage(GlobalConfig.IconSizes[ICON_SIZE_BIG]));
          }
 
       } else if ((StriCmp(TokenList[0], L"initrd") == 0) && (TokenCount > 1)) {
-         MyFreePool(Entry->InitrdPath);
-         Entry->InitrdPath = StrDuplicate(TokenList[1]);
+         Entry->InitrdPath = ScanArenaStrDuplicate(TokenList[1]);
 
       } else if ((StriCmp(TokenList[0], L"options") == 0) && (TokenCount > 1)) {
-         MyFreePool(Entry->LoadOptions);
-         Entry->LoadOptions = StrDuplicate(TokenList[1]);
+         Entry->LoadOptions = ScanArenaStrDuplicate(TokenList[1]);
 
       } else if ((StriCmp(TokenList[0], L"ostype") == 0) && (TokenCount > 1)) {
          if (TokenCount > 1) {
@@ -885,9 +1158,8 @@ static LOADER_ENTRY * AddStanzaEntries(REFIT_FILE *File, REFIT_VOLUME *Volume, C
        AddMenuEntry(Entry->me.SubScreen, &MenuEntryReturn);
 
    if (Entry->InitrdPath) {
-      MergeStrings(&Entry->LoadOptions, L"initrd=", L' ');
-      MergeStrings(&Entry->LoadOptions, Entry->InitrdPath, 0);
-      MyFreePool(Entry->InitrdPath);
+      ScanArenaMergeStrings(&Entry->LoadOptions, L"initrd=", L' ');
+      ScanArenaMergeStrings(&Entry->LoadOptions, Entry->InitrdPath, 0);
       Entry->InitrdPath = NULL;
    } // if
 
@@ -921,12 +1193,12 @@ VOID ScanUserConfigured(CHAR16 *FileName)
             Title = StrDuplicate(TokenList[1]);
             Entry = AddStanzaEntries(&File, Volume, TokenList[1]);
             if (Entry->Enabled) {
-               if (Entry->me.SubScreen == NULL)
-                  GenerateSubScreen(Entry, Volume);
+               if (Entry->me.SubScreen == NULL) { // generated on demand by FinishLoaderEntry()
+                  Entry->Volume = Volume;
+                  Entry->SubScreenPending = TRUE;
+               }
                AddPreparedLoaderEntry(Entry);
-            } else {
-               MyFreePool(Entry);
-            } // if/else
+            } // if (disabled entries are left to the scan arena)
             MyFreePool(Title);
 
          } else if ((StriCmp(TokenList[0], L"include") == 0) && (TokenCount == 2) &&
@@ -938,6 +1210,7 @@ VOID ScanUserConfigured(CHAR16 *FileName)
          } // if/else if...
          FreeTokenLine(&TokenList, &TokenCount);
       } // while()
+      MyFreePool(File.Buffer);
    } // if()
 } // VOID ScanUserConfigured()
 
@@ -949,7 +1222,7 @@ static REFIT_FILE * GenerateOptionsFromEtcFstab(REFIT_VOLUME *Volume) {
    UINTN        TokenCount, i;
    REFIT_FILE   *Options = NULL, *Fstab = NULL;
    EFI_STATUS   Status;
-   CHAR16       **TokenList, *Line, Root[100];
+   CHAR16       **TokenList, *Line, *Text = NULL, Root[100];
 
    if (FileExists(Volume->RootDir, L"\\etc\\fstab")) {
       Options = AllocateZeroPool(sizeof(REFIT_FILE));
@@ -963,7 +1236,6 @@ static REFIT_FILE * GenerateOptionsFromEtcFstab(REFIT_VOLUME *Volume) {
          Options = NULL;
          Fstab = NULL;
       } else { // File read; locate root fs and create entries
-         Options->Encoding = ENCODING_UTF16_LE;
          while ((TokenCount = ReadTokenLine(Fstab, &TokenList)) > 0) {
             if (TokenCount > 2) {
                Root[0] = '\0';
@@ -977,20 +1249,18 @@ static REFIT_FILE * GenerateOptionsFromEtcFstab(REFIT_VOLUME *Volume) {
                      if (Root[i] == '\\')
                         Root[i] = '/';
                   Line = PoolPrint(L"\"Boot with normal options\"    \"ro root=%s\"\n", Root);
-                  MergeStrings((CHAR16 **) &(Options->Buffer), Line, 0);
+                  MergeStrings(&Text, Line, 0);
                   MyFreePool(Line);
                   Line = PoolPrint(L"\"Boot into single-user mode\"  \"ro root=%s single\"\n", Root);
-                  MergeStrings((CHAR16**) &(Options->Buffer), Line, 0);
-                  Options->BufferSize = StrLen((CHAR16*) Options->Buffer) * sizeof(CHAR16);
+                  MergeStrings(&Text, Line, 0);
+                  MyFreePool(Line);
                } // if
             } // if
             FreeTokenLine(&TokenList, &TokenCount);
          } // while
 
-         Options->Current8Ptr  = (CHAR8 *)Options->Buffer;
-         Options->End8Ptr      = Options->Current8Ptr + Options->BufferSize;
-         Options->Current16Ptr = (CHAR16 *)Options->Buffer;
-         Options->End16Ptr     = Options->Current16Ptr + (Options->BufferSize >> 1);
+         SetFileText(Options, (UINT8 *) Text, (Text != NULL) ? StrLen(Text) * sizeof(CHAR16) : 0, ENCODING_UTF16_LE);
+         MyFreePool(Text);
 
          MyFreePool(Fstab->Buffer);
          MyFreePool(Fstab);
@@ -1016,7 +1286,7 @@ static REFIT_FILE * GenerateOptionsFromEtcFstab(REFIT_VOLUME *Volume) {
 //
 // The return value is a pointer to the REFIT_FILE handle for the file, or NULL if
 // it wasn't found.
-REFIT_FILE * ReadLinuxOptionsFile(IN CHAR16 *LoaderPath, IN REFIT_VOLUME *Volume) {
+static REFIT_FILE * LoadLinuxOptionsFile(IN CHAR16 *LoaderPath, IN REFIT_VOLUME *Volume) {
    CHAR16       *OptionsFilename, *FullFilename;
    BOOLEAN      GoOn = TRUE, FileFound = FALSE;
    UINTN        i = 0, size;
@@ -1043,14 +1313,83 @@ REFIT_FILE * ReadLinuxOptionsFile(IN CHAR16 *LoaderPath, IN REFIT_VOLUME *Volume
       } else { // a filename string is NULL
          GoOn = FALSE;
       } // if/else
-      if (!FileFound)
-         File = GenerateOptionsFromEtcFstab(Volume);
       MyFreePool(OptionsFilename);
       MyFreePool(FullFilename);
       OptionsFilename = FullFilename = NULL;
    } while (GoOn);
+   if (!FileFound)
+      File = GenerateOptionsFromEtcFstab(Volume);
+   return (File);
+} // static REFIT_FILE * LoadLinuxOptionsFile()
+
+// Options files loaded so far, one per kernel directory, so that several kernels
+// in one directory share a single read of the file (or of /etc/fstab).
+typedef struct {
+   REFIT_VOLUME *Volume;
+   CHAR16       *Path;
+   REFIT_FILE   *File;   // NULL if neither an options file nor /etc/fstab exists
+} LINUX_OPTIONS_DIR;
+
+static LINUX_OPTIONS_DIR **OptionsDirs = NULL;
+static UINTN             OptionsDirCount = 0;
+
+// Like LoadLinuxOptionsFile(), but consults (and fills) a per-directory cache.
+// The return value is a fresh copy of the file, since ReadTokenLine() modifies
+// the buffer it reads; the caller frees both it and its Buffer.
+REFIT_FILE * ReadLinuxOptionsFile(IN CHAR16 *LoaderPath, IN REFIT_VOLUME *Volume) {
+   CHAR16            *Path;
+   UINTN             i;
+   LINUX_OPTIONS_DIR *Dir = NULL;
+   REFIT_FILE        *File = NULL;
+
+   Path = FindPath(LoaderPath);
+   for (i = 0; (i < OptionsDirCount) && (Dir == NULL); i++) {
+      if ((OptionsDirs[i]->Volume == Volume) && (StriCmp(OptionsDirs[i]->Path, Path) == 0))
+         Dir = OptionsDirs[i];
+   } // for
+
+   if (Dir == NULL) {
+      Dir = AllocateZeroPool(sizeof(LINUX_OPTIONS_DIR));
+      if (Dir == NULL) {
+         MyFreePool(Path);
+         return LoadLinuxOptionsFile(LoaderPath, Volume);
+      } // if
+      Dir->Volume = Volume;
+      Dir->Path = Path;
+      Path = NULL;
+      Dir->File = LoadLinuxOptionsFile(LoaderPath, Volume);
+      AddListElement((VOID ***) &OptionsDirs, &OptionsDirCount, Dir);
+   } // if
+   MyFreePool(Path);
+
+   if (Dir->File != NULL) {
+      File = AllocateZeroPool(sizeof(REFIT_FILE));
+      if ((File != NULL) && (SetFileText(File, (UINT8 *) Dir->File->Current16Ptr,
+                                         (UINTN) (Dir->File->End16Ptr - Dir->File->Current16Ptr) * sizeof(CHAR16),
+                                         ENCODING_UTF16_LE) != EFI_SUCCESS)) {
+         FreePool(File);
+         File = NULL;
+      } // if
+   } // if
    return (File);
-} // static REFIT_FILE * ReadLinuxOptionsFile()
+} // REFIT_FILE * ReadLinuxOptionsFile()
+
+static VOID FreeLinuxOptionsDir(IN VOID *Element) {
+   LINUX_OPTIONS_DIR *Dir = (LINUX_OPTIONS_DIR *) Element;
+
+   if (Dir->File != NULL) {
+      MyFreePool(Dir->File->Buffer);
+      MyFreePool(Dir->File);
+   } // if
+   MyFreePool(Dir->Path);
+   MyFreePool(Dir);
+} // static VOID FreeLinuxOptionsDir()
+
+// Discard the options files cached by ReadLinuxOptionsFile(). Must be called
+// before the volume list is rebuilt, since the cache is keyed on volume pointers.
+VOID FreeLinuxOptionsCache(VOID) {
+   FreeListWith((VOID ***) &OptionsDirs, &OptionsDirCount, FreeLinuxOptionsDir);
+} // VOID FreeLinuxOptionsCache()
 
 // Retrieve a single line of options from a Linux kernel options file
 CHAR16 * GetFirstOptionsFromFile(IN CHAR16 *LoaderPath, IN REFIT_VOLUME *Volume) {
@@ -1065,6 +1404,7 @@ CHAR16 * GetFirstOptionsFromFile(IN CHAR16 *LoaderPath, IN REFIT_VOLUME *Volume)
       if (TokenCount > 1)
          Options = StrDuplicate(TokenList[1]);
       FreeTokenLine(&TokenList, &TokenCount);
+      MyFreePool(File->Buffer);
       FreePool(File);
    } // if
    return Options;
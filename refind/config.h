@@ -66,6 +66,7 @@ typedef struct {
     CHAR8   *End8Ptr;
     CHAR16  *Current16Ptr;
     CHAR16  *End16Ptr;
+    CHAR16  **TokenBuffer;   // within Buffer; see ReadTokenLine()
 } REFIT_FILE;
 
 #define HIDEUI_FLAG_NONE       (0x0000)
@@ -91,6 +92,7 @@ VOID ScanUserConfigured(CHAR16 *FileName);
 UINTN ReadTokenLine(IN REFIT_FILE *File, OUT CHAR16 ***TokenList);
 VOID FreeTokenLine(IN OUT CHAR16 ***TokenList, IN OUT UINTN *TokenCount);
 REFIT_FILE * ReadLinuxOptionsFile(IN CHAR16 *LoaderPath, IN REFIT_VOLUME *Volume);
+VOID FreeLinuxOptionsCache(VOID);
 CHAR16 * GetFirstOptionsFromFile(IN CHAR16 *LoaderPath, IN REFIT_VOLUME *Volume);
 
 #endif
@@ -0,0 +1,273 @@
+/*
+ * refind/driver_manifest.c
+ * Record of which drivers served which filesystems
+ *
+ * Copyright (c) 2014 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+// If the driver_manifest option is set, rEFInd keeps a record, in a
+// non-volatile EFI variable (DriverManifest, with rEFInd's GUID), of what
+// each driver it loaded turned out to manage: volumes holding particular
+// types of filesystem (as identified by ScanVolumes(), and so stored as a
+// bit mask of FS_TYPE_* codes), or anything else, such as a disk controller.
+// It also records all the types of filesystem that were present then. On
+// the next boot, LoadDrivers() loads drivers that managed anything but
+// volumes, drivers that managed nothing at all (which may be controller
+// drivers whose hardware was absent), and drivers that aren't in the record
+// unconditionally, and before the rest, so that their disks can be found.
+// It loads filesystem drivers only if a type of filesystem they served
+// before is present -- unless there's now a type of filesystem that wasn't
+// present before, in which case they're all loaded, so that the record can
+// be brought up to date. FS_TYPE_* detection is coarse, though: ISO-9660,
+// NTFS and others come out as FS_TYPE_UNKNOWN, and an NTFS boot sector
+// passes for FAT. So a filesystem driver that served either of those types
+// is always loaded. The variable holds a comma-delimited list of
+// "name=value" items: ":types=<mask>" for the filesystems present, and
+// "<driver filename>=<mask>" or "<driver filename>=*" for each driver. It's
+// rewritten only when it changes.
+
+#include "driver_manifest.h"
+#include "driver_support.h"
+#include "lib.h"
+#include "../include/refit_call_wrapper.h"
+
+#ifdef __MAKEWITH_TIANO
+#define FileSystemProtocol gEfiSimpleFileSystemProtocolGuid
+#endif
+
+#define DRIVER_MANIFEST_TYPES L":types"
+
+// Types that say too little about a volume to decide whether a driver that
+// served one is needed
+#define DRIVER_MANIFEST_VAGUE_TYPES ((1 << FS_TYPE_UNKNOWN) | (1 << FS_TYPE_FAT))
+
+typedef struct {
+   CHAR16   *Name;         // driver's filename
+   BOOLEAN  InManifest;    // read from the manifest or learned on this boot
+   BOOLEAN  IsDevice;      // managed something other than a volume
+   UINT32   Types;         // bit (1 << FS_TYPE_*) for each type of volume it served
+   BOOLEAN  Loaded;        // loaded on this boot
+} DRIVER_RECORD;
+
+static DRIVER_RECORD **DriverRecords = NULL;
+static UINTN         DriverRecordCount = 0;
+static UINT32        KnownTypes = 0;
+static CHAR16        *StoredManifest = NULL;
+
+// Returns the record for DriverName, creating an empty one if it doesn't
+// exist and Create is TRUE.
+static DRIVER_RECORD * FindDriverRecord(IN CHAR16 *DriverName, IN BOOLEAN Create) {
+   DRIVER_RECORD  *Record;
+   UINTN          i;
+
+   if (DriverName == NULL)
+      return NULL;
+   for (i = 0; i < DriverRecordCount; i++) {
+      if (StriCmp(DriverRecords[i]->Name, DriverName) == 0)
+         return DriverRecords[i];
+   } // for
+   if (!Create)
+      return NULL;
+
+   Record = AllocateZeroPool(sizeof(DRIVER_RECORD));
+   if (Record != NULL) {
+      Record->Name = StrDuplicate(DriverName);
+      AddListElement((VOID ***) &DriverRecords, &DriverRecordCount, Record);
+   } // if
+   return Record;
+} // static DRIVER_RECORD * FindDriverRecord()
+
+// Reads the manifest saved on the last boot, if there is one.
+VOID DriverManifestRead(VOID) {
+   EFI_STATUS     Status;
+   CHAR16         *Buffer = NULL, *Item, *Value;
+   UINTN          Size = 0, i = 0, j;
+   DRIVER_RECORD  *Record;
+   EFI_GUID       RefindGuid = REFIND_GUID_VALUE;
+
+   Status = EfivarGetRaw(&RefindGuid, DRIVER_MANIFEST_VARIABLE_NAME, (CHAR8 **) &Buffer, &Size);
+   if (EFI_ERROR(Status))
+      return;
+
+   // Copy it, to be sure it's null-terminated
+   MyFreePool(StoredManifest);
+   StoredManifest = AllocateZeroPool(Size + sizeof(CHAR16));
+   if (StoredManifest != NULL)
+      CopyMem(StoredManifest, Buffer, Size);
+   MyFreePool(Buffer);
+
+   while ((Item = FindCommaDelimited(StoredManifest, i++)) != NULL) {
+      for (j = 0; (Item[j] != L'\0') && (Item[j] != L'='); j++)
+         ;
+      if (Item[j] == L'=') {
+         Item[j] = L'\0';
+         Value = Item + j + 1;
+         if (StrCmp(Item, DRIVER_MANIFEST_TYPES) == 0) {
+            KnownTypes = (UINT32) StrToHex(Value, 0, 8);
+         } else if ((Record = FindDriverRecord(Item, TRUE)) != NULL) {
+            Record->InManifest = TRUE;
+            if (StrCmp(Value, L"*") == 0)
+               Record->IsDevice = TRUE;
+            else
+               Record->Types = (UINT32) StrToHex(Value, 0, 8);
+         } // if/else
+      } // if
+      MyFreePool(Item);
+   } // while
+} // VOID DriverManifestRead()
+
+// Returns one of the DRIVER_CLASS_* codes for DriverName. A driver that
+// managed nothing on the boot that saved the manifest is of unknown class,
+// since it may be a controller driver whose device was missing then.
+UINTN DriverManifestClass(IN CHAR16 *DriverName) {
+   DRIVER_RECORD *Record;
+
+   Record = FindDriverRecord(DriverName, FALSE);
+   if ((Record == NULL) || !Record->InManifest)
+      return DRIVER_CLASS_UNKNOWN;
+   if (Record->IsDevice)
+      return DRIVER_CLASS_DEVICE;
+   return (Record->Types != 0) ? DRIVER_CLASS_FILESYSTEM : DRIVER_CLASS_UNKNOWN;
+} // UINTN DriverManifestClass()
+
+// Returns TRUE if every type of filesystem in PresentTypes (a mask of
+// (1 << FS_TYPE_*) bits) was present when the manifest was saved, so that
+// it's known which drivers, if any, serve them.
+BOOLEAN DriverManifestCovers(IN UINT32 PresentTypes) {
+   return ((StoredManifest != NULL) && ((PresentTypes & ~KnownTypes) == 0));
+} // BOOLEAN DriverManifestCovers()
+
+// Returns TRUE if DriverName served a type of filesystem in PresentTypes, or
+// if the manifest can't rule out that it's needed because it served one of
+// the DRIVER_MANIFEST_VAGUE_TYPES.
+BOOLEAN DriverManifestServes(IN CHAR16 *DriverName, IN UINT32 PresentTypes) {
+   DRIVER_RECORD *Record;
+
+   Record = FindDriverRecord(DriverName, FALSE);
+   if (Record == NULL)
+      return FALSE;
+   if (Record->Types & DRIVER_MANIFEST_VAGUE_TYPES)
+      return TRUE;
+   return ((Record->Types & PresentTypes) != 0);
+} // BOOLEAN DriverManifestServes()
+
+// Notes that DriverName has been loaded on this boot, so that
+// DriverManifestUpdate() will record what it manages.
+VOID DriverManifestNoteLoaded(IN CHAR16 *DriverName) {
+   DRIVER_RECORD *Record;
+
+   if (!GlobalConfig.DriverManifest)
+      return;
+   Record = FindDriverRecord(DriverName, TRUE);
+   if (Record != NULL)
+      Record->Loaded = TRUE;
+} // VOID DriverManifestNoteLoaded()
+
+// Returns the record of the driver that opened a protocol with AgentHandle.
+// Most drivers install their Driver Binding protocol on their own image
+// handle, so the image's file name is taken from there.
+static DRIVER_RECORD * RecordForAgent(IN EFI_HANDLE AgentHandle) {
+   EFI_STATUS        Status;
+   EFI_LOADED_IMAGE  *Image;
+   CHAR16            *Path;
+   DRIVER_RECORD     *Record = NULL;
+
+   Status = refit_call3_wrapper(BS->HandleProtocol, AgentHandle, &LoadedImageProtocol, (VOID **) &Image);
+   if (EFI_ERROR(Status) || (Image->FilePath == NULL))
+      return NULL;
+   Path = DevicePathToStr(Image->FilePath);
+   if (Path != NULL) {
+      Record = FindDriverRecord(Basename(Path), FALSE);
+      MyFreePool(Path);
+   } // if
+   return Record;
+} // static DRIVER_RECORD * RecordForAgent()
+
+// Returns the volume whose device handle is Handle, if it holds a
+// filesystem, or NULL if there's no such volume.
+static REFIT_VOLUME * FilesystemVolumeForHandle(IN EFI_HANDLE Handle) {
+   EFI_STATUS  Status;
+   VOID        *FileSystem;
+   UINTN       i;
+
+   Status = refit_call3_wrapper(BS->HandleProtocol, Handle, &FileSystemProtocol, &FileSystem);
+   if (EFI_ERROR(Status))
+      return NULL;
+   for (i = 0; i < VolumesCount; i++) {
+      if (Volumes[i]->DeviceHandle == Handle)
+         return Volumes[i];
+   } // for
+   return NULL;
+} // static REFIT_VOLUME * FilesystemVolumeForHandle()
+
+// After ScanVolumes(), records what each driver loaded on this boot manages,
+// along with the types of filesystem now present, and saves the manifest if
+// anything has changed. Drivers that weren't loaded keep their old records.
+VOID DriverManifestUpdate(VOID) {
+   EFI_STATUS     Status;
+   EFI_HANDLE     *Controllers, *Agents;
+   UINTN          PairCount, i;
+   BOOLEAN        AnyLoaded = FALSE;
+   DRIVER_RECORD  *Record;
+   REFIT_VOLUME   *Volume;
+   CHAR16         *Manifest, *Item;
+   EFI_GUID       RefindGuid = REFIND_GUID_VALUE;
+
+   for (i = 0; i < DriverRecordCount; i++) {
+      if (DriverRecords[i]->Loaded) {
+         DriverRecords[i]->InManifest = TRUE;
+         DriverRecords[i]->IsDevice = FALSE;
+         DriverRecords[i]->Types = 0;
+         AnyLoaded = TRUE;
+      } // if
+   } // for
+   if (!AnyLoaded)
+      return;
+
+   Status = LibListManagedControllers(&PairCount, &Controllers, &Agents);
+   if (EFI_ERROR(Status))
+      return;
+   for (i = 0; i < PairCount; i++) {
+      Record = RecordForAgent(Agents[i]);
+      if ((Record == NULL) || !Record->Loaded)
+         continue;
+      Volume = FilesystemVolumeForHandle(Controllers[i]);
+      if (Volume != NULL)
+         Record->Types |= (1 << Volume->FSType);
+      else
+         Record->IsDevice = TRUE;
+   } // for
+   MyFreePool(Controllers);
+   MyFreePool(Agents);
+
+   KnownTypes = 0;
+   for (i = 0; i < VolumesCount; i++)
+      KnownTypes |= (1 << Volumes[i]->FSType);
+
+   Manifest = PoolPrint(L"%s=%x", DRIVER_MANIFEST_TYPES, KnownTypes);
+   for (i = 0; (i < DriverRecordCount) && (Manifest != NULL); i++) {
+      Record = DriverRecords[i];
+      if (!Record->InManifest)
+         continue;
+      if (Record->IsDevice)
+         Item = PoolPrint(L"%s=*", Record->Name);
+      else
+         Item = PoolPrint(L"%s=%x", Record->Name, Record->Types);
+      MergeStrings(&Manifest, Item, L',');
+      MyFreePool(Item);
+   } // for
+
+   if ((Manifest != NULL) && ((StoredManifest == NULL) || (StrCmp(Manifest, StoredManifest) != 0))) {
+      EfivarSetRaw(&RefindGuid, DRIVER_MANIFEST_VARIABLE_NAME, (CHAR8 *) Manifest, StrSize(Manifest), TRUE);
+      MyFreePool(StoredManifest);
+      StoredManifest = Manifest;
+   } else {
+      MyFreePool(Manifest);
+   } // if/else
+} // VOID DriverManifestUpdate()
@@ -0,0 +1,40 @@
+/*
+ * refind/driver_manifest.h
+ * Record of which drivers served which filesystems
+ *
+ * Copyright (c) 2014 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+#include "global.h"
+
+#ifndef __DRIVER_MANIFEST_H_
+#define __DRIVER_MANIFEST_H_
+
+#ifdef __MAKEWITH_GNUEFI
+#include "efi.h"
+#include "efilib.h"
+#else
+#include "../include/tiano_includes.h"
+#endif
+
+#define DRIVER_MANIFEST_VARIABLE_NAME L"DriverManifest"
+
+// What DriverManifestClass() knows of a driver
+#define DRIVER_CLASS_UNKNOWN     0   // not in the manifest, or managed nothing
+#define DRIVER_CLASS_DEVICE      1   // managed something other than a volume
+#define DRIVER_CLASS_FILESYSTEM  2   // managed volumes, and nothing else
+
+VOID DriverManifestRead(VOID);
+UINTN DriverManifestClass(IN CHAR16 *DriverName);
+BOOLEAN DriverManifestCovers(IN UINT32 PresentTypes);
+BOOLEAN DriverManifestServes(IN CHAR16 *DriverName, IN UINT32 PresentTypes);
+VOID DriverManifestNoteLoaded(IN CHAR16 *DriverName);
+VOID DriverManifestUpdate(VOID);
+
+#endif
@@ -249,3 +249,282 @@ Error:
 
   return Status;
 } /* EFI_STATUS LibScanHandleDatabase() */
+
+//
+// Hash table mapping handles to their positions in a handle buffer, used by
+// LibClassifyHandleDatabase() to resolve OpenProtocolInformation() results
+// without a linear search of the whole buffer for each one.
+//
+
+static
+UINTN
+HandleHashSlot (
+  EFI_HANDLE  Handle,
+  UINTN       TableSize
+  )
+{
+  UINT64  Key;
+
+  Key = (UINT64) (UINTN) Handle;
+  Key ^= Key >> 17;
+  Key *= 0x9E3779B97F4A7C15ULL;
+  return (UINTN) (Key >> 32) & (TableSize - 1);
+}
+
+static
+UINTN
+FindHandleIndex (
+  EFI_HANDLE  Handle,
+  EFI_HANDLE  *HandleBuffer,
+  UINT32      *Table,
+  UINTN       TableSize
+  )
+{
+  UINTN  Slot;
+
+  for (Slot = HandleHashSlot (Handle, TableSize); Table[Slot] != 0; Slot = (Slot + 1) & (TableSize - 1)) {
+    if (HandleBuffer[Table[Slot] - 1] == Handle) {
+      return Table[Slot] - 1;
+    }
+  }
+  return (UINTN) -1;
+}
+
+//
+// Classify every handle in the handle database in a single pass. Unlike
+// LibScanHandleDatabase(), which answers questions about one controller or
+// driver and so must be called once per handle, this makes one
+// ProtocolsPerHandle() call per handle and one OpenProtocolInformation() call
+// per protocol instance, and records for each handle:
+//   EFI_HANDLE_TYPE_IMAGE_HANDLE, EFI_HANDLE_TYPE_DRIVER_BINDING_HANDLE,
+//   EFI_HANDLE_TYPE_DRIVER_CONFIGURATION_HANDLE,
+//   EFI_HANDLE_TYPE_DRIVER_DIAGNOSTICS_HANDLE,
+//   EFI_HANDLE_TYPE_COMPONENT_NAME_HANDLE -- the handle carries that protocol;
+//   EFI_HANDLE_TYPE_DEVICE_HANDLE -- the handle carries a device path;
+//   EFI_HANDLE_TYPE_PARENT_HANDLE -- a bus driver has opened one of the
+//     handle's protocols on behalf of a child controller;
+//   EFI_HANDLE_TYPE_CHILD_HANDLE -- the handle is such a child controller.
+// The caller must free *HandleBuffer and *HandleType.
+//
+EFI_STATUS
+LibClassifyHandleDatabase (
+  UINTN       *HandleCount,
+  EFI_HANDLE  **HandleBuffer,
+  UINT32      **HandleType
+  )
+{
+  EFI_STATUS                          Status;
+  UINTN                               HandleIndex;
+  UINTN                               ChildIndex;
+  EFI_GUID                            **ProtocolGuidArray;
+  UINTN                               ArrayCount;
+  UINTN                               ProtocolIndex;
+  EFI_OPEN_PROTOCOL_INFORMATION_ENTRY *OpenInfo;
+  UINTN                               OpenInfoCount;
+  UINTN                               OpenInfoIndex;
+  UINT32                              *Table;
+  UINTN                               TableSize;
+  UINTN                               Slot;
+
+  *HandleCount  = 0;
+  *HandleBuffer = NULL;
+  *HandleType   = NULL;
+
+  Status = refit_call5_wrapper(BS->LocateHandleBuffer,
+     AllHandles,
+     NULL,
+     NULL,
+     HandleCount,
+     HandleBuffer
+  );
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  TableSize = 64;
+  while (TableSize < *HandleCount * 2) {
+    TableSize <<= 1;
+  }
+  *HandleType = AllocateZeroPool (*HandleCount * sizeof (UINT32));
+  Table = AllocateZeroPool (TableSize * sizeof (UINT32));
+  if ((*HandleType == NULL) || (Table == NULL)) {
+    MyFreePool (Table);
+    MyFreePool (*HandleType);
+    MyFreePool (*HandleBuffer);
+    *HandleCount  = 0;
+    *HandleBuffer = NULL;
+    *HandleType   = NULL;
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  for (HandleIndex = 0; HandleIndex < *HandleCount; HandleIndex++) {
+    Slot = HandleHashSlot ((*HandleBuffer)[HandleIndex], TableSize);
+    while (Table[Slot] != 0) {
+      Slot = (Slot + 1) & (TableSize - 1);
+    }
+    Table[Slot] = (UINT32) (HandleIndex + 1);
+  }
+
+  for (HandleIndex = 0; HandleIndex < *HandleCount; HandleIndex++) {
+    Status = refit_call3_wrapper(BS->ProtocolsPerHandle,
+                  (*HandleBuffer)[HandleIndex],
+                  &ProtocolGuidArray,
+                  &ArrayCount
+                  );
+    if (EFI_ERROR (Status)) {
+      continue;
+    }
+
+    for (ProtocolIndex = 0; ProtocolIndex < ArrayCount; ProtocolIndex++) {
+      if (CompareGuid (ProtocolGuidArray[ProtocolIndex], &gEfiLoadedImageProtocolGuid) == 0) {
+        (*HandleType)[HandleIndex] |= EFI_HANDLE_TYPE_IMAGE_HANDLE;
+      } else if (CompareGuid (ProtocolGuidArray[ProtocolIndex], &gEfiDriverBindingProtocolGuid) == 0) {
+        (*HandleType)[HandleIndex] |= EFI_HANDLE_TYPE_DRIVER_BINDING_HANDLE;
+      } else if (CompareGuid (ProtocolGuidArray[ProtocolIndex], &gEfiDriverConfigurationProtocolGuid) == 0) {
+        (*HandleType)[HandleIndex] |= EFI_HANDLE_TYPE_DRIVER_CONFIGURATION_HANDLE;
+      } else if (CompareGuid (ProtocolGuidArray[ProtocolIndex], &gEfiDriverDiagnosticsProtocolGuid) == 0) {
+        (*HandleType)[HandleIndex] |= EFI_HANDLE_TYPE_DRIVER_DIAGNOSTICS_HANDLE;
+      } else if (CompareGuid (ProtocolGuidArray[ProtocolIndex], &gEfiComponentNameProtocolGuid) == 0) {
+        (*HandleType)[HandleIndex] |= EFI_HANDLE_TYPE_COMPONENT_NAME_HANDLE;
+      } else if (CompareGuid (ProtocolGuidArray[ProtocolIndex], &gEfiDevicePathProtocolGuid) == 0) {
+        (*HandleType)[HandleIndex] |= EFI_HANDLE_TYPE_DEVICE_HANDLE;
+      }
+
+      Status = refit_call4_wrapper(BS->OpenProtocolInformation,
+                    (*HandleBuffer)[HandleIndex],
+                    ProtocolGuidArray[ProtocolIndex],
+                    &OpenInfo,
+                    &OpenInfoCount
+                    );
+      if (EFI_ERROR (Status)) {
+        continue;
+      }
+
+      for (OpenInfoIndex = 0; OpenInfoIndex < OpenInfoCount; OpenInfoIndex++) {
+        if ((OpenInfo[OpenInfoIndex].Attributes & EFI_OPEN_PROTOCOL_BY_CHILD_CONTROLLER) == EFI_OPEN_PROTOCOL_BY_CHILD_CONTROLLER) {
+          (*HandleType)[HandleIndex] |= EFI_HANDLE_TYPE_PARENT_HANDLE;
+          ChildIndex = FindHandleIndex (OpenInfo[OpenInfoIndex].ControllerHandle, *HandleBuffer, Table, TableSize);
+          if (ChildIndex != (UINTN) -1) {
+            (*HandleType)[ChildIndex] |= EFI_HANDLE_TYPE_CHILD_HANDLE;
+          }
+        }
+      }
+      MyFreePool (OpenInfo);
+    }
+    MyFreePool (ProtocolGuidArray);
+  }
+
+  MyFreePool (Table);
+  return EFI_SUCCESS;
+} /* EFI_STATUS LibClassifyHandleDatabase() */
+
+//
+// List every controller that a driver is managing, as found in the handle
+// database: each protocol that a driver has opened BY_DRIVER on a handle
+// yields one (Controllers[i], Agents[i]) pair, where Agents[i] is the handle
+// that the driver opened it with (normally the one its Driver Binding
+// protocol is installed on, which for most drivers is also its image handle).
+// A driver that opens several protocols on the same controller is listed
+// once for it. The caller must free *Controllers and *Agents.
+//
+EFI_STATUS
+LibListManagedControllers (
+  UINTN       *PairCount,
+  EFI_HANDLE  **Controllers,
+  EFI_HANDLE  **Agents
+  )
+{
+  EFI_STATUS                          Status;
+  UINTN                               HandleCount;
+  EFI_HANDLE                          *HandleBuffer;
+  UINTN                               HandleIndex;
+  EFI_GUID                            **ProtocolGuidArray;
+  UINTN                               ArrayCount;
+  UINTN                               ProtocolIndex;
+  EFI_OPEN_PROTOCOL_INFORMATION_ENTRY *OpenInfo;
+  UINTN                               OpenInfoCount;
+  UINTN                               OpenInfoIndex;
+  UINTN                               AgentCount;
+  UINTN                               PairIndex;
+  UINTN                               FirstPair;
+  BOOLEAN                             OutOfMemory;
+
+  *PairCount   = 0;
+  *Controllers = NULL;
+  *Agents      = NULL;
+  AgentCount   = 0;
+  OutOfMemory  = FALSE;
+
+  Status = refit_call5_wrapper(BS->LocateHandleBuffer,
+     AllHandles,
+     NULL,
+     NULL,
+     &HandleCount,
+     &HandleBuffer
+  );
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  for (HandleIndex = 0; HandleIndex < HandleCount; HandleIndex++) {
+    Status = refit_call3_wrapper(BS->ProtocolsPerHandle,
+                  HandleBuffer[HandleIndex],
+                  &ProtocolGuidArray,
+                  &ArrayCount
+                  );
+    if (EFI_ERROR (Status)) {
+      continue;
+    }
+
+    FirstPair = *PairCount;
+    for (ProtocolIndex = 0; ProtocolIndex < ArrayCount; ProtocolIndex++) {
+      Status = refit_call4_wrapper(BS->OpenProtocolInformation,
+                    HandleBuffer[HandleIndex],
+                    ProtocolGuidArray[ProtocolIndex],
+                    &OpenInfo,
+                    &OpenInfoCount
+                    );
+      if (EFI_ERROR (Status)) {
+        continue;
+      }
+
+      for (OpenInfoIndex = 0; OpenInfoIndex < OpenInfoCount; OpenInfoIndex++) {
+        if ((OpenInfo[OpenInfoIndex].Attributes & EFI_OPEN_PROTOCOL_BY_DRIVER) != EFI_OPEN_PROTOCOL_BY_DRIVER) {
+          continue;
+        }
+        for (PairIndex = FirstPair; PairIndex < *PairCount; PairIndex++) {
+          if ((*Agents)[PairIndex] == OpenInfo[OpenInfoIndex].AgentHandle) {
+            break;
+          }
+        }
+        if (PairIndex == *PairCount) {
+          AddListElement ((VOID ***) Controllers, PairCount, HandleBuffer[HandleIndex]);
+          AddListElement ((VOID ***) Agents, &AgentCount, OpenInfo[OpenInfoIndex].AgentHandle);
+          if ((AgentCount == 0) || (AgentCount != *PairCount)) {
+            OutOfMemory = TRUE;
+            break;
+          }
+        }
+      }
+      MyFreePool (OpenInfo);
+      if (OutOfMemory) {
+        break;
+      }
+    }
+    MyFreePool (ProtocolGuidArray);
+    if (OutOfMemory) {
+      break;
+    }
+  }
+
+  MyFreePool (HandleBuffer);
+  if (OutOfMemory) {
+    MyFreePool (*Controllers);
+    MyFreePool (*Agents);
+    *PairCount   = 0;
+    *Controllers = NULL;
+    *Agents      = NULL;
+    return EFI_OUT_OF_RESOURCES;
+  }
+  return EFI_SUCCESS;
+} /* EFI_STATUS LibListManagedControllers() */
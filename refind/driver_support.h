@@ -41,6 +41,20 @@ LibScanHandleDatabase (
   UINT32      **HandleType
   );
 
+EFI_STATUS
+LibClassifyHandleDatabase (
+  UINTN       *HandleCount,
+  EFI_HANDLE  **HandleBuffer,
+  UINT32      **HandleType
+  );
+
+EFI_STATUS
+LibListManagedControllers (
+  UINTN       *PairCount,
+  EFI_HANDLE  **Controllers,
+  EFI_HANDLE  **Agents
+  );
+
 
 #define EFI_HANDLE_TYPE_UNKNOWN                     0x000
 #define EFI_HANDLE_TYPE_IMAGE_HANDLE                0x001
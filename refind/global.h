@@ -219,6 +219,8 @@ typedef struct _refit_menu_screen {
    CHAR16      *TimeoutText;
    CHAR16      *Hint1;
    CHAR16      *Hint2;
+   UINTN       InfoLineCapacity; // sizes of the InfoLines and Entries arrays
+   UINTN       EntryCapacity;
 } REFIT_MENU_SCREEN;
 
 typedef struct {
@@ -232,6 +234,9 @@ typedef struct {
    CHAR16           *LoadOptions;
    CHAR16           *InitrdPath; // Linux stub loader only
    CHAR8            OSType;
+   REFIT_VOLUME     *Volume;
+   BOOLEAN          OptionsPending;   // LoadOptions not yet read from disk
+   BOOLEAN          SubScreenPending; // SubScreen not yet generated
 } LOADER_ENTRY;
 
 typedef struct {
@@ -242,10 +247,41 @@ typedef struct {
    BOOLEAN           Enabled;
 } LEGACY_ENTRY;
 
+// A comma-delimited list of names (or of volume, path and filename
+// specifications), split and hashed once by CompileNameList() for quick
+// membership tests; see lib.c.
+#define NAME_LIST_BUCKETS 32
+
+typedef struct _name_list_item {
+   CHAR16                  *VolName;   // NULL if the element names no volume
+   CHAR16                  *Path;      // NULL if the element names no path
+   CHAR16                  *Filename;  // NULL if the element names no file
+   struct _name_list_item  *Next;      // next item in the same bucket
+} NAME_LIST_ITEM;
+
+typedef struct {
+   UINTN            Count;
+   NAME_LIST_ITEM   *Items;              // in list order
+   NAME_LIST_ITEM   *Buckets[NAME_LIST_BUCKETS];
+   NAME_LIST_ITEM   *Unkeyed;            // items without a hashable component
+} NAME_LIST;
+
+// An open-addressed hash table of GUIDs, each mapped to a caller-supplied
+// value; see GuidIndexAdd() in lib.c. The index holds pointers to the keys,
+// not copies, so they must outlive it.
+typedef struct {
+   EFI_GUID   **Keys;
+   VOID       **Values;
+   UINTN      Size;       // number of slots; zero or a power of two
+   UINTN      Count;
+} GUID_INDEX;
+
 typedef struct {
    BOOLEAN     TextOnly;
    BOOLEAN     ScanAllLinux;
    BOOLEAN     DeepLegacyScan;
+   BOOLEAN     CacheIcons;
+   BOOLEAN     CacheScans;
    UINTN       RequestedScreenWidth;
    UINTN       RequestedScreenHeight;
    UINTN       BannerBottomEdge;
@@ -274,6 +310,12 @@ typedef struct {
    CHAR16      *IconsDir;
    UINTN       ShowTools[NUM_TOOLS];
    CHAR8       ScanFor[NUM_SCAN_OPTIONS]; // codes of types of loaders for which to scan
+   NAME_LIST   AlsoScanList;              // compiled forms of the above strings, by ReadConfig()
+   NAME_LIST   DontScanVolumesList;
+   NAME_LIST   DontScanDirsList;
+   NAME_LIST   DontScanFilesList;
+   UINTN       BootTimeReport;            // BOOT_TIME_REPORT_* flags
+   BOOLEAN     DriverManifest;            // load filesystem drivers only as needed
 } REFIT_CONFIG;
 
 // Global variables
@@ -296,6 +338,7 @@ extern EFI_GUID gEfiGlobalVariableGuid;
 LOADER_ENTRY *InitializeLoaderEntry(IN LOADER_ENTRY *Entry);
 REFIT_MENU_SCREEN *InitializeSubScreen(IN LOADER_ENTRY *Entry);
 VOID GenerateSubScreen(LOADER_ENTRY *Entry, IN REFIT_VOLUME *Volume);
+VOID FinishLoaderEntry(IN OUT LOADER_ENTRY *Entry);
 LOADER_ENTRY * MakeGenericLoaderEntry(VOID);
 LOADER_ENTRY * AddLoaderEntry(IN CHAR16 *LoaderPath, IN CHAR16 *LoaderTitle, IN REFIT_VOLUME *Volume);
 VOID SetLoaderDefaults(LOADER_ENTRY *Entry, CHAR16 *LoaderPath, IN REFIT_VOLUME *Volume);
@@ -23,6 +23,11 @@
 
 extern GPT_DATA *gPartitions;
 
+// Every named partition in gPartitions, by partition GUID, for
+// PartNameFromGuid(); kept up to date by AddPartitionTable() and
+// ForgetPartitionTables().
+static GUID_INDEX PartitionIndex;
+
 // Allocate data for the main GPT_DATA structure, as well as the ProtectiveMBR
 // and Header structures it contains. This function does *NOT*, however,
 // allocate memory for the Entries data structure, since its size is variable
@@ -137,14 +142,12 @@ EFI_STATUS ReadGptData(REFIT_VOLUME *Volume, GPT_DATA **Data) {
 
    // Read the MBR and store it in GptData->ProtectiveMBR.
    if (Status == EFI_SUCCESS) {
-      Status = refit_call5_wrapper(Volume->BlockIO->ReadBlocks, Volume->BlockIO, Volume->BlockIO->Media->MediaId,
-                                   0, sizeof(MBR_RECORD), (VOID*) GptData->ProtectiveMBR);
+      Status = ReadDiskCached(Volume->BlockIO, 0, sizeof(MBR_RECORD), (VOID*) GptData->ProtectiveMBR);
    }
 
    // Read the GPT header and store it in GptData->Header.
    if (Status == EFI_SUCCESS) {
-      Status = refit_call5_wrapper(Volume->BlockIO->ReadBlocks, Volume->BlockIO, Volume->BlockIO->Media->MediaId,
-                                   1, sizeof(GPT_HEADER), GptData->Header);
+      Status = ReadDiskCached(Volume->BlockIO, 1, sizeof(GPT_HEADER), GptData->Header);
    }
 
    // If it looks like a valid protective MBR & GPT header, try to do more with it....
@@ -157,8 +160,7 @@ EFI_STATUS ReadGptData(REFIT_VOLUME *Volume, GPT_DATA **Data) {
             Status = EFI_OUT_OF_RESOURCES;
 
          if (Status == EFI_SUCCESS)
-            Status = refit_call5_wrapper(Volume->BlockIO->ReadBlocks, Volume->BlockIO, Volume->BlockIO->Media->MediaId,
-                                         GptData->Header->entry_lba, BufferSize, GptData->Entries);
+            Status = ReadDiskCached(Volume->BlockIO, GptData->Header->entry_lba, (UINTN) BufferSize, GptData->Entries);
 
          // Check CRC status of table
          if ((Status == EFI_SUCCESS) && (crc32(0x0, GptData->Entries, BufferSize) != GptData->Header->entry_crc32))
@@ -189,31 +191,32 @@ EFI_STATUS ReadGptData(REFIT_VOLUME *Volume, GPT_DATA **Data) {
 // a pointer to that partition's name string. If not found, return a NULL pointer.
 // The calling function is responsible for freeing the returned memory.
 CHAR16 * PartNameFromGuid(EFI_GUID *Guid) {
-   UINTN     i;
-   CHAR16    *Found = NULL;
-   GPT_DATA  *GptData;
+   GPT_ENTRY *Entry;
 
-   if ((Guid == NULL) || (gPartitions == NULL))
+   Entry = (GPT_ENTRY *) GuidIndexFind(&PartitionIndex, Guid);
+   if (Entry == NULL)
       return NULL;
-
-   GptData = gPartitions;
-   while ((GptData != NULL) && (!Found)) {
-      i = 0;
-      while ((i < GptData->Header->entry_count) && (!Found)) {
-         if (GuidsAreEqual((EFI_GUID*) &(GptData->Entries[i].partition_guid), Guid))
-            Found = StrDuplicate(GptData->Entries[i].name);
-         else
-            i++;
-      } // while(scanning entries)
-      GptData = GptData->NextEntry;
-   } // while(scanning GPTs)
-   return Found;
+   return StrDuplicate(Entry->name);
 } // CHAR16 * PartNameFromGuid()
 
+// Add the partitions in GptData to PartitionIndex. Unused entries (which all
+// have a null partition GUID) are left out. If two disks hold a partition
+// with the same GUID, the first one added wins.
+static VOID IndexPartitions(GPT_DATA *GptData) {
+   UINTN    i;
+   EFI_GUID NullGuid = NULL_GUID_VALUE;
+
+   for (i = 0; i < GptData->Header->entry_count; i++) {
+      if (!GuidsAreEqual((EFI_GUID*) &(GptData->Entries[i].partition_guid), &NullGuid))
+         GuidIndexAdd(&PartitionIndex, (EFI_GUID*) &(GptData->Entries[i].partition_guid), &(GptData->Entries[i]));
+   } // for
+} // static VOID IndexPartitions()
+
 // Erase the gPartitions linked-list data structure
 VOID ForgetPartitionTables(VOID) {
    GPT_DATA  *Next;
 
+   FreeGuidIndex(&PartitionIndex);
    while (gPartitions != NULL) {
       Next = gPartitions->NextEntry;
       ClearGptData(gPartitions);
@@ -241,6 +244,7 @@ VOID AddPartitionTable(REFIT_VOLUME *Volume) {
          GptList->NextEntry = GptData;
          NumTables++;
       } // if/else
+      IndexPartitions(GptData);
    } else if (GptData != NULL) {
       ClearGptData(GptData);
       NumTables = 0;
@@ -89,9 +89,12 @@ EG_IMAGE * BuiltinIcon(IN UINTN Id)
 // Load an OS icon from among the comma-delimited list provided in OSIconName.
 // Searches for icons with extensions in the ICON_EXTENSIONS list (via
 // egFindIcon()).
-// Returns image data. On failure, returns an ugly "dummy" icon.
+// Returns image data. On failure, returns an ugly "dummy" icon. The returned
+// image is shared with other entries (it comes from egFindIcon()'s cache or
+// from a single shared dummy), so callers must not free it.
 EG_IMAGE * LoadOSIcon(IN CHAR16 *OSIconName OPTIONAL, IN CHAR16 *FallbackIconName, BOOLEAN BootLogo)
 {
+    static EG_IMAGE *DummyOSImage = NULL;
     EG_IMAGE        *Image = NULL;
     CHAR16          *CutoutName, BaseName[256];
     UINTN           Index = 0;
@@ -117,9 +120,13 @@ EG_IMAGE * LoadOSIcon(IN CHAR16 *OSIconName OPTIONAL, IN CHAR16 *FallbackIconNam
        Image = egFindIcon(BaseName, GlobalConfig.IconSizes[ICON_SIZE_BIG]);
     }
 
-    // If all of these fail, return the dummy image....
-    if (Image == NULL)
-       Image = DummyImage(GlobalConfig.IconSizes[ICON_SIZE_BIG]);
+    // If all of these fail, return the dummy image. An older dummy of another
+    // size is not freed, since earlier entries may still refer to it....
+    if (Image == NULL) {
+       if ((DummyOSImage == NULL) || (DummyOSImage->Width != GlobalConfig.IconSizes[ICON_SIZE_BIG]))
+          DummyOSImage = DummyImage(GlobalConfig.IconSizes[ICON_SIZE_BIG]);
+       Image = DummyOSImage;
+    }
 
     return Image;
 } /* EG_IMAGE * LoadOSIcon() */
@@ -49,6 +49,8 @@
 #include "../include/refit_call_wrapper.h"
 #include "../include/RemovableMedia.h"
 #include "gpt.h"
+#include "boottime.h"
+#include "bootsig.h"
 
 #ifdef __MAKEWITH_GNUEFI
 #define EfiReallocatePool ReallocatePool
@@ -88,9 +90,6 @@ REFIT_VOLUME     **Volumes = NULL;
 UINTN            VolumesCount = 0;
 extern GPT_DATA *gPartitions;
 
-// Maximum size for disk sectors
-#define SECTOR_SIZE 4096
-
 // Number of bytes to read from a partition to determine its filesystem type
 // and identify its boot loader, and hence probable BIOS-mode OS installation
 #define SAMPLE_SIZE 69632 /* 68 KiB -- ReiserFS superblock begins at 64 KiB */
@@ -204,7 +203,7 @@ VOID UninitRefitLib(VOID)
 {
     // This piece of code was made to correspond to weirdness in ReinitRefitLib().
     // See the comment on it there.
-    if(SelfRootDir == SelfVolume->RootDir)
+    if (SelfVolume && SelfRootDir == SelfVolume->RootDir)
         SelfRootDir=0;
 
     UninitVolumes();
@@ -303,48 +302,29 @@ EFI_STATUS EfivarSetRaw(EFI_GUID *vendor, CHAR16 *name, CHAR8 *buf, UINTN size,
 } // EFI_STATUS EfivarSetRaw()
 
 //
-// list functions
+// timing
 //
 
-VOID CreateList(OUT VOID ***ListPtr, OUT UINTN *ElementCount, IN UINTN InitialElementCount)
-{
-    UINTN AllocateCount;
+// Returns a millisecond timestamp from the real-time clock, suitable for
+// measuring elapsed time over short intervals (not across a month boundary).
+// Many firmware clocks report whole seconds only, so short intervals may read
+// as 0 ms.
+UINT64 TimeStampMs(VOID) {
+   EFI_TIME Now;
 
-    *ElementCount = InitialElementCount;
-    if (*ElementCount > 0) {
-        AllocateCount = (*ElementCount + 7) & ~7;   // next multiple of 8
-        *ListPtr = AllocatePool(sizeof(VOID *) * AllocateCount);
-    } else {
-        *ListPtr = NULL;
-    }
-}
-
-VOID AddListElement(IN OUT VOID ***ListPtr, IN OUT UINTN *ElementCount, IN VOID *NewElement)
-{
-    UINTN AllocateCount;
+   if (EFI_ERROR(refit_call2_wrapper(RT->GetTime, &Now, NULL)))
+      return 0;
+   return ((((UINT64) Now.Day * 24 + Now.Hour) * 60 + Now.Minute) * 60 + Now.Second) * 1000 +
+          Now.Nanosecond / 1000000;
+} // UINT64 TimeStampMs()
 
-    if ((*ElementCount & 7) == 0) {
-        AllocateCount = *ElementCount + 8;
-        if (*ElementCount == 0)
-            *ListPtr = AllocatePool(sizeof(VOID *) * AllocateCount);
-        else
-            *ListPtr = EfiReallocatePool(*ListPtr, sizeof(VOID *) * (*ElementCount), sizeof(VOID *) * AllocateCount);
-    }
-    (*ListPtr)[*ElementCount] = NewElement;
-    (*ElementCount)++;
-} /* VOID AddListElement() */
+//
+// list functions
+//
 
 VOID FreeList(IN OUT VOID ***ListPtr, IN OUT UINTN *ElementCount)
 {
-    UINTN i;
-
-    if ((*ElementCount > 0) && (**ListPtr != NULL)) {
-        for (i = 0; i < *ElementCount; i++) {
-            // TODO: call a user-provided routine for each element here
-            MyFreePool((*ListPtr)[i]);
-        }
-        MyFreePool(*ListPtr);
-    }
+    FreeListWith(ListPtr, ElementCount, MyFreePool);
 } // VOID FreeList()
 
 //
@@ -539,6 +519,169 @@ static VOID SetFilesystemData(IN UINT8 *Buffer, IN UINTN BufferSize, IN OUT REFI
 
 } // UINT32 SetFilesystemData()
 
+//
+// disk metadata cache
+//
+
+// While ScanVolumes() runs, the same few sectors would otherwise be read
+// over and over: each disk's MBR and GPT by ReadGptData(), its boot code
+// sample by ScanVolumeBootcode(), its extended partition tables, and the
+// first sector of each partition (through both the partition's BlockIO and
+// the whole disk's) while matching MBR entries to volumes. ReadDiskCached()
+// keeps everything it reads, keyed on the BlockIO protocol and media ID, so
+// that each of these is read from the disk once per scan. The first read at
+// the start of a device fetches DISK_CACHE_HEAD_SIZE bytes in one go; that
+// covers the MBR, the GPT header and (for a standard 128-entry table) the
+// GPT entries, as well as the boot code sample.
+// Entries are keyed on pointers and media IDs that a rescan can't trust, so
+// the cache lives no longer than one pass of ScanVolumes(), which empties it
+// both on entry and on exit. The one exception is the start-up scan, which
+// follows LoadDrivers() directly: main() passes KeepDiskCache = TRUE so that
+// the sectors FilesystemTypesPresent() read for the driver manifest are
+// reused rather than read again.
+
+#define DISK_CACHE_HEAD_SIZE SAMPLE_SIZE
+
+typedef struct {
+   EFI_BLOCK_IO   *BlockIO;
+   UINT32         MediaId;
+   EFI_LBA        Lba;
+   UINTN          Size;   // bytes; a multiple of the block size
+   UINT8          *Data;
+} DISK_CACHE_ENTRY;
+
+static DISK_CACHE_ENTRY **DiskCache = NULL;
+static UINTN            DiskCacheCount = 0;
+
+// Returns the cached data for Size bytes at block Lba of BlockIO, or NULL if
+// no cache entry covers all of them.
+static UINT8 * FindDiskCacheData(IN EFI_BLOCK_IO *BlockIO, IN EFI_LBA Lba, IN UINTN Size)
+{
+   DISK_CACHE_ENTRY  *Entry;
+   UINT32            BlockSize = BlockIO->Media->BlockSize;
+   UINTN             i, Offset;
+
+   for (i = 0; i < DiskCacheCount; i++) {
+      Entry = DiskCache[i];
+      if ((Entry->BlockIO != BlockIO) || (Entry->MediaId != BlockIO->Media->MediaId) ||
+          (Lba < Entry->Lba) || (Lba - Entry->Lba >= Entry->Size / BlockSize))
+         continue;
+      Offset = (UINTN) (Lba - Entry->Lba) * BlockSize;
+      if (Size <= Entry->Size - Offset)
+         return Entry->Data + Offset;
+   } // for
+   return NULL;
+} // static UINT8 * FindDiskCacheData()
+
+// Reads Size bytes, starting at block Lba, from BlockIO into Buffer, going
+// to the disk only if this data hasn't been read since the cache was last
+// emptied. Unlike ReadBlocks(), Size need not be a multiple of the block
+// size; whole blocks are read and the excess discarded.
+EFI_STATUS ReadDiskCached(IN EFI_BLOCK_IO *BlockIO, IN EFI_LBA Lba, IN UINTN Size, OUT VOID *Buffer)
+{
+   EFI_STATUS        Status;
+   DISK_CACHE_ENTRY  *Entry;
+   UINT8             *Data;
+   UINT32            BlockSize;
+   UINTN             ReadSize, MinReadSize;
+
+   if ((BlockIO == NULL) || (Buffer == NULL) || (Size == 0) || (BlockIO->Media->BlockSize == 0))
+      return EFI_INVALID_PARAMETER;
+
+   Data = FindDiskCacheData(BlockIO, Lba, Size);
+   if (Data != NULL) {
+      CopyMem(Buffer, Data, Size);
+      return EFI_SUCCESS;
+   } // if
+
+   BlockSize = BlockIO->Media->BlockSize;
+   ReadSize = MinReadSize = ((Size + BlockSize - 1) / BlockSize) * BlockSize;
+   if ((Lba == 0) && (ReadSize < DISK_CACHE_HEAD_SIZE)) {
+      // Fetch the whole head of the device, if it's that big
+      ReadSize = ((DISK_CACHE_HEAD_SIZE + BlockSize - 1) / BlockSize) * BlockSize;
+      if (ReadSize / BlockSize > BlockIO->Media->LastBlock + 1)
+         ReadSize = MinReadSize;
+   } // if
+
+   Data = AllocatePool(ReadSize);
+   if (Data == NULL)
+      return EFI_OUT_OF_RESOURCES;
+   Status = refit_call5_wrapper(BlockIO->ReadBlocks, BlockIO, BlockIO->Media->MediaId, Lba, ReadSize, Data);
+   if (EFI_ERROR(Status) && (ReadSize > MinReadSize)) {
+      // Some devices fail a read this big (or one that reaches a bad block
+      // that the caller never asked for), so fall back to what was requested.
+      ReadSize = MinReadSize;
+      Status = refit_call5_wrapper(BlockIO->ReadBlocks, BlockIO, BlockIO->Media->MediaId, Lba, ReadSize, Data);
+   } // if
+   if (EFI_ERROR(Status)) {
+      MyFreePool(Data);
+      return Status;
+   } // if
+   CopyMem(Buffer, Data, Size);
+
+   Entry = AllocatePool(sizeof(DISK_CACHE_ENTRY));
+   if (Entry == NULL) {
+      MyFreePool(Data);
+      return EFI_SUCCESS;
+   } // if
+   Entry->BlockIO = BlockIO;
+   Entry->MediaId = BlockIO->Media->MediaId;
+   Entry->Lba = Lba;
+   Entry->Size = ReadSize;
+   Entry->Data = Data;
+   AddListElement((VOID ***) &DiskCache, &DiskCacheCount, Entry);
+   return EFI_SUCCESS;
+} // EFI_STATUS ReadDiskCached()
+
+static VOID FreeDiskCacheEntry(IN VOID *Element)
+{
+   DISK_CACHE_ENTRY *Entry = (DISK_CACHE_ENTRY *) Element;
+
+   MyFreePool(Entry->Data);
+   MyFreePool(Entry);
+} // static VOID FreeDiskCacheEntry()
+
+// Empties the disk metadata cache.
+VOID FreeDiskCache(VOID)
+{
+   FreeListWith((VOID ***) &DiskCache, &DiskCacheCount, FreeDiskCacheEntry);
+} // VOID FreeDiskCache()
+
+// Returns a bit mask with bit (1 << FS_TYPE_*) set for each type of
+// filesystem on the block devices that are present now. Like ScanVolumes(),
+// this identifies filesystems by their superblocks, so it needs no
+// filesystem drivers; LoadDrivers() uses it to decide which ones to load.
+UINT32 FilesystemTypesPresent(VOID)
+{
+   EFI_STATUS    Status;
+   EFI_HANDLE    *Handles;
+   EFI_BLOCK_IO  *BlockIO;
+   UINTN         HandleCount = 0, i;
+   UINT8         *Buffer;
+   REFIT_VOLUME  Volume;
+   UINT32        Types = 0;
+
+   Status = LibLocateHandle(ByProtocol, &BlockIoProtocol, NULL, &HandleCount, &Handles);
+   if (EFI_ERROR(Status))
+      return 0;
+
+   Buffer = AllocatePool(SAMPLE_SIZE);
+   if (Buffer != NULL) {
+      for (i = 0; i < HandleCount; i++) {
+         Status = refit_call3_wrapper(BS->HandleProtocol, Handles[i], &BlockIoProtocol, (VOID **) &BlockIO);
+         if (EFI_ERROR(Status) || (BlockIO->Media->BlockSize > SAMPLE_SIZE))
+            continue;
+         if (ReadDiskCached(BlockIO, 0, SAMPLE_SIZE, Buffer) == EFI_SUCCESS) {
+            SetFilesystemData(Buffer, SAMPLE_SIZE, &Volume);
+            Types |= (1 << Volume.FSType);
+         } // if
+      } // for
+      MyFreePool(Buffer);
+   } // if
+   MyFreePool(Handles);
+   return Types;
+} // UINT32 FilesystemTypesPresent()
+
 static VOID ScanVolumeBootcode(REFIT_VOLUME *Volume, BOOLEAN *Bootable)
 {
     EFI_STATUS              Status;
@@ -558,102 +701,11 @@ static VOID ScanVolumeBootcode(REFIT_VOLUME *Volume, BOOLEAN *Bootable)
         return;   // our buffer is too small...
 
     // look at the boot sector (this is used for both hard disks and El Torito images!)
-    Status = refit_call5_wrapper(Volume->BlockIO->ReadBlocks,
-                                 Volume->BlockIO, Volume->BlockIO->Media->MediaId,
-                                 Volume->BlockIOOffset, SAMPLE_SIZE, Buffer);
+    Status = ReadDiskCached(Volume->BlockIO, Volume->BlockIOOffset, SAMPLE_SIZE, Buffer);
     if (!EFI_ERROR(Status)) {
 
         SetFilesystemData(Buffer, SAMPLE_SIZE, Volume);
-        if ((*((UINT16 *)(Buffer + 510)) == 0xaa55 && Buffer[0] != 0) && (FindMem(Buffer, 512, "EXFAT", 5) == -1)) {
-            *Bootable = TRUE;
-            Volume->HasBootCode = TRUE;
-        }
-
-        // detect specific boot codes
-        if (CompareMem(Buffer + 2, "LILO", 4) == 0 ||
-            CompareMem(Buffer + 6, "LILO", 4) == 0 ||
-            CompareMem(Buffer + 3, "SYSLINUX", 8) == 0 ||
-            FindMem(Buffer, SECTOR_SIZE, "ISOLINUX", 8) >= 0) {
-            Volume->HasBootCode = TRUE;
-            Volume->OSIconName = L"linux";
-            Volume->OSName = L"Linux";
-
-        } else if (FindMem(Buffer, 512, "Geom\0Hard Disk\0Read\0 Error", 26) >= 0) {   // GRUB
-            Volume->HasBootCode = TRUE;
-            Volume->OSIconName = L"grub,linux";
-            Volume->OSName = L"Linux";
-
-//         // Below doesn't produce a bootable entry, so commented out for the moment....
-//         // GRUB in BIOS boot partition:
-//         } else if (FindMem(Buffer, 512, "Geom\0Read\0 Error", 16) >= 0) {
-//             Volume->HasBootCode = TRUE;
-//             Volume->OSIconName = L"grub,linux";
-//             Volume->OSName = L"Linux";
-//             Volume->VolName = L"BIOS Boot Partition";
-//             *Bootable = TRUE;
-
-        } else if ((*((UINT32 *)(Buffer + 502)) == 0 &&
-                    *((UINT32 *)(Buffer + 506)) == 50000 &&
-                    *((UINT16 *)(Buffer + 510)) == 0xaa55) ||
-                    FindMem(Buffer, SECTOR_SIZE, "Starting the BTX loader", 23) >= 0) {
-            Volume->HasBootCode = TRUE;
-            Volume->OSIconName = L"freebsd";
-            Volume->OSName = L"FreeBSD";
-
-        } else if (FindMem(Buffer, 512, "!Loading", 8) >= 0 ||
-                   FindMem(Buffer, SECTOR_SIZE, "/cdboot\0/CDBOOT\0", 16) >= 0) {
-            Volume->HasBootCode = TRUE;
-            Volume->OSIconName = L"openbsd";
-            Volume->OSName = L"OpenBSD";
-
-        } else if (FindMem(Buffer, 512, "Not a bootxx image", 18) >= 0 ||
-                   *((UINT32 *)(Buffer + 1028)) == 0x7886b6d1) {
-            Volume->HasBootCode = TRUE;
-            Volume->OSIconName = L"netbsd";
-            Volume->OSName = L"NetBSD";
-
-        } else if (FindMem(Buffer, SECTOR_SIZE, "NTLDR", 5) >= 0) {
-            Volume->HasBootCode = TRUE;
-            Volume->OSIconName = L"win";
-            Volume->OSName = L"Windows";
-
-        } else if (FindMem(Buffer, SECTOR_SIZE, "BOOTMGR", 7) >= 0) {
-            Volume->HasBootCode = TRUE;
-            Volume->OSIconName = L"winvista,win";
-            Volume->OSName = L"Windows";
-
-        } else if (FindMem(Buffer, 512, "CPUBOOT SYS", 11) >= 0 ||
-                   FindMem(Buffer, 512, "KERNEL  SYS", 11) >= 0) {
-            Volume->HasBootCode = TRUE;
-            Volume->OSIconName = L"freedos";
-            Volume->OSName = L"FreeDOS";
-
-        } else if (FindMem(Buffer, 512, "OS2LDR", 6) >= 0 ||
-                   FindMem(Buffer, 512, "OS2BOOT", 7) >= 0) {
-            Volume->HasBootCode = TRUE;
-            Volume->OSIconName = L"ecomstation";
-            Volume->OSName = L"eComStation";
-
-        } else if (FindMem(Buffer, 512, "Be Boot Loader", 14) >= 0) {
-            Volume->HasBootCode = TRUE;
-            Volume->OSIconName = L"beos";
-            Volume->OSName = L"BeOS";
-
-        } else if (FindMem(Buffer, 512, "yT Boot Loader", 14) >= 0) {
-            Volume->HasBootCode = TRUE;
-            Volume->OSIconName = L"zeta,beos";
-            Volume->OSName = L"ZETA";
-
-        } else if (FindMem(Buffer, 512, "\x04" "beos\x06" "system\x05" "zbeos", 18) >= 0 ||
-                   FindMem(Buffer, 512, "\x06" "system\x0c" "haiku_loader", 20) >= 0) {
-            Volume->HasBootCode = TRUE;
-            Volume->OSIconName = L"haiku,beos";
-            Volume->OSName = L"Haiku";
-
-        }
-
-        // NOTE: If you add an operating system with a name that starts with 'W' or 'L', you
-        //  need to fix AddLegacyEntry in main.c.
+        IdentifyBootCode(Buffer, &Volume->HasBootCode, Bootable, &Volume->OSIconName, &Volume->OSName);
 
 #if REFIT_DEBUG > 0
         Print(L"  Result of bootcode detection: %s %s (%s)\n",
@@ -661,18 +713,6 @@ static VOID ScanVolumeBootcode(REFIT_VOLUME *Volume, BOOLEAN *Bootable)
               Volume->OSName, Volume->OSIconName);
 #endif
 
-        // dummy FAT boot sector (created by OS X's newfs_msdos)
-        if (FindMem(Buffer, 512, "Non-system disk", 15) >= 0)
-            Volume->HasBootCode = FALSE;
-
-        // dummy FAT boot sector (created by Linux's mkdosfs)
-        if (FindMem(Buffer, 512, "This is not a bootable disk", 27) >= 0)
-            Volume->HasBootCode = FALSE;
-
-        // dummy FAT boot sector (created by Windows)
-        if (FindMem(Buffer, 512, "Press any key to restart", 24) >= 0)
-            Volume->HasBootCode = FALSE;
-
         // check for MBR partition table
         if (*((UINT16 *)(Buffer + 510)) == 0xaa55) {
             MbrTable = (MBR_PARTITION_INFO *)(Buffer + 446);
@@ -699,7 +739,8 @@ static VOID ScanVolumeBootcode(REFIT_VOLUME *Volume, BOOLEAN *Bootable)
 VOID SetVolumeBadgeIcon(REFIT_VOLUME *Volume)
 {
    if (Volume->VolBadgeImage == NULL) {
-      Volume->VolBadgeImage = egLoadIconAnyType(Volume->RootDir, L"", L".VolumeBadge", GlobalConfig.IconSizes[ICON_SIZE_BADGE]);
+      Volume->VolBadgeImage = ScanArenaKeepImage(egLoadIconAnyType(Volume->RootDir, L"", L".VolumeBadge",
+                                                                   GlobalConfig.IconSizes[ICON_SIZE_BADGE]));
    }
 
    if (Volume->VolBadgeImage == NULL) {
@@ -953,7 +994,8 @@ VOID ScanVolume(REFIT_VOLUME *Volume)
 
     // get custom volume icons if present
     if (!Volume->VolIconImage)
-       Volume->VolIconImage = egLoadIconAnyType(Volume->RootDir, L"", L".VolumeIcon", GlobalConfig.IconSizes[ICON_SIZE_BIG]);
+       Volume->VolIconImage = ScanArenaKeepImage(egLoadIconAnyType(Volume->RootDir, L"", L".VolumeIcon",
+                                                                   GlobalConfig.IconSizes[ICON_SIZE_BIG]));
 } // ScanVolume()
 
 static VOID ScanExtendedPartition(REFIT_VOLUME *WholeDiskVolume, MBR_PARTITION_INFO *MbrEntry)
@@ -971,10 +1013,7 @@ static VOID ScanExtendedPartition(REFIT_VOLUME *WholeDiskVolume, MBR_PARTITION_I
 
     for (ExtCurrent = ExtBase; ExtCurrent; ExtCurrent = NextExtCurrent) {
         // read current EMBR
-      Status = refit_call5_wrapper(WholeDiskVolume->BlockIO->ReadBlocks,
-                                   WholeDiskVolume->BlockIO,
-                                   WholeDiskVolume->BlockIO->Media->MediaId,
-                                   ExtCurrent, 512, SectorBuffer);
+        Status = ReadDiskCached(WholeDiskVolume->BlockIO, ExtCurrent, 512, SectorBuffer);
         if (EFI_ERROR(Status))
             break;
         if (*((UINT16 *)(SectorBuffer + 510)) != 0xaa55)
@@ -1018,7 +1057,31 @@ static VOID ScanExtendedPartition(REFIT_VOLUME *WholeDiskVolume, MBR_PARTITION_I
     }
 } /* VOID ScanExtendedPartition() */
 
-VOID ScanVolumes(VOID)
+// Releases a volume from a previous ScanVolumes() pass. OSIconName and OSName
+// point to string literals, and the icon and badge images are either built-in
+// icons or were handed to the scan arena (which the rescan has already
+// emptied, along with the menu entries that showed them), so those are left
+// alone. The root directory is kept open if
+// ReinitRefitLib() has adopted it as SelfRootDir.
+static VOID FreeVolume(IN VOID *Element)
+{
+    REFIT_VOLUME *Volume = (REFIT_VOLUME *) Element;
+
+    if (Volume == NULL)
+        return;
+    if ((Volume->RootDir != NULL) && (Volume->RootDir != SelfRootDir))
+        refit_call1_wrapper(Volume->RootDir->Close, Volume->RootDir);
+    MyFreePool(Volume->DevicePath);
+    MyFreePool(Volume->WholeDiskDevicePath);
+    MyFreePool(Volume->MbrPartitionTable);
+    MyFreePool(Volume->VolName);
+    MyFreePool(Volume->PartName);
+    MyFreePool(Volume);
+} // static VOID FreeVolume()
+
+// Builds the Volumes list from every BlockIO handle. Unless KeepDiskCache is
+// TRUE, the disk metadata cache is emptied first (see ReadDiskCached()).
+VOID ScanVolumes(IN BOOLEAN KeepDiskCache)
 {
     EFI_STATUS              Status;
     EFI_HANDLE              *Handles;
@@ -1028,19 +1091,19 @@ VOID ScanVolumes(VOID)
     UINTN                   HandleIndex;
     UINTN                   VolumeIndex, VolumeIndex2;
     UINTN                   PartitionIndex;
-    UINTN                   SectorSum, i, VolNumber = 0;
+    UINTN                   SectorSum, i, VolNumber = 0, TimingId;
     UINT8                   *SectorBuffer1, *SectorBuffer2;
-    EFI_GUID                *UuidList;
+    GUID_INDEX              UuidSet;
     EFI_GUID                NullUuid = NULL_GUID_VALUE;
 
-    MyFreePool(Volumes);
-    Volumes = NULL;
-    VolumesCount = 0;
+    FreeListWith((VOID ***) &Volumes, &VolumesCount, FreeVolume);
+    SelfVolume = NULL;
     ForgetPartitionTables();
+    if (!KeepDiskCache)
+        FreeDiskCache();
 
     // get all filesystem handles
     Status = LibLocateHandle(ByProtocol, &BlockIoProtocol, NULL, &HandleCount, &Handles);
-    UuidList = AllocateZeroPool(sizeof(EFI_GUID) * HandleCount);
     if (Status == EFI_NOT_FOUND) {
         return;  // no filesystems. strange, but true...
     }
@@ -1048,19 +1111,17 @@ VOID ScanVolumes(VOID)
         return;
 
     // first pass: collect information about all handles
+    ZeroMem(&UuidSet, sizeof(GUID_INDEX));
     for (HandleIndex = 0; HandleIndex < HandleCount; HandleIndex++) {
         Volume = AllocateZeroPool(sizeof(REFIT_VOLUME));
         Volume->DeviceHandle = Handles[HandleIndex];
+        TimingId = BootTimeBegin(L"ScanVolume", NULL);
         AddPartitionTable(Volume);
         ScanVolume(Volume);
-        if (UuidList) {
-           UuidList[HandleIndex] = Volume->VolUuid;
-           for (i = 0; i < HandleIndex; i++) {
-              if ((CompareMem(&(Volume->VolUuid), &(UuidList[i]), sizeof(EFI_GUID)) == 0) &&
-                  (CompareMem(&(Volume->VolUuid), &NullUuid, sizeof(EFI_GUID)) != 0)) { // Duplicate filesystem UUID
-                 Volume->IsReadable = FALSE;
-              } // if
-           } // for
+        BootTimeEnd(TimingId, Volume->VolName);
+        if (!GuidsAreEqual(&(Volume->VolUuid), &NullUuid) &&
+            (GuidIndexAdd(&UuidSet, &(Volume->VolUuid), Volume) == EFI_ALREADY_STARTED)) { // Duplicate filesystem UUID
+           Volume->IsReadable = FALSE;
         } // if
         if (Volume->IsReadable)
            Volume->VolNumber = VolNumber++;
@@ -1073,6 +1134,7 @@ VOID ScanVolumes(VOID)
             SelfVolume = Volume;
     }
     MyFreePool(Handles);
+    FreeGuidIndex(&UuidSet);
 
     if (SelfVolume == NULL)
         Print(L"WARNING: SelfVolume not found");
@@ -1115,14 +1177,10 @@ VOID ScanVolumes(VOID)
                     continue;
 
                 // compare boot sector read through offset vs. directly
-                Status = refit_call5_wrapper(Volume->BlockIO->ReadBlocks,
-                                             Volume->BlockIO, Volume->BlockIO->Media->MediaId,
-                                             Volume->BlockIOOffset, 512, SectorBuffer1);
+                Status = ReadDiskCached(Volume->BlockIO, Volume->BlockIOOffset, 512, SectorBuffer1);
                 if (EFI_ERROR(Status))
                     break;
-                Status = refit_call5_wrapper(Volume->WholeDiskBlockIO->ReadBlocks,
-                                             Volume->WholeDiskBlockIO, Volume->WholeDiskBlockIO->Media->MediaId,
-                                             MbrTable[PartitionIndex].StartLBA, 512, SectorBuffer2);
+                Status = ReadDiskCached(Volume->WholeDiskBlockIO, MbrTable[PartitionIndex].StartLBA, 512, SectorBuffer2);
                 if (EFI_ERROR(Status))
                     break;
                 if (CompareMem(SectorBuffer1, SectorBuffer2, 512) != 0)
@@ -1149,6 +1207,8 @@ VOID ScanVolumes(VOID)
             MyFreePool(SectorBuffer2);
         }
     } // for
+
+    FreeDiskCache();
 } /* VOID ScanVolumes() */
 
 static VOID UninitVolumes(VOID)
@@ -1362,12 +1422,28 @@ static VOID StrLwr (IN OUT CHAR16 *Str) {
 
 #endif
 
+// Returns TRUE if DirEntry is a file whose name matches any of the
+// comma-delimited patterns in FilePattern.
+static BOOLEAN DirEntryMatches(IN EFI_FILE_INFO *DirEntry, IN CHAR16 *FilePattern)
+{
+    BOOLEAN Found = FALSE;
+    UINTN   i = 0;
+    CHAR16  *OnePattern;
+
+    if (DirEntry->Attribute & EFI_FILE_DIRECTORY)
+        return TRUE;
+    while (!Found && (OnePattern = FindCommaDelimited(FilePattern, i++)) != NULL) {
+        if (MetaiMatch(DirEntry->FileName, OnePattern))
+            Found = TRUE;
+        MyFreePool(OnePattern);
+    } // while
+    return Found;
+} // static BOOLEAN DirEntryMatches()
+
 BOOLEAN DirIterNext(IN OUT REFIT_DIR_ITER *DirIter, IN UINTN FilterMode, IN CHAR16 *FilePattern OPTIONAL,
                     OUT EFI_FILE_INFO **DirEntry)
 {
     BOOLEAN KeepGoing = TRUE;
-    UINTN   i;
-    CHAR16  *OnePattern;
 
     if (DirIter->LastFileInfo != NULL) {
        FreePool(DirIter->LastFileInfo);
@@ -1384,13 +1460,7 @@ BOOLEAN DirIterNext(IN OUT REFIT_DIR_ITER *DirIter, IN UINTN FilterMode, IN CHAR
         if (DirIter->LastFileInfo == NULL)  // end of listing
             return FALSE;
         if (FilePattern != NULL) {
-            if ((DirIter->LastFileInfo->Attribute & EFI_FILE_DIRECTORY))
-                KeepGoing = FALSE;
-            i = 0;
-            while (KeepGoing && (OnePattern = FindCommaDelimited(FilePattern, i++)) != NULL) {
-               if (MetaiMatch(DirIter->LastFileInfo->FileName, OnePattern))
-                   KeepGoing = FALSE;
-            } // while
+            KeepGoing = !DirEntryMatches(DirIter->LastFileInfo, FilePattern);
             // else continue loop
         } else
             break;
@@ -1411,6 +1481,204 @@ EFI_STATUS DirIterClose(IN OUT REFIT_DIR_ITER *DirIter)
    return DirIter->LastStatus;
 }
 
+// Read the whole of a directory (or, with FilterMode 1 or 2, only its
+// subdirectories or files, as with DirNextEntry()) into Snapshot. The
+// snapshot's LastStatus holds what DirIterClose() would have returned.
+// The caller must release the snapshot with DirSnapshotFree().
+VOID DirSnapshotRead(IN EFI_FILE *BaseDir, IN CHAR16 *RelativePath OPTIONAL, IN UINTN FilterMode, OUT REFIT_DIR_SNAPSHOT *Snapshot)
+{
+   REFIT_DIR_ITER DirIter;
+   EFI_FILE_INFO  *DirEntry;
+
+   Snapshot->EntryCount = 0;
+   Snapshot->Entries = NULL;
+
+   DirIterOpen(BaseDir, RelativePath, &DirIter);
+   while (!EFI_ERROR(DirIter.LastStatus)) {
+      DirEntry = NULL;
+      DirIter.LastStatus = DirNextEntry(DirIter.DirHandle, &DirEntry, FilterMode);
+      if (DirEntry == NULL)
+         break;
+      AddListElement((VOID ***) &(Snapshot->Entries), &(Snapshot->EntryCount), DirEntry);
+   } // while
+   Snapshot->LastStatus = DirIterClose(&DirIter);
+} // VOID DirSnapshotRead()
+
+// Returns the next entry at or after *Index that matches FilePattern (or any
+// entry, if FilePattern is NULL), in the manner of DirIterNext(). The returned
+// entry belongs to the snapshot and must not be freed.
+BOOLEAN DirSnapshotNext(IN REFIT_DIR_SNAPSHOT *Snapshot, IN OUT UINTN *Index, IN CHAR16 *FilePattern OPTIONAL,
+                        OUT EFI_FILE_INFO **DirEntry)
+{
+   while (*Index < Snapshot->EntryCount) {
+      *DirEntry = Snapshot->Entries[(*Index)++];
+      if ((FilePattern == NULL) || DirEntryMatches(*DirEntry, FilePattern))
+         return TRUE;
+   } // while
+   return FALSE;
+} // BOOLEAN DirSnapshotNext()
+
+// Returns the snapshot's entry for FileName (case-insensitive), or NULL if
+// there is none.
+EFI_FILE_INFO * DirSnapshotFind(IN REFIT_DIR_SNAPSHOT *Snapshot, IN CHAR16 *FileName)
+{
+   UINTN i;
+
+   for (i = 0; i < Snapshot->EntryCount; i++) {
+      if (StriCmp(Snapshot->Entries[i]->FileName, FileName) == 0)
+         return Snapshot->Entries[i];
+   } // for
+   return NULL;
+} // EFI_FILE_INFO * DirSnapshotFind()
+
+VOID DirSnapshotFree(IN OUT REFIT_DIR_SNAPSHOT *Snapshot)
+{
+   FreeList((VOID ***) &(Snapshot->Entries), &(Snapshot->EntryCount));
+} // VOID DirSnapshotFree()
+
+//
+// per-volume directory listing cache
+//
+
+// Probes for a handful of well-known files (tools, recovery loaders) across
+// every volume would otherwise cost one Open()/Close() pair per name, per
+// location, per volume. Instead, each directory is read at most once per
+// scan, and every later probe in it is answered from that listing. Listings
+// that the loader scan has already made can be handed over with
+// DirCacheStore(). The cache is keyed on volume pointers, so it must be
+// emptied with FreeDirCache() before the volume list is rebuilt.
+
+typedef struct {
+   REFIT_VOLUME        *Volume;
+   CHAR16              *Path;      // as cleaned by CleanUpPathNameSlashes(); L"" for the root
+   REFIT_DIR_SNAPSHOT  Snapshot;   // regular files only
+} DIR_CACHE_ENTRY;
+
+static DIR_CACHE_ENTRY **DirCache = NULL;
+static UINTN           DirCacheCount = 0;
+
+// Returns a cleaned-up copy of the directory name Path, with L"" standing for
+// the root directory.
+static CHAR16 * DirCacheKey(IN CHAR16 *Path OPTIONAL)
+{
+   CHAR16 *Key;
+
+   Key = StrDuplicate((Path != NULL) ? Path : L"");
+   if (Key != NULL) {
+      CleanUpPathNameSlashes(Key);
+      if (StrCmp(Key, L"\\") == 0)
+         Key[0] = 0;
+   } // if
+   return Key;
+} // static CHAR16 * DirCacheKey()
+
+static DIR_CACHE_ENTRY * FindDirCacheEntry(IN REFIT_VOLUME *Volume, IN CHAR16 *Key)
+{
+   UINTN i;
+
+   for (i = 0; i < DirCacheCount; i++) {
+      if ((DirCache[i]->Volume == Volume) && (StriCmp(DirCache[i]->Path, Key) == 0))
+         return DirCache[i];
+   } // for
+   return NULL;
+} // static DIR_CACHE_ENTRY * FindDirCacheEntry()
+
+// Adds Key (which the cache takes over) and the contents of *Snapshot to the
+// cache, leaving *Snapshot empty. Listings that could only be partly read
+// are not cached, since they can't answer "no" reliably.
+static DIR_CACHE_ENTRY * AddDirCacheEntry(IN REFIT_VOLUME *Volume, IN CHAR16 *Key, IN OUT REFIT_DIR_SNAPSHOT *Snapshot)
+{
+   DIR_CACHE_ENTRY *Entry;
+
+   if (EFI_ERROR(Snapshot->LastStatus) && (Snapshot->EntryCount > 0)) {
+      MyFreePool(Key);
+      return NULL;
+   } // if
+   Entry = AllocateZeroPool(sizeof(DIR_CACHE_ENTRY));
+   if (Entry == NULL) {
+      MyFreePool(Key);
+      return NULL;
+   } // if
+   Entry->Volume = Volume;
+   Entry->Path = Key;
+   CopyMem(&(Entry->Snapshot), Snapshot, sizeof(REFIT_DIR_SNAPSHOT));
+   Snapshot->Entries = NULL;
+   Snapshot->EntryCount = 0;
+   AddListElement((VOID ***) &DirCache, &DirCacheCount, Entry);
+   return Entry;
+} // static DIR_CACHE_ENTRY * AddDirCacheEntry()
+
+// Hands a files-only (FilterMode 2) snapshot of Path on Volume to the cache,
+// which takes over its entries; the caller should still pass *Snapshot to
+// DirSnapshotFree(), which is then harmless. Does nothing if Path is already
+// cached.
+VOID DirCacheStore(IN REFIT_VOLUME *Volume, IN CHAR16 *Path OPTIONAL, IN OUT REFIT_DIR_SNAPSHOT *Snapshot)
+{
+   CHAR16 *Key;
+
+   Key = DirCacheKey(Path);
+   if (Key == NULL)
+      return;
+   if (FindDirCacheEntry(Volume, Key) != NULL)
+      MyFreePool(Key);
+   else
+      AddDirCacheEntry(Volume, Key, Snapshot);
+} // VOID DirCacheStore()
+
+// Returns TRUE if the regular file FileName (a full path) exists on Volume.
+// The first probe in a given directory reads that directory; later probes in
+// the same directory are answered from the cached listing.
+BOOLEAN VolumeFileExists(IN REFIT_VOLUME *Volume, IN CHAR16 *FileName)
+{
+   CHAR16             *CleanName, *Name, *Key;
+   DIR_CACHE_ENTRY    *Entry;
+   REFIT_DIR_SNAPSHOT Snapshot;
+   BOOLEAN            Found;
+
+   if ((Volume == NULL) || (Volume->RootDir == NULL) || (FileName == NULL))
+      return FALSE;
+   CleanName = StrDuplicate(FileName);
+   if (CleanName == NULL)
+      return FileExists(Volume->RootDir, FileName);
+   CleanUpPathNameSlashes(CleanName);
+   Name = Basename(CleanName);
+   if (Name > CleanName) {
+      Name[-1] = 0;
+      Key = CleanName;
+   } else {
+      Key = L"";
+   } // if/else
+
+   Entry = FindDirCacheEntry(Volume, Key);
+   if (Entry == NULL) {
+      DirSnapshotRead(Volume->RootDir, (Key[0] != 0) ? Key : NULL, 2, &Snapshot);
+      Entry = AddDirCacheEntry(Volume, StrDuplicate(Key), &Snapshot);
+      DirSnapshotFree(&Snapshot);
+   } // if
+   if (Entry != NULL)
+      Found = (DirSnapshotFind(&(Entry->Snapshot), Name) != NULL);
+   else
+      Found = FileExists(Volume->RootDir, FileName);
+   MyFreePool(CleanName);
+   return Found;
+} // BOOLEAN VolumeFileExists()
+
+static VOID FreeDirCacheEntry(IN VOID *Element)
+{
+   DIR_CACHE_ENTRY *Entry = (DIR_CACHE_ENTRY *) Element;
+
+   DirSnapshotFree(&(Entry->Snapshot));
+   MyFreePool(Entry->Path);
+   MyFreePool(Entry);
+} // static VOID FreeDirCacheEntry()
+
+// Empties the directory listing cache; must be called before the volume list
+// is rebuilt.
+VOID FreeDirCache(VOID)
+{
+   FreeListWith((VOID ***) &DirCache, &DirCacheCount, FreeDirCacheEntry);
+} // VOID FreeDirCache()
+
 //
 // file name manipulation
 //
@@ -1920,38 +2188,6 @@ BOOLEAN IsInSubstring(IN CHAR16 *BigString, IN CHAR16 *List) {
    return Found;
 } // BOOLEAN IsSubstringIn()
 
-// Returns TRUE if specified Volume, Directory, and Filename correspond to an
-// element in the comma-delimited List, FALSE otherwise. Note that Directory and
-// Filename must *NOT* include a volume or path specification (that's part of
-// the Volume variable), but the List elements may. Performs comparison
-// case-insensitively (except on buggy EFIs with case-sensitive StriCmp()
-// functions).
-BOOLEAN FilenameIn(REFIT_VOLUME *Volume, CHAR16 *Directory, CHAR16 *Filename, CHAR16 *List) {
-   UINTN     i = 0;
-   BOOLEAN   Found = FALSE;
-   CHAR16    *OneElement;
-   CHAR16    *TargetVolName = NULL, *TargetPath = NULL, *TargetFilename = NULL;
-
-   if (Filename && List) {
-      while (!Found && (OneElement = FindCommaDelimited(List, i++))) {
-         Found = TRUE;
-         SplitPathName(OneElement, &TargetVolName, &TargetPath, &TargetFilename);
-         VolumeNumberToName(Volume, &TargetVolName);
-         if (((TargetVolName != NULL) && ((Volume == NULL) || (StriCmp(TargetVolName, Volume->VolName) != 0))) ||
-             ((TargetPath != NULL) && (StriCmp(TargetPath, Directory) != 0)) ||
-             ((TargetFilename != NULL) && (StriCmp(TargetFilename, Filename) != 0))) {
-            Found = FALSE;
-         } // if
-         MyFreePool(OneElement);
-      } // while
-   } // if
-
-   MyFreePool(TargetVolName);
-   MyFreePool(TargetPath);
-   MyFreePool(TargetFilename);
-   return Found;
-} // BOOLEAN FilenameIn()
-
 // If *VolName is of the form "fs#", where "#" is a number, and if Volume points
 // to this volume number, returns with *VolName changed to the volume name, as
 // stored in the Volume data structure.
@@ -1974,6 +2210,129 @@ BOOLEAN VolumeNumberToName(REFIT_VOLUME *Volume, CHAR16 **VolName) {
    return MadeSubstitution;
 } // BOOLEAN VolumeMatchesNumber()
 
+// Returns TRUE if VolName identifies Volume, either by name or in the form
+// "fs#", where "#" is Volume's number.
+BOOLEAN VolumeNameMatches(IN REFIT_VOLUME *Volume, IN CHAR16 *VolName) {
+   if ((Volume == NULL) || (VolName == NULL))
+      return FALSE;
+
+   if ((StrLen(VolName) > 2) && (VolName[0] == L'f') && (VolName[1] == L's') && (VolName[2] >= L'0') && (VolName[2] <= L'9') &&
+       (Atoi(VolName + 2) == Volume->VolNumber))
+      return TRUE;
+   return ((Volume->VolName != NULL) && (StriCmp(VolName, Volume->VolName) == 0));
+} // BOOLEAN VolumeNameMatches()
+
+// Case-insensitive hash of Name, reduced to a NAME_LIST bucket number.
+static UINTN NameListBucket(IN CHAR16 *Name) {
+   UINTN  Hash = 0;
+   CHAR16 c;
+
+   while ((c = *Name++) != 0) {
+      if ((c >= L'A') && (c <= L'Z'))
+         c = c - L'A' + L'a';
+      Hash = (Hash * 31) + c;
+   } // while
+   return (Hash % NAME_LIST_BUCKETS);
+} // static UINTN NameListBucket()
+
+// Releases the memory held by a compiled name list and leaves it empty.
+VOID FreeNameList(IN OUT NAME_LIST *Compiled) {
+   UINTN i;
+
+   for (i = 0; i < Compiled->Count; i++) {
+      MyFreePool(Compiled->Items[i].VolName);
+      MyFreePool(Compiled->Items[i].Path);
+      MyFreePool(Compiled->Items[i].Filename);
+   } // for
+   MyFreePool(Compiled->Items);
+   ZeroMem(Compiled, sizeof(NAME_LIST));
+} // VOID FreeNameList()
+
+// Splits the comma-delimited List into *Compiled, replacing its previous
+// contents. Mode tells how to read each element: NAME_LIST_PLAIN elements are
+// taken whole; NAME_LIST_PATHS elements may carry a volume, and have their
+// slashes cleaned up; NAME_LIST_FILES elements are split into volume, path,
+// and filename. Items are hashed on their path (NAME_LIST_PATHS) or filename
+// (otherwise), so that NameListMatch() usually inspects just one of them.
+// Empty elements are dropped.
+VOID CompileNameList(IN CHAR16 *List, IN UINTN Mode, IN OUT NAME_LIST *Compiled) {
+   UINTN           i, Count = 1, Bucket;
+   CHAR16          *Element, *Key;
+   NAME_LIST_ITEM  *Item;
+
+   FreeNameList(Compiled);
+   if ((List == NULL) || (*List == L'\0'))
+      return;
+
+   for (i = 0; List[i] != L'\0'; i++) {
+      if (List[i] == L',')
+         Count++;
+   } // for
+   Compiled->Items = AllocateZeroPool(Count * sizeof(NAME_LIST_ITEM));
+   if (Compiled->Items == NULL)
+      return;
+
+   for (i = 0; (Element = FindCommaDelimited(List, i)) != NULL; i++) {
+      Item = &(Compiled->Items[Compiled->Count]);
+      if (StrLen(Element) == 0) {
+         MyFreePool(Element);
+         continue;
+      } // if
+      if (Mode == NAME_LIST_FILES) {
+         SplitPathName(Element, &(Item->VolName), &(Item->Path), &(Item->Filename));
+         MyFreePool(Element);
+      } else if (Mode == NAME_LIST_PATHS) {
+         SplitVolumeAndFilename(&Element, &(Item->VolName));
+         CleanUpPathNameSlashes(Element);
+         Item->Path = Element;
+      } else {
+         Item->Filename = Element;
+      } // if/else
+      if ((Item->VolName == NULL) && (Item->Path == NULL) && (Item->Filename == NULL))
+         continue;
+
+      Key = (Mode == NAME_LIST_PATHS) ? Item->Path : Item->Filename;
+      if (Key != NULL) {
+         Bucket = NameListBucket(Key);
+         Item->Next = Compiled->Buckets[Bucket];
+         Compiled->Buckets[Bucket] = Item;
+      } else {
+         Item->Next = Compiled->Unkeyed;
+         Compiled->Unkeyed = Item;
+      } // if/else
+      Compiled->Count++;
+   } // for
+} // VOID CompileNameList()
+
+// Returns TRUE if any item in List matches the specified Volume, Directory,
+// and Filename -- that is, if every component the item specifies equals the
+// corresponding argument (case-insensitively). Pass Filename for lists
+// compiled as NAME_LIST_PLAIN or NAME_LIST_FILES, and Directory (with a NULL
+// Filename) for lists compiled as NAME_LIST_PATHS.
+BOOLEAN NameListMatch(IN NAME_LIST *List, IN REFIT_VOLUME *Volume OPTIONAL, IN CHAR16 *Directory OPTIONAL, IN CHAR16 *Filename OPTIONAL) {
+   NAME_LIST_ITEM  *Item;
+   CHAR16          *Key;
+   UINTN           Pass;
+
+   if ((List == NULL) || (List->Count == 0))
+      return FALSE;
+
+   Key = (Filename != NULL) ? Filename : Directory;
+   for (Pass = 0; Pass < 2; Pass++) {
+      if (Pass == 0)
+         Item = (Key != NULL) ? List->Buckets[NameListBucket(Key)] : NULL;
+      else
+         Item = List->Unkeyed;
+      for (; Item != NULL; Item = Item->Next) {
+         if (((Item->VolName == NULL) || VolumeNameMatches(Volume, Item->VolName)) &&
+             ((Item->Path == NULL) || ((Directory != NULL) && (StriCmp(Item->Path, Directory) == 0))) &&
+             ((Item->Filename == NULL) || ((Filename != NULL) && (StriCmp(Item->Filename, Filename) == 0))))
+            return TRUE;
+      } // for
+   } // for
+   return FALSE;
+} // BOOLEAN NameListMatch()
+
 // Implement FreePool the way it should have been done to begin with, so that
 // it doesn't throw an ASSERT message if fed a NULL pointer....
 VOID MyFreePool(IN VOID *Pointer) {
@@ -2115,3 +2474,95 @@ BOOLEAN GuidsAreEqual(EFI_GUID *Guid1, EFI_GUID *Guid2) {
    return (CompareMem(Guid1, Guid2, 16) == 0);
 } // BOOLEAN CompareGuids()
 
+// Returns the first slot of a GUID_INDEX of Size slots to probe for Guid.
+static UINTN GuidIndexSlot(IN EFI_GUID *Guid, IN UINTN Size) {
+   UINT64 Half[2];
+   UINT64 Key;
+
+   CopyMem(Half, Guid, sizeof(Half));
+   Key = Half[0] ^ Half[1];
+   Key ^= Key >> 29;
+   Key *= 0x9E3779B97F4A7C15ULL;
+   return (UINTN) (Key >> 32) & (Size - 1);
+} // static UINTN GuidIndexSlot()
+
+// Doubles the number of slots in Index (or gives it its first ones).
+static EFI_STATUS GrowGuidIndex(IN OUT GUID_INDEX *Index) {
+   EFI_GUID  **OldKeys = Index->Keys;
+   VOID      **OldValues = Index->Values;
+   UINTN     OldSize = Index->Size, NewSize, i, Slot;
+
+   NewSize = (OldSize == 0) ? 64 : OldSize * 2;
+   Index->Keys = AllocateZeroPool(NewSize * sizeof(EFI_GUID *));
+   Index->Values = AllocateZeroPool(NewSize * sizeof(VOID *));
+   if ((Index->Keys == NULL) || (Index->Values == NULL)) {
+      MyFreePool(Index->Keys);
+      MyFreePool(Index->Values);
+      Index->Keys = OldKeys;
+      Index->Values = OldValues;
+      return EFI_OUT_OF_RESOURCES;
+   } // if
+   Index->Size = NewSize;
+   for (i = 0; i < OldSize; i++) {
+      if (OldKeys[i] != NULL) {
+         Slot = GuidIndexSlot(OldKeys[i], NewSize);
+         while (Index->Keys[Slot] != NULL)
+            Slot = (Slot + 1) & (NewSize - 1);
+         Index->Keys[Slot] = OldKeys[i];
+         Index->Values[Slot] = OldValues[i];
+      } // if
+   } // for
+   MyFreePool(OldKeys);
+   MyFreePool(OldValues);
+   return EFI_SUCCESS;
+} // static EFI_STATUS GrowGuidIndex()
+
+// Adds Key to Index, mapped to Value. Returns EFI_ALREADY_STARTED, leaving
+// the index alone, if Key is already in it, so that the first value stored
+// for a GUID is the one that GuidIndexFind() returns, and so that the index
+// can also serve as a set for spotting duplicates. Index must have been
+// zeroed before its first use.
+EFI_STATUS GuidIndexAdd(IN OUT GUID_INDEX *Index, IN EFI_GUID *Key, IN VOID *Value) {
+   UINTN Slot;
+
+   if ((Index == NULL) || (Key == NULL))
+      return EFI_INVALID_PARAMETER;
+   if (GuidIndexFind(Index, Key) != NULL)
+      return EFI_ALREADY_STARTED;
+   if (((Index->Count + 1) * 2 > Index->Size) && EFI_ERROR(GrowGuidIndex(Index)))
+      return EFI_OUT_OF_RESOURCES;
+
+   Slot = GuidIndexSlot(Key, Index->Size);
+   while (Index->Keys[Slot] != NULL)
+      Slot = (Slot + 1) & (Index->Size - 1);
+   Index->Keys[Slot] = Key;
+   Index->Values[Slot] = Value;
+   Index->Count++;
+   return EFI_SUCCESS;
+} // EFI_STATUS GuidIndexAdd()
+
+// Returns the value mapped to Key in Index, or NULL if Key isn't in it.
+// (Values must therefore be non-NULL for the index to tell them apart from
+// missing keys.)
+VOID * GuidIndexFind(IN GUID_INDEX *Index, IN EFI_GUID *Key) {
+   UINTN Slot;
+
+   if ((Index == NULL) || (Key == NULL) || (Index->Size == 0))
+      return NULL;
+   for (Slot = GuidIndexSlot(Key, Index->Size); Index->Keys[Slot] != NULL; Slot = (Slot + 1) & (Index->Size - 1)) {
+      if (GuidsAreEqual(Index->Keys[Slot], Key))
+         return Index->Values[Slot];
+   } // for
+   return NULL;
+} // VOID * GuidIndexFind()
+
+// Releases the memory held by Index and leaves it empty; the keys and values
+// themselves belong to the caller.
+VOID FreeGuidIndex(IN OUT GUID_INDEX *Index) {
+   if (Index != NULL) {
+      MyFreePool(Index->Keys);
+      MyFreePool(Index->Values);
+      ZeroMem(Index, sizeof(GUID_INDEX));
+   } // if
+} // VOID FreeGuidIndex()
+
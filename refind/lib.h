@@ -56,6 +56,8 @@
 #include "global.h"
 
 #include "libeg.h"
+#include "list.h"
+#include "scanarena.h"
 
 //
 // lib module
@@ -70,12 +72,25 @@ typedef struct {
     EFI_FILE_INFO       *LastFileInfo;
 } REFIT_DIR_ITER;
 
+// In-memory copy of a directory's listing, so that several tests can be run
+// against the entries without going back to the filesystem for each one.
+typedef struct {
+    EFI_STATUS          LastStatus;
+    UINTN               EntryCount;
+    EFI_FILE_INFO       **Entries;
+} REFIT_DIR_SNAPSHOT;
+
 #define DISK_KIND_INTERNAL  (0)
 #define DISK_KIND_EXTERNAL  (1)
 #define DISK_KIND_OPTICAL   (2)
 
 #define VOL_UNREADABLE 999
 
+// Ways CompileNameList() can interpret list elements
+#define NAME_LIST_PLAIN     (0)  /* whole element is a name (e.g., a volume name) */
+#define NAME_LIST_PATHS     (1)  /* "[volume:]path" */
+#define NAME_LIST_FILES     (2)  /* "[volume:][path\]filename" */
+
 #define IS_EXTENDED_PART_TYPE(type) ((type) == 0x05 || (type) == 0x0f || (type) == 0x85)
 
 // Partition names to be ignored when setting volume name
@@ -87,15 +102,17 @@ EFI_STATUS ReinitRefitLib(VOID);
 
 EFI_STATUS EfivarGetRaw(EFI_GUID *vendor, CHAR16 *name, CHAR8 **buffer, UINTN *size);
 EFI_STATUS EfivarSetRaw(EFI_GUID *vendor, CHAR16 *name, CHAR8 *buf, UINTN size, BOOLEAN persistent);
+UINT64 TimeStampMs(VOID);
 
 VOID CleanUpPathNameSlashes(IN OUT CHAR16 *PathName);
-VOID CreateList(OUT VOID ***ListPtr, OUT UINTN *ElementCount, IN UINTN InitialElementCount);
-VOID AddListElement(IN OUT VOID ***ListPtr, IN OUT UINTN *ElementCount, IN VOID *NewElement);
 VOID FreeList(IN OUT VOID ***ListPtr, IN OUT UINTN *ElementCount);
 
 VOID ExtractLegacyLoaderPaths(EFI_DEVICE_PATH **PathList, UINTN MaxPaths, EFI_DEVICE_PATH **HardcodedPathList);
 
-VOID ScanVolumes(VOID);
+EFI_STATUS ReadDiskCached(IN EFI_BLOCK_IO *BlockIO, IN EFI_LBA Lba, IN UINTN Size, OUT VOID *Buffer);
+VOID FreeDiskCache(VOID);
+UINT32 FilesystemTypesPresent(VOID);
+VOID ScanVolumes(IN BOOLEAN KeepDiskCache);
 
 BOOLEAN FileExists(IN EFI_FILE *BaseDir, IN CHAR16 *RelativePath);
 BOOLEAN DirectoryExists(IN EFI_FILE *BaseDir, IN CHAR16 *RelativePath);
@@ -106,6 +123,14 @@ VOID DirIterOpen(IN EFI_FILE *BaseDir, IN CHAR16 *RelativePath OPTIONAL, OUT REF
 BOOLEAN DirIterNext(IN OUT REFIT_DIR_ITER *DirIter, IN UINTN FilterMode, IN CHAR16 *FilePattern OPTIONAL, OUT EFI_FILE_INFO **DirEntry);
 EFI_STATUS DirIterClose(IN OUT REFIT_DIR_ITER *DirIter);
 
+VOID DirSnapshotRead(IN EFI_FILE *BaseDir, IN CHAR16 *RelativePath OPTIONAL, IN UINTN FilterMode, OUT REFIT_DIR_SNAPSHOT *Snapshot);
+BOOLEAN DirSnapshotNext(IN REFIT_DIR_SNAPSHOT *Snapshot, IN OUT UINTN *Index, IN CHAR16 *FilePattern OPTIONAL, OUT EFI_FILE_INFO **DirEntry);
+EFI_FILE_INFO * DirSnapshotFind(IN REFIT_DIR_SNAPSHOT *Snapshot, IN CHAR16 *FileName);
+VOID DirSnapshotFree(IN OUT REFIT_DIR_SNAPSHOT *Snapshot);
+VOID DirCacheStore(IN REFIT_VOLUME *Volume, IN CHAR16 *Path OPTIONAL, IN OUT REFIT_DIR_SNAPSHOT *Snapshot);
+BOOLEAN VolumeFileExists(IN REFIT_VOLUME *Volume, IN CHAR16 *FileName);
+VOID FreeDirCache(VOID);
+
 CHAR16 * Basename(IN CHAR16 *Path);
 CHAR16 * StripEfiExtension(CHAR16 *FileName);
 
@@ -126,8 +151,11 @@ INTN FindSubString(IN CHAR16 *SmallString, IN CHAR16 *BigString);
 VOID SplitPathName(CHAR16 *InPath, CHAR16 **VolName, CHAR16 **Path, CHAR16 **Filename);
 BOOLEAN IsIn(IN CHAR16 *Filename, IN CHAR16 *List);
 BOOLEAN IsInSubstring(IN CHAR16 *BigString, IN CHAR16 *List);
-BOOLEAN FilenameIn(IN REFIT_VOLUME *Volume, IN CHAR16 *Directory, IN CHAR16 *Filename, IN CHAR16 *List);
 BOOLEAN VolumeNumberToName(REFIT_VOLUME *Volume, CHAR16 **VolName);
+VOID CompileNameList(IN CHAR16 *List, IN UINTN Mode, IN OUT NAME_LIST *Compiled);
+VOID FreeNameList(IN OUT NAME_LIST *Compiled);
+BOOLEAN NameListMatch(IN NAME_LIST *List, IN REFIT_VOLUME *Volume OPTIONAL, IN CHAR16 *Directory OPTIONAL, IN CHAR16 *Filename OPTIONAL);
+BOOLEAN VolumeNameMatches(IN REFIT_VOLUME *Volume, IN CHAR16 *VolName);
 VOID MyFreePool(IN OUT VOID *Pointer);
 
 BOOLEAN EjectMedia(VOID);
@@ -137,5 +165,8 @@ BOOLEAN IsGuid(CHAR16 *UnknownString);
 CHAR16 * GuidAsString(EFI_GUID *GuidData);
 EFI_GUID StringAsGuid(CHAR16 * InString);
 BOOLEAN GuidsAreEqual(EFI_GUID *Guid1, EFI_GUID *Guid2);
+EFI_STATUS GuidIndexAdd(IN OUT GUID_INDEX *Index, IN EFI_GUID *Key, IN VOID *Value);
+VOID * GuidIndexFind(IN GUID_INDEX *Index, IN EFI_GUID *Key);
+VOID FreeGuidIndex(IN OUT GUID_INDEX *Index);
 
 #endif
\ No newline at end of file
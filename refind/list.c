@@ -0,0 +1,170 @@
+/*
+ * refind/list.c
+ * Growable arrays of pointers
+ *
+ * Copyright (c) 2014 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+// This code has no dependencies beyond the pool functions, so that
+// refind/test can build it on the host and count the allocations it makes.
+
+#include "list.h"
+
+#if defined(__MAKEWITH_GNUEFI) && !defined(HOST_POSIX)
+#define EfiReallocatePool ReallocatePool
+#endif
+
+// Smallest array allocated for a non-empty list
+#define LIST_MIN_CAPACITY 8
+
+//
+// lists with implicit capacity
+//
+
+// Lists built with these functions keep their capacity implicit: an array
+// holding ElementCount pointers is always sized to the next power of two
+// (minimum 8), so AddListElement() only has to reallocate when the count
+// reaches such a boundary, and appending N elements costs O(log N)
+// reallocations rather than N/8.
+static UINTN ListCapacity(IN UINTN ElementCount)
+{
+    UINTN Capacity = LIST_MIN_CAPACITY;
+
+    while (Capacity < ElementCount)
+        Capacity <<= 1;
+    return Capacity;
+} // static UINTN ListCapacity()
+
+VOID CreateList(OUT VOID ***ListPtr, OUT UINTN *ElementCount, IN UINTN InitialElementCount)
+{
+    *ElementCount = InitialElementCount;
+    if (*ElementCount > 0) {
+        *ListPtr = AllocatePool(sizeof(VOID *) * ListCapacity(*ElementCount));
+    } else {
+        *ListPtr = NULL;
+    }
+}
+
+VOID AddListElement(IN OUT VOID ***ListPtr, IN OUT UINTN *ElementCount, IN VOID *NewElement)
+{
+    if (*ElementCount == 0) {
+        *ListPtr = AllocatePool(sizeof(VOID *) * ListCapacity(1));
+    } else if (ListCapacity(*ElementCount) == *ElementCount) {
+        *ListPtr = EfiReallocatePool(*ListPtr, sizeof(VOID *) * (*ElementCount), sizeof(VOID *) * (*ElementCount) * 2);
+    }
+    if (*ListPtr == NULL) {
+        *ElementCount = 0;
+        return;
+    }
+    (*ListPtr)[*ElementCount] = NewElement;
+    (*ElementCount)++;
+} /* VOID AddListElement() */
+
+// Frees a list, passing each element to FreeElement first. If FreeElement is
+// NULL, the elements are assumed to be owned elsewhere and only the array
+// itself is freed. Either way, the list is left empty.
+VOID FreeListWith(IN OUT VOID ***ListPtr, IN OUT UINTN *ElementCount, IN LIST_ELEMENT_FREE FreeElement OPTIONAL)
+{
+    UINTN i;
+
+    if (*ListPtr != NULL) {
+        if (FreeElement != NULL) {
+            for (i = 0; i < *ElementCount; i++)
+                FreeElement((*ListPtr)[i]);
+        }
+        FreePool(*ListPtr);
+    }
+    *ListPtr = NULL;
+    *ElementCount = 0;
+} // VOID FreeListWith()
+
+//
+// lists with recorded capacity
+//
+
+// These lists record the size of their array in *Capacity alongside the
+// element count, so that a caller that knows how many elements are coming
+// can size the array once with ReserveList(), and one that's done adding
+// elements can trim the spare room with ShrinkList(). Appending N elements
+// one at a time still costs only O(log N) allocations, since the array
+// doubles whenever it fills. An empty list has a NULL array and a Capacity
+// of 0; the two kinds of list mustn't be mixed on the same array.
+
+// Moves the list's elements to a new array that holds NewCapacity pointers.
+// Returns FALSE, leaving the list as it was, if that can't be allocated.
+static BOOLEAN ResizeList(IN OUT VOID ***ListPtr, IN UINTN ElementCount, IN OUT UINTN *Capacity, IN UINTN NewCapacity)
+{
+    VOID **NewList;
+    UINTN i;
+
+    NewList = AllocatePool(sizeof(VOID *) * NewCapacity);
+    if (NewList == NULL)
+        return FALSE;
+    for (i = 0; i < ElementCount; i++)
+        NewList[i] = (*ListPtr)[i];
+    if (*ListPtr != NULL)
+        FreePool(*ListPtr);
+    *ListPtr = NewList;
+    *Capacity = NewCapacity;
+    return TRUE;
+} // static BOOLEAN ResizeList()
+
+// Makes room in the list for at least MinCapacity elements in all, growing
+// its array to at least twice its old size if it has to grow at all (so an
+// empty list gets exactly MinCapacity). Returns FALSE if the array can't be
+// grown, in which case the list is unchanged.
+BOOLEAN ReserveList(IN OUT VOID ***ListPtr, IN UINTN ElementCount, IN OUT UINTN *Capacity, IN UINTN MinCapacity)
+{
+    UINTN NewCapacity;
+
+    if (MinCapacity <= *Capacity)
+        return TRUE;
+    NewCapacity = *Capacity * 2;
+    if (NewCapacity < MinCapacity)
+        NewCapacity = MinCapacity;
+    return ResizeList(ListPtr, ElementCount, Capacity, NewCapacity);
+} // BOOLEAN ReserveList()
+
+// Appends NewElement to the list, growing its array (to hold at least 8
+// elements) if it's full. If the array can't be grown, the element is
+// dropped and the list is unchanged.
+VOID AddReservedListElement(IN OUT VOID ***ListPtr, IN OUT UINTN *ElementCount, IN OUT UINTN *Capacity,
+                            IN VOID *NewElement)
+{
+    UINTN MinCapacity = *ElementCount + 1;
+
+    if ((MinCapacity > *Capacity) && (MinCapacity < LIST_MIN_CAPACITY))
+        MinCapacity = LIST_MIN_CAPACITY;
+    if (ReserveList(ListPtr, *ElementCount, Capacity, MinCapacity)) {
+        (*ListPtr)[*ElementCount] = NewElement;
+        (*ElementCount)++;
+    }
+} // VOID AddReservedListElement()
+
+// Trims the list's array to hold exactly ElementCount elements, freeing it
+// altogether if the list is empty. If a smaller array can't be allocated,
+// the list keeps its old one.
+VOID ShrinkList(IN OUT VOID ***ListPtr, IN UINTN ElementCount, IN OUT UINTN *Capacity)
+{
+    if (ElementCount == 0) {
+        if (*ListPtr != NULL)
+            FreePool(*ListPtr);
+        *ListPtr = NULL;
+        *Capacity = 0;
+    } else if (ElementCount < *Capacity) {
+        ResizeList(ListPtr, ElementCount, Capacity, ElementCount);
+    }
+} // VOID ShrinkList()
+
+// Frees the list's array (but not its elements) and leaves the list empty.
+VOID FreeReservedList(IN OUT VOID ***ListPtr, IN OUT UINTN *ElementCount, IN OUT UINTN *Capacity)
+{
+    FreeListWith(ListPtr, ElementCount, NULL);
+    *Capacity = 0;
+} // VOID FreeReservedList()
@@ -0,0 +1,42 @@
+/*
+ * refind/list.h
+ * Growable arrays of pointers
+ *
+ * Copyright (c) 2014 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+#ifndef __LIST_H_
+#define __LIST_H_
+
+// The host test in refind/test defines HOST_POSIX and supplies the EFI
+// types, AllocatePool(), FreePool() and EfiReallocatePool() itself.
+#ifndef HOST_POSIX
+#include "global.h"
+#ifdef __MAKEWITH_GNUEFI
+#include "efi.h"
+#include "efilib.h"
+#else
+#include "../include/tiano_includes.h"
+#endif
+#endif
+
+// Destructor applied to each element by FreeListWith()
+typedef VOID (*LIST_ELEMENT_FREE)(IN VOID *Element);
+
+VOID CreateList(OUT VOID ***ListPtr, OUT UINTN *ElementCount, IN UINTN InitialElementCount);
+VOID AddListElement(IN OUT VOID ***ListPtr, IN OUT UINTN *ElementCount, IN VOID *NewElement);
+VOID FreeListWith(IN OUT VOID ***ListPtr, IN OUT UINTN *ElementCount, IN LIST_ELEMENT_FREE FreeElement OPTIONAL);
+
+BOOLEAN ReserveList(IN OUT VOID ***ListPtr, IN UINTN ElementCount, IN OUT UINTN *Capacity, IN UINTN MinCapacity);
+VOID AddReservedListElement(IN OUT VOID ***ListPtr, IN OUT UINTN *ElementCount, IN OUT UINTN *Capacity,
+                            IN VOID *NewElement);
+VOID ShrinkList(IN OUT VOID ***ListPtr, IN UINTN ElementCount, IN OUT UINTN *Capacity);
+VOID FreeReservedList(IN OUT VOID ***ListPtr, IN OUT UINTN *ElementCount, IN OUT UINTN *Capacity);
+
+#endif
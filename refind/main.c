@@ -54,6 +54,10 @@
 #include "../include/Handle.h"
 #include "../include/refit_call_wrapper.h"
 #include "driver_support.h"
+#include "crc32.h"
+#include "scancache.h"
+#include "boottime.h"
+#include "driver_manifest.h"
 #include "../include/syslinux_mbr.h"
 
 #ifdef __MAKEWITH_GNUEFI
@@ -139,7 +143,7 @@ static REFIT_MENU_SCREEN MainMenu       = { L"Main Menu", NULL, 0, NULL, 0, NULL
                                             L"Insert or F2 for more options; Esc to refresh" };
 static REFIT_MENU_SCREEN AboutMenu      = { L"About", NULL, 0, NULL, 0, NULL, 0, NULL, L"Press Enter to return to main menu", L"" };
 
-REFIT_CONFIG GlobalConfig = { FALSE, FALSE, FALSE, 0, 0, 0, DONT_CHANGE_TEXT_MODE, 20, 0, 0, GRAPHICS_FOR_OSX, LEGACY_TYPE_MAC, 0, 0,
+REFIT_CONFIG GlobalConfig = { FALSE, FALSE, FALSE, FALSE, FALSE, 0, 0, 0, DONT_CHANGE_TEXT_MODE, 20, 0, 0, GRAPHICS_FOR_OSX, LEGACY_TYPE_MAC, 0, 0,
                               { DEFAULT_BIG_ICON_SIZE / 4, DEFAULT_SMALL_ICON_SIZE, DEFAULT_BIG_ICON_SIZE }, BANNER_NOSCALE,
                               NULL, NULL, CONFIG_FILE_NAME, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
                               { TAG_SHELL, TAG_MEMTEST, TAG_GDISK, TAG_APPLE_RECOVERY, TAG_WINDOWS_RECOVERY, TAG_MOK_TOOL,
@@ -197,10 +201,13 @@ static VOID AboutrEFInd(VOID)
 #else
         AddMenuInfoLine(&AboutMenu, L"Built with TianoCore EDK2");
 #endif
+        AddMenuInfoLine(&AboutMenu, L"");
+        BootTimeAddInfoLines(&AboutMenu);
         AddMenuInfoLine(&AboutMenu, L"");
         AddMenuInfoLine(&AboutMenu, L"For more information, see the rEFInd Web site:");
         AddMenuInfoLine(&AboutMenu, L"http://www.rodsbooks.com/refind/");
         AddMenuEntry(&AboutMenu, &MenuEntryReturn);
+        ShrinkMenuItems(&AboutMenu);
     }
 
     RunMenu(&AboutMenu, NULL);
@@ -227,14 +234,35 @@ static VOID WarnSecureBootError(CHAR16 *Name, BOOLEAN Verbose) {
    } // if
 } // VOID WarnSecureBootError()
 
+// Returns TRUE if the already-open file has the header of a valid EFI loader
+// file for this ARCH. Reads from the file's current position.
+static BOOLEAN HasValidLoaderHeader(EFI_FILE_HANDLE FileHandle) {
+    BOOLEAN         IsValid = TRUE;
+#if defined (EFIX64) | defined (EFI32)
+    EFI_STATUS      Status;
+    CHAR8           Header[512];
+    UINTN           Size = sizeof(Header);
+
+    Status = refit_call3_wrapper(FileHandle->Read, FileHandle, &Size, Header);
+
+    IsValid = !EFI_ERROR(Status) &&
+              Size == sizeof(Header) &&
+              ((Header[0] == 'M' && Header[1] == 'Z' &&
+               (Size = *(UINT32 *)&Header[0x3c]) < 0x180 &&
+               Header[Size] == 'P' && Header[Size+1] == 'E' &&
+               Header[Size+2] == 0 && Header[Size+3] == 0 &&
+               *(UINT16 *)&Header[Size+4] == EFI_STUB_ARCH) ||
+              (*(UINT32 *)&Header == FAT_ARCH));
+#endif
+    return IsValid;
+} // BOOLEAN HasValidLoaderHeader()
+
 // Returns TRUE if this file is a valid EFI loader file, and is proper ARCH
 static BOOLEAN IsValidLoader(EFI_FILE *RootDir, CHAR16 *FileName) {
     BOOLEAN         IsValid = TRUE;
 #if defined (EFIX64) | defined (EFI32)
     EFI_STATUS      Status;
     EFI_FILE_HANDLE FileHandle;
-    CHAR8           Header[512];
-    UINTN           Size = sizeof(Header);
 
     if ((RootDir == NULL) || (FileName == NULL)) {
        // Assume valid here, because Macs produce NULL RootDir (& maybe FileName)
@@ -247,27 +275,19 @@ static BOOLEAN IsValidLoader(EFI_FILE *RootDir, CHAR16 *FileName) {
     if (EFI_ERROR(Status))
        return FALSE;
 
-    Status = refit_call3_wrapper(FileHandle->Read, FileHandle, &Size, Header);
+    IsValid = HasValidLoaderHeader(FileHandle);
     refit_call1_wrapper(FileHandle->Close, FileHandle);
-
-    IsValid = !EFI_ERROR(Status) &&
-              Size == sizeof(Header) &&
-              ((Header[0] == 'M' && Header[1] == 'Z' &&
-               (Size = *(UINT32 *)&Header[0x3c]) < 0x180 &&
-               Header[Size] == 'P' && Header[Size+1] == 'E' &&
-               Header[Size+2] == 0 && Header[Size+3] == 0 &&
-               *(UINT16 *)&Header[Size+4] == EFI_STUB_ARCH) ||
-              (*(UINT32 *)&Header == FAT_ARCH));
 #endif
     return IsValid;
 } // BOOLEAN IsValidLoader()
 
-// Launch an EFI binary.
+// Launch an EFI binary. If IsOS is TRUE, the boot-time report is saved once
+// the image has loaded, so that it includes the LoadImage() call.
 static EFI_STATUS StartEFIImageList(IN EFI_DEVICE_PATH **DevicePaths,
                                     IN CHAR16 *LoadOptions, IN UINTN LoaderType,
                                     IN CHAR16 *ImageTitle, IN CHAR8 OSType,
                                     OUT UINTN *ErrorInStep,
-                                    IN BOOLEAN Verbose)
+                                    IN BOOLEAN Verbose, IN BOOLEAN IsOS)
 {
     EFI_STATUS              Status, ReturnStatus;
     EFI_HANDLE              ChildImageHandle;
@@ -278,6 +298,7 @@ static EFI_STATUS StartEFIImageList(IN EFI_DEVICE_PATH **DevicePaths,
     CHAR16                  *FullLoadOptions = NULL;
     CHAR16                  *Filename = NULL;
     CHAR16                  *Temp;
+    UINTN                   TimingId;
 
     if (ErrorInStep != NULL)
         *ErrorInStep = 0;
@@ -296,6 +317,7 @@ static EFI_STATUS StartEFIImageList(IN EFI_DEVICE_PATH **DevicePaths,
 
     // load the image into memory (and execute it, in the case of a shim/MOK image).
     ReturnStatus = Status = EFI_NOT_FOUND;  // in case the list is empty
+    TimingId = BootTimeBegin(L"LoadImage", ImageTitle);
     for (DevicePathIndex = 0; DevicePaths[DevicePathIndex] != NULL; DevicePathIndex++) {
        FindVolumeAndFilename(DevicePaths[DevicePathIndex], &Volume, &Filename);
        // Some EFIs crash if attempting to load driver for invalid architecture, so
@@ -327,6 +349,7 @@ static EFI_STATUS StartEFIImageList(IN EFI_DEVICE_PATH **DevicePaths,
           break;
        }
     }
+    BootTimeEnd(TimingId, NULL);
     if ((Status == EFI_ACCESS_DENIED) || (Status == EFI_SECURITY_VIOLATION)) {
        WarnSecureBootError(ImageTitle, Verbose);
        goto bailout;
@@ -350,9 +373,14 @@ static EFI_STATUS StartEFIImageList(IN EFI_DEVICE_PATH **DevicePaths,
     // turn control over to the image
     // TODO: (optionally) re-enable the EFI watchdog timer!
 
+    if (IsOS)
+       BootTimeSaveReport();
+
     // close open file handles
     UninitRefitLib();
+    TimingId = BootTimeBegin(L"StartImage", ImageTitle);
     ReturnStatus = Status = refit_call3_wrapper(BS->StartImage, ChildImageHandle, NULL, NULL);
+    BootTimeEnd(TimingId, NULL);
 
     // control returns here when the child image calls Exit()
     SPrint(ErrorInfo, 255, L"returned from %s", ImageTitle);
@@ -377,13 +405,13 @@ static EFI_STATUS StartEFIImage(IN EFI_DEVICE_PATH *DevicePath,
                                 IN CHAR16 *LoadOptions, IN UINTN LoaderType,
                                 IN CHAR16 *ImageTitle, IN CHAR8 OSType,
                                 OUT UINTN *ErrorInStep,
-                                IN BOOLEAN Verbose)
+                                IN BOOLEAN Verbose, IN BOOLEAN IsOS)
 {
     EFI_DEVICE_PATH *DevicePaths[2];
 
     DevicePaths[0] = DevicePath;
     DevicePaths[1] = NULL;
-    return StartEFIImageList(DevicePaths, LoadOptions, LoaderType, ImageTitle, OSType, ErrorInStep, Verbose);
+    return StartEFIImageList(DevicePaths, LoadOptions, LoaderType, ImageTitle, OSType, ErrorInStep, Verbose, IsOS);
 } /* static EFI_STATUS StartEFIImage() */
 
 // From gummiboot: Reboot the computer into its built-in user interface
@@ -434,13 +462,155 @@ static VOID StartLoader(LOADER_ENTRY *Entry, CHAR16 *SelectionName)
 {
     UINTN ErrorInStep = 0;
 
+    FinishLoaderEntry(Entry);
     BeginExternalScreen(Entry->UseGraphicsMode, L"Booting OS");
     StoreLoaderName(SelectionName);
+    egSaveIconCache();
+    SaveScanCache();
     StartEFIImage(Entry->DevicePath, Entry->LoadOptions, TYPE_EFI,
-                  Basename(Entry->LoaderPath), Entry->OSType, &ErrorInStep, !Entry->UseGraphicsMode);
+                  Basename(Entry->LoaderPath), Entry->OSType, &ErrorInStep, !Entry->UseGraphicsMode, TRUE);
     FinishExternalScreen();
 }
 
+// Initrd files found in one kernel directory, indexed by the version string
+// that FindNumbers() extracts from each name. Only the preferred file for each
+// version (see InitrdRank()) is kept.
+#define INITRD_INDEX_BUCKETS 16
+
+typedef struct _initrd_info {
+   CHAR16               *FileName;   // full path, as used in an initrd= option
+   CHAR16               *Version;    // NULL if the name holds no digits
+   UINTN                Rank;
+   struct _initrd_info  *Next;       // next in same hash bucket
+} INITRD_INFO;
+
+typedef struct {
+   REFIT_VOLUME   *Volume;
+   CHAR16         *Path;
+   UINTN          InitrdCount;
+   INITRD_INFO    **Initrds;
+   INITRD_INFO    *Buckets[INITRD_INDEX_BUCKETS];
+} INITRD_INDEX;
+
+static INITRD_INDEX  **InitrdIndexes = NULL;
+static UINTN         InitrdIndexCount = 0;
+
+// Case-insensitive hash of a version string, used to pick an index bucket.
+static UINTN HashInitrdVersion(IN CHAR16 *Version) {
+   UINTN  Hash = 0;
+   CHAR16 c;
+
+   if (Version != NULL) {
+      while ((c = *Version++) != 0) {
+         if ((c >= L'A') && (c <= L'Z'))
+            c = c - L'A' + L'a';
+         Hash = (Hash * 31) + c;
+      } // while
+   } // if
+   return (Hash % INITRD_INDEX_BUCKETS);
+} // static UINTN HashInitrdVersion()
+
+// Returns a ranking for an initrd filename; when several files in a directory
+// carry the same version, the one with the lowest rank is used. Rescue
+// variants (e.g., initramfs-3.3.0-fallback.img) rank behind the plain file,
+// and otherwise the shortest name (the one with the fewest extra suffixes)
+// wins; ties go to the file found first.
+static UINTN InitrdRank(IN CHAR16 *FileName) {
+   UINTN Rank;
+
+   Rank = StrLen(FileName);
+   if (StriSubCmp(L"fallback", FileName) || StriSubCmp(L"kdump", FileName) || StriSubCmp(L"rescue", FileName))
+      Rank += 0x10000;
+   return Rank;
+} // static UINTN InitrdRank()
+
+// Returns the preferred initrd in Index whose version matches Version (both
+// NULL counts as a match), or NULL if there's none.
+static INITRD_INFO * FindIndexedInitrd(IN INITRD_INDEX *Index, IN CHAR16 *Version) {
+   INITRD_INFO *Initrd;
+
+   for (Initrd = Index->Buckets[HashInitrdVersion(Version)]; Initrd != NULL; Initrd = Initrd->Next) {
+      if ((Version == NULL) ? (Initrd->Version == NULL) :
+          ((Initrd->Version != NULL) && (StriCmp(Initrd->Version, Version) == 0)))
+         return Initrd;
+   } // for
+   return NULL;
+} // static INITRD_INFO * FindIndexedInitrd()
+
+// Read the init* files in the directory Path on Volume into a new index.
+// Path must end in a backslash.
+static INITRD_INDEX * BuildInitrdIndex(IN REFIT_VOLUME *Volume, IN CHAR16 *Path) {
+   INITRD_INDEX     *Index;
+   INITRD_INFO      *Initrd, *Existing;
+   REFIT_DIR_ITER   DirIter;
+   EFI_FILE_INFO    *DirEntry;
+   UINTN            Bucket;
+
+   Index = AllocateZeroPool(sizeof(INITRD_INDEX));
+   if (Index == NULL)
+      return NULL;
+   Index->Volume = Volume;
+   Index->Path = StrDuplicate(Path);
+
+   // Some systems require a trailing backslash on the root directory, but
+   // others flake out if any other directory has one....
+   if (StrLen(Path) == 1) {
+      DirIterOpen(Volume->RootDir, Path, &DirIter);
+   } else {
+      Path[StrLen(Path) - 1] = 0;
+      DirIterOpen(Volume->RootDir, Path, &DirIter);
+      Path[StrLen(Path)] = L'\\';
+   } // if/else
+   while (DirIterNext(&DirIter, 2, L"init*", &DirEntry)) {
+      Initrd = AllocateZeroPool(sizeof(INITRD_INFO));
+      if (Initrd == NULL)
+         break;
+      Initrd->FileName = PoolPrint(L"%s%s", Path, DirEntry->FileName);
+      Initrd->Version = FindNumbers(DirEntry->FileName);
+      Initrd->Rank = InitrdRank(DirEntry->FileName);
+      Existing = FindIndexedInitrd(Index, Initrd->Version);
+      if (Existing == NULL) {
+         Bucket = HashInitrdVersion(Initrd->Version);
+         Initrd->Next = Index->Buckets[Bucket];
+         Index->Buckets[Bucket] = Initrd;
+         AddListElement((VOID ***) &(Index->Initrds), &(Index->InitrdCount), Initrd);
+      } else {
+         if (Initrd->Rank < Existing->Rank) { // swap contents; Existing keeps its place in the bucket
+            MyFreePool(Existing->FileName);
+            Existing->FileName = Initrd->FileName;
+            Existing->Rank = Initrd->Rank;
+         } else {
+            MyFreePool(Initrd->FileName);
+         } // if/else
+         MyFreePool(Initrd->Version);
+         MyFreePool(Initrd);
+      } // if/else
+   } // while
+   DirIterClose(&DirIter);
+   return Index;
+} // static INITRD_INDEX * BuildInitrdIndex()
+
+static VOID FreeInitrdInfo(IN VOID *Element) {
+   INITRD_INFO *Initrd = (INITRD_INFO *) Element;
+
+   MyFreePool(Initrd->FileName);
+   MyFreePool(Initrd->Version);
+   MyFreePool(Initrd);
+} // static VOID FreeInitrdInfo()
+
+static VOID FreeInitrdIndex(IN VOID *Element) {
+   INITRD_INDEX *Index = (INITRD_INDEX *) Element;
+
+   FreeListWith((VOID ***) &(Index->Initrds), &(Index->InitrdCount), FreeInitrdInfo);
+   MyFreePool(Index->Path);
+   MyFreePool(Index);
+} // static VOID FreeInitrdIndex()
+
+// Discard all initrd indexes; called whenever the volume list is rebuilt.
+static VOID FreeInitrdIndexes(VOID) {
+   FreeListWith((VOID ***) &InitrdIndexes, &InitrdIndexCount, FreeInitrdIndex);
+} // static VOID FreeInitrdIndexes()
+
 // Locate an initrd or initramfs file that matches the kernel specified by LoaderPath.
 // The matching file has a name that begins with "init" and includes the same version
 // number string as is found in LoaderPath -- but not a longer version number string.
@@ -448,49 +618,40 @@ static VOID StartLoader(LOADER_ENTRY *Entry, CHAR16 *SelectionName)
 // has a file called initramfs-3.3.0.img, this function will return the string
 // '\EFI\kernels\initramfs-3.3.0.img'. If the directory ALSO contains the file
 // initramfs-3.3.0-rc7.img or initramfs-13.3.0.img, those files will NOT match;
-// however, initmine-3.3.0.img might match. (FindInitrd() returns the first match it
-// finds). Thus, care should be taken to avoid placing duplicate matching files in
-// the kernel's directory.
+// however, initmine-3.3.0.img might match. If several files match, the one
+// preferred by InitrdRank() is returned -- initramfs-3.3.0.img rather than
+// initramfs-3.3.0-fallback.img, for instance.
+// Each directory is read only once per scan; later kernels in the same
+// directory are matched against the index built for the first one.
 // If no matching init file can be found, returns NULL.
 static CHAR16 * FindInitrd(IN CHAR16 *LoaderPath, IN REFIT_VOLUME *Volume) {
-   CHAR16              *InitrdName = NULL, *FileName, *KernelVersion, *InitrdVersion, *Path;
-   REFIT_DIR_ITER      DirIter;
-   EFI_FILE_INFO       *DirEntry;
+   CHAR16              *KernelVersion, *Path;
+   INITRD_INDEX        *Index = NULL;
+   INITRD_INFO         *Initrd = NULL;
+   UINTN               i;
 
-   FileName = Basename(LoaderPath);
-   KernelVersion = FindNumbers(FileName);
+   // Always end Path with a backslash, for building the initrd's name later....
    Path = FindPath(LoaderPath);
-
-   // Add trailing backslash for root directory; necessary on some systems, but must
-   // NOT be added to all directories, since on other systems, a trailing backslash on
-   // anything but the root directory causes them to flake out!
-   if (StrLen(Path) == 0) {
+   if ((StrLen(Path) == 0) || (Path[StrLen(Path) - 1] != L'\\'))
       MergeStrings(&Path, L"\\", 0);
+
+   for (i = 0; (i < InitrdIndexCount) && (Index == NULL); i++) {
+      if ((InitrdIndexes[i]->Volume == Volume) && (StriCmp(InitrdIndexes[i]->Path, Path) == 0))
+         Index = InitrdIndexes[i];
+   } // for
+   if (Index == NULL) {
+      Index = BuildInitrdIndex(Volume, Path);
+      if (Index != NULL)
+         AddListElement((VOID ***) &InitrdIndexes, &InitrdIndexCount, Index);
    } // if
-   DirIterOpen(Volume->RootDir, Path, &DirIter);
-   // Now add a trailing backslash if it was NOT added earlier, for consistency in
-   // building the InitrdName later....
-   if ((StrLen(Path) > 0) && (Path[StrLen(Path) - 1] != L'\\'))
-      MergeStrings(&Path, L"\\", 0);
-   while ((DirIterNext(&DirIter, 2, L"init*", &DirEntry)) && (InitrdName == NULL)) {
-      InitrdVersion = FindNumbers(DirEntry->FileName);
-      if (KernelVersion != NULL) {
-         if (StriCmp(InitrdVersion, KernelVersion) == 0) {
-            InitrdName = PoolPrint(L"%s%s", Path, DirEntry->FileName);
-         } // if
-      } else {
-         if (InitrdVersion == NULL) {
-            InitrdName = PoolPrint(L"%s%s", Path, DirEntry->FileName);
-         } // if
-      } // if/else
-      MyFreePool(InitrdVersion);
-   } // while
-   DirIterClose(&DirIter);
 
-   // Note: Don't FreePool(FileName), since Basename returns a pointer WITHIN the string it's passed.
+   KernelVersion = FindNumbers(Basename(LoaderPath));
+   if (Index != NULL)
+      Initrd = FindIndexedInitrd(Index, KernelVersion);
+
    MyFreePool(KernelVersion);
    MyFreePool(Path);
-   return (InitrdName);
+   return ((Initrd != NULL) ? StrDuplicate(Initrd->FileName) : NULL);
 } // static CHAR16 * FindInitrd()
 
 LOADER_ENTRY * AddPreparedLoaderEntry(LOADER_ENTRY *Entry) {
@@ -505,26 +666,29 @@ static REFIT_MENU_SCREEN* CopyMenuScreen(REFIT_MENU_SCREEN *Entry) {
    REFIT_MENU_SCREEN *NewEntry;
    UINTN i;
 
-   NewEntry = AllocateZeroPool(sizeof(REFIT_MENU_SCREEN));
+   NewEntry = ScanArenaAllocateZero(sizeof(REFIT_MENU_SCREEN));
    if ((Entry != NULL) && (NewEntry != NULL)) {
       CopyMem(NewEntry, Entry, sizeof(REFIT_MENU_SCREEN));
-      NewEntry->Title = (Entry->Title) ? StrDuplicate(Entry->Title) : NULL;
-      NewEntry->TimeoutText = (Entry->TimeoutText) ? StrDuplicate(Entry->TimeoutText) : NULL;
+      NewEntry->Title = ScanArenaStrDuplicate(Entry->Title);
+      NewEntry->TimeoutText = ScanArenaStrDuplicate(Entry->TimeoutText);
       if (Entry->TitleImage != NULL) {
-         NewEntry->TitleImage = AllocatePool(sizeof(EG_IMAGE));
+         NewEntry->TitleImage = ScanArenaAllocateZero(sizeof(EG_IMAGE));
          if (NewEntry->TitleImage != NULL)
             CopyMem(NewEntry->TitleImage, Entry->TitleImage, sizeof(EG_IMAGE));
       } // if
-      NewEntry->InfoLines = (CHAR16**) AllocateZeroPool(Entry->InfoLineCount * (sizeof(CHAR16*)));
-      for (i = 0; i < Entry->InfoLineCount && NewEntry->InfoLines; i++) {
-         NewEntry->InfoLines[i] = (Entry->InfoLines[i]) ? StrDuplicate(Entry->InfoLines[i]) : NULL;
+      NewEntry->InfoLines = NULL;
+      NewEntry->InfoLineCount = NewEntry->InfoLineCapacity = 0;
+      NewEntry->Entries = NULL;
+      NewEntry->EntryCount = NewEntry->EntryCapacity = 0;
+      ReserveMenuItems(NewEntry, Entry->InfoLineCount, Entry->EntryCount);
+      for (i = 0; i < Entry->InfoLineCount; i++) {
+         AddMenuInfoLine(NewEntry, ScanArenaStrDuplicate(Entry->InfoLines[i]));
       } // for
-      NewEntry->Entries = (REFIT_MENU_ENTRY**) AllocateZeroPool(Entry->EntryCount * (sizeof (REFIT_MENU_ENTRY*)));
-      for (i = 0; i < Entry->EntryCount && NewEntry->Entries; i++) {
+      for (i = 0; i < Entry->EntryCount; i++) {
          AddMenuEntry(NewEntry, Entry->Entries[i]);
       } // for
-      NewEntry->Hint1 = (Entry->Hint1) ? StrDuplicate(Entry->Hint1) : NULL;
-      NewEntry->Hint2 = (Entry->Hint2) ? StrDuplicate(Entry->Hint2) : NULL;
+      NewEntry->Hint1 = ScanArenaStrDuplicate(Entry->Hint1);
+      NewEntry->Hint2 = ScanArenaStrDuplicate(Entry->Hint2);
    } // if
    return (NewEntry);
 } // static REFIT_MENU_SCREEN* CopyMenuScreen()
@@ -537,17 +701,17 @@ static REFIT_MENU_SCREEN* CopyMenuScreen(REFIT_MENU_SCREEN *Entry) {
 static REFIT_MENU_ENTRY* CopyMenuEntry(REFIT_MENU_ENTRY *Entry) {
    REFIT_MENU_ENTRY *NewEntry;
 
-   NewEntry = AllocateZeroPool(sizeof(REFIT_MENU_ENTRY));
+   NewEntry = ScanArenaAllocateZero(sizeof(REFIT_MENU_ENTRY));
    if ((Entry != NULL) && (NewEntry != NULL)) {
       CopyMem(NewEntry, Entry, sizeof(REFIT_MENU_ENTRY));
-      NewEntry->Title = (Entry->Title) ? StrDuplicate(Entry->Title) : NULL;
+      NewEntry->Title = ScanArenaStrDuplicate(Entry->Title);
       if (Entry->BadgeImage != NULL) {
-         NewEntry->BadgeImage = AllocatePool(sizeof(EG_IMAGE));
+         NewEntry->BadgeImage = ScanArenaAllocateZero(sizeof(EG_IMAGE));
          if (NewEntry->BadgeImage != NULL)
             CopyMem(NewEntry->BadgeImage, Entry->BadgeImage, sizeof(EG_IMAGE));
       }
       if (Entry->Image != NULL) {
-         NewEntry->Image = AllocatePool(sizeof(EG_IMAGE));
+         NewEntry->Image = ScanArenaAllocateZero(sizeof(EG_IMAGE));
          if (NewEntry->Image != NULL)
             CopyMem(NewEntry->Image, Entry->Image, sizeof(EG_IMAGE));
       }
@@ -566,7 +730,7 @@ static REFIT_MENU_ENTRY* CopyMenuEntry(REFIT_MENU_ENTRY *Entry) {
 LOADER_ENTRY *InitializeLoaderEntry(IN LOADER_ENTRY *Entry) {
    LOADER_ENTRY *NewEntry = NULL;
 
-   NewEntry = AllocateZeroPool(sizeof(LOADER_ENTRY));
+   NewEntry = ScanArenaAllocateZero(sizeof(LOADER_ENTRY));
    if (NewEntry != NULL) {
       NewEntry->me.Title        = NULL;
       NewEntry->me.Tag          = TAG_LOADER;
@@ -574,12 +738,13 @@ LOADER_ENTRY *InitializeLoaderEntry(IN LOADER_ENTRY *Entry) {
       NewEntry->UseGraphicsMode = FALSE;
       NewEntry->OSType          = 0;
       if (Entry != NULL) {
-         NewEntry->LoaderPath      = (Entry->LoaderPath) ? StrDuplicate(Entry->LoaderPath) : NULL;
-         NewEntry->VolName         = (Entry->VolName) ? StrDuplicate(Entry->VolName) : NULL;
+         NewEntry->LoaderPath      = ScanArenaStrDuplicate(Entry->LoaderPath);
+         NewEntry->VolName         = ScanArenaStrDuplicate(Entry->VolName);
          NewEntry->DevicePath      = Entry->DevicePath;
          NewEntry->UseGraphicsMode = Entry->UseGraphicsMode;
-         NewEntry->LoadOptions     = (Entry->LoadOptions) ? StrDuplicate(Entry->LoadOptions) : NULL;
-         NewEntry->InitrdPath      = (Entry->InitrdPath) ? StrDuplicate(Entry->InitrdPath) : NULL;
+         NewEntry->LoadOptions     = ScanArenaStrDuplicate(Entry->LoadOptions);
+         NewEntry->InitrdPath      = ScanArenaStrDuplicate(Entry->InitrdPath);
+         NewEntry->Volume          = Entry->Volume;
       }
    } // if
    return (NewEntry);
@@ -610,32 +775,30 @@ static CHAR16 *AddInitrdToOptions(CHAR16 *Options, CHAR16 *InitrdPath) {
 // Returns a pointer to the new subscreen data structure, or NULL if there
 // were problems allocating memory.
 REFIT_MENU_SCREEN *InitializeSubScreen(IN LOADER_ENTRY *Entry) {
-   CHAR16              *FileName, *MainOptions = NULL;
+   CHAR16              *FileName;
    REFIT_MENU_SCREEN   *SubScreen = NULL;
    LOADER_ENTRY        *SubEntry;
 
    FileName = Basename(Entry->LoaderPath);
    if (Entry->me.SubScreen == NULL) { // No subscreen yet; initialize default entry....
-      SubScreen = AllocateZeroPool(sizeof(REFIT_MENU_SCREEN));
+      SubScreen = ScanArenaAllocateZero(sizeof(REFIT_MENU_SCREEN));
       if (SubScreen != NULL) {
-         SubScreen->Title = AllocateZeroPool(sizeof(CHAR16) * 256);
+         SubScreen->Title = ScanArenaAllocateZero(sizeof(CHAR16) * 256);
          SPrint(SubScreen->Title, 255, L"Boot Options for %s on %s",
                 (Entry->Title != NULL) ? Entry->Title : FileName, Entry->VolName);
          SubScreen->TitleImage = Entry->me.Image;
          // default entry
          SubEntry = InitializeLoaderEntry(Entry);
          if (SubEntry != NULL) {
-            SubEntry->me.Title = StrDuplicate(L"Boot using default options");
-            MainOptions = SubEntry->LoadOptions;
-            SubEntry->LoadOptions = AddInitrdToOptions(MainOptions, SubEntry->InitrdPath);
-            MyFreePool(MainOptions);
+            SubEntry->me.Title = ScanArenaStrDuplicate(L"Boot using default options");
+            SubEntry->LoadOptions = ScanArenaKeepString(AddInitrdToOptions(SubEntry->LoadOptions, SubEntry->InitrdPath));
             AddMenuEntry(SubScreen, (REFIT_MENU_ENTRY *)SubEntry);
          } // if (SubEntry != NULL)
-         SubScreen->Hint1 = StrDuplicate(SUBSCREEN_HINT1);
+         SubScreen->Hint1 = SUBSCREEN_HINT1;
          if (GlobalConfig.HideUIFlags & HIDEUI_FLAG_EDITOR) {
-            SubScreen->Hint2 = StrDuplicate(SUBSCREEN_HINT2_NO_EDITOR);
+            SubScreen->Hint2 = SUBSCREEN_HINT2_NO_EDITOR;
          } else {
-            SubScreen->Hint2 = StrDuplicate(SUBSCREEN_HINT2);
+            SubScreen->Hint2 = SUBSCREEN_HINT2;
          } // if/else
       } // if (SubScreen != NULL)
    } else { // existing subscreen; less initialization, and just add new entry later....
@@ -654,10 +817,8 @@ VOID GenerateSubScreen(LOADER_ENTRY *Entry, IN REFIT_VOLUME *Volume) {
    CHAR16             **TokenList;
 
    // create the submenu
-   if (StrLen(Entry->Title) == 0) {
-      MyFreePool(Entry->Title);
+   if (StrLen(Entry->Title) == 0)
       Entry->Title = NULL;
-   }
    SubScreen = InitializeSubScreen(Entry);
 
    // loader-specific submenu entries
@@ -732,9 +893,8 @@ VOID GenerateSubScreen(LOADER_ENTRY *Entry, IN REFIT_VOLUME *Volume) {
          SubEntry = InitializeLoaderEntry(Entry);
          if (SubEntry != NULL) {
             SubEntry->me.Title        = L"Run Apple Hardware Test";
-            MyFreePool(SubEntry->LoaderPath);
-            SubEntry->LoaderPath      = StrDuplicate(DiagsFileName);
-            SubEntry->DevicePath      = FileDevicePath(Volume->DeviceHandle, SubEntry->LoaderPath);
+            SubEntry->LoaderPath      = ScanArenaStrDuplicate(DiagsFileName);
+            SubEntry->DevicePath      = ScanArenaKeepDevicePath(FileDevicePath(Volume->DeviceHandle, SubEntry->LoaderPath));
             SubEntry->UseGraphicsMode = GlobalConfig.GraphicsFor & GRAPHICS_FOR_OSX;
             AddMenuEntry(SubScreen, (REFIT_MENU_ENTRY *)SubEntry);
          } // if
@@ -749,20 +909,19 @@ VOID GenerateSubScreen(LOADER_ENTRY *Entry, IN REFIT_VOLUME *Volume) {
          // up with a default title but correct options by InitializeSubScreen(),
          // earlier....
          if ((SubScreen->Entries != NULL) && (SubScreen->Entries[0] != NULL)) {
-            MyFreePool(SubScreen->Entries[0]->Title);
-            SubScreen->Entries[0]->Title = TokenList[0] ? StrDuplicate(TokenList[0]) : StrDuplicate(L"Boot Linux");
+            SubScreen->Entries[0]->Title = ScanArenaStrDuplicate(TokenList[0] ? TokenList[0] : L"Boot Linux");
          } // if
          FreeTokenLine(&TokenList, &TokenCount);
          while ((TokenCount = ReadTokenLine(File, &TokenList)) > 1) {
             SubEntry = InitializeLoaderEntry(Entry);
-            SubEntry->me.Title = TokenList[0] ? StrDuplicate(TokenList[0]) : StrDuplicate(L"Boot Linux");
-            MyFreePool(SubEntry->LoadOptions);
-            SubEntry->LoadOptions = AddInitrdToOptions(TokenList[1], InitrdName);
+            SubEntry->me.Title = ScanArenaStrDuplicate(TokenList[0] ? TokenList[0] : L"Boot Linux");
+            SubEntry->LoadOptions = ScanArenaKeepString(AddInitrdToOptions(TokenList[1], InitrdName));
             FreeTokenLine(&TokenList, &TokenCount);
             SubEntry->UseGraphicsMode = GlobalConfig.GraphicsFor & GRAPHICS_FOR_LINUX;
             AddMenuEntry(SubScreen, (REFIT_MENU_ENTRY *)SubEntry);
          } // while
          MyFreePool(InitrdName);
+         MyFreePool(File->Buffer);
          MyFreePool(File);
       } // if
 
@@ -853,6 +1012,26 @@ static CHAR16 * GetMainLinuxOptions(IN CHAR16 * LoaderPath, IN REFIT_VOLUME *Vol
    return (FullOptions);
 } // static CHAR16 * GetMainLinuxOptions()
 
+// Fills in the parts of a loader entry whose creation was deferred when the
+// entry was added to the menu -- the Linux options (which require reading an
+// options file and scanning for an initrd) and the submenu. Called when the
+// entry is first expanded or launched, so entries the user never touches cost
+// no further disk access.
+VOID FinishLoaderEntry(IN OUT LOADER_ENTRY *Entry) {
+   if ((Entry == NULL) || (Entry->Volume == NULL))
+      return;
+
+   if (Entry->OptionsPending) {
+      Entry->OptionsPending = FALSE;
+      Entry->LoadOptions = ScanArenaKeepString(GetMainLinuxOptions(Entry->LoaderPath, Entry->Volume));
+   } // if
+   if (Entry->SubScreenPending) {
+      Entry->SubScreenPending = FALSE;
+      if (Entry->me.SubScreen == NULL)
+         GenerateSubScreen(Entry, Entry->Volume);
+   } // if
+} // VOID FinishLoaderEntry()
+
 // Try to guess the name of the Linux distribution & add that name to
 // OSIconName list.
 static VOID GuessLinuxDistribution(CHAR16 **OSIconName, REFIT_VOLUME *Volume, CHAR16 *LoaderPath) {
@@ -882,8 +1061,9 @@ static VOID GuessLinuxDistribution(CHAR16 **OSIconName, REFIT_VOLUME *Volume, CH
 } // VOID GuessLinuxDistribution()
 
 // Sets a few defaults for a loader entry -- mainly the icon, but also the OS type
-// code and shortcut letter. For Linux EFI stub loaders, also sets kernel options
-// that will (with luck) work fairly automatically.
+// code and shortcut letter. For Linux EFI stub loaders, also flags the entry so
+// that FinishLoaderEntry() will set kernel options that will (with luck) work
+// fairly automatically.
 VOID SetLoaderDefaults(LOADER_ENTRY *Entry, CHAR16 *LoaderPath, REFIT_VOLUME *Volume) {
    CHAR16      *FileName, *PathOnly, *NoExtension, *OSIconName = NULL, *Temp, *SubString;
    CHAR16      ShortcutLetter = 0;
@@ -892,14 +1072,16 @@ VOID SetLoaderDefaults(LOADER_ENTRY *Entry, CHAR16 *LoaderPath, REFIT_VOLUME *Vo
    FileName = Basename(LoaderPath);
    PathOnly = FindPath(LoaderPath);
    NoExtension = StripEfiExtension(FileName);
+   Entry->Volume = Volume;
 
    // locate a custom icon for the loader
    // Anything found here takes precedence over the "hints" in the OSIconName variable
    if (!Entry->me.Image) {
-      Entry->me.Image = egLoadIconAnyType(Volume->RootDir, PathOnly, NoExtension, GlobalConfig.IconSizes[ICON_SIZE_BIG]);
+      Entry->me.Image = ScanArenaKeepImage(egLoadIconAnyType(Volume->RootDir, PathOnly, NoExtension,
+                                                             GlobalConfig.IconSizes[ICON_SIZE_BIG]));
    }
    if (!Entry->me.Image) {
-      Entry->me.Image = egCopyImage(Volume->VolIconImage);
+      Entry->me.Image = ScanArenaKeepImage(egCopyImage(Volume->VolIconImage));
    }
 
    // Begin creating icon "hints" by using last part of directory path leading
@@ -939,7 +1121,7 @@ VOID SetLoaderDefaults(LOADER_ENTRY *Entry, CHAR16 *LoaderPath, REFIT_VOLUME *Vo
       Entry->OSType = 'L';
       if (ShortcutLetter == 0)
          ShortcutLetter = 'L';
-      Entry->LoadOptions = GetMainLinuxOptions(LoaderPath, Volume);
+      Entry->OptionsPending = TRUE;
       Entry->UseGraphicsMode = GlobalConfig.GraphicsFor & GRAPHICS_FOR_LINUX;
    } else if (StriSubCmp(L"refit", LoaderPath)) {
       MergeStrings(&OSIconName, L"refit", L',');
@@ -991,30 +1173,31 @@ VOID SetLoaderDefaults(LOADER_ENTRY *Entry, CHAR16 *LoaderPath, REFIT_VOLUME *Vo
 } // VOID SetLoaderDefaults()
 
 // Add a specified EFI boot loader to the list, using automatic settings
-// for icons, options, etc.
+// for icons, options, etc. The submenu is generated on demand, by
+// FinishLoaderEntry().
 LOADER_ENTRY * AddLoaderEntry(IN CHAR16 *LoaderPath, IN CHAR16 *LoaderTitle, IN REFIT_VOLUME *Volume) {
    LOADER_ENTRY      *Entry;
 
    CleanUpPathNameSlashes(LoaderPath);
    Entry = InitializeLoaderEntry(NULL);
    if (Entry != NULL) {
-      Entry->Title = StrDuplicate((LoaderTitle != NULL) ? LoaderTitle : LoaderPath);
-      Entry->me.Title = AllocateZeroPool(sizeof(CHAR16) * 256);
+      Entry->Title = ScanArenaStrDuplicate((LoaderTitle != NULL) ? LoaderTitle : LoaderPath);
+      Entry->me.Title = ScanArenaAllocateZero(sizeof(CHAR16) * 256);
       // Extra space at end of Entry->me.Title enables searching on Volume->VolName even if another volume
       // name is identical except for something added to the end (e.g., VolB1 vs. VolB12).
       SPrint(Entry->me.Title, 255, L"Boot %s from %s ", (LoaderTitle != NULL) ? LoaderTitle : LoaderPath, Volume->VolName);
       Entry->me.Row = 0;
       Entry->me.BadgeImage = Volume->VolBadgeImage;
       if ((LoaderPath != NULL) && (LoaderPath[0] != L'\\')) {
-         Entry->LoaderPath = StrDuplicate(L"\\");
+         Entry->LoaderPath = L"\\";
       } else {
          Entry->LoaderPath = NULL;
       }
-      MergeStrings(&(Entry->LoaderPath), LoaderPath, 0);
+      ScanArenaMergeStrings(&(Entry->LoaderPath), LoaderPath, 0);
       Entry->VolName = Volume->VolName;
-      Entry->DevicePath = FileDevicePath(Volume->DeviceHandle, Entry->LoaderPath);
+      Entry->DevicePath = ScanArenaKeepDevicePath(FileDevicePath(Volume->DeviceHandle, Entry->LoaderPath));
       SetLoaderDefaults(Entry, LoaderPath, Volume);
-      GenerateSubScreen(Entry, Volume);
+      Entry->SubScreenPending = TRUE;
       AddMenuEntry(&MainMenu, (REFIT_MENU_ENTRY *)Entry);
    }
 
@@ -1083,14 +1266,14 @@ static VOID CleanUpLoaderList(struct LOADER_LIST *LoaderList) {
 // Returns TRUE if none of these conditions is met -- that is, if the path is
 // eligible for scanning.
 static BOOLEAN ShouldScan(REFIT_VOLUME *Volume, CHAR16 *Path) {
-   CHAR16   *VolName = NULL, *DontScanDir, *PathCopy = NULL;
-   UINTN    i = 0;
+   CHAR16   *VolName = NULL, *PathCopy = NULL;
    BOOLEAN  ScanIt = TRUE;
 
-   if ((IsIn(Volume->VolName, GlobalConfig.DontScanVolumes)) || (IsIn(Volume->PartName, GlobalConfig.DontScanVolumes)))
+   if (NameListMatch(&GlobalConfig.DontScanVolumesList, NULL, NULL, Volume->VolName) ||
+       NameListMatch(&GlobalConfig.DontScanVolumesList, NULL, NULL, Volume->PartName))
       return FALSE;
 
-   if ((StriCmp(Path, SelfDirPath) == 0) && (Volume->DeviceHandle == SelfVolume->DeviceHandle))
+   if ((StriCmp(Path, SelfDirPath) == 0) && SelfVolume && (Volume->DeviceHandle == SelfVolume->DeviceHandle))
       return FALSE;
 
    // See if Path includes an explicit volume declaration that's NOT Volume....
@@ -1103,123 +1286,255 @@ static BOOLEAN ShouldScan(REFIT_VOLUME *Volume, CHAR16 *Path) {
    } // if Path includes volume specification
    MyFreePool(PathCopy);
    MyFreePool(VolName);
-   VolName = NULL;
 
    // See if Volume is in GlobalConfig.DontScanDirs....
-   while (ScanIt && (DontScanDir = FindCommaDelimited(GlobalConfig.DontScanDirs, i++))) {
-      SplitVolumeAndFilename(&DontScanDir, &VolName);
-      CleanUpPathNameSlashes(DontScanDir);
-      VolumeNumberToName(Volume, &VolName);
-      if (VolName != NULL) {
-         if ((StriCmp(VolName, Volume->VolName) == 0) && (StriCmp(DontScanDir, Path) == 0))
-            ScanIt = FALSE;
-      } else {
-         if (StriCmp(DontScanDir, Path) == 0)
-            ScanIt = FALSE;
-      }
-      MyFreePool(DontScanDir);
-      MyFreePool(VolName);
-      DontScanDir = NULL;
-      VolName = NULL;
-   } // while()
+   if (ScanIt && NameListMatch(&GlobalConfig.DontScanDirsList, Volume, Path, NULL))
+      ScanIt = FALSE;
 
    return ScanIt;
 } // BOOLEAN ShouldScan()
 
-// Returns TRUE if the file is byte-for-byte identical with the fallback file
-// on the volume AND if the file is not itself the fallback file; returns
-// FALSE if the file is not identical to the fallback file OR if the file
-// IS the fallback file. Intended for use in excluding the fallback boot
-// loader when it's a duplicate of another boot loader.
-static BOOLEAN DuplicatesFallback(IN REFIT_VOLUME *Volume, IN CHAR16 *FileName) {
-   CHAR8           *FileContents, *FallbackContents;
-   EFI_FILE_HANDLE FileHandle, FallbackHandle;
-   EFI_FILE_INFO   *FileInfo, *FallbackInfo;
-   UINTN           FileSize = 0, FallbackSize = 0;
-   EFI_STATUS      Status;
-   BOOLEAN         AreIdentical = FALSE;
+//
+// File fingerprints, used to spot loaders that duplicate the fallback loader
+// without reading and comparing whole files
+//
+
+#define FINGERPRINT_BLOCK_SIZE  4096
+#define FINGERPRINT_CHUNK_SIZE  65536
+#define FINGERPRINT_QUICK       1
+#define FINGERPRINT_FULL        2
+
+typedef struct {
+   BOOLEAN  Checked;        // size taken from a directory entry, or file opened
+   BOOLEAN  Valid;          // file's size is known
+   UINT64   FileSize;
+   UINTN    Level;          // 0, FINGERPRINT_QUICK, or FINGERPRINT_FULL
+   UINT32   QuickHash;      // CRC32 of PE header plus sampled blocks
+   UINT32   FullHash;       // CRC32 of the whole file
+} FILE_FINGERPRINT;
+
+// Fingerprint of the fallback loader on the volume currently being scanned;
+// reset by ScanEfiFiles() so that it's computed at most once per volume per scan.
+static FILE_FINGERPRINT FallbackPrint;
+static REFIT_VOLUME     *FallbackPrintVolume = NULL;
+
+// Add Size bytes from Offset in the file to the running CRC32 in *Hash,
+// stopping early at the end of the file.
+static EFI_STATUS HashFileRange(IN EFI_FILE_HANDLE FileHandle, IN UINT64 Offset, IN UINT64 Size,
+                                IN UINT8 *Buffer, IN UINTN BufferSize, IN OUT UINT32 *Hash) {
+   EFI_STATUS Status;
+   UINTN      ReadSize;
 
-   if (!FileExists(Volume->RootDir, FileName) || !FileExists(Volume->RootDir, FALLBACK_FULLNAME))
+   Status = refit_call2_wrapper(FileHandle->SetPosition, FileHandle, Offset);
+   while ((Status == EFI_SUCCESS) && (Size > 0)) {
+      ReadSize = (Size < BufferSize) ? (UINTN) Size : BufferSize;
+      Status = refit_call3_wrapper(FileHandle->Read, FileHandle, &ReadSize, Buffer);
+      if ((Status != EFI_SUCCESS) || (ReadSize == 0))
+         break;
+      *Hash = crc32(*Hash, Buffer, ReadSize);
+      Size -= ReadSize;
+   } // while
+   return Status;
+} // static EFI_STATUS HashFileRange()
+
+// Bring Print up to (at least) the specified Level for the open file. The
+// quick hash covers the first block (which holds the PE header) and blocks
+// sampled at each quarter of the file and at its end; the full hash covers
+// everything. Returns FALSE if the file couldn't be read.
+static BOOLEAN UpdateFingerprint(IN EFI_FILE_HANDLE FileHandle, IN OUT FILE_FINGERPRINT *Print, IN UINTN Level) {
+   EFI_STATUS Status = EFI_SUCCESS;
+   UINT8      *Buffer;
+   UINT64     Quarter;
+   UINT32     Hash = 0;
+   UINTN      i;
+
+   if (!Print->Valid)
       return FALSE;
+   if (Print->Level >= Level)
+      return TRUE;
 
-   CleanUpPathNameSlashes(FileName);
+   Buffer = AllocatePool(FINGERPRINT_CHUNK_SIZE);
+   if (Buffer == NULL)
+      return FALSE;
 
-   if (StriCmp(FileName, FALLBACK_FULLNAME) == 0)
-      return FALSE; // identical filenames, so not a duplicate....
+   if (Print->Level < FINGERPRINT_QUICK) {
+      Quarter = Print->FileSize >> 2;
+      for (i = 0; (i < 4) && (Status == EFI_SUCCESS); i++)
+         Status = HashFileRange(FileHandle, Quarter * i, FINGERPRINT_BLOCK_SIZE, Buffer, FINGERPRINT_BLOCK_SIZE, &Hash);
+      if ((Status == EFI_SUCCESS) && (Print->FileSize > FINGERPRINT_BLOCK_SIZE))
+         Status = HashFileRange(FileHandle, Print->FileSize - FINGERPRINT_BLOCK_SIZE, FINGERPRINT_BLOCK_SIZE,
+                                Buffer, FINGERPRINT_BLOCK_SIZE, &Hash);
+      if (Status == EFI_SUCCESS) {
+         Print->QuickHash = Hash;
+         Print->Level = FINGERPRINT_QUICK;
+      }
+   } // if need quick hash
+
+   if ((Status == EFI_SUCCESS) && (Level >= FINGERPRINT_FULL)) {
+      Hash = 0;
+      Status = HashFileRange(FileHandle, 0, Print->FileSize, Buffer, FINGERPRINT_CHUNK_SIZE, &Hash);
+      if (Status == EFI_SUCCESS) {
+         Print->FullHash = Hash;
+         Print->Level = FINGERPRINT_FULL;
+      }
+   } // if need full hash
+
+   MyFreePool(Buffer);
+   if (Status != EFI_SUCCESS)
+      Print->Valid = FALSE;
+   return Print->Valid;
+} // static BOOLEAN UpdateFingerprint()
+
+// Open FileName and set up a fingerprint of (at least) the specified Level
+// for it, or update an existing one. Returns FALSE if the file can't be read.
+static BOOLEAN GetFingerprint(IN REFIT_VOLUME *Volume, IN CHAR16 *FileName, IN OUT FILE_FINGERPRINT *Print, IN UINTN Level) {
+   EFI_FILE_HANDLE FileHandle;
+   EFI_FILE_INFO   *FileInfo;
+   EFI_STATUS      Status;
+
+   if (Print->Checked && (!Print->Valid || (Print->Level >= Level)))
+      return Print->Valid;
 
    Status = refit_call5_wrapper(Volume->RootDir->Open, Volume->RootDir, &FileHandle, FileName, EFI_FILE_MODE_READ, 0);
-   if (Status == EFI_SUCCESS) {
-      FileInfo = LibFileInfo(FileHandle);
-      FileSize = FileInfo->FileSize;
-   } else {
+   if (Status != EFI_SUCCESS) {
+      Print->Checked = TRUE;
+      Print->Valid = FALSE;
       return FALSE;
    }
 
+   if (!Print->Checked) {
+      Print->Checked = TRUE;
+      FileInfo = LibFileInfo(FileHandle);
+      if (FileInfo != NULL) {
+         Print->FileSize = FileInfo->FileSize;
+         Print->Valid = TRUE;
+         MyFreePool(FileInfo);
+      }
+   } // if
+   if (Level > 0)
+      UpdateFingerprint(FileHandle, Print, Level);
+
+   refit_call1_wrapper(FileHandle->Close, FileHandle);
+   return Print->Valid;
+} // static BOOLEAN GetFingerprint()
+
+// Returns TRUE if the first Size bytes of FileName and of the fallback file
+// on Volume are the same, comparing them a chunk at a time.
+static BOOLEAN SameAsFallback(IN REFIT_VOLUME *Volume, IN CHAR16 *FileName, IN UINT64 Size) {
+   EFI_FILE_HANDLE FileHandle, FallbackHandle;
+   EFI_STATUS      Status;
+   UINT8           *FileContents, *FallbackContents;
+   UINTN           FileRead, FallbackRead;
+   BOOLEAN         AreIdentical = FALSE;
+
    Status = refit_call5_wrapper(Volume->RootDir->Open, Volume->RootDir, &FallbackHandle, FALLBACK_FULLNAME, EFI_FILE_MODE_READ, 0);
-   if (Status == EFI_SUCCESS) {
-      FallbackInfo = LibFileInfo(FallbackHandle);
-      FallbackSize = FallbackInfo->FileSize;
-   } else {
-      refit_call1_wrapper(FileHandle->Close, FileHandle);
+   if (Status != EFI_SUCCESS)
+      return FALSE;
+   Status = refit_call5_wrapper(Volume->RootDir->Open, Volume->RootDir, &FileHandle, FileName, EFI_FILE_MODE_READ, 0);
+   if (Status != EFI_SUCCESS) {
+      refit_call1_wrapper(FallbackHandle->Close, FallbackHandle);
       return FALSE;
    }
 
-   if (FallbackSize != FileSize) { // not same size, so can't be identical
-      AreIdentical = FALSE;
-   } else { // could be identical; do full check....
-      FileContents = AllocatePool(FileSize);
-      FallbackContents = AllocatePool(FallbackSize);
-      if (FileContents && FallbackContents) {
-         Status = refit_call3_wrapper(FileHandle->Read, FileHandle, &FileSize, FileContents);
-         if (Status == EFI_SUCCESS) {
-            Status = refit_call3_wrapper(FallbackHandle->Read, FallbackHandle, &FallbackSize, FallbackContents);
-         }
-         if (Status == EFI_SUCCESS) {
-            AreIdentical = (CompareMem(FileContents, FallbackContents, FileSize) == 0);
-         } // if
-      } // if
-      MyFreePool(FileContents);
-      MyFreePool(FallbackContents);
-   } // if/else
+   FileContents = AllocatePool(FINGERPRINT_CHUNK_SIZE);
+   FallbackContents = AllocatePool(FINGERPRINT_CHUNK_SIZE);
+   if (FileContents && FallbackContents) {
+      AreIdentical = TRUE;
+      while (AreIdentical && (Size > 0)) {
+         FileRead = FallbackRead = (Size < FINGERPRINT_CHUNK_SIZE) ? (UINTN) Size : FINGERPRINT_CHUNK_SIZE;
+         Status = refit_call3_wrapper(FileHandle->Read, FileHandle, &FileRead, FileContents);
+         if (Status == EFI_SUCCESS)
+            Status = refit_call3_wrapper(FallbackHandle->Read, FallbackHandle, &FallbackRead, FallbackContents);
+         AreIdentical = ((Status == EFI_SUCCESS) && (FileRead > 0) && (FileRead == FallbackRead) &&
+                         (CompareMem(FileContents, FallbackContents, FileRead) == 0));
+         Size -= FileRead;
+      } // while
+   } // if
+   MyFreePool(FileContents);
+   MyFreePool(FallbackContents);
 
    // BUG ALERT: Some systems (e.g., DUET, some Macs with large displays) crash if the
    // following two calls are reversed. Go figure....
-   refit_call1_wrapper(FileHandle->Close, FallbackHandle);
+   refit_call1_wrapper(FallbackHandle->Close, FallbackHandle);
    refit_call1_wrapper(FileHandle->Close, FileHandle);
    return AreIdentical;
+} // static BOOLEAN SameAsFallback()
+
+// Returns TRUE if the file is identical with the fallback file on the volume
+// AND if the file is not itself the fallback file; returns FALSE if the file
+// is not identical to the fallback file OR if the file IS the fallback file.
+// Intended for use in excluding the fallback boot loader when it's a duplicate
+// of another boot loader. Files are compared by size, then by a hash of a few
+// sampled blocks, then by a hash of their full contents; files that pass all
+// of those are compared byte for byte, since a CRC32 match doesn't prove
+// they're the same. The fallback file's fingerprint is kept for the rest of
+// the volume's scan. If the caller has the file's directory entry (DirEntry),
+// its size is taken from there rather than by opening the file.
+static BOOLEAN DuplicatesFallback(IN REFIT_VOLUME *Volume, IN CHAR16 *FileName, IN EFI_FILE_INFO *DirEntry OPTIONAL) {
+   FILE_FINGERPRINT FilePrint;
+
+   CleanUpPathNameSlashes(FileName);
+
+   if (StriCmp(FileName, FALLBACK_FULLNAME) == 0)
+      return FALSE; // identical filenames, so not a duplicate....
+
+   if (FallbackPrintVolume != Volume) {
+      ZeroMem(&FallbackPrint, sizeof(FILE_FINGERPRINT));
+      FallbackPrintVolume = Volume;
+   }
+   // A failed open doubles as the test for each file's existence.
+   if (!GetFingerprint(Volume, FALLBACK_FULLNAME, &FallbackPrint, 0))
+      return FALSE;
+
+   ZeroMem(&FilePrint, sizeof(FILE_FINGERPRINT));
+   if (DirEntry != NULL) {
+      FilePrint.Checked = FilePrint.Valid = TRUE;
+      FilePrint.FileSize = DirEntry->FileSize;
+   }
+   if (!GetFingerprint(Volume, FileName, &FilePrint, 0) || (FilePrint.FileSize != FallbackPrint.FileSize))
+      return FALSE; // not same size, so can't be identical
+
+   if (!GetFingerprint(Volume, FileName, &FilePrint, FINGERPRINT_QUICK) ||
+       !GetFingerprint(Volume, FALLBACK_FULLNAME, &FallbackPrint, FINGERPRINT_QUICK) ||
+       (FilePrint.QuickHash != FallbackPrint.QuickHash))
+      return FALSE;
+
+   return (GetFingerprint(Volume, FileName, &FilePrint, FINGERPRINT_FULL) &&
+           GetFingerprint(Volume, FALLBACK_FULLNAME, &FallbackPrint, FINGERPRINT_FULL) &&
+           (FilePrint.FullHash == FallbackPrint.FullHash) &&
+           SameAsFallback(Volume, FileName, FilePrint.FileSize));
 } // BOOLEAN DuplicatesFallback()
 
-// Returns FALSE if two measures of file size are identical for a single file,
-// TRUE if not or if the file can't be opened and the other measure is non-0.
-// Despite the function's name, this isn't really a direct test of symbolic
-// link status, since EFI doesn't officially support symlinks. It does seem
-// to be a reliable indicator, though. (OTOH, some disk errors might cause a
-// file to fail to open, which would return a false positive -- but as I use
-// this function to exclude symbolic links from the list of boot loaders,
-// that would be fine, since such boot loaders wouldn't work.)
-static BOOLEAN IsSymbolicLink(REFIT_VOLUME *Volume, CHAR16 *Path, EFI_FILE_INFO *DirEntry) {
+// Returns TRUE if the file described by DirEntry looks like a usable boot
+// loader: its size as reported by the open file matches the size in its
+// directory entry, and it has a valid loader header for this ARCH. Opens the
+// file only once for both tests.
+// The size test is in effect a test of symbolic link status, since EFI doesn't
+// officially support symlinks but they show up with differing sizes. It does
+// seem to be a reliable indicator. (OTOH, some disk errors might cause a file
+// to fail to open, which would return a false positive -- but as this is used
+// to exclude symbolic links from the list of boot loaders, that would be fine,
+// since such boot loaders wouldn't work.)
+static BOOLEAN IsUsableLoader(REFIT_VOLUME *Volume, CHAR16 *FileName, EFI_FILE_INFO *DirEntry) {
    EFI_FILE_HANDLE FileHandle;
    EFI_FILE_INFO   *FileInfo = NULL;
    EFI_STATUS      Status;
    UINTN           FileSize2 = 0;
-   CHAR16          *FileName;
-
-   FileName = StrDuplicate(Path);
-   MergeStrings(&FileName, DirEntry->FileName, L'\\');
-   CleanUpPathNameSlashes(FileName);
+   BOOLEAN         IsUsable = FALSE;
 
    Status = refit_call5_wrapper(Volume->RootDir->Open, Volume->RootDir, &FileHandle, FileName, EFI_FILE_MODE_READ, 0);
    if (Status == EFI_SUCCESS) {
       FileInfo = LibFileInfo(FileHandle);
       if (FileInfo != NULL)
          FileSize2 = FileInfo->FileSize;
+      if (DirEntry->FileSize == FileSize2)
+         IsUsable = HasValidLoaderHeader(FileHandle);
+      refit_call1_wrapper(FileHandle->Close, FileHandle);
    }
 
-   MyFreePool(FileName);
    MyFreePool(FileInfo);
-
-   return (DirEntry->FileSize != FileSize2);
-} // BOOLEAN IsSymbolicLink()
+   return IsUsable;
+} // BOOLEAN IsUsableLoader()
 
 // Returns TRUE if a file with the same name as the original but with
 // ".efi.signed" is also present in the same directory. Ubuntu is using
@@ -1227,23 +1542,80 @@ static BOOLEAN IsSymbolicLink(REFIT_VOLUME *Volume, CHAR16 *Path, EFI_FILE_INFO
 // there's no point in cluttering the display with two kernels that will
 // behave identically on non-SB systems, or when one will fail when SB
 // is active.
-static BOOLEAN HasSignedCounterpart(IN REFIT_VOLUME *Volume, IN CHAR16 *Path, IN CHAR16 *Filename) {
-   CHAR16 *NewFile = NULL;
+static BOOLEAN HasSignedCounterpart(IN REFIT_DIR_SNAPSHOT *Snapshot, IN CHAR16 *Filename) {
+   CHAR16 *NewFile;
    BOOLEAN retval = FALSE;
 
-   MergeStrings(&NewFile, Path, 0);
-   MergeStrings(&NewFile, Filename, L'\\');
-   MergeStrings(&NewFile, L".efi.signed", 0);
+   NewFile = PoolPrint(L"%s.efi.signed", Filename);
    if (NewFile != NULL) {
-      CleanUpPathNameSlashes(NewFile);
-      if (FileExists(Volume->RootDir, NewFile))
-         retval = TRUE;
+      retval = (DirSnapshotFind(Snapshot, NewFile) != NULL);
       MyFreePool(NewFile);
    } // if
 
    return retval;
 } // BOOLEAN HasSignedCounterpart()
 
+// Value stored with scan cache records for the volume being scanned; covers
+// the fallback boot loader, which affects every directory's results. Set
+// by ScanEfiFiles().
+static UINT32 VolumeScanStamp = 0;
+
+// Returns a value that changes whenever any of the fallback boot loader's size
+// and time stamp, the loader name patterns, or the dont_scan_files setting
+// change, for use in validating scan cache records.
+static UINT32 ComputeVolumeScanStamp(IN REFIT_VOLUME *Volume) {
+   EFI_FILE_HANDLE FileHandle;
+   EFI_FILE_INFO   *FileInfo;
+   EFI_STATUS      Status;
+   UINT32          Stamp = 0;
+
+   Status = refit_call5_wrapper(Volume->RootDir->Open, Volume->RootDir, &FileHandle, FALLBACK_FULLNAME, EFI_FILE_MODE_READ, 0);
+   if (Status == EFI_SUCCESS) {
+      FileInfo = LibFileInfo(FileHandle);
+      if (FileInfo != NULL) {
+         Stamp = crc32(Stamp, &(FileInfo->FileSize), sizeof(FileInfo->FileSize));
+         Stamp = crc32(Stamp, &(FileInfo->ModificationTime), sizeof(EFI_TIME));
+         MyFreePool(FileInfo);
+      }
+      refit_call1_wrapper(FileHandle->Close, FileHandle);
+   } // if
+   if (GlobalConfig.DontScanFiles)
+      Stamp = crc32(Stamp, GlobalConfig.DontScanFiles, StrSize(GlobalConfig.DontScanFiles));
+   return Stamp;
+} // static UINT32 ComputeVolumeScanStamp()
+
+// Add loader entries for the loaders recorded in the scan cache for Path on
+// Volume. Returns TRUE if the cache had valid results for the directory (and
+// sets *FoundFallbackDuplicate), FALSE if the directory must be scanned.
+static BOOLEAN AddCachedLoaderEntries(IN REFIT_VOLUME *Volume, IN CHAR16 *Path, IN UINT32 Stamp, IN EFI_TIME *DirTime,
+                                      OUT BOOLEAN *FoundFallbackDuplicate) {
+   CHAR16 **LoaderNames, FileName[256];
+   UINTN  LoaderCount, i;
+
+   if (!ScanCacheLookup(Volume, Path, Stamp, DirTime, &LoaderNames, &LoaderCount, FoundFallbackDuplicate))
+      return FALSE;
+
+   for (i = 0; i < LoaderCount; i++) {
+      SPrint(FileName, 255, L"\\%s\\%s", Path, LoaderNames[i]);
+      CleanUpPathNameSlashes(FileName);
+      AddLoaderEntry(FileName, NULL, Volume);
+   } // for
+   return TRUE;
+} // static BOOLEAN AddCachedLoaderEntries()
+
+// Record the loaders in LoaderList, found in Path on Volume, in the scan cache.
+static VOID CacheLoaderList(IN REFIT_VOLUME *Volume, IN CHAR16 *Path, IN UINT32 Stamp, IN EFI_TIME *DirTime,
+                            IN struct LOADER_LIST *LoaderList, IN BOOLEAN FoundFallbackDuplicate) {
+   struct LOADER_LIST *Loader;
+   CHAR16             **LoaderNames = NULL;
+   UINTN              LoaderCount = 0;
+
+   for (Loader = LoaderList; Loader != NULL; Loader = Loader->NextEntry)
+      AddListElement((VOID ***) &LoaderNames, &LoaderCount, Basename(Loader->FileName));
+   ScanCacheStore(Volume, Path, Stamp, DirTime, LoaderNames, LoaderCount, FoundFallbackDuplicate);
+   MyFreePool(LoaderNames); // names point into LoaderList
+} // static VOID CacheLoaderList()
+
 // Scan an individual directory for EFI boot loader files and, if found,
 // add them to the list. Exception: Ignores FALLBACK_FULLNAME, which is picked
 // up in ScanEfiFiles(). Sorts the entries within the loader directory so that
@@ -1252,27 +1624,39 @@ static BOOLEAN HasSignedCounterpart(IN REFIT_VOLUME *Volume, IN CHAR16 *Path, IN
 static BOOLEAN ScanLoaderDir(IN REFIT_VOLUME *Volume, IN CHAR16 *Path, IN CHAR16 *Pattern)
 {
     EFI_STATUS              Status;
-    REFIT_DIR_ITER          DirIter;
+    REFIT_DIR_SNAPSHOT      Snapshot;
     EFI_FILE_INFO           *DirEntry;
+    EFI_TIME                DirTime;
     CHAR16                  FileName[256], *Extension;
     struct LOADER_LIST      *LoaderList = NULL, *NewLoader;
-    BOOLEAN                 FoundFallbackDuplicate = FALSE;
+    BOOLEAN                 FoundFallbackDuplicate = FALSE, SkipIt, UseCache = FALSE;
+    UINTN                   i = 0;
+    UINT32                  Stamp = 0;
 
-    if ((!SelfDirPath || !Path || ((StriCmp(Path, SelfDirPath) == 0) && (Volume->DeviceHandle != SelfVolume->DeviceHandle)) ||
+    if ((!SelfDirPath || !Path || ((StriCmp(Path, SelfDirPath) == 0) && (!SelfVolume || (Volume->DeviceHandle != SelfVolume->DeviceHandle))) ||
            (StriCmp(Path, SelfDirPath) != 0)) && (ShouldScan(Volume, Path))) {
-       // look through contents of the directory
-       DirIterOpen(Volume->RootDir, Path, &DirIter);
-       while (DirIterNext(&DirIter, 2, Pattern, &DirEntry)) {
+       if (GlobalConfig.CacheScans && ScanCacheGetDirTime(Volume, Path, &DirTime)) {
+          UseCache = TRUE;
+          Stamp = crc32(VolumeScanStamp, Pattern, StrSize(Pattern));
+          if (AddCachedLoaderEntries(Volume, Path, Stamp, &DirTime, &FoundFallbackDuplicate))
+             return FoundFallbackDuplicate;
+       } // if
+
+       // Read the directory once, then run the name-based tests against that
+       // snapshot; candidates are opened only to check their headers.
+       DirSnapshotRead(Volume->RootDir, Path, 2, &Snapshot);
+       while (DirSnapshotNext(&Snapshot, &i, Pattern, &DirEntry)) {
           Extension = FindExtension(DirEntry->FileName);
-          if (DirEntry->FileName[0] == '.' ||
-              StriCmp(Extension, L".icns") == 0 ||
-              StriCmp(Extension, L".png") == 0 ||
-              (StriCmp(DirEntry->FileName, FALLBACK_BASENAME) == 0 && (StriCmp(Path, L"EFI\\BOOT") == 0)) ||
-              StriSubCmp(L"shell", DirEntry->FileName) ||
-              IsSymbolicLink(Volume, Path, DirEntry) || /* is symbolic link */
-              HasSignedCounterpart(Volume, Path, DirEntry->FileName) || /* a file with same name plus ".efi.signed" is present */
-              FilenameIn(Volume, Path, DirEntry->FileName, GlobalConfig.DontScanFiles))
-                continue;   // skip this
+          SkipIt = (DirEntry->FileName[0] == '.' ||
+                    StriCmp(Extension, L".icns") == 0 ||
+                    StriCmp(Extension, L".png") == 0 ||
+                    (StriCmp(DirEntry->FileName, FALLBACK_BASENAME) == 0 && (StriCmp(Path, L"EFI\\BOOT") == 0)) ||
+                    StriSubCmp(L"shell", DirEntry->FileName) ||
+                    HasSignedCounterpart(&Snapshot, DirEntry->FileName) || /* a file with same name plus ".efi.signed" is present */
+                    NameListMatch(&GlobalConfig.DontScanFilesList, Volume, Path, DirEntry->FileName));
+          MyFreePool(Extension);
+          if (SkipIt)
+             continue;
 
           if (Path)
              SPrint(FileName, 255, L"\\%s\\%s", Path, DirEntry->FileName);
@@ -1280,7 +1664,7 @@ static BOOLEAN ScanLoaderDir(IN REFIT_VOLUME *Volume, IN CHAR16 *Path, IN CHAR16
              SPrint(FileName, 255, L"\\%s", DirEntry->FileName);
           CleanUpPathNameSlashes(FileName);
 
-          if(!IsValidLoader(Volume->RootDir, FileName))
+          if (!IsUsableLoader(Volume, FileName, DirEntry)) /* is symbolic link or not a loader for this ARCH */
              continue;
 
           NewLoader = AllocateZeroPool(sizeof(struct LOADER_LIST));
@@ -1288,10 +1672,9 @@ static BOOLEAN ScanLoaderDir(IN REFIT_VOLUME *Volume, IN CHAR16 *Path, IN CHAR16
              NewLoader->FileName = StrDuplicate(FileName);
              NewLoader->TimeStamp = DirEntry->ModificationTime;
              LoaderList = AddLoaderListEntry(LoaderList, NewLoader);
-             if (DuplicatesFallback(Volume, FileName))
+             if (DuplicatesFallback(Volume, FileName, DirEntry))
                 FoundFallbackDuplicate = TRUE;
           } // if
-          MyFreePool(Extension);
        } // while
 
        NewLoader = LoaderList;
@@ -1300,8 +1683,12 @@ static BOOLEAN ScanLoaderDir(IN REFIT_VOLUME *Volume, IN CHAR16 *Path, IN CHAR16
           NewLoader = NewLoader->NextEntry;
        } // while
 
+       Status = Snapshot.LastStatus;
+       if (UseCache && !EFI_ERROR(Status))
+          CacheLoaderList(Volume, Path, Stamp, &DirTime, LoaderList, FoundFallbackDuplicate);
        CleanUpLoaderList(LoaderList);
-       Status = DirIterClose(&DirIter);
+       DirCacheStore(Volume, Path, &Snapshot); // for later tool probes
+       DirSnapshotFree(&Snapshot);
        // NOTE: EFI_INVALID_PARAMETER really is an error that should be reported;
        // but I've gotten reports from users who are getting this error occasionally
        // and I can't find anything wrong or reproduce the problem, so I'm putting
@@ -1322,12 +1709,16 @@ static VOID ScanEfiFiles(REFIT_VOLUME *Volume) {
    EFI_STATUS              Status;
    REFIT_DIR_ITER          EfiDirIter;
    EFI_FILE_INFO           *EfiDirEntry;
-   CHAR16                  FileName[256], *Directory = NULL, *MatchPatterns, *VolName = NULL, *SelfPath;
-   UINTN                   i, Length;
+   CHAR16                  FileName[256], *MatchPatterns, *SelfPath;
+   NAME_LIST_ITEM          *AlsoScan;
+   UINTN                   i;
    BOOLEAN                 ScanFallbackLoader = TRUE;
    BOOLEAN                 FoundBRBackup = FALSE;
 
    if ((Volume->RootDir != NULL) && (Volume->VolName != NULL) && (Volume->IsReadable)) {
+      FallbackPrintVolume = NULL; // fallback loader may have changed since the last scan
+      if (GlobalConfig.CacheScans)
+         VolumeScanStamp = ComputeVolumeScanStamp(Volume);
       MatchPatterns = StrDuplicate(LOADER_MATCH_PATTERNS);
       if (GlobalConfig.ScanAllLinux)
          MergeStrings(&MatchPatterns, LINUX_MATCH_PATTERNS, L',');
@@ -1335,17 +1726,17 @@ static VOID ScanEfiFiles(REFIT_VOLUME *Volume) {
       // check for Mac OS X boot loader
       if (ShouldScan(Volume, L"System\\Library\\CoreServices")) {
          StrCpy(FileName, MACOSX_LOADER_PATH);
-         if (FileExists(Volume->RootDir, FileName) && !FilenameIn(Volume, Directory, L"boot.efi", GlobalConfig.DontScanFiles)) {
+         if (FileExists(Volume->RootDir, FileName) && !NameListMatch(&GlobalConfig.DontScanFilesList, Volume, L"System\\Library\\CoreServices", L"boot.efi")) {
             AddLoaderEntry(FileName, L"Mac OS X", Volume);
-            if (DuplicatesFallback(Volume, FileName))
+            if (DuplicatesFallback(Volume, FileName, NULL))
                ScanFallbackLoader = FALSE;
          }
 
          // check for XOM
          StrCpy(FileName, L"System\\Library\\CoreServices\\xom.efi");
-         if (FileExists(Volume->RootDir, FileName) && !FilenameIn(Volume, Directory, L"boot.efi", GlobalConfig.DontScanFiles)) {
+         if (FileExists(Volume->RootDir, FileName) && !NameListMatch(&GlobalConfig.DontScanFilesList, Volume, L"System\\Library\\CoreServices", L"boot.efi")) {
             AddLoaderEntry(FileName, L"Windows XP (XoM)", Volume);
-            if (DuplicatesFallback(Volume, FileName))
+            if (DuplicatesFallback(Volume, FileName, NULL))
                ScanFallbackLoader = FALSE;
          }
       } // if should scan Mac directory
@@ -1353,20 +1744,20 @@ static VOID ScanEfiFiles(REFIT_VOLUME *Volume) {
       // check for Microsoft boot loader/menu
       if (ShouldScan(Volume, L"EFI\\Microsoft\\Boot")) {
          StrCpy(FileName, L"EFI\\Microsoft\\Boot\\bkpbootmgfw.efi");
-         if (FileExists(Volume->RootDir, FileName) &&  !FilenameIn(Volume, Directory, L"bkpbootmgfw.efi",
-             GlobalConfig.DontScanFiles)) {
+         if (FileExists(Volume->RootDir, FileName) &&  !NameListMatch(&GlobalConfig.DontScanFilesList, Volume, L"EFI\\Microsoft\\Boot",
+                                                                 L"bkpbootmgfw.efi")) {
             AddLoaderEntry(FileName, L"Microsoft EFI boot (Boot Repair backup)", Volume);
             FoundBRBackup = TRUE;
-            if (DuplicatesFallback(Volume, FileName))
+            if (DuplicatesFallback(Volume, FileName, NULL))
                ScanFallbackLoader = FALSE;
          }
          StrCpy(FileName, L"EFI\\Microsoft\\Boot\\bootmgfw.efi");
-         if (FileExists(Volume->RootDir, FileName) &&  !FilenameIn(Volume, Directory, L"bootmgfw.efi", GlobalConfig.DontScanFiles)) {
+         if (FileExists(Volume->RootDir, FileName) &&  !NameListMatch(&GlobalConfig.DontScanFilesList, Volume, L"EFI\\Microsoft\\Boot", L"bootmgfw.efi")) {
             if (FoundBRBackup)
                AddLoaderEntry(FileName, L"Supposed Microsoft EFI boot (probably GRUB)", Volume);
             else
                AddLoaderEntry(FileName, L"Microsoft EFI boot", Volume);
-            if (DuplicatesFallback(Volume, FileName))
+            if (DuplicatesFallback(Volume, FileName, NULL))
                ScanFallbackLoader = FALSE;
          }
       } // if
@@ -1389,23 +1780,18 @@ static VOID ScanEfiFiles(REFIT_VOLUME *Volume) {
          CheckError(Status, L"while scanning the EFI directory");
 
       // Scan user-specified (or additional default) directories....
-      i = 0;
-      while ((Directory = FindCommaDelimited(GlobalConfig.AlsoScan, i++)) != NULL) {
-         if (ShouldScan(Volume, Directory)) {
-            SplitVolumeAndFilename(&Directory, &VolName);
-            CleanUpPathNameSlashes(Directory);
-            Length = StrLen(Directory);
-            if ((Length > 0) && ScanLoaderDir(Volume, Directory, MatchPatterns))
-               ScanFallbackLoader = FALSE;
-            MyFreePool(VolName);
-         } // if should scan dir
-         MyFreePool(Directory);
-      } // while
+      for (i = 0; i < GlobalConfig.AlsoScanList.Count; i++) {
+         AlsoScan = &(GlobalConfig.AlsoScanList.Items[i]);
+         if (((AlsoScan->VolName == NULL) || VolumeNameMatches(Volume, AlsoScan->VolName)) &&
+             (StrLen(AlsoScan->Path) > 0) && ShouldScan(Volume, AlsoScan->Path) &&
+             ScanLoaderDir(Volume, AlsoScan->Path, MatchPatterns))
+            ScanFallbackLoader = FALSE;
+      } // for
 
       // Don't scan the fallback loader if it's on the same volume and a duplicate of rEFInd itself....
       SelfPath = DevicePathToStr(SelfLoadedImage->FilePath);
       CleanUpPathNameSlashes(SelfPath);
-      if ((Volume->DeviceHandle == SelfLoadedImage->DeviceHandle) && DuplicatesFallback(Volume, SelfPath))
+      if ((Volume->DeviceHandle == SelfLoadedImage->DeviceHandle) && DuplicatesFallback(Volume, SelfPath, NULL))
          ScanFallbackLoader = FALSE;
 
       // If not a duplicate & if it exists & if it's not us, create an entry
@@ -1629,7 +2015,7 @@ static VOID StartLegacy(IN LEGACY_ENTRY *Entry, IN CHAR16 *SelectionName)
     ExtractLegacyLoaderPaths(DiscoveredPathList, MAX_DISCOVERED_PATHS, LegacyLoaderList);
 
     StoreLoaderName(SelectionName);
-    Status = StartEFIImageList(DiscoveredPathList, Entry->LoadOptions, TYPE_LEGACY, L"legacy loader", 0, &ErrorInStep, TRUE);
+    Status = StartEFIImageList(DiscoveredPathList, Entry->LoadOptions, TYPE_LEGACY, L"legacy loader", 0, &ErrorInStep, TRUE, TRUE);
     if (Status == EFI_NOT_FOUND) {
         if (ErrorInStep == 1) {
             Print(L"\nPlease make sure that you have the latest firmware update installed.\n");
@@ -1676,16 +2062,14 @@ static LEGACY_ENTRY * AddLegacyEntry(IN CHAR16 *LoaderTitle, IN REFIT_VOLUME *Vo
     else
         VolDesc = (Volume->DiskKind == DISK_KIND_OPTICAL) ? L"CD" : L"HD";
 
-    LegacyTitle = AllocateZeroPool(256 * sizeof(CHAR16));
+    LegacyTitle = ScanArenaAllocateZero(256 * sizeof(CHAR16));
     if (LegacyTitle != NULL)
        SPrint(LegacyTitle, 255, L"Boot %s from %s", LoaderTitle, VolDesc);
-    if (IsInSubstring(LegacyTitle, GlobalConfig.DontScanVolumes)) {
-       MyFreePool(LegacyTitle);
+    if (IsInSubstring(LegacyTitle, GlobalConfig.DontScanVolumes))
        return NULL;
-    } // if
 
     // prepare the menu entry
-    Entry = AllocateZeroPool(sizeof(LEGACY_ENTRY));
+    Entry = ScanArenaAllocateZero(sizeof(LEGACY_ENTRY));
     Entry->me.Title = LegacyTitle;
     Entry->me.Tag          = TAG_LEGACY;
     Entry->me.Row          = 0;
@@ -1698,20 +2082,20 @@ static LEGACY_ENTRY * AddLegacyEntry(IN CHAR16 *LoaderTitle, IN REFIT_VOLUME *Vo
     Entry->Enabled         = TRUE;
 
     // create the submenu
-    SubScreen = AllocateZeroPool(sizeof(REFIT_MENU_SCREEN));
-    SubScreen->Title = AllocateZeroPool(256 * sizeof(CHAR16));
+    SubScreen = ScanArenaAllocateZero(sizeof(REFIT_MENU_SCREEN));
+    SubScreen->Title = ScanArenaAllocateZero(256 * sizeof(CHAR16));
     SPrint(SubScreen->Title, 255, L"Boot Options for %s on %s", LoaderTitle, VolDesc);
     SubScreen->TitleImage = Entry->me.Image;
-    SubScreen->Hint1 = StrDuplicate(SUBSCREEN_HINT1);
+    SubScreen->Hint1 = SUBSCREEN_HINT1;
     if (GlobalConfig.HideUIFlags & HIDEUI_FLAG_EDITOR) {
-       SubScreen->Hint2 = StrDuplicate(SUBSCREEN_HINT2_NO_EDITOR);
+       SubScreen->Hint2 = SUBSCREEN_HINT2_NO_EDITOR;
     } else {
-       SubScreen->Hint2 = StrDuplicate(SUBSCREEN_HINT2);
+       SubScreen->Hint2 = SUBSCREEN_HINT2;
     } // if/else
 
     // default entry
-    SubEntry = AllocateZeroPool(sizeof(LEGACY_ENTRY));
-    SubEntry->me.Title = AllocateZeroPool(256 * sizeof(CHAR16));
+    SubEntry = ScanArenaAllocateZero(sizeof(LEGACY_ENTRY));
+    SubEntry->me.Title = ScanArenaAllocateZero(256 * sizeof(CHAR16));
     SPrint(SubEntry->me.Title, 255, L"Boot %s", LoaderTitle);
     SubEntry->me.Tag          = TAG_LEGACY;
     SubEntry->Volume          = Entry->Volume;
@@ -1743,15 +2127,35 @@ static EG_IMAGE * GetDiskBadge(IN UINTN DiskType) {
    return Badge;
 } // static EG_IMAGE * GetDiskBadge()
 
+// Moves a boot option read by BdsLibVariableToOption(), and the buffers it
+// points to, into the scan arena, so that it lasts as long as the legacy
+// entry that boots it. Returns the arena copy.
+static BDS_COMMON_OPTION * ScanArenaKeepBdsOption(IN BDS_COMMON_OPTION *BdsOption) {
+   BdsOption->DevicePath = ScanArenaKeepDevicePath(BdsOption->DevicePath);
+   BdsOption->Description = ScanArenaKeepString(BdsOption->Description);
+   BdsOption->LoadOptions = ScanArenaKeep(BdsOption->LoadOptions, BdsOption->LoadOptionsSize);
+   return ScanArenaKeep(BdsOption, sizeof(BDS_COMMON_OPTION));
+} // static BDS_COMMON_OPTION * ScanArenaKeepBdsOption()
+
+// Frees a boot option read by BdsLibVariableToOption() that no entry uses.
+static VOID FreeBdsOption(IN BDS_COMMON_OPTION *BdsOption) {
+   MyFreePool(BdsOption->DevicePath);
+   MyFreePool(BdsOption->Description);
+   MyFreePool(BdsOption->LoadOptions);
+   MyFreePool(BdsOption);
+} // static VOID FreeBdsOption()
+
 /**
     Create a rEFInd boot option from a Legacy BIOS protocol option.
+    On success, BdsOption is moved into the scan arena; on failure (NULL
+    return), it's left for the caller to free.
 */
 static LEGACY_ENTRY * AddLegacyEntryUEFI(BDS_COMMON_OPTION *BdsOption, IN UINT16 DiskType)
 {
     LEGACY_ENTRY            *Entry, *SubEntry;
     REFIT_MENU_SCREEN       *SubScreen;
     CHAR16                  ShortcutLetter = 0;
-    CHAR16 *LegacyDescription = StrDuplicate(BdsOption->Description);
+    CHAR16 *LegacyDescription = ScanArenaStrDuplicate(BdsOption->Description);
 
     if (IsInSubstring(LegacyDescription, GlobalConfig.DontScanVolumes))
        return NULL;
@@ -1761,9 +2165,11 @@ static LEGACY_ENTRY * AddLegacyEntryUEFI(BDS_COMMON_OPTION *BdsOption, IN UINT16
     // description on the screen....
     LimitStringLength(LegacyDescription, 100);
 
+    BdsOption = ScanArenaKeepBdsOption(BdsOption);
+
     // prepare the menu entry
-    Entry = AllocateZeroPool(sizeof(LEGACY_ENTRY));
-    Entry->me.Title = AllocateZeroPool(256 * sizeof(CHAR16));
+    Entry = ScanArenaAllocateZero(sizeof(LEGACY_ENTRY));
+    Entry->me.Title = ScanArenaAllocateZero(256 * sizeof(CHAR16));
     SPrint(Entry->me.Title, 255, L"Boot legacy target %s", LegacyDescription);
     Entry->me.Tag          = TAG_LEGACY_UEFI;
     Entry->me.Row          = 0;
@@ -1776,20 +2182,20 @@ static LEGACY_ENTRY * AddLegacyEntryUEFI(BDS_COMMON_OPTION *BdsOption, IN UINT16
     Entry->Enabled         = TRUE;
 
     // create the submenu
-    SubScreen = AllocateZeroPool(sizeof(REFIT_MENU_SCREEN));
-    SubScreen->Title = AllocateZeroPool(256 * sizeof(CHAR16));
+    SubScreen = ScanArenaAllocateZero(sizeof(REFIT_MENU_SCREEN));
+    SubScreen->Title = ScanArenaAllocateZero(256 * sizeof(CHAR16));
     SPrint(SubScreen->Title, 255, L"No boot options for legacy target");
     SubScreen->TitleImage = Entry->me.Image;
-    SubScreen->Hint1 = StrDuplicate(SUBSCREEN_HINT1);
+    SubScreen->Hint1 = SUBSCREEN_HINT1;
     if (GlobalConfig.HideUIFlags & HIDEUI_FLAG_EDITOR) {
-       SubScreen->Hint2 = StrDuplicate(SUBSCREEN_HINT2_NO_EDITOR);
+       SubScreen->Hint2 = SUBSCREEN_HINT2_NO_EDITOR;
     } else {
-       SubScreen->Hint2 = StrDuplicate(SUBSCREEN_HINT2);
+       SubScreen->Hint2 = SUBSCREEN_HINT2;
     } // if/else
 
     // default entry
-    SubEntry = AllocateZeroPool(sizeof(LEGACY_ENTRY));
-    SubEntry->me.Title = AllocateZeroPool(256 * sizeof(CHAR16));
+    SubEntry = ScanArenaAllocateZero(sizeof(LEGACY_ENTRY));
+    SubEntry->me.Title = ScanArenaAllocateZero(256 * sizeof(CHAR16));
     SPrint(SubEntry->me.Title, 255, L"Boot %s", LegacyDescription);
     SubEntry->me.Tag          = TAG_LEGACY_UEFI;
     Entry->BdsOption          = BdsOption; 
@@ -1817,6 +2223,7 @@ static VOID ScanLegacyUEFI(IN UINTN DiskType)
     UINTN                     BootOrderSize = 0;
     CHAR16                    Buffer[20];
     BDS_COMMON_OPTION         *BdsOption;
+    LEGACY_ENTRY              *Entry;
     LIST_ENTRY                TempList;
     BBS_BBS_DEVICE_PATH       *BbsDevicePath = NULL;
     BOOLEAN                   SearchingForUsb = FALSE;
@@ -1853,6 +2260,7 @@ static VOID ScanLegacyUEFI(IN UINTN DiskType)
         BdsOption = BdsLibVariableToOption (&TempList, BootOption);
 
         if (BdsOption != NULL) {
+           Entry = NULL;
            BbsDevicePath = (BBS_BBS_DEVICE_PATH *)BdsOption->DevicePath;
            // Only add the entry if it is of a requested type (e.g. USB, HD)
            // Two checks necessary because some systems return EFI boot loaders
@@ -1864,17 +2272,20 @@ static VOID ScanLegacyUEFI(IN UINTN DiskType)
               // incorrect, but internally useful) BBS_TYPE_USB flag set.
               if (DiskType == BBS_HARDDISK) {
                  if (SearchingForUsb && (BbsDevicePath->StatusFlag & (BBS_MEDIA_PRESENT | BBS_MEDIA_MAYBE_PRESENT))) {
-                    AddLegacyEntryUEFI(BdsOption, BBS_USB);
+                    Entry = AddLegacyEntryUEFI(BdsOption, BBS_USB);
                  } else if (!SearchingForUsb && !(BbsDevicePath->StatusFlag & (BBS_MEDIA_PRESENT | BBS_MEDIA_MAYBE_PRESENT))) {
-                    AddLegacyEntryUEFI(BdsOption, DiskType);
+                    Entry = AddLegacyEntryUEFI(BdsOption, DiskType);
                  }
               } else {
-                 AddLegacyEntryUEFI(BdsOption, DiskType);
+                 Entry = AddLegacyEntryUEFI(BdsOption, DiskType);
               } // if/else
            } // if
+           if (Entry == NULL)
+              FreeBdsOption(BdsOption);
         } // if (BdsOption != NULL)
         Index++;
     } // while
+    MyFreePool(BootOrder);
 } /* static VOID ScanLegacyUEFI() */
 
 static VOID ScanLegacyVolume(REFIT_VOLUME *Volume, UINTN VolumeIndex) {
@@ -1974,7 +2385,7 @@ static VOID StartTool(IN LOADER_ENTRY *Entry)
    BeginExternalScreen(Entry->UseGraphicsMode, Entry->me.Title + 6);  // assumes "Start <title>" as assigned below
    StoreLoaderName(Entry->me.Title);
    StartEFIImage(Entry->DevicePath, Entry->LoadOptions, TYPE_EFI,
-                 Basename(Entry->LoaderPath), Entry->OSType, NULL, TRUE);
+                 Basename(Entry->LoaderPath), Entry->OSType, NULL, TRUE, FALSE);
    FinishExternalScreen();
 } /* static VOID StartTool() */
 
@@ -1984,16 +2395,16 @@ static LOADER_ENTRY * AddToolEntry(EFI_HANDLE DeviceHandle, IN CHAR16 *LoaderPat
     LOADER_ENTRY *Entry;
     CHAR16       *TitleStr = NULL;
 
-    Entry = AllocateZeroPool(sizeof(LOADER_ENTRY));
+    Entry = ScanArenaAllocateZero(sizeof(LOADER_ENTRY));
 
-    TitleStr = PoolPrint(L"Start %s", LoaderTitle);
+    TitleStr = ScanArenaPoolPrint(L"Start %s", LoaderTitle);
     Entry->me.Title = TitleStr;
     Entry->me.Tag = TAG_TOOL;
     Entry->me.Row = 1;
     Entry->me.ShortcutLetter = ShortcutLetter;
     Entry->me.Image = Image;
-    Entry->LoaderPath = (LoaderPath) ? StrDuplicate(LoaderPath) : NULL;
-    Entry->DevicePath = FileDevicePath(DeviceHandle, Entry->LoaderPath);
+    Entry->LoaderPath = ScanArenaStrDuplicate(LoaderPath);
+    Entry->DevicePath = ScanArenaKeepDevicePath(FileDevicePath(DeviceHandle, Entry->LoaderPath));
     Entry->UseGraphicsMode = UseGraphicsMode;
 
     AddMenuEntry(&MainMenu, (REFIT_MENU_ENTRY *)Entry);
@@ -2004,13 +2415,16 @@ static LOADER_ENTRY * AddToolEntry(EFI_HANDLE DeviceHandle, IN CHAR16 *LoaderPat
 // pre-boot driver functions
 //
 
-static UINTN ScanDriverDir(IN CHAR16 *Path)
+// Adds the drivers in the Path directory to the *Drivers list, as full
+// pathnames, skipping any whose filename is already on the list (from
+// another directory), so that the same driver isn't loaded twice.
+static VOID FindDriversInDir(IN CHAR16 *Path, IN OUT CHAR16 ***Drivers, IN OUT UINTN *DriverCount)
 {
     EFI_STATUS              Status;
     REFIT_DIR_ITER          DirIter;
-    UINTN                   NumFound = 0;
     EFI_FILE_INFO           *DirEntry;
     CHAR16                  FileName[256];
+    UINTN                   i;
 
     CleanUpPathNameSlashes(Path);
     // look through contents of the directory
@@ -2019,109 +2433,109 @@ static UINTN ScanDriverDir(IN CHAR16 *Path)
         if (DirEntry->FileName[0] == '.')
             continue;   // skip this
 
-        SPrint(FileName, 255, L"%s\\%s", Path, DirEntry->FileName);
-        NumFound++;
-        Status = StartEFIImage(FileDevicePath(SelfLoadedImage->DeviceHandle, FileName),
-                               L"", TYPE_EFI, DirEntry->FileName, 0, NULL, FALSE);
+        for (i = 0; i < *DriverCount; i++) {
+            if (StriCmp(Basename((*Drivers)[i]), DirEntry->FileName) == 0)
+                break;
+        }
+        if (i < *DriverCount)
+            continue;   // already found elsewhere
+        AddListElement((VOID ***) Drivers, DriverCount, PoolPrint(L"%s\\%s", Path, DirEntry->FileName));
     }
     Status = DirIterClose(&DirIter);
     if (Status != EFI_NOT_FOUND) {
         SPrint(FileName, 255, L"while scanning the %s directory", Path);
         CheckError(Status, FileName);
     }
-    return (NumFound);
-}
+} /* static VOID FindDriversInDir() */
+
+static VOID LoadDriver(IN CHAR16 *FileName)
+{
+    StartEFIImage(FileDevicePath(SelfLoadedImage->DeviceHandle, FileName),
+                  L"", TYPE_EFI, Basename(FileName), 0, NULL, FALSE, FALSE);
+    DriverManifestNoteLoaded(Basename(FileName));
+} /* static VOID LoadDriver() */
 
 #ifdef __MAKEWITH_GNUEFI
+// Connect every root controller: that is, every handle with a device path that
+// isn't an image or a driver and that isn't already a child of another
+// controller. The handle database is classified once, up front, rather than
+// re-scanned for each handle.
 static EFI_STATUS ConnectAllDriversToAllControllers(VOID)
 {
     EFI_STATUS           Status;
-    UINTN                AllHandleCount;
-    EFI_HANDLE           *AllHandleBuffer;
-    UINTN                Index;
     UINTN                HandleCount;
     EFI_HANDLE           *HandleBuffer;
     UINT32               *HandleType;
-    UINTN                HandleIndex;
-    BOOLEAN              Parent;
-    BOOLEAN              Device;
-
-    Status = LibLocateHandle(AllHandles,
-                             NULL,
-                             NULL,
-                             &AllHandleCount,
-                             &AllHandleBuffer);
-    if (EFI_ERROR(Status))
-        return Status;
-
-    for (Index = 0; Index < AllHandleCount; Index++) {
-        //
-        // Scan the handle database
-        //
-        Status = LibScanHandleDatabase(NULL,
-                                       NULL,
-                                       AllHandleBuffer[Index],
-                                       NULL,
-                                       &HandleCount,
-                                       &HandleBuffer,
-                                       &HandleType);
-        if (EFI_ERROR (Status))
-            goto Done;
-
-        Device = TRUE;
-        if (HandleType[Index] & EFI_HANDLE_TYPE_DRIVER_BINDING_HANDLE)
-            Device = FALSE;
-        if (HandleType[Index] & EFI_HANDLE_TYPE_IMAGE_HANDLE)
-            Device = FALSE;
-
-        if (Device) {
-            Parent = FALSE;
-            for (HandleIndex = 0; HandleIndex < HandleCount; HandleIndex++) {
-                if (HandleType[HandleIndex] & EFI_HANDLE_TYPE_PARENT_HANDLE)
-                    Parent = TRUE;
-            } // for
-
-            if (!Parent) {
-                if (HandleType[Index] & EFI_HANDLE_TYPE_DEVICE_HANDLE) {
-                   Status = refit_call4_wrapper(BS->ConnectController,
-                                                AllHandleBuffer[Index],
-                                                NULL,
-                                                NULL,
-                                                TRUE);
-                }
-            }
-        }
+    UINTN                HandleIndex, TimingId;
+    CHAR16               Detail[64];
+#if REFIT_DEBUG > 0
+    UINTN                Connected = 0;
+    UINT64               StartTime = TimeStampMs();
+#endif
 
-        MyFreePool (HandleBuffer);
-        MyFreePool (HandleType);
+    TimingId = BootTimeBegin(L"ConnectAllDriversToAllControllers", NULL);
+    Status = LibClassifyHandleDatabase(&HandleCount, &HandleBuffer, &HandleType);
+    if (EFI_ERROR(Status)) {
+        BootTimeEnd(TimingId, NULL);
+        return Status;
     }
 
-Done:
-    MyFreePool (AllHandleBuffer);
+    for (HandleIndex = 0; HandleIndex < HandleCount; HandleIndex++) {
+        if ((HandleType[HandleIndex] & (EFI_HANDLE_TYPE_IMAGE_HANDLE | EFI_HANDLE_TYPE_DRIVER_BINDING_HANDLE |
+                                        EFI_HANDLE_TYPE_CHILD_HANDLE)) ||
+            !(HandleType[HandleIndex] & EFI_HANDLE_TYPE_DEVICE_HANDLE))
+            continue;
+        Status = refit_call4_wrapper(BS->ConnectController,
+                                     HandleBuffer[HandleIndex],
+                                     NULL,
+                                     NULL,
+                                     TRUE);
+#if REFIT_DEBUG > 0
+        Connected++;
+#endif
+    } // for
+
+#if REFIT_DEBUG > 0
+    Print(L"Connected %d of %d handles in %ld ms\n", Connected, HandleCount, TimeStampMs() - StartTime);
+#endif
+    SPrint(Detail, sizeof(Detail), L"%d handles", HandleCount);
+    BootTimeEnd(TimingId, Detail);
+    MyFreePool(HandleBuffer);
+    MyFreePool(HandleType);
     return Status;
 } /* EFI_STATUS ConnectAllDriversToAllControllers() */
 #else
 static EFI_STATUS ConnectAllDriversToAllControllers(VOID) {
+   UINTN TimingId;
+
+   TimingId = BootTimeBegin(L"ConnectAllDriversToAllControllers", NULL);
    BdsLibConnectAllDriversToAllControllers();
+   BootTimeEnd(TimingId, NULL);
    return 0;
 }
 #endif
 
 // Load all EFI drivers from rEFInd's "drivers" subdirectory and from the
 // directories specified by the user in the "scan_driver_dirs" configuration
-// file line.
+// file line. A driver whose filename matches one in an earlier directory is
+// skipped. With the "driver_manifest" option, drivers that are known to
+// serve only filesystems that aren't present are skipped, too; see
+// driver_manifest.c.
 static VOID LoadDrivers(VOID)
 {
     CHAR16        *Directory, *SelfDirectory;
-    UINTN         i = 0, Length, NumFound = 0;
+    CHAR16        **Drivers = NULL;
+    UINTN         i = 0, Length, DriverCount = 0, NumLoaded = 0, NumFsLoaded;
+    UINT32        PresentTypes;
+    BOOLEAN       LoadAll;
 
-    // load drivers from the subdirectories of rEFInd's home directory specified
+    // find drivers in the subdirectories of rEFInd's home directory specified
     // in the DRIVER_DIRS constant.
     while ((Directory = FindCommaDelimited(DRIVER_DIRS, i++)) != NULL) {
        SelfDirectory = SelfDirPath ? StrDuplicate(SelfDirPath) : NULL;
        CleanUpPathNameSlashes(SelfDirectory);
        MergeStrings(&SelfDirectory, Directory, L'\\');
-       NumFound += ScanDriverDir(SelfDirectory);
+       FindDriversInDir(SelfDirectory, &Drivers, &DriverCount);
        MyFreePool(Directory);
        MyFreePool(SelfDirectory);
     }
@@ -2132,14 +2546,54 @@ static VOID LoadDrivers(VOID)
        CleanUpPathNameSlashes(Directory);
        Length = StrLen(Directory);
        if (Length > 0) {
-          NumFound += ScanDriverDir(Directory);
+          FindDriversInDir(Directory, &Drivers, &DriverCount);
        } // if
        MyFreePool(Directory);
     } // while
 
-    // connect all devices
-    if (NumFound > 0)
+    if (DriverCount == 0)
+       return;
+
+    if (!GlobalConfig.DriverManifest) {
+       for (i = 0; i < DriverCount; i++)
+          LoadDriver(Drivers[i]);
+       // connect all devices
        ConnectAllDriversToAllControllers();
+       FreeList((VOID ***) &Drivers, &DriverCount);
+       return;
+    }
+
+    // Load drivers that may reveal more disks (or that the manifest doesn't
+    // know about) first, and connect all devices so that their disks can be
+    // examined....
+    DriverManifestRead();
+    for (i = 0; i < DriverCount; i++) {
+       if (DriverManifestClass(Basename(Drivers[i])) != DRIVER_CLASS_FILESYSTEM) {
+          LoadDriver(Drivers[i]);
+          NumLoaded++;
+       }
+    } // for
+    if (NumLoaded > 0)
+       ConnectAllDriversToAllControllers();
+
+    // ...then the filesystem drivers for the filesystems that are present,
+    // or all of them if there's a filesystem the manifest hasn't seen.
+    PresentTypes = FilesystemTypesPresent();
+    LoadAll = !DriverManifestCovers(PresentTypes);
+    NumFsLoaded = 0;
+    for (i = 0; i < DriverCount; i++) {
+       if ((DriverManifestClass(Basename(Drivers[i])) == DRIVER_CLASS_FILESYSTEM) &&
+           (LoadAll || DriverManifestServes(Basename(Drivers[i]), PresentTypes))) {
+          LoadDriver(Drivers[i]);
+          NumFsLoaded++;
+       }
+    } // for
+
+    // As without the manifest, finish with a full connect, in case it was
+    // wrong about what a driver does; unless that's what was done last.
+    if ((NumFsLoaded > 0) || (NumLoaded == 0))
+       ConnectAllDriversToAllControllers();
+    FreeList((VOID ***) &Drivers, &DriverCount);
 } /* static VOID LoadDrivers() */
 
 // Determine what (if any) type of legacy (BIOS) boot support is available
@@ -2188,8 +2642,9 @@ static VOID WarnIfLegacyProblems(VOID) {
 
 // Locates boot loaders. NOTE: This assumes that GlobalConfig.LegacyType is set correctly.
 static VOID ScanForBootloaders(VOID) {
-   UINTN    i;
+   UINTN    i, TimingId;
    CHAR8    s;
+   CHAR16   ScanType[2];
    BOOLEAN  ScanForLegacy = FALSE;
 
    // Determine up-front if we'll be scanning for legacy loaders....
@@ -2207,6 +2662,11 @@ static VOID ScanForBootloaders(VOID) {
 
    // scan for loaders and tools, add them to the menu
    for (i = 0; i < NUM_SCAN_OPTIONS; i++) {
+      if (GlobalConfig.ScanFor[i] == ' ')
+         continue;
+      ScanType[0] = (CHAR16) GlobalConfig.ScanFor[i];
+      ScanType[1] = 0;
+      TimingId = BootTimeBegin(L"ScanFor", ScanType);
       switch(GlobalConfig.ScanFor[i]) {
          case 'c': case 'C':
             ScanLegacyDisc();
@@ -2230,6 +2690,7 @@ static VOID ScanForBootloaders(VOID) {
             ScanOptical();
             break;
       } // switch()
+      BootTimeEnd(TimingId, NULL);
    } // for
 
    // assign shortcut keys
@@ -2252,7 +2713,7 @@ static VOID FindTool(CHAR16 *Locations, CHAR16 *Names, CHAR16 *Description, UINT
          PathName = StrDuplicate(DirName);
          MergeStrings(&PathName, FileName, (StriCmp(PathName, L"\\") == 0) ? 0 : L'\\');
          for (VolumeIndex = 0; VolumeIndex < VolumesCount; VolumeIndex++) {
-            if ((Volumes[VolumeIndex]->RootDir != NULL) && (FileExists(Volumes[VolumeIndex]->RootDir, PathName))) {
+            if (VolumeFileExists(Volumes[VolumeIndex], PathName)) {
                SPrint(FullDescription, 255, L"%s at %s on %s", Description, PathName, Volumes[VolumeIndex]->VolName);
                AddToolEntry(Volumes[VolumeIndex]->DeviceHandle, PathName, FullDescription, BuiltinIcon(Icon), 'S', FALSE);
             } // if
@@ -2264,6 +2725,13 @@ static VOID FindTool(CHAR16 *Locations, CHAR16 *Names, CHAR16 *Description, UINT
    } // while Locations
 } // VOID FindTool()
 
+// Returns TRUE if FileName exists on the volume from which rEFInd was launched.
+static BOOLEAN SelfFileExists(IN CHAR16 *FileName) {
+   if ((SelfVolume != NULL) && (SelfVolume->RootDir != NULL))
+      return VolumeFileExists(SelfVolume, FileName);
+   return FileExists(SelfRootDir, FileName);
+} // static BOOLEAN SelfFileExists()
+
 // Add the second-row tags containing built-in and external tools (EFI shell,
 // reboot, etc.)
 static VOID ScanForTools(VOID) {
@@ -2318,7 +2786,7 @@ static VOID ScanForTools(VOID) {
          case TAG_SHELL:
             j = 0;
             while ((FileName = FindCommaDelimited(SHELL_NAMES, j++)) != NULL) {
-               if (FileExists(SelfRootDir, FileName)) {
+               if (SelfFileExists(FileName)) {
                   AddToolEntry(SelfLoadedImage->DeviceHandle, FileName, L"EFI Shell", BuiltinIcon(BUILTIN_ICON_TOOL_SHELL),
                                'S', FALSE);
                }
@@ -2329,7 +2797,7 @@ static VOID ScanForTools(VOID) {
          case TAG_GPTSYNC:
             j = 0;
             while ((FileName = FindCommaDelimited(GPTSYNC_NAMES, j++)) != NULL) {
-               if (FileExists(SelfRootDir, FileName)) {
+               if (SelfFileExists(FileName)) {
                   AddToolEntry(SelfLoadedImage->DeviceHandle, FileName, L"Hybrid MBR tool", BuiltinIcon(BUILTIN_ICON_TOOL_PART),
                                'P', FALSE);
                } // if
@@ -2341,7 +2809,7 @@ static VOID ScanForTools(VOID) {
          case TAG_GDISK:
             j = 0;
             while ((FileName = FindCommaDelimited(GDISK_NAMES, j++)) != NULL) {
-               if (FileExists(SelfRootDir, FileName)) {
+               if (SelfFileExists(FileName)) {
                   AddToolEntry(SelfLoadedImage->DeviceHandle, FileName, L"disk partitioning tool",
                                BuiltinIcon(BUILTIN_ICON_TOOL_PART), 'G', FALSE);
                } // if
@@ -2353,7 +2821,7 @@ static VOID ScanForTools(VOID) {
          case TAG_APPLE_RECOVERY:
             FileName = StrDuplicate(L"\\com.apple.recovery.boot\\boot.efi");
             for (VolumeIndex = 0; VolumeIndex < VolumesCount; VolumeIndex++) {
-               if ((Volumes[VolumeIndex]->RootDir != NULL) && (FileExists(Volumes[VolumeIndex]->RootDir, FileName))) {
+               if (VolumeFileExists(Volumes[VolumeIndex], FileName)) {
                   SPrint(Description, 255, L"Apple Recovery on %s", Volumes[VolumeIndex]->VolName);
                   AddToolEntry(Volumes[VolumeIndex]->DeviceHandle, FileName, Description,
                                BuiltinIcon(BUILTIN_ICON_TOOL_APPLE_RESCUE), 'R', TRUE);
@@ -2368,8 +2836,8 @@ static VOID ScanForTools(VOID) {
             while ((FileName = FindCommaDelimited(GlobalConfig.WindowsRecoveryFiles, j++)) != NULL) {
                SplitVolumeAndFilename(&FileName, &VolName);
                for (VolumeIndex = 0; VolumeIndex < VolumesCount; VolumeIndex++) {
-                  if ((Volumes[VolumeIndex]->RootDir != NULL) && (FileExists(Volumes[VolumeIndex]->RootDir, FileName)) &&
-                      ((VolName == NULL) || (StriCmp(VolName, Volumes[VolumeIndex]->VolName) == 0))) {
+                  if (((VolName == NULL) || (StriCmp(VolName, Volumes[VolumeIndex]->VolName) == 0)) &&
+                      VolumeFileExists(Volumes[VolumeIndex], FileName)) {
                      SPrint(Description, 255, L"Microsoft Recovery on %s", Volumes[VolumeIndex]->VolName);
                      AddToolEntry(Volumes[VolumeIndex]->DeviceHandle, FileName, Description,
                                   BuiltinIcon(BUILTIN_ICON_TOOL_WINDOWS_RESCUE), 'R', TRUE);
@@ -2392,11 +2860,33 @@ static VOID ScanForTools(VOID) {
 
       } // switch()
    } // for
+   ShrinkMenuItems(&MainMenu); // the main menu is complete
 } // static VOID ScanForTools
 
+// Discard the main menu's entries and sub-screens. These, and the strings,
+// device paths, images and legacy boot options they point to, belong to the
+// scan arena, so only the pool-allocated Entries and InfoLines arrays need
+// to be freed one by one before the arena itself is released.
+static VOID FreeMainMenuEntries(VOID) {
+   UINTN             i;
+   REFIT_MENU_SCREEN *SubScreen;
+
+   for (i = 0; i < MainMenu.EntryCount; i++) {
+      SubScreen = MainMenu.Entries[i]->SubScreen;
+      if (SubScreen != NULL)
+         FreeMenuItems(SubScreen);
+   } // for
+   FreeMenuItems(&MainMenu);
+   FreeScanArena();
+} // static VOID FreeMainMenuEntries()
+
 // Rescan for boot loaders
 static VOID RescanAll(BOOLEAN DisplayMessage) {
    EG_PIXEL           BGColor;
+   UINTN              TimingId;
+#if REFIT_DEBUG > 0
+   UINTN              IconHits, IconMisses;
+#endif
 
    BGColor.b = 255;
    BGColor.g = 175;
@@ -2404,14 +2894,21 @@ static VOID RescanAll(BOOLEAN DisplayMessage) {
    BGColor.a = 0;
    if (DisplayMessage)
       egDisplayMessage(L"Scanning for new boot loaders; please wait....", &BGColor);
-   FreeList((VOID ***) &(MainMenu.Entries), &MainMenu.EntryCount);
-   MainMenu.Entries = NULL;
-   MainMenu.EntryCount = 0;
+   FreeMainMenuEntries();
+   FreeLinuxOptionsCache();
+   FreeInitrdIndexes();
+   FreeDirCache();
+   TimingId = BootTimeBegin(L"Rescan", NULL);
    ReadConfig(GlobalConfig.ConfigFilename);
    ConnectAllDriversToAllControllers();
-   ScanVolumes();
+   ScanVolumes(FALSE);
    ScanForBootloaders();
    ScanForTools();
+   BootTimeEnd(TimingId, NULL);
+#if REFIT_DEBUG > 0
+   egGetIconCacheStats(&IconHits, &IconMisses);
+   Print(L"Icon cache: %d hits, %d misses\n", IconHits, IconMisses);
+#endif
    SetupScreen();
 } // VOID RescanAll()
 
@@ -2508,12 +3005,16 @@ efi_main (EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable)
     BOOLEAN            MainLoopRunning = TRUE;
     BOOLEAN            MokProtocol;
     REFIT_MENU_ENTRY   *ChosenEntry;
-    UINTN              MenuExit, i;
+    UINTN              MenuExit, i, TimingId;
     CHAR16             *SelectionName = NULL;
     EG_PIXEL           BGColor;
+#if REFIT_DEBUG > 0
+    UINTN              IconHits, IconMisses;
+#endif
 
     // bootstrap
     InitializeLib(ImageHandle, SystemTable);
+    BootTimeInit();
     Status = InitRefitLib(ImageHandle);
     if (EFI_ERROR(Status))
         return Status;
@@ -2524,9 +3025,13 @@ efi_main (EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable)
     if (GlobalConfig.LegacyType == LEGACY_TYPE_MAC)
        CopyMem(GlobalConfig.ScanFor, "ihebocm   ", NUM_SCAN_OPTIONS);
     SetConfigFilename(ImageHandle);
+    TimingId = BootTimeBegin(L"ReadConfig", NULL);
     ReadConfig(GlobalConfig.ConfigFilename);
+    BootTimeEnd(TimingId, NULL);
 
+    TimingId = BootTimeBegin(L"InitScreen", NULL);
     InitScreen();
+    BootTimeEnd(TimingId, NULL);
     WarnIfLegacyProblems();
     MainMenu.TimeoutSeconds = GlobalConfig.Timeout;
 
@@ -2535,10 +3040,24 @@ efi_main (EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable)
 
     // further bootstrap (now with config available)
     MokProtocol = SecureBootSetup();
+    TimingId = BootTimeBegin(L"LoadDrivers", NULL);
     LoadDrivers();
-    ScanVolumes();
+    BootTimeEnd(TimingId, NULL);
+    TimingId = BootTimeBegin(L"ScanVolumes", NULL);
+    ScanVolumes(TRUE); // reuse the disk reads LoadDrivers() made for the driver manifest
+    BootTimeEnd(TimingId, NULL);
+    if (GlobalConfig.DriverManifest)
+       DriverManifestUpdate();
+    TimingId = BootTimeBegin(L"ScanForBootloaders", NULL);
     ScanForBootloaders();
+    BootTimeEnd(TimingId, NULL);
+    TimingId = BootTimeBegin(L"ScanForTools", NULL);
     ScanForTools();
+    BootTimeEnd(TimingId, NULL);
+#if REFIT_DEBUG > 0
+    egGetIconCacheStats(&IconHits, &IconMisses);
+    Print(L"Icon cache: %d hits, %d misses\n", IconHits, IconMisses);
+#endif
     SetupScreen();
 
     if (GlobalConfig.ScanDelay > 0) {
@@ -47,6 +47,7 @@
 #include "lib.h"
 #include "menu.h"
 #include "config.h"
+#include "boottime.h"
 #include "libeg.h"
 #include "libegint.h"
 #include "../include/refit_call_wrapper.h"
@@ -84,6 +85,7 @@ static UINTN TileSizes[2] = { 144, 64 };
 
 static EG_IMAGE *SelectionImages[2] = { NULL, NULL };
 static EG_PIXEL SelectionBackgroundPixel = { 0xff, 0xff, 0xff, 0 };
+static BOOLEAN MenuPainted = FALSE;   // for the boot-time "First menu paint" mark
 
 //
 // Graphics helper functions
@@ -275,14 +277,38 @@ static VOID UpdateScroll(IN OUT SCROLL_STATE *State, IN UINTN Movement)
 
 VOID AddMenuInfoLine(IN REFIT_MENU_SCREEN *Screen, IN CHAR16 *InfoLine)
 {
-    AddListElement((VOID ***) &(Screen->InfoLines), &(Screen->InfoLineCount), InfoLine);
+    AddReservedListElement((VOID ***) &(Screen->InfoLines), &(Screen->InfoLineCount), &(Screen->InfoLineCapacity), InfoLine);
 }
 
 VOID AddMenuEntry(IN REFIT_MENU_SCREEN *Screen, IN REFIT_MENU_ENTRY *Entry)
 {
-    AddListElement((VOID ***) &(Screen->Entries), &(Screen->EntryCount), Entry);
+    AddReservedListElement((VOID ***) &(Screen->Entries), &(Screen->EntryCount), &(Screen->EntryCapacity), Entry);
 }
 
+// Makes room for ExtraInfoLines more info lines and ExtraEntries more
+// entries on Screen, for callers that know how many are coming.
+VOID ReserveMenuItems(IN REFIT_MENU_SCREEN *Screen, IN UINTN ExtraInfoLines, IN UINTN ExtraEntries)
+{
+    ReserveList((VOID ***) &(Screen->InfoLines), Screen->InfoLineCount, &(Screen->InfoLineCapacity),
+                Screen->InfoLineCount + ExtraInfoLines);
+    ReserveList((VOID ***) &(Screen->Entries), Screen->EntryCount, &(Screen->EntryCapacity),
+                Screen->EntryCount + ExtraEntries);
+} // VOID ReserveMenuItems()
+
+// Returns the spare room in Screen's arrays once it's fully built.
+VOID ShrinkMenuItems(IN REFIT_MENU_SCREEN *Screen)
+{
+    ShrinkList((VOID ***) &(Screen->InfoLines), Screen->InfoLineCount, &(Screen->InfoLineCapacity));
+    ShrinkList((VOID ***) &(Screen->Entries), Screen->EntryCount, &(Screen->EntryCapacity));
+} // VOID ShrinkMenuItems()
+
+// Frees Screen's info line and entry arrays (but not what they point to).
+VOID FreeMenuItems(IN REFIT_MENU_SCREEN *Screen)
+{
+    FreeReservedList((VOID ***) &(Screen->InfoLines), &(Screen->InfoLineCount), &(Screen->InfoLineCapacity));
+    FreeReservedList((VOID ***) &(Screen->Entries), &(Screen->EntryCount), &(Screen->EntryCapacity));
+} // VOID FreeMenuItems()
+
 
 static INTN FindMenuShortcutEntry(IN REFIT_MENU_SCREEN *Screen, IN CHAR16 *Defaults)
 {
@@ -390,6 +416,10 @@ static UINTN RunGenericMenu(IN REFIT_MENU_SCREEN *Screen, IN MENU_STYLE_FUNC Sty
         if (State.PaintAll && (GlobalConfig.ScreensaverTime != -1)) {
             StyleFunc(Screen, &State, MENU_FUNCTION_PAINT_ALL, NULL);
             State.PaintAll = FALSE;
+            if (!MenuPainted) {
+               BootTimeMark(L"First menu paint", NULL);
+               MenuPainted = TRUE;
+            }
         } else if (State.PaintSelection) {
             StyleFunc(Screen, &State, MENU_FUNCTION_PAINT_SELECTION, NULL);
             State.PaintSelection = FALSE;
@@ -1132,8 +1162,7 @@ static BOOLEAN EditOptions(LOADER_ENTRY *MenuEntry) {
       SwitchToText(TRUE);
 
    if (line_edit(MenuEntry->LoadOptions, &EditedOptions, x_max)) {
-      MyFreePool(MenuEntry->LoadOptions);
-      MenuEntry->LoadOptions = EditedOptions;
+      MenuEntry->LoadOptions = ScanArenaKeepString(EditedOptions); // old options belong to the arena
       retval = TRUE;
    } // if
    if (!GlobalConfig.TextOnly)
@@ -1185,6 +1214,8 @@ UINTN RunMainMenu(REFIT_MENU_SCREEN *Screen, CHAR16** DefaultSelection, REFIT_ME
 
         MenuTitle = StrDuplicate(TempChosenEntry->Title);
         if (MenuExit == MENU_EXIT_DETAILS) {
+            if (TempChosenEntry->Tag == TAG_LOADER)
+               FinishLoaderEntry((LOADER_ENTRY *) TempChosenEntry);
             if (TempChosenEntry->SubScreen != NULL) {
                MenuExit = RunGenericMenu(TempChosenEntry->SubScreen, Style, &DefaultSubmenuIndex, &TempChosenEntry);
                if (MenuExit == MENU_EXIT_ESCAPE || TempChosenEntry->Tag == TAG_RETURN)
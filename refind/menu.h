@@ -94,6 +94,9 @@ struct _refit_menu_screen;
 
 VOID AddMenuInfoLine(IN REFIT_MENU_SCREEN *Screen, IN CHAR16 *InfoLine);
 VOID AddMenuEntry(IN REFIT_MENU_SCREEN *Screen, IN REFIT_MENU_ENTRY *Entry);
+VOID ReserveMenuItems(IN REFIT_MENU_SCREEN *Screen, IN UINTN ExtraInfoLines, IN UINTN ExtraEntries);
+VOID ShrinkMenuItems(IN REFIT_MENU_SCREEN *Screen);
+VOID FreeMenuItems(IN REFIT_MENU_SCREEN *Screen);
 inline UINTN ComputeRow0PosY(VOID);
 VOID MainMenuStyle(IN REFIT_MENU_SCREEN *Screen, IN SCROLL_STATE *State, IN UINTN Function, IN CHAR16 *ParamText);
 UINTN RunMenu(IN REFIT_MENU_SCREEN *Screen, OUT REFIT_MENU_ENTRY **ChosenEntry);
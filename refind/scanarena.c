@@ -0,0 +1,188 @@
+/*
+ * refind/scanarena.c
+ * Scan-lifetime allocation of menu entries and the data they point to
+ *
+ * Copyright (c) 2014 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+// Menu entries and sub-screens are created by the thousand on each scan and
+// all die together on the next rescan, so rather than allocating (and
+// freeing) them one at a time, they're carved out of large pool blocks that
+// FreeScanArena() releases in a single pass. The same goes for the strings,
+// device paths and images hung off them.
+//
+// Ownership is explicit: a field of an entry or sub-screen holds either
+// arena memory, a constant, or something shared (such as an icon from the
+// icon cache), and never a pool allocation of its own. Code that replaces
+// such a field just overwrites it (or uses ScanArenaMergeStrings()); it must
+// not hand the old value to FreePool() or MyFreePool(). Pool results that
+// are to be stored in an entry go through one of the ScanArenaKeep*()
+// functions first.
+//
+// This code has no dependencies beyond the pool, string and list functions
+// and egFreeImage(), so that refind/test can build it on the host and check
+// that rescans don't leak.
+
+#include "scanarena.h"
+#include "list.h"
+
+#define SCAN_ARENA_BLOCK_SIZE (32 * 1024)
+#define SCAN_ARENA_ALIGN(n)   (((n) + 7) & ~((UINTN) 7))
+
+typedef struct SCAN_ARENA_BLOCK {
+   struct SCAN_ARENA_BLOCK *Next;
+   UINTN                   Size;   // usable bytes after the header
+   UINTN                   Used;
+} SCAN_ARENA_BLOCK;
+
+#define SCAN_ARENA_HEADER_SIZE SCAN_ARENA_ALIGN(sizeof(SCAN_ARENA_BLOCK))
+
+static SCAN_ARENA_BLOCK *ScanArena = NULL;
+
+// Images handed over by ScanArenaKeepImage()
+static EG_IMAGE **ScanImages = NULL;
+static UINTN    ScanImageCount = 0;
+
+// Returns Size bytes of zeroed memory that remain valid until the next call to
+// FreeScanArena(), or NULL if memory is exhausted. The memory must NOT be
+// passed to FreePool() or MyFreePool().
+VOID * ScanArenaAllocateZero(IN UINTN Size)
+{
+   SCAN_ARENA_BLOCK *Block;
+   UINTN            BlockSize;
+   UINT8            *Pointer;
+
+   Size = SCAN_ARENA_ALIGN(Size);
+   Block = ScanArena;
+   if ((Block == NULL) || (Block->Size - Block->Used < Size)) {
+      BlockSize = (Size > SCAN_ARENA_BLOCK_SIZE / 4) ? Size : SCAN_ARENA_BLOCK_SIZE;
+      Block = AllocatePool(SCAN_ARENA_HEADER_SIZE + BlockSize);
+      if (Block == NULL)
+         return NULL;
+      Block->Size = BlockSize;
+      Block->Used = 0;
+      if ((BlockSize == Size) && (ScanArena != NULL)) {
+         // Oversized request; keep the partly-used block at the head so that
+         // later small allocations can still use it.
+         Block->Next = ScanArena->Next;
+         ScanArena->Next = Block;
+      } else {
+         Block->Next = ScanArena;
+         ScanArena = Block;
+      } // if/else
+   } // if
+   Pointer = (UINT8 *) Block + SCAN_ARENA_HEADER_SIZE + Block->Used;
+   Block->Used += Size;
+   ZeroMem(Pointer, Size);
+   return Pointer;
+} // VOID * ScanArenaAllocateZero()
+
+// Moves Size bytes at Buffer, which must have come from the pool (and not
+// from the arena), into the scan arena, freeing the original. Returns the
+// arena copy; or Buffer itself if it's NULL or can't be copied.
+VOID * ScanArenaKeep(IN VOID *Buffer, IN UINTN Size)
+{
+   VOID *Copy;
+
+   if (Buffer == NULL)
+      return NULL;
+   Copy = ScanArenaAllocateZero(Size);
+   if (Copy == NULL)
+      return Buffer;
+   CopyMem(Copy, Buffer, Size);
+   FreePool(Buffer);
+   return Copy;
+} // VOID * ScanArenaKeep()
+
+// As ScanArenaKeep(), for a pool-allocated string (such as one returned by
+// PoolPrint() or built by MergeStrings()).
+CHAR16 * ScanArenaKeepString(IN CHAR16 *String)
+{
+   return (String != NULL) ? ScanArenaKeep(String, StrSize(String)) : NULL;
+} // CHAR16 * ScanArenaKeepString()
+
+// As ScanArenaKeep(), for a pool-allocated device path (such as one returned
+// by FileDevicePath()).
+EFI_DEVICE_PATH * ScanArenaKeepDevicePath(IN EFI_DEVICE_PATH *DevicePath)
+{
+   EFI_DEVICE_PATH *Node = DevicePath;
+
+   if (DevicePath == NULL)
+      return NULL;
+   while (!IsDevicePathEnd(Node))
+      Node = NextDevicePathNode(Node);
+   return ScanArenaKeep(DevicePath, (UINTN) ((UINT8 *) Node - (UINT8 *) DevicePath) + DevicePathNodeLength(Node));
+} // EFI_DEVICE_PATH * ScanArenaKeepDevicePath()
+
+// Hands a newly created image (one loaded for this entry alone, NOT one
+// shared through the icon cache) to the scan arena, which frees it in
+// FreeScanArena(). The image itself isn't copied. Returns Image.
+EG_IMAGE * ScanArenaKeepImage(IN EG_IMAGE *Image)
+{
+   if (Image != NULL)
+      AddListElement((VOID ***) &ScanImages, &ScanImageCount, Image);
+   return Image;
+} // EG_IMAGE * ScanArenaKeepImage()
+
+// Returns an arena copy of String, or NULL if String is NULL.
+CHAR16 * ScanArenaStrDuplicate(IN CHAR16 *String)
+{
+   CHAR16 *Copy;
+
+   if (String == NULL)
+      return NULL;
+   Copy = ScanArenaAllocateZero(StrSize(String));
+   if (Copy != NULL)
+      CopyMem(Copy, String, StrSize(String));
+   return Copy;
+} // CHAR16 * ScanArenaStrDuplicate()
+
+// As MergeStrings(), but for a *First that's in the arena (or is a constant
+// or NULL): the merged string is built in the arena, and the old *First is
+// simply dropped. If memory is exhausted, *First is left unchanged.
+VOID ScanArenaMergeStrings(IN OUT CHAR16 **First, IN CHAR16 *Second, IN CHAR16 AddChar)
+{
+   UINTN  Length1 = 0, Length2 = 0;
+   CHAR16 *NewString;
+
+   if (*First != NULL)
+      Length1 = StrLen(*First);
+   if (Second != NULL)
+      Length2 = StrLen(Second);
+   NewString = ScanArenaAllocateZero(sizeof(CHAR16) * (Length1 + Length2 + 2));
+   if (NewString == NULL)
+      return;
+   if (Length1 > 0) {
+      CopyMem(NewString, *First, Length1 * sizeof(CHAR16));
+      if (AddChar)
+         NewString[Length1++] = AddChar;
+   } // if
+   if (Length2 > 0)
+      CopyMem(NewString + Length1, Second, Length2 * sizeof(CHAR16));
+   *First = NewString;
+} // VOID ScanArenaMergeStrings()
+
+static VOID FreeScanImage(IN VOID *Element)
+{
+   egFreeImage((EG_IMAGE *) Element);
+} // static VOID FreeScanImage()
+
+// Releases everything allocated by ScanArenaAllocateZero() or handed over by
+// ScanArenaKeep*().
+VOID FreeScanArena(VOID)
+{
+   SCAN_ARENA_BLOCK *Block;
+
+   FreeListWith((VOID ***) &ScanImages, &ScanImageCount, FreeScanImage);
+   while (ScanArena != NULL) {
+      Block = ScanArena;
+      ScanArena = Block->Next;
+      FreePool(Block);
+   } // while
+} // VOID FreeScanArena()
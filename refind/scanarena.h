@@ -0,0 +1,40 @@
+/*
+ * refind/scanarena.h
+ * Scan-lifetime allocation of menu entries and the data they point to
+ *
+ * Copyright (c) 2014 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+#ifndef __SCANARENA_H_
+#define __SCANARENA_H_
+
+// The host test in refind/test defines HOST_POSIX and supplies the EFI
+// types, EG_IMAGE, the pool and string functions and egFreeImage() itself.
+#ifndef HOST_POSIX
+#include "global.h"
+#ifdef __MAKEWITH_GNUEFI
+#include "efi.h"
+#include "efilib.h"
+#else
+#include "../include/tiano_includes.h"
+#endif
+#include "libeg.h"
+#endif
+
+VOID * ScanArenaAllocateZero(IN UINTN Size);
+VOID * ScanArenaKeep(IN VOID *Buffer, IN UINTN Size);
+CHAR16 * ScanArenaKeepString(IN CHAR16 *String);
+EFI_DEVICE_PATH * ScanArenaKeepDevicePath(IN EFI_DEVICE_PATH *DevicePath);
+EG_IMAGE * ScanArenaKeepImage(IN EG_IMAGE *Image);
+CHAR16 * ScanArenaStrDuplicate(IN CHAR16 *String);
+VOID ScanArenaMergeStrings(IN OUT CHAR16 **First, IN CHAR16 *Second, IN CHAR16 AddChar);
+#define ScanArenaPoolPrint(...) ScanArenaKeepString(PoolPrint(__VA_ARGS__))
+VOID FreeScanArena(VOID);
+
+#endif
@@ -0,0 +1,368 @@
+/*
+ * refind/scancache.c
+ * Persistent cache of boot loader directory scan results
+ *
+ * Copyright (c) 2014 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+// When GlobalConfig.CacheScans is set, the list of boot loaders found in each
+// scanned directory is saved in a file in rEFInd's own directory, along with
+// the directory's modification time and the identity (filesystem UUID and
+// partition GUID) of the volume that holds it. On the next boot, a directory
+// whose time stamp hasn't changed is not read again; its loaders are taken
+// from the cache instead. Each record also carries a caller-supplied Stamp
+// value, which changes if anything else that affected the scan (the file
+// name patterns or the fallback boot loader) changes.
+//
+// The root directory of a volume is never cached, since FAT doesn't keep a
+// time stamp for it.
+
+#include "scancache.h"
+#include "lib.h"
+#include "crc32.h"
+#include "../include/refit_call_wrapper.h"
+#include "../libeg/libeg.h"
+
+#define SCAN_CACHE_MAGIC     0x43534552  /* "RESC" */
+#define SCAN_CACHE_VERSION   1
+
+#define SCAN_CACHE_FLAG_FALLBACK_DUPLICATE 1
+
+typedef struct {
+   UINT32      Magic;
+   UINT32      Version;
+   UINT32      EntryCount;
+   UINT32      DataSize;    // number of bytes following this header
+   UINT32      Checksum;    // CRC32 of the DataSize bytes following this header
+   UINT32      Reserved;
+} SCAN_CACHE_FILE_HEADER;
+
+// Each record is followed by the NULL-terminated directory path (zero-padded
+// to PathSize bytes, a multiple of 4) and then by LoaderCount NULL-terminated
+// loader filenames (zero-padded to NamesSize bytes, a multiple of 4).
+typedef struct {
+   UINT32      RecordSize;  // this structure, path, and names
+   UINT32      PathSize;
+   UINT32      NamesSize;
+   UINT32      LoaderCount;
+   UINT32      Stamp;
+   UINT32      Flags;
+   EFI_GUID    VolUuid;
+   EFI_GUID    PartGuid;
+   EFI_TIME    DirTime;
+} SCAN_CACHE_FILE_RECORD;
+
+typedef struct _scan_cache_dir {
+   EFI_GUID                VolUuid;
+   EFI_GUID                PartGuid;
+   CHAR16                  *Path;
+   UINT32                  Stamp;
+   EFI_TIME                DirTime;
+   BOOLEAN                 FoundFallbackDuplicate;
+   BOOLEAN                 Used;     // valid in this session; written by SaveScanCache()
+   UINTN                   LoaderCount;
+   CHAR16                  **LoaderNames;
+   struct _scan_cache_dir  *Next;
+} SCAN_CACHE_DIR;
+
+static SCAN_CACHE_DIR *ScanCacheDirs = NULL;
+static BOOLEAN ScanCacheRead = FALSE;
+static BOOLEAN ScanCacheDirty = FALSE;
+
+static VOID FreeScanCacheNames(IN OUT SCAN_CACHE_DIR *Dir) {
+   UINTN i;
+
+   if (Dir->LoaderNames != NULL) {
+      for (i = 0; i < Dir->LoaderCount; i++)
+         MyFreePool(Dir->LoaderNames[i]);
+      MyFreePool(Dir->LoaderNames);
+   }
+   Dir->LoaderNames = NULL;
+   Dir->LoaderCount = 0;
+} // static VOID FreeScanCacheNames()
+
+// Set Dir's loader list to copies of the LoaderCount strings in LoaderNames.
+// Returns FALSE if memory couldn't be allocated.
+static BOOLEAN SetScanCacheNames(IN OUT SCAN_CACHE_DIR *Dir, IN CHAR16 **LoaderNames, IN UINTN LoaderCount) {
+   UINTN i;
+
+   FreeScanCacheNames(Dir);
+   if (LoaderCount == 0)
+      return TRUE;
+   Dir->LoaderNames = AllocateZeroPool(LoaderCount * sizeof(CHAR16 *));
+   if (Dir->LoaderNames == NULL)
+      return FALSE;
+   Dir->LoaderCount = LoaderCount;
+   for (i = 0; i < LoaderCount; i++) {
+      Dir->LoaderNames[i] = StrDuplicate(LoaderNames[i]);
+      if (Dir->LoaderNames[i] == NULL) {
+         FreeScanCacheNames(Dir);
+         return FALSE;
+      }
+   } // for
+   return TRUE;
+} // static BOOLEAN SetScanCacheNames()
+
+// Read the scan cache file and build the ScanCacheDirs list from it. A file
+// that's damaged or from another version is ignored (and replaced when next
+// saved).
+static VOID ReadScanCache(VOID) {
+   EFI_STATUS             Status;
+   UINT8                  *FileData;
+   UINTN                  FileDataLength, Offset, End, NameOffset, NameEnd, i, j;
+   SCAN_CACHE_FILE_HEADER *Header;
+   SCAN_CACHE_FILE_RECORD *Record;
+   SCAN_CACHE_DIR         *Dir;
+   CHAR16                 *Names, **NameList;
+
+   ScanCacheRead = TRUE;
+   if (SelfDir == NULL)
+      return;
+   Status = egLoadFile(SelfDir, SCAN_CACHE_FILE_NAME, &FileData, &FileDataLength);
+   if (EFI_ERROR(Status))
+      return;
+
+   Header = (SCAN_CACHE_FILE_HEADER *) FileData;
+   if ((FileDataLength < sizeof(SCAN_CACHE_FILE_HEADER)) || (Header->Magic != SCAN_CACHE_MAGIC) ||
+       (Header->Version != SCAN_CACHE_VERSION) || (Header->DataSize > FileDataLength - sizeof(SCAN_CACHE_FILE_HEADER)) ||
+       (crc32(0x0, FileData + sizeof(SCAN_CACHE_FILE_HEADER), Header->DataSize) != Header->Checksum)) {
+      FreePool(FileData);
+      ScanCacheDirty = TRUE;
+      return;
+   } // if
+
+   Offset = sizeof(SCAN_CACHE_FILE_HEADER);
+   End = Offset + Header->DataSize;
+   for (i = 0; i < Header->EntryCount; i++) {
+      if (End - Offset < sizeof(SCAN_CACHE_FILE_RECORD))
+         break;
+      Record = (SCAN_CACHE_FILE_RECORD *) (FileData + Offset);
+      if ((Record->RecordSize > End - Offset) || (Record->PathSize < sizeof(CHAR16)) || (Record->RecordSize % 4 != 0) ||
+          (Record->RecordSize != sizeof(SCAN_CACHE_FILE_RECORD) + Record->PathSize + Record->NamesSize) ||
+          (Record->NamesSize % sizeof(CHAR16) != 0) || (Record->LoaderCount > Record->NamesSize / sizeof(CHAR16)))
+         break;
+
+      // Split the names block into its strings, making sure each one is terminated
+      Names = (CHAR16 *) (FileData + Offset + sizeof(SCAN_CACHE_FILE_RECORD) + Record->PathSize);
+      NameList = NULL;
+      if (Record->LoaderCount > 0) {
+         NameList = AllocateZeroPool(Record->LoaderCount * sizeof(CHAR16 *));
+         if (NameList == NULL)
+            break;
+      }
+      NameOffset = 0;
+      NameEnd = Record->NamesSize / sizeof(CHAR16);
+      for (j = 0; j < Record->LoaderCount; j++) {
+         NameList[j] = Names + NameOffset;
+         while ((NameOffset < NameEnd) && (Names[NameOffset] != 0))
+            NameOffset++;
+         if (NameOffset++ >= NameEnd)
+            break;
+      } // for
+      if (j < Record->LoaderCount) {
+         MyFreePool(NameList);
+         break;
+      }
+
+      Dir = AllocateZeroPool(sizeof(SCAN_CACHE_DIR));
+      if (Dir == NULL) {
+         MyFreePool(NameList);
+         break;
+      }
+      ((CHAR16 *) (FileData + Offset + sizeof(SCAN_CACHE_FILE_RECORD)))[Record->PathSize / sizeof(CHAR16) - 1] = 0;
+      Dir->Path = StrDuplicate((CHAR16 *) (FileData + Offset + sizeof(SCAN_CACHE_FILE_RECORD)));
+      CopyMem(&(Dir->VolUuid), &(Record->VolUuid), sizeof(EFI_GUID));
+      CopyMem(&(Dir->PartGuid), &(Record->PartGuid), sizeof(EFI_GUID));
+      CopyMem(&(Dir->DirTime), &(Record->DirTime), sizeof(EFI_TIME));
+      Dir->Stamp = Record->Stamp;
+      Dir->FoundFallbackDuplicate = ((Record->Flags & SCAN_CACHE_FLAG_FALLBACK_DUPLICATE) != 0);
+      if ((Dir->Path == NULL) || !SetScanCacheNames(Dir, NameList, Record->LoaderCount)) {
+         MyFreePool(Dir->Path);
+         MyFreePool(Dir);
+         MyFreePool(NameList);
+         break;
+      }
+      MyFreePool(NameList);
+      Dir->Next = ScanCacheDirs;
+      ScanCacheDirs = Dir;
+      Offset += Record->RecordSize;
+   } // for
+   FreePool(FileData);
+} // static VOID ReadScanCache()
+
+// Returns the cache record for Path on Volume, or NULL if there's none.
+static SCAN_CACHE_DIR * FindScanCacheDir(IN REFIT_VOLUME *Volume, IN CHAR16 *Path) {
+   SCAN_CACHE_DIR *Dir;
+
+   if (!ScanCacheRead)
+      ReadScanCache();
+
+   for (Dir = ScanCacheDirs; Dir != NULL; Dir = Dir->Next) {
+      if (GuidsAreEqual(&(Dir->VolUuid), &(Volume->VolUuid)) && GuidsAreEqual(&(Dir->PartGuid), &(Volume->PartGuid)) &&
+          (StriCmp(Dir->Path, Path) == 0))
+         return Dir;
+   } // for
+   return NULL;
+} // static SCAN_CACHE_DIR * FindScanCacheDir()
+
+// Find the modification time of the directory Path on Volume. Returns TRUE
+// if this directory's scan results can be cached, FALSE if not -- because
+// it's the root directory, because the volume can't be uniquely identified,
+// or because its time stamp can't be read.
+BOOLEAN ScanCacheGetDirTime(IN REFIT_VOLUME *Volume, IN CHAR16 *Path, OUT EFI_TIME *DirTime) {
+   EFI_STATUS      Status;
+   EFI_FILE_HANDLE DirHandle;
+   EFI_FILE_INFO   *DirInfo;
+   EFI_TIME        NullTime;
+   BOOLEAN         Found = FALSE;
+   EFI_GUID        NullGuid = NULL_GUID_VALUE;
+
+   if ((Volume == NULL) || (Volume->RootDir == NULL) || (Path == NULL) || (Path[0] == 0) ||
+       (StriCmp(Path, L"\\") == 0) ||
+       (GuidsAreEqual(&(Volume->VolUuid), &NullGuid) && GuidsAreEqual(&(Volume->PartGuid), &NullGuid)))
+      return FALSE;
+
+   Status = refit_call5_wrapper(Volume->RootDir->Open, Volume->RootDir, &DirHandle, Path, EFI_FILE_MODE_READ, 0);
+   if (EFI_ERROR(Status))
+      return FALSE;
+   DirInfo = LibFileInfo(DirHandle);
+   refit_call1_wrapper(DirHandle->Close, DirHandle);
+   if (DirInfo != NULL) {
+      ZeroMem(&NullTime, sizeof(EFI_TIME));
+      if ((DirInfo->Attribute & EFI_FILE_DIRECTORY) &&
+          (CompareMem(&(DirInfo->ModificationTime), &NullTime, sizeof(EFI_TIME)) != 0)) {
+         CopyMem(DirTime, &(DirInfo->ModificationTime), sizeof(EFI_TIME));
+         Found = TRUE;
+      }
+      FreePool(DirInfo);
+   } // if
+   return Found;
+} // BOOLEAN ScanCacheGetDirTime()
+
+// Look up the scan results for Path on Volume. Returns TRUE and sets
+// LoaderNames (which the caller must NOT free), LoaderCount, and
+// FoundFallbackDuplicate if the cache holds results that were obtained with
+// the same Stamp value and directory time stamp; returns FALSE otherwise.
+BOOLEAN ScanCacheLookup(IN REFIT_VOLUME *Volume, IN CHAR16 *Path, IN UINT32 Stamp, IN EFI_TIME *DirTime,
+                        OUT CHAR16 ***LoaderNames, OUT UINTN *LoaderCount, OUT BOOLEAN *FoundFallbackDuplicate) {
+   SCAN_CACHE_DIR *Dir;
+
+   Dir = FindScanCacheDir(Volume, Path);
+   if ((Dir == NULL) || (Dir->Stamp != Stamp) || (CompareMem(&(Dir->DirTime), DirTime, sizeof(EFI_TIME)) != 0))
+      return FALSE;
+
+   Dir->Used = TRUE;
+   *LoaderNames = Dir->LoaderNames;
+   *LoaderCount = Dir->LoaderCount;
+   *FoundFallbackDuplicate = Dir->FoundFallbackDuplicate;
+   return TRUE;
+} // BOOLEAN ScanCacheLookup()
+
+// Record the results of scanning Path on Volume, replacing any earlier
+// record for that directory. LoaderNames holds the filenames (without the
+// directory) of the loaders found, in menu order.
+VOID ScanCacheStore(IN REFIT_VOLUME *Volume, IN CHAR16 *Path, IN UINT32 Stamp, IN EFI_TIME *DirTime,
+                    IN CHAR16 **LoaderNames, IN UINTN LoaderCount, IN BOOLEAN FoundFallbackDuplicate) {
+   SCAN_CACHE_DIR *Dir;
+
+   Dir = FindScanCacheDir(Volume, Path);
+   if (Dir == NULL) {
+      Dir = AllocateZeroPool(sizeof(SCAN_CACHE_DIR));
+      if (Dir == NULL)
+         return;
+      Dir->Path = StrDuplicate(Path);
+      if (Dir->Path == NULL) {
+         FreePool(Dir);
+         return;
+      }
+      CopyMem(&(Dir->VolUuid), &(Volume->VolUuid), sizeof(EFI_GUID));
+      CopyMem(&(Dir->PartGuid), &(Volume->PartGuid), sizeof(EFI_GUID));
+      Dir->Next = ScanCacheDirs;
+      ScanCacheDirs = Dir;
+   } // if
+
+   Dir->Stamp = Stamp;
+   CopyMem(&(Dir->DirTime), DirTime, sizeof(EFI_TIME));
+   Dir->FoundFallbackDuplicate = FoundFallbackDuplicate;
+   // A record whose names couldn't be stored is left unused, so it's not saved.
+   Dir->Used = SetScanCacheNames(Dir, LoaderNames, LoaderCount);
+   ScanCacheDirty = TRUE;
+} // VOID ScanCacheStore()
+
+// Writes the records used in this session to the scan cache file, if any of
+// them changed. Records that weren't used (for instance, for volumes that
+// weren't present) are dropped.
+VOID SaveScanCache(VOID) {
+   EFI_STATUS             Status;
+   EFI_FILE_HANDLE        FileHandle;
+   SCAN_CACHE_DIR         *Dir;
+   SCAN_CACHE_FILE_HEADER *Header;
+   SCAN_CACHE_FILE_RECORD *Record;
+   UINTN                  PathSize, NamesSize, DataSize = 0, Offset, NameOffset, i;
+   UINT8                  *Buffer;
+
+   if (!GlobalConfig.CacheScans || !ScanCacheDirty || (SelfDir == NULL))
+      return;
+
+   for (Dir = ScanCacheDirs; Dir != NULL; Dir = Dir->Next) {
+      if (!Dir->Used)
+         continue;
+      NamesSize = 0;
+      for (i = 0; i < Dir->LoaderCount; i++)
+         NamesSize += StrSize(Dir->LoaderNames[i]);
+      DataSize += sizeof(SCAN_CACHE_FILE_RECORD) + ((StrSize(Dir->Path) + 3) & ~((UINTN) 3)) + ((NamesSize + 3) & ~((UINTN) 3));
+   } // for
+
+   Buffer = AllocateZeroPool(sizeof(SCAN_CACHE_FILE_HEADER) + DataSize);
+   if (Buffer == NULL)
+      return;
+   Header = (SCAN_CACHE_FILE_HEADER *) Buffer;
+   Header->Magic = SCAN_CACHE_MAGIC;
+   Header->Version = SCAN_CACHE_VERSION;
+   Header->DataSize = (UINT32) DataSize;
+   Offset = sizeof(SCAN_CACHE_FILE_HEADER);
+   for (Dir = ScanCacheDirs; Dir != NULL; Dir = Dir->Next) {
+      if (!Dir->Used)
+         continue;
+      PathSize = (StrSize(Dir->Path) + 3) & ~((UINTN) 3);
+      NamesSize = 0;
+      for (i = 0; i < Dir->LoaderCount; i++)
+         NamesSize += StrSize(Dir->LoaderNames[i]);
+      NamesSize = (NamesSize + 3) & ~((UINTN) 3);
+      Record = (SCAN_CACHE_FILE_RECORD *) (Buffer + Offset);
+      Record->RecordSize = (UINT32) (sizeof(SCAN_CACHE_FILE_RECORD) + PathSize + NamesSize);
+      Record->PathSize = (UINT32) PathSize;
+      Record->NamesSize = (UINT32) NamesSize;
+      Record->LoaderCount = (UINT32) Dir->LoaderCount;
+      Record->Stamp = Dir->Stamp;
+      Record->Flags = Dir->FoundFallbackDuplicate ? SCAN_CACHE_FLAG_FALLBACK_DUPLICATE : 0;
+      CopyMem(&(Record->VolUuid), &(Dir->VolUuid), sizeof(EFI_GUID));
+      CopyMem(&(Record->PartGuid), &(Dir->PartGuid), sizeof(EFI_GUID));
+      CopyMem(&(Record->DirTime), &(Dir->DirTime), sizeof(EFI_TIME));
+      CopyMem(Buffer + Offset + sizeof(SCAN_CACHE_FILE_RECORD), Dir->Path, StrSize(Dir->Path));
+      NameOffset = Offset + sizeof(SCAN_CACHE_FILE_RECORD) + PathSize;
+      for (i = 0; i < Dir->LoaderCount; i++) {
+         CopyMem(Buffer + NameOffset, Dir->LoaderNames[i], StrSize(Dir->LoaderNames[i]));
+         NameOffset += StrSize(Dir->LoaderNames[i]);
+      } // for
+      Offset += Record->RecordSize;
+      Header->EntryCount++;
+   } // for
+   Header->Checksum = crc32(0x0, Buffer + sizeof(SCAN_CACHE_FILE_HEADER), DataSize);
+
+   // egSaveFile() doesn't truncate an existing file, so delete it first....
+   Status = refit_call5_wrapper(SelfDir->Open, SelfDir, &FileHandle, SCAN_CACHE_FILE_NAME,
+                                EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE, 0);
+   if (!EFI_ERROR(Status))
+      refit_call1_wrapper(FileHandle->Delete, FileHandle);
+   Status = egSaveFile(SelfDir, SCAN_CACHE_FILE_NAME, Buffer, sizeof(SCAN_CACHE_FILE_HEADER) + DataSize);
+   if (!EFI_ERROR(Status))
+      ScanCacheDirty = FALSE;
+   FreePool(Buffer);
+} // VOID SaveScanCache()
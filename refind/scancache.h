@@ -0,0 +1,35 @@
+/*
+ * refind/scancache.h
+ * Persistent cache of boot loader directory scan results
+ *
+ * Copyright (c) 2014 Roderick W. Smith
+ * All rights reserved.
+ *
+ * This program is distributed under the terms of the GNU General Public
+ * License (GPL) version 3 (GPLv3), a copy of which must be distributed
+ * with this source code or binaries made from it.
+ *
+ */
+
+#include "global.h"
+
+#ifndef __SCANCACHE_H_
+#define __SCANCACHE_H_
+
+#ifdef __MAKEWITH_GNUEFI
+#include "efi.h"
+#include "efilib.h"
+#else
+#include "../include/tiano_includes.h"
+#endif
+
+#define SCAN_CACHE_FILE_NAME L"scan.cache"
+
+BOOLEAN ScanCacheGetDirTime(IN REFIT_VOLUME *Volume, IN CHAR16 *Path, OUT EFI_TIME *DirTime);
+BOOLEAN ScanCacheLookup(IN REFIT_VOLUME *Volume, IN CHAR16 *Path, IN UINT32 Stamp, IN EFI_TIME *DirTime,
+                        OUT CHAR16 ***LoaderNames, OUT UINTN *LoaderCount, OUT BOOLEAN *FoundFallbackDuplicate);
+VOID ScanCacheStore(IN REFIT_VOLUME *Volume, IN CHAR16 *Path, IN UINT32 Stamp, IN EFI_TIME *DirTime,
+                    IN CHAR16 **LoaderNames, IN UINTN LoaderCount, IN BOOLEAN FoundFallbackDuplicate);
+VOID SaveScanCache(VOID);
+
+#endif
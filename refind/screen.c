@@ -433,62 +433,123 @@ VOID SwitchToGraphicsAndClear(VOID)
         BltClearScreen(TRUE);
 }
 
+// Banner variants already scaled or cropped for a given screen size, so that
+// switching resolutions (or clearing the screen repeatedly) doesn't re-scale
+// the original image each time.
+typedef struct _banner_variant {
+    UINTN                   ScreenWidth;
+    UINTN                   ScreenHeight;
+    EG_IMAGE                *Image;
+    struct _banner_variant  *Next;
+} BANNER_VARIANT;
+
+// Returns the banner image to be used at the current UGAWidth x UGAHeight
+// resolution, loading the original on first call and caching each scaled
+// or cropped version by resolution. The caller must NOT free the result.
+static EG_IMAGE * GetBannerForScreen(VOID)
+{
+    static EG_IMAGE       *Banner = NULL;
+    static BANNER_VARIANT *Variants = NULL;
+    BANNER_VARIANT        *Variant;
+    EG_IMAGE              *NewBanner = NULL;
+
+    // load banner on first call
+    if (Banner == NULL) {
+        if (GlobalConfig.BannerFileName)
+            Banner = egLoadImage(SelfDir, GlobalConfig.BannerFileName, FALSE);
+        if (Banner == NULL)
+            Banner = egPrepareEmbeddedImage(&egemb_refind_banner, FALSE);
+        if (Banner == NULL)
+            return NULL;
+    }
+
+    for (Variant = Variants; Variant != NULL; Variant = Variant->Next) {
+        if ((Variant->ScreenWidth == UGAWidth) && (Variant->ScreenHeight == UGAHeight))
+            return Variant->Image;
+    } // for
+
+    if (GlobalConfig.BannerScale == BANNER_FILLSCREEN) {
+        if ((Banner->Height != UGAHeight) || (Banner->Width != UGAWidth)) {
+            NewBanner = egScaleImage(Banner, UGAWidth, UGAHeight);
+        } // if
+    } else if ((Banner->Width > UGAWidth) || (Banner->Height > UGAHeight)) {
+        NewBanner = egCropImage(Banner, 0, 0, (Banner->Width > UGAWidth) ? UGAWidth : Banner->Width,
+                                (Banner->Height > UGAHeight) ? UGAHeight : Banner->Height);
+    } // if/elseif
+
+    Variant = AllocateZeroPool(sizeof(BANNER_VARIANT));
+    if (Variant != NULL) {
+        Variant->ScreenWidth = UGAWidth;
+        Variant->ScreenHeight = UGAHeight;
+        Variant->Image = NewBanner ? NewBanner : Banner;
+        Variant->Next = Variants;
+        Variants = Variant;
+    } else if (NewBanner != NULL) {
+        // can't cache it, so just use the original image
+        egFreeImage(NewBanner);
+        NewBanner = NULL;
+    }
+    return NewBanner ? NewBanner : Banner;
+} // static EG_IMAGE * GetBannerForScreen()
+
+// Clear the screen to the background color, optionally with the banner. The
+// background is composed in memory and kept in GlobalConfig.ScreenBackground,
+// which later drawing operations use to blend transparent images; it is only
+// rebuilt when its inputs change, and is never read back from the display.
 VOID BltClearScreen(BOOLEAN ShowBanner)
 {
-    static EG_IMAGE *Banner = NULL;
-    EG_IMAGE *NewBanner = NULL;
-    INTN BannerPosX, BannerPosY;
-    EG_PIXEL Black = { 0x0, 0x0, 0x0, 0 };
+    static EG_IMAGE *LastBanner = NULL;
+    static INTN     LastPosX = 0, LastPosY = 0;
+    static EG_PIXEL LastFill = { 0x0, 0x0, 0x0, 0 };
+    EG_IMAGE        *Banner = NULL;
+    INTN            BannerPosX = 0, BannerPosY = 0;
+    UINTN           ScreenWidth, ScreenHeight;
+    EG_PIXEL        Black = { 0x0, 0x0, 0x0, 0 };
+    EG_PIXEL        FillColor;
 
     if (ShowBanner && !(GlobalConfig.HideUIFlags & HIDEUI_FLAG_BANNER)) {
-        // load banner on first call
-        if (Banner == NULL) {
-            if (GlobalConfig.BannerFileName)
-                Banner = egLoadImage(SelfDir, GlobalConfig.BannerFileName, FALSE);
-            if (Banner == NULL)
-                Banner = egPrepareEmbeddedImage(&egemb_refind_banner, FALSE);
-        }
-
+        Banner = GetBannerForScreen();
         if (Banner) {
-           if (GlobalConfig.BannerScale == BANNER_FILLSCREEN) {
-              if ((Banner->Height != UGAHeight) || (Banner->Width != UGAWidth)) {
-                 NewBanner = egScaleImage(Banner, UGAWidth, UGAHeight);
-              } // if
-           } else if ((Banner->Width > UGAWidth) || (Banner->Height > UGAHeight)) {
-              NewBanner = egCropImage(Banner, 0, 0, (Banner->Width > UGAWidth) ? UGAWidth : Banner->Width,
-                                      (Banner->Height > UGAHeight) ? UGAHeight : Banner->Height);
-           } // if/elseif
-           if (NewBanner) {
-              MyFreePool(Banner);
-              Banner = NewBanner;
-           }
-           MenuBackgroundPixel = Banner->PixelData[0];
-        } // if Banner exists
-
-        // clear and draw banner
-        if (GlobalConfig.ScreensaverTime != -1)
-           egClearScreen(&MenuBackgroundPixel);
-        else
-           egClearScreen(&Black);
-
-        if (Banner != NULL) {
+            MenuBackgroundPixel = Banner->PixelData[0];
             BannerPosX = (Banner->Width < UGAWidth) ? ((UGAWidth - Banner->Width) / 2) : 0;
             BannerPosY = (INTN) (ComputeRow0PosY() / 2) - (INTN) Banner->Height;
             if (BannerPosY < 0)
                BannerPosY = 0;
             GlobalConfig.BannerBottomEdge = BannerPosY + Banner->Height;
-            if (GlobalConfig.ScreensaverTime != -1)
-               BltImage(Banner, (UINTN) BannerPosX, (UINTN) BannerPosY);
-        }
+        } // if Banner exists
 
+        if (GlobalConfig.ScreensaverTime != -1) {
+           FillColor = MenuBackgroundPixel;
+        } else {
+           FillColor = Black;
+           Banner = NULL;
+        }
     } else { // not showing banner
         // clear to menu background color
-        egClearScreen(&MenuBackgroundPixel);
+        FillColor = MenuBackgroundPixel;
     }
 
+    egGetScreenSize(&ScreenWidth, &ScreenHeight);
+    if ((GlobalConfig.ScreenBackground == NULL) || (GlobalConfig.ScreenBackground->Width != ScreenWidth) ||
+        (GlobalConfig.ScreenBackground->Height != ScreenHeight) || (Banner != LastBanner) ||
+        (BannerPosX != LastPosX) || (BannerPosY != LastPosY) ||
+        (CompareMem(&FillColor, &LastFill, sizeof(EG_PIXEL)) != 0)) {
+        egFreeImage(GlobalConfig.ScreenBackground);
+        GlobalConfig.ScreenBackground = egCreateFilledImage(ScreenWidth, ScreenHeight, FALSE, &FillColor);
+        if ((GlobalConfig.ScreenBackground != NULL) && (Banner != NULL))
+            egComposeImage(GlobalConfig.ScreenBackground, Banner, (UINTN) BannerPosX, (UINTN) BannerPosY);
+        LastBanner = Banner;
+        LastPosX = BannerPosX;
+        LastPosY = BannerPosY;
+        LastFill = FillColor;
+    } // if background must be rebuilt
+
+    if (GlobalConfig.ScreenBackground != NULL)
+        egDrawImage(GlobalConfig.ScreenBackground, 0, 0);
+    else
+        egClearScreen(&FillColor);
+
     GraphicsScreenDirty = FALSE;
-    egFreeImage(GlobalConfig.ScreenBackground);
-    GlobalConfig.ScreenBackground = egCopyScreen();
 } // VOID BltClearScreen()
 
 
@@ -0,0 +1,368 @@
+/*
+ * refind/test/arenatest.c
+ * Host test that repeated rescans don't leak, for refind/scanarena.c
+ *
+ * copyright (c) 2014 by Roderick W. Smith, and distributed
+ * under the terms of the GNU GPL v3.
+ *
+ */
+
+// Includes scanarena.c and list.c with counting versions of the pool
+// functions, and runs RESCANS rescans. Each one builds a main menu the way
+// ScanVolumes(), ScanForBootloaders() and the config file code do, and
+// then tears it down as RescanAll() does (FreeMainMenuEntries(), then the
+// volume list). The menu has:
+//  - volumes, some with their own badge image and some with a shared one;
+//  - loader entries whose titles, loader paths, device paths and options
+//    are built with the ScanArena*() functions, including options that a
+//    stanza replaces, extends with add_options and initrd, and that the
+//    options editor replaces again;
+//  - entry images that are shared (as from the icon cache), loaded for the
+//    entry alone, copied from the volume icon, or replaced by a stanza's
+//    icon token;
+//  - sub-screens with entry and info line lists;
+//  - legacy boot options, some moved into the arena and some discarded;
+//  - the odd oversized arena allocation.
+// After each rescan the number of live pool blocks must be back where it
+// was before the first one. The exit status is 0 only if it always is and
+// every string came out as expected.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define IN
+#define OUT
+#define OPTIONAL
+#define TRUE  1
+#define FALSE 0
+
+typedef uint8_t   UINT8;
+typedef intptr_t  INTN;
+typedef uintptr_t UINTN;
+typedef UINT8     BOOLEAN;
+typedef uint16_t  CHAR16;   // built with -fshort-wchar, to match L"" strings
+typedef void      VOID;
+
+typedef struct {
+   UINT8 Type;
+   UINT8 SubType;
+   UINT8 Length[2];
+} EFI_DEVICE_PATH;
+
+#define DevicePathNodeLength(a)  ((UINTN) (a)->Length[0] | ((UINTN) (a)->Length[1] << 8))
+#define NextDevicePathNode(a)    ((EFI_DEVICE_PATH *) ((UINT8 *) (a) + DevicePathNodeLength(a)))
+#define IsDevicePathEnd(a)       (((a)->Type == 0x7f) && ((a)->SubType == 0xff))
+
+typedef struct {
+   UINTN   Width;
+   UINTN   Height;
+   BOOLEAN HasAlpha;
+   UINT8   *PixelData;
+} EG_IMAGE;
+
+#define ZeroMem(Buffer, Size)          memset((Buffer), 0, (Size))
+#define CopyMem(Dest, Src, Length)     memmove((Dest), (Src), (Length))
+
+// Pool functions that count what they do
+static UINTN Allocations = 0;
+static UINTN LiveBlocks = 0;
+
+static VOID * AllocatePool(UINTN Size) {
+   VOID *Pointer = malloc(Size ? Size : 1);
+
+   if (Pointer != NULL) {
+      Allocations++;
+      LiveBlocks++;
+   }
+   return Pointer;
+}
+
+static VOID FreePool(VOID *Pointer) {
+   free(Pointer);
+   LiveBlocks--;
+}
+
+static VOID * EfiReallocatePool(VOID *OldPool, UINTN OldSize, UINTN NewSize) {
+   VOID *NewPool = AllocatePool(NewSize);
+
+   if (OldPool != NULL) {
+      if (NewPool != NULL)
+         memcpy(NewPool, OldPool, (OldSize < NewSize) ? OldSize : NewSize);
+      FreePool(OldPool);
+   }
+   return NewPool;
+}
+
+static UINTN StrLen(IN CHAR16 *String) {
+   UINTN Length = 0;
+
+   while (String[Length] != 0)
+      Length++;
+   return Length;
+}
+
+static UINTN StrSize(IN CHAR16 *String) {
+   return (StrLen(String) + 1) * sizeof(CHAR16);
+}
+
+static VOID egFreeImage(IN EG_IMAGE *Image) {
+   if (Image != NULL) {
+      if (Image->PixelData != NULL)
+         FreePool(Image->PixelData);
+      FreePool(Image);
+   }
+}
+
+#include "../list.c"
+#include "../scanarena.c"
+
+#define RESCANS             100
+#define VOLUMES             12
+#define LOADERS_PER_VOLUME  20
+
+typedef struct {
+   EG_IMAGE *VolIconImage;
+   EG_IMAGE *VolBadgeImage;
+} VOLUME;
+
+typedef struct {
+   CHAR16 *Description;
+   VOID   *DevicePath;
+   VOID   *LoadOptions;
+   UINTN  LoadOptionsSize;
+} BOOT_OPTION;
+
+typedef struct _screen SCREEN;
+
+typedef struct {
+   CHAR16          *Title;
+   CHAR16          *LoaderPath;
+   CHAR16          *LoadOptions;
+   EFI_DEVICE_PATH *DevicePath;
+   EG_IMAGE        *Image;
+   EG_IMAGE        *BadgeImage;
+   SCREEN          *SubScreen;
+   BOOT_OPTION     *BdsOption;
+} ENTRY;
+
+struct _screen {
+   CHAR16 *Title;
+   UINTN  InfoLineCount;
+   CHAR16 **InfoLines;
+   UINTN  EntryCount;
+   ENTRY  **Entries;
+   UINTN  InfoLineCapacity;
+   UINTN  EntryCapacity;
+};
+
+static SCREEN   MainMenu;
+static VOLUME   **Volumes = NULL;
+static UINTN    VolumesCount = 0;
+static EG_IMAGE *CachedIcon, *BuiltinBadge;   // shared, never freed
+static int      Failures = 0;
+
+static VOID Check(int Ok, const char *What, int Rescan) {
+   if (!Ok) {
+      printf("FAIL: %s (rescan %d)\n", What, Rescan);
+      Failures++;
+   }
+}
+
+static int SameString(CHAR16 *One, CHAR16 *Two) {
+   return (One != NULL) && (Two != NULL) && (StrLen(One) == StrLen(Two)) &&
+          (memcmp(One, Two, StrSize(One)) == 0);
+}
+
+//
+// pool-allocated results, as from StrDuplicate(), FileDevicePath(),
+// egLoadIcon() and BdsLibVariableToOption()
+//
+
+static CHAR16 * PoolString(CHAR16 *String) {
+   CHAR16 *Copy = AllocatePool(StrSize(String));
+
+   memcpy(Copy, String, StrSize(String));
+   return Copy;
+}
+
+static EFI_DEVICE_PATH * PoolDevicePath(UINTN Nodes) {
+   EFI_DEVICE_PATH *Path, *Node;
+   UINTN           i;
+
+   Path = Node = AllocatePool((Nodes + 1) * 8);
+   for (i = 0; i <= Nodes; i++) {
+      Node->Type = (i < Nodes) ? 4 : 0x7f;
+      Node->SubType = (i < Nodes) ? 4 : 0xff;
+      Node->Length[0] = (i < Nodes) ? 8 : 4;
+      Node->Length[1] = 0;
+      Node = (EFI_DEVICE_PATH *) ((UINT8 *) Node + 8);
+   }
+   return Path;
+}
+
+static EG_IMAGE * NewImage(UINTN Size) {
+   EG_IMAGE *Image = AllocatePool(sizeof(EG_IMAGE));
+
+   Image->Width = Image->Height = Size;
+   Image->HasAlpha = TRUE;
+   Image->PixelData = AllocatePool(Size * Size * 4);
+   return Image;
+}
+
+static BOOT_OPTION * PoolBootOption(VOID) {
+   BOOT_OPTION *Option = AllocatePool(sizeof(BOOT_OPTION));
+
+   Option->Description = PoolString(L"Hard Drive");
+   Option->DevicePath = PoolDevicePath(1);
+   Option->LoadOptionsSize = 16;
+   Option->LoadOptions = AllocatePool(Option->LoadOptionsSize);
+   return Option;
+}
+
+//
+// a scan, after ScanVolumes(), ScanForBootloaders() and the config file code
+//
+
+static VOID ScanVolumes(VOID) {
+   VOLUME *Volume;
+   UINTN  i;
+
+   for (i = 0; i < VOLUMES; i++) {
+      Volume = AllocatePool(sizeof(VOLUME));
+      Volume->VolIconImage = (i % 2) ? ScanArenaKeepImage(NewImage(128)) : NULL;
+      Volume->VolBadgeImage = (i % 3) ? BuiltinBadge : ScanArenaKeepImage(NewImage(32));
+      AddListElement((VOID ***) &Volumes, &VolumesCount, Volume);
+   }
+}
+
+static VOID AddLoader(VOLUME *Volume, UINTN Index, int Rescan) {
+   ENTRY       *Entry, *SubEntry;
+   SCREEN      *SubScreen;
+   BOOT_OPTION *Option;
+   UINTN       i;
+
+   Entry = ScanArenaAllocateZero(sizeof(ENTRY));
+   Entry->Title = ScanArenaStrDuplicate(L"vmlinuz-3.16.0");
+   Entry->LoaderPath = L"\\";
+   ScanArenaMergeStrings(&Entry->LoaderPath, L"boot\\vmlinuz-3.16.0", 0);
+   Check(SameString(Entry->LoaderPath, L"\\boot\\vmlinuz-3.16.0"), "loader path", Rescan);
+   Entry->DevicePath = ScanArenaKeepDevicePath(PoolDevicePath(3));
+   Entry->BadgeImage = Volume->VolBadgeImage;
+   switch (Index % 4) {
+      case 0:
+         Entry->Image = CachedIcon;
+         break;
+      case 1:
+         Entry->Image = ScanArenaKeepImage(NewImage(128));
+         break;
+      default:
+         Entry->Image = Volume->VolIconImage ? ScanArenaKeepImage(NewImage(128)) : CachedIcon;
+         break;
+   }
+
+   // options from refind_linux.conf, then a stanza's options, add_options
+   // and initrd lines
+   Entry->LoadOptions = ScanArenaKeepString(PoolString(L"ro root=/dev/sda2"));
+   if (Index % 2) {
+      Entry->LoadOptions = ScanArenaStrDuplicate(L"quiet");
+      ScanArenaMergeStrings(&Entry->LoadOptions, L"splash", L' ');
+      ScanArenaMergeStrings(&Entry->LoadOptions, L"initrd=", L' ');
+      ScanArenaMergeStrings(&Entry->LoadOptions, L"\\initrd.img", 0);
+      Check(SameString(Entry->LoadOptions, L"quiet splash initrd=\\initrd.img"), "merged options", Rescan);
+      Entry->Image = ScanArenaKeepImage(NewImage(128)); // icon token
+   }
+
+   SubScreen = ScanArenaAllocateZero(sizeof(SCREEN));
+   SubScreen->Title = ScanArenaAllocateZero(256 * sizeof(CHAR16));
+   AddReservedListElement((VOID ***) &SubScreen->InfoLines, &SubScreen->InfoLineCount, &SubScreen->InfoLineCapacity,
+                          ScanArenaStrDuplicate(L"info"));
+   for (i = 0; i < 3 + Index % 4; i++) {
+      SubEntry = ScanArenaAllocateZero(sizeof(ENTRY));
+      SubEntry->Title = ScanArenaStrDuplicate(L"Boot with standard options");
+      SubEntry->LoadOptions = ScanArenaKeepString(PoolString(L"ro root=/dev/sda2 single"));
+      AddReservedListElement((VOID ***) &SubScreen->Entries, &SubScreen->EntryCount, &SubScreen->EntryCapacity, SubEntry);
+   }
+   Entry->SubScreen = SubScreen;
+
+   // the options editor
+   if (Index % 5 == 0)
+      Entry->LoadOptions = ScanArenaKeepString(PoolString(L"ro root=/dev/sda2 init=/bin/sh"));
+
+   // legacy boot options: some used, some not
+   if (Index % 10 == 0) {
+      Option = PoolBootOption();
+      if (Index % 20 == 0) {
+         Option->DevicePath = ScanArenaKeep(Option->DevicePath, 12);
+         Option->Description = ScanArenaKeepString(Option->Description);
+         Option->LoadOptions = ScanArenaKeep(Option->LoadOptions, Option->LoadOptionsSize);
+         Entry->BdsOption = ScanArenaKeep(Option, sizeof(BOOT_OPTION));
+      } else {
+         FreePool(Option->DevicePath);
+         FreePool(Option->Description);
+         FreePool(Option->LoadOptions);
+         FreePool(Option);
+      }
+   }
+
+   if (Index % 50 == 0)
+      ScanArenaAllocateZero(20000);
+
+   AddReservedListElement((VOID ***) &MainMenu.Entries, &MainMenu.EntryCount, &MainMenu.EntryCapacity, Entry);
+}
+
+static VOID Scan(int Rescan) {
+   UINTN i, j;
+
+   ScanVolumes();
+   for (i = 0; i < VolumesCount; i++) {
+      for (j = 0; j < LOADERS_PER_VOLUME; j++)
+         AddLoader(Volumes[i], j, Rescan);
+   }
+   ShrinkList((VOID ***) &MainMenu.Entries, MainMenu.EntryCount, &MainMenu.EntryCapacity);
+}
+
+// As FreeMainMenuEntries() and then ScanVolumes()'s release of the old volumes
+static VOID FreeScan(VOID) {
+   SCREEN *SubScreen;
+   UINTN  i;
+
+   for (i = 0; i < MainMenu.EntryCount; i++) {
+      SubScreen = MainMenu.Entries[i]->SubScreen;
+      if (SubScreen != NULL) {
+         FreeReservedList((VOID ***) &SubScreen->InfoLines, &SubScreen->InfoLineCount, &SubScreen->InfoLineCapacity);
+         FreeReservedList((VOID ***) &SubScreen->Entries, &SubScreen->EntryCount, &SubScreen->EntryCapacity);
+      }
+   }
+   FreeReservedList((VOID ***) &MainMenu.InfoLines, &MainMenu.InfoLineCount, &MainMenu.InfoLineCapacity);
+   FreeReservedList((VOID ***) &MainMenu.Entries, &MainMenu.EntryCount, &MainMenu.EntryCapacity);
+   FreeScanArena();
+   FreeListWith((VOID ***) &Volumes, &VolumesCount, FreePool);
+}
+
+int main(int argc, char **argv) {
+   UINTN Baseline, PerScan = 0, Entries = 0;
+   int   Rescan;
+
+   CachedIcon = NewImage(128);
+   BuiltinBadge = NewImage(32);
+   Baseline = LiveBlocks;
+
+   for (Rescan = 1; Rescan <= RESCANS; Rescan++) {
+      Allocations = 0;
+      Scan(Rescan);
+      Entries = MainMenu.EntryCount;
+      PerScan = Allocations;
+      FreeScan();
+      if ((Rescan <= 3) || (Rescan == RESCANS))
+         printf("arenatest rescan=%d entries=%lu allocations=%lu live_after=%lu\n", Rescan, (unsigned long) Entries,
+                (unsigned long) PerScan, (unsigned long) (LiveBlocks - Baseline));
+      Check(LiveBlocks == Baseline, "pool blocks left behind", Rescan);
+   }
+
+   egFreeImage(CachedIcon);
+   egFreeImage(BuiltinBadge);
+   printf("%s\n", Failures ? "FAILED" : "all rescans freed everything they allocated");
+   return Failures ? 1 : 0;
+}
@@ -0,0 +1,413 @@
+/*
+ * refind/test/bootsigtest.c
+ * Host test for the boot code identification in refind/bootsig.c
+ *
+ * copyright (c) 2014 by Roderick W. Smith, and distributed
+ * under the terms of the GNU GPL v3.
+ *
+ */
+
+// Runs IdentifyBootCode() and a copy of the FindMem()/CompareMem() chain it
+// replaced over a corpus of boot sectors, and reports any sector on which
+// the two disagree about whether it's bootable, whether it has boot code, or
+// which OS it belongs to. The corpus is made up of:
+//  - every boot signature planted at, and one byte either side of, the
+//    edges of the window in which it's recognized, in both a zeroed and a
+//    random sector, with and without the 0xaa55 marker;
+//  - random pairs and triples of signatures (which exercise the precedence
+//    of the old if/else chain, and the dummy and exFAT markers);
+//  - the syslinux MBR that rEFInd installs (include/syslinux_mbr.h);
+//  - random sectors;
+//  - the first SECTOR_SIZE bytes of each file named on the command line
+//    (boot sectors saved with dd, for instance).
+// Both versions are then timed on the random sectors. The exit status is 0
+// only if they agree on every sector.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#define IN
+#define OUT
+#define TRUE  1
+#define FALSE 0
+
+typedef uint8_t   UINT8;
+typedef uint16_t  UINT16;
+typedef uint32_t  UINT32;
+typedef intptr_t  INTN;
+typedef uintptr_t UINTN;
+typedef UINT8     BOOLEAN;
+typedef uint16_t  CHAR16;   // built with -fshort-wchar, to match L"" strings
+typedef void      VOID;
+
+#define ZeroMem(Buffer, Size)          memset((Buffer), 0, (Size))
+#define CompareMem(Dest, Src, Length)  memcmp((Dest), (Src), (Length))
+
+#include "../bootsig.c"
+#include "syslinux_mbr.h"
+
+#define RANDOM_SECTORS   20000
+#define RANDOM_COMBOS    20000
+#define BENCH_ROUNDS     5
+
+typedef struct {
+   BOOLEAN  HasBootCode;
+   BOOLEAN  Bootable;
+   CHAR16   *OSIconName;
+   CHAR16   *OSName;
+} BOOT_CODE_INFO;
+
+static unsigned long Sectors = 0, Mismatches = 0;
+
+//
+// the code that bootsig.c replaced, from ScanVolumeBootcode()
+//
+
+static INTN FindMem(IN VOID *Buffer, IN UINTN BufferLength, IN VOID *SearchString, IN UINTN SearchStringLength)
+{
+    UINT8 *BufferPtr;
+    UINTN Offset;
+
+    BufferPtr = Buffer;
+    BufferLength -= SearchStringLength;
+    for (Offset = 0; Offset < BufferLength; Offset++, BufferPtr++) {
+        if (CompareMem(BufferPtr, SearchString, SearchStringLength) == 0)
+            return (INTN)Offset;
+    }
+
+    return -1;
+}
+
+static VOID OldIdentifyBootCode(UINT8 *Buffer, BOOT_CODE_INFO *Volume, BOOLEAN *Bootable)
+{
+        Volume->HasBootCode = FALSE;
+        Volume->OSIconName = NULL;
+        Volume->OSName = NULL;
+        *Bootable = FALSE;
+
+        if ((*((UINT16 *)(Buffer + 510)) == 0xaa55 && Buffer[0] != 0) && (FindMem(Buffer, 512, "EXFAT", 5) == -1)) {
+            *Bootable = TRUE;
+            Volume->HasBootCode = TRUE;
+        }
+
+        // detect specific boot codes
+        if (CompareMem(Buffer + 2, "LILO", 4) == 0 ||
+            CompareMem(Buffer + 6, "LILO", 4) == 0 ||
+            CompareMem(Buffer + 3, "SYSLINUX", 8) == 0 ||
+            FindMem(Buffer, SECTOR_SIZE, "ISOLINUX", 8) >= 0) {
+            Volume->HasBootCode = TRUE;
+            Volume->OSIconName = L"linux";
+            Volume->OSName = L"Linux";
+
+        } else if (FindMem(Buffer, 512, "Geom\0Hard Disk\0Read\0 Error", 26) >= 0) {   // GRUB
+            Volume->HasBootCode = TRUE;
+            Volume->OSIconName = L"grub,linux";
+            Volume->OSName = L"Linux";
+
+        } else if ((*((UINT32 *)(Buffer + 502)) == 0 &&
+                    *((UINT32 *)(Buffer + 506)) == 50000 &&
+                    *((UINT16 *)(Buffer + 510)) == 0xaa55) ||
+                    FindMem(Buffer, SECTOR_SIZE, "Starting the BTX loader", 23) >= 0) {
+            Volume->HasBootCode = TRUE;
+            Volume->OSIconName = L"freebsd";
+            Volume->OSName = L"FreeBSD";
+
+        } else if (FindMem(Buffer, 512, "!Loading", 8) >= 0 ||
+                   FindMem(Buffer, SECTOR_SIZE, "/cdboot\0/CDBOOT\0", 16) >= 0) {
+            Volume->HasBootCode = TRUE;
+            Volume->OSIconName = L"openbsd";
+            Volume->OSName = L"OpenBSD";
+
+        } else if (FindMem(Buffer, 512, "Not a bootxx image", 18) >= 0 ||
+                   *((UINT32 *)(Buffer + 1028)) == 0x7886b6d1) {
+            Volume->HasBootCode = TRUE;
+            Volume->OSIconName = L"netbsd";
+            Volume->OSName = L"NetBSD";
+
+        } else if (FindMem(Buffer, SECTOR_SIZE, "NTLDR", 5) >= 0) {
+            Volume->HasBootCode = TRUE;
+            Volume->OSIconName = L"win";
+            Volume->OSName = L"Windows";
+
+        } else if (FindMem(Buffer, SECTOR_SIZE, "BOOTMGR", 7) >= 0) {
+            Volume->HasBootCode = TRUE;
+            Volume->OSIconName = L"winvista,win";
+            Volume->OSName = L"Windows";
+
+        } else if (FindMem(Buffer, 512, "CPUBOOT SYS", 11) >= 0 ||
+                   FindMem(Buffer, 512, "KERNEL  SYS", 11) >= 0) {
+            Volume->HasBootCode = TRUE;
+            Volume->OSIconName = L"freedos";
+            Volume->OSName = L"FreeDOS";
+
+        } else if (FindMem(Buffer, 512, "OS2LDR", 6) >= 0 ||
+                   FindMem(Buffer, 512, "OS2BOOT", 7) >= 0) {
+            Volume->HasBootCode = TRUE;
+            Volume->OSIconName = L"ecomstation";
+            Volume->OSName = L"eComStation";
+
+        } else if (FindMem(Buffer, 512, "Be Boot Loader", 14) >= 0) {
+            Volume->HasBootCode = TRUE;
+            Volume->OSIconName = L"beos";
+            Volume->OSName = L"BeOS";
+
+        } else if (FindMem(Buffer, 512, "yT Boot Loader", 14) >= 0) {
+            Volume->HasBootCode = TRUE;
+            Volume->OSIconName = L"zeta,beos";
+            Volume->OSName = L"ZETA";
+
+        } else if (FindMem(Buffer, 512, "\x04" "beos\x06" "system\x05" "zbeos", 18) >= 0 ||
+                   FindMem(Buffer, 512, "\x06" "system\x0c" "haiku_loader", 20) >= 0) {
+            Volume->HasBootCode = TRUE;
+            Volume->OSIconName = L"haiku,beos";
+            Volume->OSName = L"Haiku";
+
+        }
+
+        // dummy FAT boot sector (created by OS X's newfs_msdos)
+        if (FindMem(Buffer, 512, "Non-system disk", 15) >= 0)
+            Volume->HasBootCode = FALSE;
+
+        // dummy FAT boot sector (created by Linux's mkdosfs)
+        if (FindMem(Buffer, 512, "This is not a bootable disk", 27) >= 0)
+            Volume->HasBootCode = FALSE;
+
+        // dummy FAT boot sector (created by Windows)
+        if (FindMem(Buffer, 512, "Press any key to restart", 24) >= 0)
+            Volume->HasBootCode = FALSE;
+}
+
+//
+// comparison
+//
+
+static int SameString(CHAR16 *One, CHAR16 *Two) {
+   if ((One == NULL) || (Two == NULL))
+      return (One == Two);
+   while ((*One != 0) && (*One == *Two)) {
+      One++;
+      Two++;
+   }
+   return (*One == *Two);
+}
+
+static const char * Narrow(CHAR16 *String) {
+   static char Buffer[2][64];
+   static int  Which = 0;
+   char        *Out = Buffer[Which = !Which];
+   size_t      i = 0;
+
+   if (String == NULL)
+      return "(none)";
+   while ((String[i] != 0) && (i < sizeof(Buffer[0]) - 1)) {
+      Out[i] = (char) String[i];
+      i++;
+   }
+   Out[i] = '\0';
+   return Out;
+}
+
+// Classifies Buffer (SECTOR_SIZE bytes) both ways and reports a difference.
+static void CompareSector(UINT8 *Buffer, const char *Description) {
+   BOOT_CODE_INFO Old, New;
+
+   OldIdentifyBootCode(Buffer, &Old, &Old.Bootable);
+   IdentifyBootCode(Buffer, &New.HasBootCode, &New.Bootable, &New.OSIconName, &New.OSName);
+   Sectors++;
+   if ((Old.HasBootCode != New.HasBootCode) || (Old.Bootable != New.Bootable) ||
+       !SameString(Old.OSIconName, New.OSIconName) || !SameString(Old.OSName, New.OSName)) {
+      if (Mismatches++ < 20) {
+         printf("MISMATCH: %s\n", Description);
+         printf("  old: bootcode=%d bootable=%d os=%s icon=%s\n", Old.HasBootCode, Old.Bootable,
+                Narrow(Old.OSName), Narrow(Old.OSIconName));
+         printf("  new: bootcode=%d bootable=%d os=%s icon=%s\n", New.HasBootCode, New.Bootable,
+                Narrow(New.OSName), Narrow(New.OSIconName));
+      }
+   }
+}
+
+//
+// corpus
+//
+
+static void FillRandom(UINT8 *Buffer, size_t Size) {
+   size_t i;
+
+   for (i = 0; i < Size; i++)
+      Buffer[i] = (UINT8) rand();
+}
+
+// Plants BootSignatures[Index] at Pos in Buffer, if it fits in the sector.
+static int Plant(UINT8 *Buffer, UINTN Index, long Pos) {
+   BOOT_SIGNATURE *Sig = &BootSignatures[Index];
+
+   if ((Pos < 0) || ((UINTN) Pos + Sig->Length > SECTOR_SIZE))
+      return 0;
+   memcpy(Buffer + Pos, Sig->Pattern, Sig->Length);
+   return 1;
+}
+
+// Each signature at the edges of its window, and a byte beyond them.
+static void TestBoundaries(UINT8 *Buffer) {
+   UINTN  Index;
+   long   Edges[6], Start, End;
+   int    e, Random, Marker;
+   char   Description[128];
+
+   for (Index = 0; Index < BOOTSIG_COUNT; Index++) {
+      Start = BootSignatures[Index].Offset;
+      End = Start + BootSignatures[Index].Range - 1;
+      Edges[0] = Start - 1; Edges[1] = Start; Edges[2] = Start + 1;
+      Edges[3] = End - 1; Edges[4] = End; Edges[5] = End + 1;
+      for (e = 0; e < 6; e++) {
+         for (Random = 0; Random < 2; Random++) {
+            for (Marker = 0; Marker < 2; Marker++) {
+               if (Random)
+                  FillRandom(Buffer, SECTOR_SIZE);
+               else
+                  memset(Buffer, 0, SECTOR_SIZE);
+               if (Marker) {
+                  Buffer[0] = 0xeb;
+                  Buffer[510] = 0x55;
+                  Buffer[511] = 0xaa;
+               }
+               if (!Plant(Buffer, Index, Edges[e]))
+                  continue;
+               snprintf(Description, sizeof(Description), "signature %u at offset %ld (%s sector%s)",
+                        (unsigned) Index, Edges[e], Random ? "random" : "zeroed", Marker ? ", 0xaa55" : "");
+               CompareSector(Buffer, Description);
+            }
+         }
+      }
+   }
+}
+
+// Two or three signatures at random places near (or in) their windows.
+static void TestCombinations(UINT8 *Buffer) {
+   UINTN  Index;
+   int    n, Count, Planted;
+   long   Pos;
+   char   Description[160];
+   size_t Length;
+
+   for (n = 0; n < RANDOM_COMBOS; n++) {
+      if (n & 1)
+         FillRandom(Buffer, SECTOR_SIZE);
+      else
+         memset(Buffer, 0, SECTOR_SIZE);
+      if (n & 2) {
+         Buffer[0] = 0xeb;
+         Buffer[510] = 0x55;
+         Buffer[511] = 0xaa;
+      }
+      Length = snprintf(Description, sizeof(Description), "combination %d:", n);
+      Count = 2 + (rand() % 2);
+      for (Planted = 0; Planted < Count; Planted++) {
+         Index = rand() % BOOTSIG_COUNT;
+         Pos = BootSignatures[Index].Offset + (rand() % (BootSignatures[Index].Range + 2)) - 1;
+         if (Plant(Buffer, Index, Pos) && (Length < sizeof(Description)))
+            Length += snprintf(Description + Length, sizeof(Description) - Length, " %u@%ld", (unsigned) Index, Pos);
+      }
+      CompareSector(Buffer, Description);
+   }
+}
+
+static void TestSyslinuxMbr(UINT8 *Buffer) {
+   memset(Buffer, 0, SECTOR_SIZE);
+   memcpy(Buffer, syslinux_mbr, SYSLINUX_MBR_SIZE);
+   Buffer[510] = 0x55;
+   Buffer[511] = 0xaa;
+   CompareSector(Buffer, "syslinux MBR");
+}
+
+static void TestRandom(UINT8 *Sectors, int Count) {
+   char Description[64];
+   int  n;
+
+   for (n = 0; n < Count; n++) {
+      snprintf(Description, sizeof(Description), "random sector %d", n);
+      CompareSector(Sectors + (size_t) n * SECTOR_SIZE, Description);
+   }
+}
+
+static int TestFile(UINT8 *Buffer, const char *FileName) {
+   FILE *File = fopen(FileName, "rb");
+
+   if (File == NULL) {
+      perror(FileName);
+      return 0;
+   }
+   memset(Buffer, 0, SECTOR_SIZE);
+   if (fread(Buffer, 1, SECTOR_SIZE, File) == 0)
+      fprintf(stderr, "%s: empty\n", FileName);
+   fclose(File);
+   CompareSector(Buffer, FileName);
+   return 1;
+}
+
+//
+// timing
+//
+
+static double Seconds(void) {
+   struct timeval Now;
+
+   gettimeofday(&Now, NULL);
+   return Now.tv_sec + Now.tv_usec / 1e6;
+}
+
+static void Bench(UINT8 *Sectors, int Count) {
+   BOOT_CODE_INFO Info;
+   double         Start, OldTime = 0, NewTime = 0;
+   volatile int   Sink = 0;
+   int            Round, n;
+
+   for (Round = 0; Round < BENCH_ROUNDS; Round++) {
+      Start = Seconds();
+      for (n = 0; n < Count; n++) {
+         OldIdentifyBootCode(Sectors + (size_t) n * SECTOR_SIZE, &Info, &Info.Bootable);
+         Sink += Info.HasBootCode;
+      }
+      OldTime += Seconds() - Start;
+      Start = Seconds();
+      for (n = 0; n < Count; n++) {
+         IdentifyBootCode(Sectors + (size_t) n * SECTOR_SIZE, &Info.HasBootCode, &Info.Bootable,
+                          &Info.OSIconName, &Info.OSName);
+         Sink += Info.HasBootCode;
+      }
+      NewTime += Seconds() - Start;
+   }
+   printf("bootsigbench sectors=%d old_usec_per_sector=%.2f new_usec_per_sector=%.2f\n", Count,
+          OldTime * 1e6 / (Count * BENCH_ROUNDS), NewTime * 1e6 / (Count * BENCH_ROUNDS));
+}
+
+int main(int argc, char **argv) {
+   UINT8  *Buffer, *RandomSectors;
+   int    i;
+
+   Buffer = malloc(SECTOR_SIZE);
+   RandomSectors = malloc((size_t) RANDOM_SECTORS * SECTOR_SIZE);
+   if ((Buffer == NULL) || (RandomSectors == NULL)) {
+      fprintf(stderr, "out of memory\n");
+      return 2;
+   }
+   srand(1);
+   FillRandom(RandomSectors, (size_t) RANDOM_SECTORS * SECTOR_SIZE);
+
+   TestBoundaries(Buffer);
+   TestCombinations(Buffer);
+   TestSyslinuxMbr(Buffer);
+   TestRandom(RandomSectors, RANDOM_SECTORS);
+   for (i = 1; i < argc; i++)
+      TestFile(Buffer, argv[i]);
+   printf("bootsigtest sectors=%lu mismatches=%lu files=%d\n", Sectors, Mismatches, argc - 1);
+
+   Bench(RandomSectors, RANDOM_SECTORS);
+
+   free(RandomSectors);
+   free(Buffer);
+   return Mismatches ? 1 : 0;
+}
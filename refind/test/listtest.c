@@ -0,0 +1,174 @@
+/*
+ * refind/test/listtest.c
+ * Host test for the growable pointer arrays in refind/list.c
+ *
+ * copyright (c) 2014 by Roderick W. Smith, and distributed
+ * under the terms of the GNU GPL v3.
+ *
+ */
+
+// Appends N elements, for assorted N up to 100000, to lists built with
+// AddListElement() and with AddReservedListElement(), counting the pool
+// allocations each makes, and checks that the count is no more than
+// 1 + log2(N) -- that is, that the arrays grow geometrically rather than by
+// a fixed step. Also checks that ReserveList() followed by N appends
+// allocates only once, that ShrinkList() trims a list to its element
+// count, that no list loses or reorders its elements along the way, and
+// that freeing a list leaves no pool allocations behind. The exit status
+// is 0 only if every check passed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define IN
+#define OUT
+#define OPTIONAL
+#define TRUE  1
+#define FALSE 0
+
+typedef intptr_t  INTN;
+typedef uintptr_t UINTN;
+typedef uint8_t   BOOLEAN;
+typedef void      VOID;
+
+// Pool functions that count what they do. EfiReallocatePool() counts as an
+// allocation, since under EFI it allocates a new block and copies into it.
+static UINTN Allocations = 0;
+static UINTN LiveBlocks = 0;
+
+static VOID * AllocatePool(UINTN Size) {
+   VOID *Pointer = malloc(Size);
+
+   if (Pointer != NULL) {
+      Allocations++;
+      LiveBlocks++;
+   }
+   return Pointer;
+}
+
+static VOID FreePool(VOID *Pointer) {
+   free(Pointer);
+   LiveBlocks--;
+}
+
+static VOID * EfiReallocatePool(VOID *OldPool, UINTN OldSize, UINTN NewSize) {
+   VOID *NewPool = AllocatePool(NewSize);
+
+   if (OldPool != NULL) {
+      if (NewPool != NULL)
+         memcpy(NewPool, OldPool, (OldSize < NewSize) ? OldSize : NewSize);
+      FreePool(OldPool);
+   }
+   return NewPool;
+}
+
+#include "../list.c"
+
+static int Failures = 0;
+
+static VOID Check(int Ok, const char *What, UINTN N) {
+   if (!Ok) {
+      printf("FAIL: %s (N = %lu)\n", What, (unsigned long) N);
+      Failures++;
+   }
+}
+
+// Smallest k such that 2^k >= N
+static UINTN Log2Ceil(UINTN N) {
+   UINTN k = 0;
+
+   while (((UINTN) 1 << k) < N)
+      k++;
+   return k;
+}
+
+// Element i of every test list is (VOID *) (i + 1).
+static int HoldsSequence(VOID **List, UINTN Count) {
+   UINTN i;
+
+   for (i = 0; i < Count; i++) {
+      if (List[i] != (VOID *) (i + 1))
+         return 0;
+   }
+   return 1;
+}
+
+static VOID TestImplicit(UINTN N) {
+   VOID  **List = NULL;
+   UINTN Count = 0, i;
+
+   Allocations = 0;
+   for (i = 0; i < N; i++)
+      AddListElement(&List, &Count, (VOID *) (i + 1));
+   printf("listtest kind=implicit n=%lu allocations=%lu\n", (unsigned long) N, (unsigned long) Allocations);
+   Check(Count == N, "AddListElement() count", N);
+   Check(HoldsSequence(List, Count), "AddListElement() contents", N);
+   Check(Allocations <= 1 + Log2Ceil(N), "AddListElement() allocations exceed 1 + log2(N)", N);
+   FreeListWith(&List, &Count, NULL);
+   Check((List == NULL) && (Count == 0) && (LiveBlocks == 0), "FreeListWith() left the list or a block behind", N);
+}
+
+static VOID TestReserved(UINTN N) {
+   VOID  **List = NULL;
+   UINTN Count = 0, Capacity = 0, i;
+
+   Allocations = 0;
+   for (i = 0; i < N; i++)
+      AddReservedListElement(&List, &Count, &Capacity, (VOID *) (i + 1));
+   printf("listtest kind=reserved n=%lu allocations=%lu capacity=%lu\n", (unsigned long) N,
+          (unsigned long) Allocations, (unsigned long) Capacity);
+   Check(Count == N, "AddReservedListElement() count", N);
+   Check(HoldsSequence(List, Count), "AddReservedListElement() contents", N);
+   Check(Allocations <= 1 + Log2Ceil(N), "AddReservedListElement() allocations exceed 1 + log2(N)", N);
+   Check((Capacity >= Count) && (Capacity < 2 * Count + LIST_MIN_CAPACITY), "AddReservedListElement() capacity", N);
+
+   ShrinkList(&List, Count, &Capacity);
+   Check(Capacity == Count, "ShrinkList() capacity", N);
+   Check(HoldsSequence(List, Count), "ShrinkList() contents", N);
+   Check(LiveBlocks == 1, "ShrinkList() leaked its old array", N);
+
+   // Once shrunk, the list must still grow correctly.
+   AddReservedListElement(&List, &Count, &Capacity, (VOID *) (Count + 1));
+   Check((Count == N + 1) && HoldsSequence(List, Count), "append after ShrinkList()", N);
+
+   FreeReservedList(&List, &Count, &Capacity);
+   Check((List == NULL) && (Count == 0) && (Capacity == 0) && (LiveBlocks == 0),
+         "FreeReservedList() left the list or a block behind", N);
+
+   // With the space reserved up front, the appends shouldn't allocate.
+   Allocations = 0;
+   Check(ReserveList(&List, Count, &Capacity, N), "ReserveList() failed", N);
+   for (i = 0; i < N; i++)
+      AddReservedListElement(&List, &Count, &Capacity, (VOID *) (i + 1));
+   Check((Allocations == 1) && (Capacity == N), "ReserveList() then appends allocated more than once", N);
+   Check(HoldsSequence(List, Count), "contents after ReserveList()", N);
+   ShrinkList(&List, Count, &Capacity);
+   Check(Allocations == 1, "ShrinkList() reallocated an exactly-sized list", N);
+   FreeReservedList(&List, &Count, &Capacity);
+   Check(LiveBlocks == 0, "reserved list leaked", N);
+}
+
+int main(int argc, char **argv) {
+   static const UINTN Sizes[] = { 1, 2, 7, 8, 9, 16, 17, 100, 1000, 4096, 10000, 100000 };
+   UINTN i;
+
+   for (i = 0; i < sizeof(Sizes) / sizeof(Sizes[0]); i++) {
+      TestImplicit(Sizes[i]);
+      TestReserved(Sizes[i]);
+   }
+
+   // An empty list has no array, and shrinking or freeing it is harmless.
+   {
+      VOID  **List = NULL;
+      UINTN Count = 0, Capacity = 0;
+
+      ShrinkList(&List, Count, &Capacity);
+      FreeReservedList(&List, &Count, &Capacity);
+      Check((List == NULL) && (Capacity == 0) && (LiveBlocks == 0), "empty list", 0);
+   }
+
+   printf("%s\n", Failures ? "FAILED" : "all list checks passed");
+   return Failures ? 1 : 0;
+}